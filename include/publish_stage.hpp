@@ -0,0 +1,223 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <exception>
+
+#include <rclcpp/rclcpp.hpp>
+
+
+// what PublishStage::push() does when the queue is full
+enum class OverflowPolicy
+{
+    DROP_OLDEST,    // discard the oldest queued message to make room
+    DROP_NEWEST,    // discard the message being pushed
+    BLOCK           // block the producer until there is room
+};
+
+// parses "drop_oldest", "drop_newest", or "block" -- returns false (and DROP_OLDEST) for anything else
+inline bool parseOverflowPolicy(std::string_view s, OverflowPolicy& policy)
+{
+    policy = OverflowPolicy::DROP_OLDEST;
+    if(s == "drop_newest") policy = OverflowPolicy::DROP_NEWEST;
+    else if(s == "block") policy = OverflowPolicy::BLOCK;
+    else if(s != "drop_oldest") return false;
+    return true;
+}
+inline const char* overflowPolicyName(OverflowPolicy p)
+{
+    switch(p)
+    {
+        case OverflowPolicy::DROP_NEWEST: return "drop_newest";
+        case OverflowPolicy::BLOCK: return "block";
+        default: return "drop_oldest";
+    }
+}
+
+// result of PublishStage::push()
+enum class PushResult
+{
+    QUEUED,     // the message was queued without loss
+    DROPPED,    // a message (this or an older one) was dropped due to overflow
+    STOPPED     // the stage is not running -- the message was discarded
+};
+
+/* Owns a publisher and a dedicated thread which performs the (potentially slow)
+ * RMW publish call, so that the producer (ie. the UDP receive loop) only ever
+ * pays for a move into a bounded queue. */
+template<typename Msg_T>
+class PublishStage
+{
+public:
+    using Pub_T = typename rclcpp::Publisher<Msg_T>::SharedPtr;
+    using Msg_Ptr = std::unique_ptr<Msg_T>;
+    using Shared_Msg_Ptr = std::shared_ptr<const Msg_T>;
+
+public:
+    inline PublishStage(
+        Pub_T pub,
+        rclcpp::Logger logger,
+        rclcpp::Clock::SharedPtr clock,
+        size_t max_queued = 2,
+        OverflowPolicy policy = OverflowPolicy::DROP_OLDEST)
+        :   pub{ pub },
+            logger{ logger },
+            clock{ clock },
+            max_queued{ max_queued > 0 ? max_queued : 1 },
+            policy{ policy } {}
+    PublishStage(const PublishStage&) = delete;
+    inline ~PublishStage()
+    {
+        this->stop();
+    }
+
+public:
+    void start()
+    {
+        std::unique_lock _lock{ this->mtx };
+        if(!this->thread.joinable())
+        {
+            this->is_running = true;
+            this->thread = std::thread{ &PublishStage::run, this };
+        }
+    }
+    // stops the publishing thread -- anything still queued is discarded
+    void stop()
+    {
+        {
+            std::unique_lock _lock{ this->mtx };
+            if(!this->thread.joinable()) return;
+            this->is_running = false;
+        }
+        this->push_cond.notify_all();
+        this->pop_cond.notify_all();
+        this->thread.join();
+
+        std::unique_lock _lock{ this->mtx };
+        this->queue.clear();
+    }
+
+    // hand off a message to the publishing thread -- returns DROPPED if a message was dropped as a result
+    inline PushResult push(Msg_Ptr&& msg)
+    {
+        if(!msg) return PushResult::QUEUED;
+        return this->enqueue(QueuedMsg{ std::move(msg), nullptr });
+    }
+    // hand off a message which is shared with another consumer (ie. the recorder) -- published by const reference
+    inline PushResult push(Shared_Msg_Ptr msg)
+    {
+        if(!msg) return PushResult::QUEUED;
+        return this->enqueue(QueuedMsg{ nullptr, std::move(msg) });
+    }
+
+    inline size_t publishedCount() const { return this->num_published.load(); }
+    inline size_t droppedCount() const { return this->num_dropped.load(); }
+    inline size_t failedCount() const { return this->num_failed.load(); }
+    inline size_t queuedCount()
+    {
+        std::unique_lock _lock{ this->mtx };
+        return this->queue.size();
+    }
+    inline OverflowPolicy overflowPolicy() const { return this->policy; }
+
+protected:
+    struct QueuedMsg
+    {
+        Msg_Ptr unique;         // published by move, or
+        Shared_Msg_Ptr shared;  // published by const reference
+    };
+
+    PushResult enqueue(QueuedMsg&& msg)
+    {
+        std::unique_lock _lock{ this->mtx };
+        if(!this->is_running) return PushResult::STOPPED;
+
+        bool dropped = false;
+        if(this->queue.size() >= this->max_queued)
+        {
+            switch(this->policy)
+            {
+                case OverflowPolicy::DROP_NEWEST:
+                {
+                    this->num_dropped++;
+                    return PushResult::DROPPED;
+                }
+                case OverflowPolicy::BLOCK:
+                {
+                    this->pop_cond.wait(_lock,
+                        [this]{ return !this->is_running || this->queue.size() < this->max_queued; });
+                    if(!this->is_running) return PushResult::STOPPED;
+                    break;
+                }
+                case OverflowPolicy::DROP_OLDEST:
+                default:
+                {
+                    this->queue.pop_front();
+                    this->num_dropped++;
+                    dropped = true;
+                }
+            }
+        }
+        this->queue.emplace_back(std::move(msg));
+        _lock.unlock();
+
+        this->push_cond.notify_one();
+        return dropped ? PushResult::DROPPED : PushResult::QUEUED;
+    }
+
+    void run()
+    {
+        std::unique_lock _lock{ this->mtx };
+        while(this->is_running)
+        {
+            this->push_cond.wait(_lock, [this]{ return !this->is_running || !this->queue.empty(); });
+            if(!this->is_running) break;
+
+            QueuedMsg msg = std::move(this->queue.front());
+            this->queue.pop_front();
+            _lock.unlock();
+            this->pop_cond.notify_one();
+
+            try
+            {
+                if(msg.unique) this->pub->publish(std::move(msg.unique));
+                else this->pub->publish(*msg.shared);
+                this->num_published++;
+            }
+            catch(const std::exception& e)
+            {
+                const size_t n = ++this->num_failed;
+                RCLCPP_ERROR_THROTTLE(this->logger, *this->clock, 5000,
+                    "[PUBLISH STAGE]: Publish on '%s' failed (%lu failures so far): %s",
+                    this->pub->get_topic_name(), n, e.what());
+            }
+
+            _lock.lock();
+        }
+    }
+
+protected:
+    Pub_T pub;
+    rclcpp::Logger logger;
+    rclcpp::Clock::SharedPtr clock;
+    const size_t max_queued;
+    const OverflowPolicy policy;
+
+    std::mutex mtx;
+    std::condition_variable push_cond, pop_cond;
+    std::deque<QueuedMsg> queue;
+    std::thread thread;
+    bool is_running = false;
+
+    std::atomic<size_t>
+        num_published = 0,
+        num_dropped = 0,
+        num_failed = 0;
+
+};
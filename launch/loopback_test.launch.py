@@ -0,0 +1,69 @@
+# Loopback throughput and latency test: runs the driver against sopas_mock_server and loopback_harness,
+# which emulates the lidar's udp stream at increasing rates and reports drops, completeness and latency.
+#
+#   ros2 launch multiscan_driver loopback_test.launch.py rates:="[1.0, 2.0, 4.0, 8.0, 16.0]" echos:=3
+#
+# The launch shuts down when the harness has finished, its exit code is non-zero if the saturation point
+# is below min_pass_rate.
+
+from launch import LaunchDescription
+from launch.actions import DeclareLaunchArgument, ExecuteProcess, RegisterEventHandler, Shutdown
+from launch.event_handlers import OnProcessExit
+from launch.substitutions import LaunchConfiguration, PathJoinSubstitution
+from launch_ros.actions import Node
+from launch_ros.parameter_descriptions import ParameterValue
+from launch_ros.substitutions import FindPackagePrefix
+
+
+def generate_launch_description():
+    udp_port = LaunchConfiguration('udp_port')
+    sopas_port = LaunchConfiguration('sopas_port')
+
+    mock = ExecuteProcess(
+        cmd = [
+            PathJoinSubstitution([FindPackagePrefix('multiscan_driver'), 'lib', 'multiscan_driver', 'sopas_mock_server']),
+            '--port', sopas_port ],
+        output = 'screen')
+
+    driver = Node(
+        package = 'multiscan_driver',
+        executable = 'multiscan_driver',
+        output = 'screen',
+        parameters = [{
+            'lidar_hostname': '127.0.0.1',
+            'driver_hostname': '127.0.0.1',
+            'lidar_udp_port': udp_port,
+            'sopas_tcp_port': sopas_port,
+            'use_msgpack': LaunchConfiguration('use_msgpack'),
+            'publish_queue_size': LaunchConfiguration('publish_queue_size') }])
+
+    harness = Node(
+        package = 'multiscan_driver',
+        executable = 'loopback_harness',
+        output = 'screen',
+        parameters = [{
+            'udp_dest_port': udp_port,
+            'echos': LaunchConfiguration('echos'),
+            'use_msgpack': LaunchConfiguration('use_msgpack'),
+            'rates': LaunchConfiguration('rates'),
+            'step_duration': LaunchConfiguration('step_duration'),
+            'max_drop_rate': LaunchConfiguration('max_drop_rate'),
+            'min_pass_rate': LaunchConfiguration('min_pass_rate'),
+            'csv_file': ParameterValue(LaunchConfiguration('csv_file'), value_type = str) }])
+
+    return LaunchDescription([
+        DeclareLaunchArgument('udp_port', default_value = '2115'),
+        DeclareLaunchArgument('sopas_port', default_value = '2111'),
+        DeclareLaunchArgument('echos', default_value = '1'),
+        DeclareLaunchArgument('use_msgpack', default_value = 'false'),
+        DeclareLaunchArgument('publish_queue_size', default_value = '2'),
+        DeclareLaunchArgument('rates', default_value = '[1.0, 2.0, 4.0, 8.0]'),
+        DeclareLaunchArgument('step_duration', default_value = '5.0'),
+        DeclareLaunchArgument('max_drop_rate', default_value = '0.01'),
+        DeclareLaunchArgument('min_pass_rate', default_value = '0.0'),
+        DeclareLaunchArgument('csv_file', default_value = ''),
+        mock,
+        driver,
+        harness,
+        RegisterEventHandler(OnProcessExit(target_action = harness, on_exit = [ Shutdown() ]))
+    ])
@@ -0,0 +1,355 @@
+/* Offline evaluation of the lidar tick -> system time estimators in SoftwarePLL.
+ *
+ * Replays tick/system time pairs through each estimator and reports error statistics,
+ * convergence time and cost per update. Input is either a csv file as read by
+ * SoftwarePLL::getDemoFileData() (header line, then "tick;sec;nanosec" rows), or a pcap /
+ * raw datagram log (see datagram_log.h) from which the transmit ticks of compact scan and
+ * imu telegrams are paired with the capture timestamps.
+ *
+ * Errors are reported against the receive timestamps and against an offline least squares
+ * fit over the complete trace, which is the best linear tick mapping in hindsight. */
+
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "sick_scan_xd/softwarePLL.h"
+#include "sick_scan_xd/datagram_log.h"
+#include "sick_scan_xd/compact_parser.h"
+
+
+struct ClockSample
+{
+    uint32_t tick;
+    uint32_t sec;
+    uint32_t nsec;
+    double t() const { return this->sec + 1e-9 * this->nsec; }
+};
+
+struct EvalConfig
+{
+    std::vector<std::string> files;
+    int udp_port = 2115;
+    std::vector<std::string> estimators = { "fifo", "kalman", "offset" };
+    int fifo_size = SoftwarePLL::fifoSize;
+    double max_deviation = -1.;     // < 0: SoftwarePLL default
+    double kalman_sigma = -1.;      // < 0: ClockKalmanFilter default
+    double kalman_gate = -1.;
+    double converge_tol = 1e-3;
+    bool verbose = false;
+};
+
+struct ErrorStats
+{
+    size_t n = 0;
+    double mean = 0., stddev = 0., p50 = 0., p95 = 0., p99 = 0., max = 0.;
+
+    static ErrorStats compute(const std::vector<double>& err)
+    {
+        ErrorStats s;
+        s.n = err.size();
+        if(s.n == 0) return s;
+
+        double sum = 0., sum_sq = 0.;
+        std::vector<double> abs_err;
+        abs_err.reserve(err.size());
+        for(double e : err)
+        {
+            sum += e;
+            sum_sq += e * e;
+            abs_err.push_back(std::fabs(e));
+        }
+        std::sort(abs_err.begin(), abs_err.end());
+        s.mean = sum / s.n;
+        s.stddev = std::sqrt(std::max(sum_sq / s.n - s.mean * s.mean, 0.));
+        auto pct = [&abs_err](double p) { return abs_err[std::min(abs_err.size() - 1, static_cast<size_t>(p * abs_err.size()))]; };
+        s.p50 = pct(0.50);
+        s.p95 = pct(0.95);
+        s.p99 = pct(0.99);
+        s.max = abs_err.back();
+        return s;
+    }
+};
+
+
+static void printUsage(const char* argv0)
+{
+    std::printf(
+        "Usage: %s [options] <trace.csv | capture.pcap | datagrams.msdglog> ...\n"
+        "Options:\n"
+        "  --port <n>             udp port of scan data in pcap files (default 2115)\n"
+        "  --estimator <name>     fifo, kalman, offset or all (default all), may be repeated\n"
+        "  --fifo-size <n>        number of tick/timestamp pairs of the fifo regression (default %d)\n"
+        "  --max-deviation <sec>  max. allowed time deviation of the fifo regression (default %.3f)\n"
+        "  --kalman-sigma <sec>   measurement std. deviation of the kalman filter\n"
+        "  --kalman-gate <n>      outlier gate of the kalman filter in standard deviations\n"
+        "  --converge-tol <sec>   tolerance vs. the offline fit for convergence (default 0.001)\n"
+        "  --verbose              print every corrected sample\n",
+        argv0, SoftwarePLL::fifoSize, SoftwarePLL().AllowedTimeDeviation());
+}
+
+static bool parseArgs(int argc, char** argv, EvalConfig& config)
+{
+    bool estimator_given = false;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto next = [&](const char* name) -> const char*
+        {
+            if(i + 1 >= argc)
+            {
+                std::fprintf(stderr, "## ERROR clock_sync_eval: missing value for %s\n", name);
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if(arg == "--help" || arg == "-h") return false;
+        else if(arg == "--port") config.udp_port = std::atoi(next("--port"));
+        else if(arg == "--estimator")
+        {
+            if(!estimator_given) config.estimators.clear();
+            estimator_given = true;
+            std::string name = next("--estimator");
+            if(name == "all") config.estimators = { "fifo", "kalman", "offset" };
+            else config.estimators.push_back(name);
+        }
+        else if(arg == "--fifo-size") config.fifo_size = std::atoi(next("--fifo-size"));
+        else if(arg == "--max-deviation") config.max_deviation = std::atof(next("--max-deviation"));
+        else if(arg == "--kalman-sigma") config.kalman_sigma = std::atof(next("--kalman-sigma"));
+        else if(arg == "--kalman-gate") config.kalman_gate = std::atof(next("--kalman-gate"));
+        else if(arg == "--converge-tol") config.converge_tol = std::atof(next("--converge-tol"));
+        else if(arg == "--verbose") config.verbose = true;
+        else if(arg.size() > 2 && arg.compare(0, 2, "--") == 0)
+        {
+            std::fprintf(stderr, "## ERROR clock_sync_eval: unknown option %s\n", arg.c_str());
+            return false;
+        }
+        else config.files.push_back(arg);
+    }
+    return !config.files.empty();
+}
+
+// csv traces as written for SoftwarePLL::getDemoFileData(), everything else is read as pcap or raw datagram log
+static bool loadSamples(const std::string& file, int udp_port, std::vector<ClockSample>& samples)
+{
+    samples.clear();
+    if(file.size() > 4 && file.compare(file.size() - 4, 4, ".csv") == 0)
+    {
+        std::vector<uint32_t> ticks, secs, nsecs;
+        if(!SoftwarePLL::getDemoFileData(file, ticks, secs, nsecs)) return false;
+        for(size_t i = 0; i < ticks.size(); i++)
+        {
+            samples.push_back(ClockSample{ ticks[i], secs[i], nsecs[i] });
+        }
+        return true;
+    }
+
+    sick_scansegment_xd::DatagramLogReader reader;
+    if(!reader.Open(file, udp_port)) return false;
+
+    size_t num_unsupported = 0;
+    sick_scansegment_xd::LoggedDatagram datagram;
+    while(reader.Next(datagram))
+    {
+        const std::vector<uint8_t>& p = datagram.payload;
+        // compact format: 0x02020202, uint32 commandId (1: scan data, 2: imu), see CompactDataParser::ParseHeader()
+        if(p.size() < 64 || p[0] != 0x02 || p[1] != 0x02 || p[2] != 0x02 || p[3] != 0x02)
+        {
+            num_unsupported++;
+            continue;
+        }
+        uint32_t command_id = p[4] | (p[5] << 8) | (p[6] << 16) | (static_cast<uint32_t>(p[7]) << 24);
+        if(command_id != 1 && command_id != 2)
+        {
+            num_unsupported++;     // msgpack or unknown telegram
+            continue;
+        }
+        sick_scansegment_xd::CompactDataHeader header = sick_scansegment_xd::CompactDataParser::ParseHeader(p.data() + 4);
+        samples.push_back(ClockSample{
+            static_cast<uint32_t>(header.timeStampTransmit & 0xFFFFFFFF),
+            static_cast<uint32_t>(datagram.timestamp_nsec / 1000000000ULL),
+            static_cast<uint32_t>(datagram.timestamp_nsec % 1000000000ULL) });
+    }
+    if(num_unsupported > 0)
+    {
+        std::printf("%s: %lu datagrams skipped (not compact format, only compact scan and imu telegrams carry usable ticks)\n",
+            file.c_str(), num_unsupported);
+    }
+    return !samples.empty();
+}
+
+// offline least squares fit time = a + b * unwrapped_tick over the whole trace (centered for numerical stability)
+static std::vector<double> offlineReference(const std::vector<ClockSample>& samples)
+{
+    std::vector<double> x(samples.size()), ref(samples.size());
+    int64_t unwrapped = 0;
+    double mean_x = 0., mean_y = 0.;
+    for(size_t i = 0; i < samples.size(); i++)
+    {
+        if(i > 0) unwrapped += static_cast<int32_t>(samples[i].tick - samples[i - 1].tick);
+        x[i] = static_cast<double>(unwrapped);
+        mean_x += x[i];
+        mean_y += samples[i].t() - samples[0].t();
+    }
+    mean_x /= samples.size();
+    mean_y /= samples.size();
+    double sxy = 0., sxx = 0.;
+    for(size_t i = 0; i < samples.size(); i++)
+    {
+        double dx = x[i] - mean_x;
+        sxy += dx * (samples[i].t() - samples[0].t() - mean_y);
+        sxx += dx * dx;
+    }
+    double slope = sxx > 0. ? sxy / sxx : 1e-6;
+    for(size_t i = 0; i < samples.size(); i++)
+    {
+        ref[i] = samples[0].t() + mean_y + slope * (x[i] - mean_x);
+    }
+    return ref;
+}
+
+static void configurePLL(SoftwarePLL& pll, const std::string& estimator, const EvalConfig& config)
+{
+    if(estimator == "offset")
+    {
+        pll.setTicksToTimestampMode(1);  // TICKS_TO_MICROSEC_OFFSET_TIMESTAMP
+        return;
+    }
+    pll.setClockEstimator(estimator == "kalman" ?
+        SoftwarePLL::CLOCK_ESTIMATOR_KALMAN_FILTER : SoftwarePLL::CLOCK_ESTIMATOR_FIFO_REGRESSION);
+    pll.setFifoSize(config.fifo_size);
+    if(config.max_deviation > 0.) pll.AllowedTimeDeviation(config.max_deviation);
+    if(config.kalman_sigma > 0.) pll.KalmanFilter().MeasurementStdDevSec = config.kalman_sigma;
+    if(config.kalman_gate > 0.) pll.KalmanFilter().GateSigma = config.kalman_gate;
+}
+
+static void evaluate(const std::vector<ClockSample>& samples, const std::vector<double>& ref,
+    const std::string& estimator, const EvalConfig& config)
+{
+    using clock = std::chrono::steady_clock;
+
+    // pass 1: cost of updatePLL() alone
+    double update_ns = 0.;
+    {
+        SoftwarePLL pll;
+        configurePLL(pll, estimator, config);
+        auto t0 = clock::now();
+        for(const ClockSample& s : samples)
+        {
+            pll.updatePLL(s.sec, s.nsec, s.tick);
+        }
+        update_ns = std::chrono::duration<double, std::nano>(clock::now() - t0).count() / samples.size();
+    }
+
+    // pass 2: errors of the timestamps as they would have been produced online
+    SoftwarePLL pll;
+    configurePLL(pll, estimator, config);
+    std::vector<double> err_rx, err_ref;
+    std::vector<double> sample_err_ref(samples.size(), NAN);
+    err_rx.reserve(samples.size());
+    err_ref.reserve(samples.size());
+    size_t num_resets = 0;
+    bool was_valid = false;
+    double first_valid_time = -1.;
+    for(size_t i = 0; i < samples.size(); i++)
+    {
+        const ClockSample& s = samples[i];
+        pll.updatePLL(s.sec, s.nsec, s.tick);
+
+        uint32_t corr_sec = 0, corr_nsec = 0;
+        bool valid = pll.getCorrectedTimeStamp(corr_sec, corr_nsec, s.tick);
+        if(was_valid && !valid) num_resets++;
+        was_valid = valid;
+        if(!valid) continue;
+
+        if(first_valid_time < 0.) first_valid_time = s.t() - samples[0].t();
+        double corr = corr_sec + 1e-9 * corr_nsec;
+        err_rx.push_back(corr - s.t());
+        err_ref.push_back(corr - ref[i]);
+        sample_err_ref[i] = corr - ref[i];
+        if(config.verbose)
+        {
+            std::printf("%s;%u;%u.%09u;%u.%09u;%+.6f;%+.6f\n", estimator.c_str(), s.tick, s.sec, s.nsec, corr_sec, corr_nsec,
+                corr - s.t(), corr - ref[i]);
+        }
+    }
+
+    // convergence: from here on every sample is valid and within converge_tol of the offline fit
+    double converge_time = -1.;
+    for(size_t i = samples.size(); i > 0; i--)
+    {
+        if(std::isnan(sample_err_ref[i - 1]) || std::fabs(sample_err_ref[i - 1]) > config.converge_tol)
+        {
+            if(i < samples.size()) converge_time = samples[i].t() - samples[0].t();
+            break;
+        }
+        if(i == 1) converge_time = 0.;
+    }
+
+    // pass 3: cost of getCorrectedTimeStamp() on the final model
+    double correct_ns = 0.;
+    {
+        volatile uint32_t sink = 0;
+        uint32_t corr_sec = 0, corr_nsec = 0;
+        auto t0 = clock::now();
+        for(const ClockSample& s : samples)
+        {
+            pll.getCorrectedTimeStamp(corr_sec, corr_nsec, s.tick);
+            sink = corr_nsec;
+        }
+        (void)sink;
+        correct_ns = std::chrono::duration<double, std::nano>(clock::now() - t0).count() / samples.size();
+    }
+
+    ErrorStats rx = ErrorStats::compute(err_rx), fit = ErrorStats::compute(err_ref);
+    std::printf("\n[%s] %lu of %lu samples corrected, %lu resets, first valid after %.3f s, ",
+        estimator.c_str(), err_rx.size(), samples.size(), num_resets, first_valid_time);
+    if(converge_time >= 0.) std::printf("converged (|err| < %.3f ms) after %.3f s\n", config.converge_tol * 1e3, converge_time);
+    else std::printf("not converged (|err| < %.3f ms)\n", config.converge_tol * 1e3);
+    std::printf("  error vs. receive time [ms]: mean %+.4f  std %.4f  p50 %.4f  p95 %.4f  p99 %.4f  max %.4f\n",
+        rx.mean * 1e3, rx.stddev * 1e3, rx.p50 * 1e3, rx.p95 * 1e3, rx.p99 * 1e3, rx.max * 1e3);
+    std::printf("  error vs. offline fit  [ms]: mean %+.4f  std %.4f  p50 %.4f  p95 %.4f  p99 %.4f  max %.4f\n",
+        fit.mean * 1e3, fit.stddev * 1e3, fit.p50 * 1e3, fit.p95 * 1e3, fit.p99 * 1e3, fit.max * 1e3);
+    std::printf("  cost: %.1f ns per updatePLL(), %.1f ns per getCorrectedTimeStamp()\n", update_ns, correct_ns);
+}
+
+
+int main(int argc, char** argv)
+{
+    EvalConfig config;
+    if(!parseArgs(argc, argv, config))
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for(const std::string& file : config.files)
+    {
+        std::vector<ClockSample> samples;
+        if(!loadSamples(file, config.udp_port, samples) || samples.size() < 2)
+        {
+            std::fprintf(stderr, "## ERROR clock_sync_eval: no tick/timestamp samples in %s\n", file.c_str());
+            continue;
+        }
+        std::printf("%s: %lu samples over %.3f s\n", file.c_str(), samples.size(), samples.back().t() - samples.front().t());
+
+        std::vector<double> ref = offlineReference(samples);
+        for(const std::string& estimator : config.estimators)
+        {
+            if(estimator != "fifo" && estimator != "kalman" && estimator != "offset")
+            {
+                std::fprintf(stderr, "## ERROR clock_sync_eval: unknown estimator \"%s\"\n", estimator.c_str());
+                continue;
+            }
+            evaluate(samples, ref, estimator, config);
+        }
+        std::printf("\n");
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,376 @@
+/* Microbenchmarks of the receive path: crc check, compact and msgpack decoding, the
+ * PointCloud2 packing loop of MultiscanNode::run_receiver(), the sensor to vehicle transform and the range image compression.
+ *
+ * All inputs are generated deterministically by SyntheticScanGenerator: one multiScan segment
+ * of 16 layers with 1, 2 or 3 echoes, encoded as compact telegramVersion 3 or 4 and as msgpack. No lidar and
+ * no recorded data are required, so results are comparable between builds and machines.
+ * Each benchmark reports points/s ("items_per_second") and datagram bytes/s.
+ *
+ * Usage: decode_benchmark [--benchmark_filter=<regex>] [--benchmark_min_time=<sec>] ... */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "sick_scan_xd/compact_parser.h"
+#include "sick_scan_xd/msgpack_parser.h"
+#include "sick_scan_xd/packed_point.h"
+#include "sick_scan_xd/range_image_codec.h"
+#include "sick_scan_xd/udp_sockets.h"
+#include "sick_scan_xd/synthetic_scan.h"
+
+
+namespace
+{
+
+constexpr uint32_t FIXTURE_SEGMENTS = sick_scansegment_xd::SyntheticScanGenerator::SegmentsPerFrame;
+constexpr size_t POINT_BYTE_LEN = sizeof(sick_scansegment_xd::PackedPoint);   // PointCloud2 point step of the driver
+
+// sensor timestamps of a segment in microseconds, 20 Hz rotation
+inline uint64_t fixture_ts_start(uint32_t segment) { return 1000000ULL + segment * 4166ULL; }
+inline uint64_t fixture_ts_stop(uint32_t segment) { return fixture_ts_start(segment) + 4000ULL; }
+
+std::vector<uint8_t> make_compact_datagram(uint32_t num_echos, uint32_t telegram_version, uint32_t segment = 0)
+{
+    return sick_scansegment_xd::SyntheticScanGenerator(num_echos, telegram_version)
+        .CompactSegment(segment, 1 + segment, fixture_ts_start(segment), fixture_ts_stop(segment));
+}
+
+std::vector<uint8_t> make_msgpack_payload(uint32_t num_echos, uint32_t segment = 0)
+{
+    return sick_scansegment_xd::SyntheticScanGenerator(num_echos)
+        .MsgPackPayload(segment, 1 + segment, fixture_ts_start(segment), fixture_ts_stop(segment));
+}
+
+size_t count_points(const sick_scansegment_xd::ScanSegmentParserOutput& segment)
+{
+    size_t n = 0;
+    for(const auto& group : segment.scandata)
+    {
+        for(const auto& line : group.scanlines)
+        {
+            n += line.points.size();
+        }
+    }
+    return n;
+}
+
+void set_counters(benchmark::State& state, size_t points_per_iteration, size_t bytes_per_iteration)
+{
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * points_per_iteration));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes_per_iteration));
+    state.counters["points"] = static_cast<double>(points_per_iteration);
+}
+
+void compact_args(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({ "echos", "version" });
+    for(int version : { 3, 4 })
+    {
+        for(int echos : { 1, 2, 3 })
+        {
+            b->Args({ echos, version });
+        }
+    }
+}
+
+} // namespace
+
+
+static void BM_Crc32(benchmark::State& state)
+{
+    const std::vector<uint8_t> datagram = make_compact_datagram(static_cast<uint32_t>(state.range(0)), 4);
+    const size_t len = datagram.size() - sizeof(uint32_t);
+    for(auto _ : state)
+    {
+        uint32_t crc = sick_scansegment_xd::crc32(0, datagram.data(), len);
+        benchmark::DoNotOptimize(crc);
+    }
+    set_counters(state, sick_scansegment_xd::SyntheticScanGenerator(static_cast<uint32_t>(state.range(0))).PointsPerSegment(), len);
+}
+BENCHMARK(BM_Crc32)->ArgName("echos")->DenseRange(1, 3);
+
+static void BM_CompactParseSegment(benchmark::State& state)
+{
+    const uint32_t echos = static_cast<uint32_t>(state.range(0)), version = static_cast<uint32_t>(state.range(1));
+    const std::vector<uint8_t> datagram = make_compact_datagram(echos, version);
+    sick_scansegment_xd::CompactSegmentData segment_data;
+    uint32_t payload_length_bytes = 0, num_bytes_required = 0;
+    for(auto _ : state)
+    {
+        if(!sick_scansegment_xd::CompactDataParser::ParseSegment(datagram.data(), datagram.size(), &segment_data, payload_length_bytes, num_bytes_required))
+        {
+            state.SkipWithError("CompactDataParser::ParseSegment() failed");
+            break;
+        }
+        benchmark::DoNotOptimize(segment_data);
+    }
+    set_counters(state, sick_scansegment_xd::SyntheticScanGenerator(echos).PointsPerSegment(), datagram.size());
+}
+BENCHMARK(BM_CompactParseSegment)->Apply(compact_args);
+
+static void BM_CompactParse(benchmark::State& state)
+{
+    const uint32_t echos = static_cast<uint32_t>(state.range(0)), version = static_cast<uint32_t>(state.range(1));
+    const std::vector<uint8_t> datagram = make_compact_datagram(echos, version);
+    size_t points = 0;
+    for(auto _ : state)
+    {
+        sick_scansegment_xd::ScanSegmentParserOutput segment;
+        // the software pll is excluded here, see clock_sync_eval for the cost of the clock estimators
+        if(!sick_scansegment_xd::CompactDataParser::Parse(datagram, fifo_clock::now(), segment, 0, false, false))
+        {
+            state.SkipWithError("CompactDataParser::Parse() failed");
+            break;
+        }
+        points = count_points(segment);
+        benchmark::DoNotOptimize(segment);
+    }
+    set_counters(state, points, datagram.size());
+}
+BENCHMARK(BM_CompactParse)->Apply(compact_args);
+
+static void BM_CompactParseModuleMeasurementData(benchmark::State& state)
+{
+    const uint32_t echos = static_cast<uint32_t>(state.range(0)), version = static_cast<uint32_t>(state.range(1));
+    const std::vector<uint8_t> datagram = make_compact_datagram(echos, version);
+    const sick_scansegment_xd::CompactDataHeader header = sick_scansegment_xd::CompactDataParser::ParseHeader(datagram.data() + 4);
+    uint32_t metadata_size = 0;
+    const sick_scansegment_xd::CompactModuleMetaData metadata =
+        sick_scansegment_xd::CompactDataParser::ParseModuleMetaData(datagram.data() + 32, header.sizeModule0, header.telegramVersion, metadata_size);
+    const uint8_t* measurement = datagram.data() + 32 + metadata_size;
+    const uint32_t measurement_size = header.sizeModule0 - metadata_size;
+    sick_scansegment_xd::CompactModuleMeasurementData measurement_data;
+    for(auto _ : state)
+    {
+        if(!sick_scansegment_xd::CompactDataParser::ParseModuleMeasurementData(measurement, measurement_size, header, metadata, 0.f, measurement_data))
+        {
+            state.SkipWithError("CompactDataParser::ParseModuleMeasurementData() failed");
+            break;
+        }
+        benchmark::DoNotOptimize(measurement_data);
+    }
+    set_counters(state, sick_scansegment_xd::SyntheticScanGenerator(echos).PointsPerSegment(), measurement_size);
+}
+BENCHMARK(BM_CompactParseModuleMeasurementData)->Apply(compact_args);
+
+static void BM_MsgPackParse(benchmark::State& state)
+{
+    const std::vector<uint8_t> payload = make_msgpack_payload(static_cast<uint32_t>(state.range(0)));
+    size_t points = 0;
+    for(auto _ : state)
+    {
+        sick_scansegment_xd::ScanSegmentParserOutput segment;
+        if(!sick_scansegment_xd::MsgPackParser::Parse(payload, fifo_clock::now(), segment, false, false))
+        {
+            state.SkipWithError("MsgPackParser::Parse() failed");
+            break;
+        }
+        points = count_points(segment);
+        benchmark::DoNotOptimize(segment);
+    }
+    set_counters(state, points, payload.size());
+}
+BENCHMARK(BM_MsgPackParse)->ArgName("echos")->DenseRange(1, 3);
+
+/* Frame assembly as in MultiscanNode::run_receiver(): all segments of a frame are packed into
+ * PointCloud2 points by packPoint(). Bytes/s counts the packed cloud. */
+static void BM_PackPointCloud(benchmark::State& state)
+{
+    const uint32_t echos = static_cast<uint32_t>(state.range(0));
+    std::vector<sick_scansegment_xd::ScanSegmentParserOutput> frame(FIXTURE_SEGMENTS);
+    for(uint32_t s = 0; s < FIXTURE_SEGMENTS; s++)
+    {
+        if(!sick_scansegment_xd::CompactDataParser::Parse(make_compact_datagram(echos, 4, s), fifo_clock::now(), frame[s], 0, false, false))
+        {
+            state.SkipWithError("CompactDataParser::Parse() failed");
+            return;
+        }
+    }
+    std::vector<uint8_t> data;
+    for(auto _ : state)
+    {
+        data.reserve(900 * FIXTURE_SEGMENTS * POINT_BYTE_LEN);
+        data.resize(0);
+        uint64_t earliest_ts = std::numeric_limits<uint64_t>::max();
+        for(const auto& _seg : frame)
+        {
+            uint64_t ts = static_cast<uint64_t>(_seg.timestamp_sec) * 1000000000UL + static_cast<uint64_t>(_seg.timestamp_nsec);
+            if(ts < earliest_ts) earliest_ts = ts;
+
+            for(const auto& _group : _seg.scandata)
+            {
+                for(const auto& _line : _group.scanlines)
+                {
+                    for(const auto& _point : _line.points)
+                    {
+                        data.resize(data.size() + POINT_BYTE_LEN);
+                        sick_scansegment_xd::packPoint(_point, data.end().base() - POINT_BYTE_LEN);
+                    }
+                }
+            }
+        }
+        benchmark::DoNotOptimize(earliest_ts);
+        benchmark::DoNotOptimize(data.data());
+        benchmark::ClobberMemory();
+        std::vector<uint8_t>().swap(data);  // the published message takes the buffer, so every frame allocates anew
+    }
+    size_t points = 0;
+    for(const auto& _seg : frame) points += count_points(_seg);
+    set_counters(state, points, points * POINT_BYTE_LEN);
+}
+BENCHMARK(BM_PackPointCloud)->ArgName("echos")->DenseRange(1, 3);
+
+/* Sensor to vehicle transform of a segment incl. packing into PointCloud2 points. "after": 0 applies the transform
+ * in the parser (DecoderConfig::SetTransform()), 1 parses without transform and transforms a copy of the packed
+ * points afterwards, like a separate transform node. The "max_err_um" counter is the largest deviation of the
+ * transformed points from a double precision transform of the untransformed points in micrometer. */
+static void BM_Transform(benchmark::State& state)
+{
+    const uint32_t echos = static_cast<uint32_t>(state.range(0));
+    const bool after = (state.range(1) != 0);
+    const double xyz_rpy[6] = { 0.35, -0.12, 1.25, 0.02, -0.05, 1.5708 };
+    const std::string transform = "0.35,-0.12,1.25,0.02,-0.05,1.5708";
+    const double cr = std::cos(xyz_rpy[3]), sr = std::sin(xyz_rpy[3]), cp = std::cos(xyz_rpy[4]), sp = std::sin(xyz_rpy[4]), cy = std::cos(xyz_rpy[5]), sy = std::sin(xyz_rpy[5]);
+    const double rotation[9] = {
+        cy * cp, cy * sp * sr - sy * cr, cy * sp * cr + sy * sr,
+        sy * cp, sy * sp * sr + cy * cr, sy * sp * cr - cy * sr,
+        -sp,     cp * sr,                cp * cr };
+    const std::vector<uint8_t> datagram = make_compact_datagram(echos, 4);
+    auto pack = [](const sick_scansegment_xd::ScanSegmentParserOutput& segment, std::vector<uint8_t>& data)
+    {
+        data.resize(0);
+        for(const auto& group : segment.scandata)
+            for(const auto& line : group.scanlines)
+                for(const auto& point : line.points)
+                {
+                    data.resize(data.size() + POINT_BYTE_LEN);
+                    sick_scansegment_xd::packPoint(point, data.end().base() - POINT_BYTE_LEN);
+                }
+    };
+
+    // double precision reference, parsed without decoder config, i.e. without transform
+    sick_scansegment_xd::ScanSegmentParserOutput segment;
+    std::vector<uint8_t> reference;
+    if(!sick_scansegment_xd::CompactDataParser::Parse(datagram, fifo_clock::now(), segment, 0, false, false))
+    {
+        state.SkipWithError("CompactDataParser::Parse() failed");
+        return;
+    }
+    pack(segment, reference);
+
+    float rotation_f[9];
+    for(int n = 0; n < 9; n++) rotation_f[n] = static_cast<float>(rotation[n]);
+    sick_scansegment_xd::DecoderConfig decoder_config;
+    decoder_config.SetTransform(after ? "" : transform);
+    std::vector<uint8_t> packed, transformed;
+    for(auto _ : state)
+    {
+        if(!sick_scansegment_xd::CompactDataParser::Parse(datagram, fifo_clock::now(), segment, 0, false, false, 0, &decoder_config))
+        {
+            state.SkipWithError("CompactDataParser::Parse() failed");
+            break;
+        }
+        pack(segment, packed);
+        if(after)
+        {
+            transformed = packed;   // the transform node publishes a new cloud
+            for(size_t n = 0; n < transformed.size(); n += POINT_BYTE_LEN)
+            {
+                float* xyz = reinterpret_cast<float*>(transformed.data() + n);
+                float x = xyz[0], y = xyz[1], z = xyz[2];
+                xyz[0] = rotation_f[0] * x + rotation_f[1] * y + rotation_f[2] * z + static_cast<float>(xyz_rpy[0]);
+                xyz[1] = rotation_f[3] * x + rotation_f[4] * y + rotation_f[5] * z + static_cast<float>(xyz_rpy[1]);
+                xyz[2] = rotation_f[6] * x + rotation_f[7] * y + rotation_f[8] * z + static_cast<float>(xyz_rpy[2]);
+            }
+        }
+        benchmark::DoNotOptimize(after ? transformed.data() : packed.data());
+        benchmark::ClobberMemory();
+    }
+
+    const std::vector<uint8_t>& result = (after ? transformed : packed);
+    double max_err = 0;
+    for(size_t n = 0; n + POINT_BYTE_LEN <= std::min(result.size(), reference.size()); n += POINT_BYTE_LEN)
+    {
+        float p[3], q[3];
+        memcpy(p, reference.data() + n, sizeof(p));
+        memcpy(q, result.data() + n, sizeof(q));
+        for(int row = 0; row < 3; row++)
+        {
+            double expected = rotation[3 * row] * p[0] + rotation[3 * row + 1] * p[1] + rotation[3 * row + 2] * p[2] + xyz_rpy[row];
+            max_err = std::max(max_err, std::fabs(expected - q[row]));
+        }
+    }
+    set_counters(state, reference.size() / POINT_BYTE_LEN, reference.size());
+    state.counters["max_err_um"] = 1e6 * max_err;
+}
+BENCHMARK(BM_Transform)->ArgNames({ "echos", "after" })->ArgsProduct({ { 1, 3 }, { 0, 1 } });
+
+/* Lossless range image compression of a frame (see range_image_codec.h). Bytes/s counts the compact
+ * datagrams, the "ratio" counter is compact size / compressed size. */
+static void BM_RangeImageCompress(benchmark::State& state)
+{
+    const uint32_t echos = static_cast<uint32_t>(state.range(0));
+    std::vector<std::vector<uint8_t>> datagrams;
+    std::vector<const std::vector<uint8_t>*> segments;
+    size_t bytes = 0;
+    for(uint32_t s = 0; s < FIXTURE_SEGMENTS; s++)
+    {
+        datagrams.push_back(make_compact_datagram(echos, 4, s));
+        bytes += datagrams.back().size();
+    }
+    for(const auto& datagram : datagrams) segments.push_back(&datagram);
+    std::vector<uint8_t> frame;
+    for(auto _ : state)
+    {
+        if(!sick_scansegment_xd::RangeImageCodec::CompressFrame(segments, frame))
+        {
+            state.SkipWithError("RangeImageCodec::CompressFrame() failed");
+            break;
+        }
+        benchmark::DoNotOptimize(frame.data());
+    }
+    set_counters(state, sick_scansegment_xd::SyntheticScanGenerator(echos).PointsPerSegment() * FIXTURE_SEGMENTS, bytes);
+    state.counters["ratio"] = static_cast<double>(bytes) / static_cast<double>(std::max<size_t>(frame.size(), 1));
+}
+BENCHMARK(BM_RangeImageCompress)->ArgName("echos")->DenseRange(1, 3);
+
+static void BM_RangeImageDecompress(benchmark::State& state)
+{
+    const uint32_t echos = static_cast<uint32_t>(state.range(0));
+    std::vector<std::vector<uint8_t>> datagrams;
+    std::vector<const std::vector<uint8_t>*> segments;
+    size_t bytes = 0;
+    for(uint32_t s = 0; s < FIXTURE_SEGMENTS; s++)
+    {
+        datagrams.push_back(make_compact_datagram(echos, 4, s));
+        bytes += datagrams.back().size();
+    }
+    for(const auto& datagram : datagrams) segments.push_back(&datagram);
+    std::vector<uint8_t> frame;
+    if(!sick_scansegment_xd::RangeImageCodec::CompressFrame(segments, frame))
+    {
+        state.SkipWithError("RangeImageCodec::CompressFrame() failed");
+        return;
+    }
+    std::vector<std::vector<uint8_t>> restored;
+    for(auto _ : state)
+    {
+        if(!sick_scansegment_xd::RangeImageCodec::DecompressFrame(frame.data(), frame.size(), restored))
+        {
+            state.SkipWithError("RangeImageCodec::DecompressFrame() failed");
+            break;
+        }
+        benchmark::DoNotOptimize(restored.data());
+    }
+    set_counters(state, sick_scansegment_xd::SyntheticScanGenerator(echos).PointsPerSegment() * FIXTURE_SEGMENTS, bytes);
+}
+BENCHMARK(BM_RangeImageDecompress)->ArgName("echos")->DenseRange(1, 3);
+
+BENCHMARK_MAIN();
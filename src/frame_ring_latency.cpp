@@ -0,0 +1,264 @@
+/* Latency benchmark of the shared memory frame ring (see frame_ring.h).
+ *
+ * Creates a ring, forks a number of reader processes and writes synthetic frames at a given rate,
+ * like the driver does after frame assembly. Each reader waits on the ring's futex, takes the latest
+ * frame and reads all of its points in place (or copies them with --copy), then validates the frame.
+ * Reported per reader: frames received, frames skipped because a newer frame was already available,
+ * frames overwritten while being read, the latency from completing a frame in the writer to waking up
+ * in the reader (steady clock, which is system wide) and the time to read a frame. */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sick_scan_xd/frame_ring.h"
+#include "sick_scan_xd/packed_point.h"
+
+
+static constexpr size_t POINT_BYTE_LEN = sizeof(sick_scansegment_xd::PackedPoint);   // PointCloud2 point step of the driver
+
+struct BenchConfig
+{
+    std::string name = "/multiscan_ring_latency";
+    int num_readers = 2;
+    size_t num_frames = 400;
+    double rate = 20.;              // frames per second, 0: as fast as possible
+    size_t num_points = 32400;      // 3 echos x 10800 points
+    int num_slots = 4;
+    bool copy = false;              // readers copy the points instead of reading them in place
+};
+
+// sent from each reader to the writer through a pipe
+struct ReaderResult
+{
+    size_t received = 0;
+    size_t skipped = 0;             // frames not read because a newer frame was available
+    size_t overwritten = 0;         // frames overwritten while being read
+    double latency_p50_us = 0, latency_p99_us = 0, latency_max_us = 0;
+    double read_mean_us = 0;
+    double checksum = 0;
+};
+
+static inline uint64_t steadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static void printUsage(const char* argv0)
+{
+    std::printf(
+        "Usage: %s [options]\n"
+        "Options:\n"
+        "  --name <name>          shared memory name (default /multiscan_ring_latency)\n"
+        "  --readers <n>          number of reader processes (default 2)\n"
+        "  --frames <n>           number of frames to write (default 400)\n"
+        "  --rate <hz>            frame rate, 0 writes as fast as possible (default 20)\n"
+        "  --points <n>           points per frame (default 32400)\n"
+        "  --slots <n>            number of ring slots (default 4)\n"
+        "  --copy                 readers copy each frame instead of reading it in place\n",
+        argv0);
+}
+
+static bool parseArgs(int argc, char** argv, BenchConfig& config)
+{
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto next = [&](const char* name) -> const char*
+        {
+            if(i + 1 >= argc)
+            {
+                std::fprintf(stderr, "## ERROR frame_ring_latency: missing value for %s\n", name);
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if(arg == "--help" || arg == "-h") return false;
+        else if(arg == "--name") config.name = next("--name");
+        else if(arg == "--readers") config.num_readers = std::max(1, std::atoi(next("--readers")));
+        else if(arg == "--frames") config.num_frames = static_cast<size_t>(std::max(1, std::atoi(next("--frames"))));
+        else if(arg == "--rate") config.rate = std::max(0., std::atof(next("--rate")));
+        else if(arg == "--points") config.num_points = static_cast<size_t>(std::max(1, std::atoi(next("--points"))));
+        else if(arg == "--slots") config.num_slots = std::max(2, std::atoi(next("--slots")));
+        else if(arg == "--copy") config.copy = true;
+        else
+        {
+            std::fprintf(stderr, "## ERROR frame_ring_latency: unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// reads frames until the writer closes the ring
+static ReaderResult runReader(const BenchConfig& config, int ready_fd)
+{
+    ReaderResult result;
+    sick_scansegment_xd::FrameRingReader ring;
+    char ready = (ring.Open(config.name) ? 1 : 0);
+    if(write(ready_fd, &ready, 1) != 1 || !ready)
+    {
+        return result;
+    }
+
+    std::vector<double> latency_us;
+    std::vector<uint8_t> copied;
+    double read_sum_us = 0;
+    uint64_t num_seen = ring.NumFramesWritten();
+    while(ring.WaitForFrames(num_seen, 5.))
+    {
+        const uint64_t wakeup_nsec = steadyNanoseconds();
+        const uint64_t latest = ring.NumFramesWritten() - 1;
+        result.skipped += latest - num_seen;
+        num_seen = latest + 1;
+
+        sick_scansegment_xd::FrameRingView view;
+        bool valid = false;
+        double sum = 0;
+        if(config.copy)
+        {
+            valid = ring.Copy(latest, view, copied);
+        }
+        else
+        {
+            valid = ring.Acquire(latest, view);
+        }
+        if(valid)
+        {
+            // touch every point like a consumer would, f.e. sum up the ranges
+            for(size_t n = 0; n < view.num_points; n++)
+            {
+                float range;
+                std::memcpy(&range, view.points + n * POINT_BYTE_LEN + offsetof(sick_scansegment_xd::PackedPoint, range), sizeof(float));
+                sum += range;
+            }
+            valid = (config.copy || ring.Validate(view));
+        }
+        const uint64_t done_nsec = steadyNanoseconds();
+        if(!valid)
+        {
+            result.overwritten++;
+            continue;
+        }
+        result.received++;
+        result.checksum += sum;
+        latency_us.push_back(1e-3 * static_cast<double>(wakeup_nsec - view.write_steady_nsec));
+        read_sum_us += 1e-3 * static_cast<double>(done_nsec - wakeup_nsec);
+    }
+
+    if(!latency_us.empty())
+    {
+        std::sort(latency_us.begin(), latency_us.end());
+        auto pct = [&latency_us](double p) { return latency_us[std::min(latency_us.size() - 1, static_cast<size_t>(p * latency_us.size()))]; };
+        result.latency_p50_us = pct(0.50);
+        result.latency_p99_us = pct(0.99);
+        result.latency_max_us = latency_us.back();
+        result.read_mean_us = read_sum_us / latency_us.size();
+    }
+    return result;
+}
+
+
+int main(int argc, char** argv)
+{
+    BenchConfig config;
+    if(!parseArgs(argc, argv, config))
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    sick_scansegment_xd::FrameRingWriter ring;
+    if(!ring.Open(config.name, static_cast<uint32_t>(config.num_slots), config.num_points))
+    {
+        std::fprintf(stderr, "## ERROR frame_ring_latency: can't create frame ring %s\n", config.name.c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<pid_t> readers;
+    std::vector<int> result_fds;
+    for(int r = 0; r < config.num_readers; r++)
+    {
+        int fds[2];
+        if(pipe(fds) != 0)
+        {
+            std::fprintf(stderr, "## ERROR frame_ring_latency: pipe() failed\n");
+            return EXIT_FAILURE;
+        }
+        pid_t pid = fork();
+        if(pid == 0)
+        {
+            close(fds[0]);
+            ReaderResult result = runReader(config, fds[1]);
+            bool success = (write(fds[1], &result, sizeof(result)) == static_cast<ssize_t>(sizeof(result)));
+            close(fds[1]);
+            _exit(success ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        close(fds[1]);
+        char ready = 0;
+        if(pid < 0 || read(fds[0], &ready, 1) != 1 || !ready)
+        {
+            std::fprintf(stderr, "## ERROR frame_ring_latency: reader %d failed to start\n", r);
+            return EXIT_FAILURE;
+        }
+        readers.push_back(pid);
+        result_fds.push_back(fds[0]);
+    }
+
+    // synthetic points, the ranges change every frame
+    std::vector<uint8_t> points(config.num_points * POINT_BYTE_LEN, 0);
+    double write_sum_us = 0, write_max_us = 0;
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(config.rate > 0 ? 1. / config.rate : 0.));
+    auto next_write = std::chrono::steady_clock::now();
+    for(size_t frame = 0; frame < config.num_frames; frame++)
+    {
+        for(size_t n = 0; n < config.num_points; n += 64)
+        {
+            float range = static_cast<float>((frame + n) % 1000) * 0.01f;
+            std::memcpy(points.data() + n * POINT_BYTE_LEN + offsetof(sick_scansegment_xd::PackedPoint, range), &range, sizeof(float));
+        }
+        std::this_thread::sleep_until(next_write);
+        next_write += period;
+        uint64_t t0 = steadyNanoseconds();
+        ring.Write(steadyNanoseconds(), points.data(), config.num_points);
+        double write_us = 1e-3 * static_cast<double>(steadyNanoseconds() - t0);
+        write_sum_us += write_us;
+        write_max_us = std::max(write_max_us, write_us);
+    }
+    ring.Close();
+
+    std::printf("frame_ring_latency: %zu frames of %zu points (%.1f MB) at %.1f Hz (0: max. rate), %d slots, %d readers (%s)\n",
+        config.num_frames, config.num_points, config.num_points * POINT_BYTE_LEN * 1e-6, config.rate,
+        config.num_slots, config.num_readers, (config.copy ? "copy" : "zero copy"));
+    std::printf("frame_ring_latency: writer: %.1f us mean, %.1f us max per frame\n", write_sum_us / config.num_frames, write_max_us);
+    bool success = true;
+    for(size_t r = 0; r < readers.size(); r++)
+    {
+        ReaderResult result;
+        if(read(result_fds[r], &result, sizeof(result)) != static_cast<ssize_t>(sizeof(result)))
+        {
+            std::fprintf(stderr, "## ERROR frame_ring_latency: no result from reader %zu\n", r);
+            success = false;
+        }
+        else
+        {
+            std::printf("frame_ring_latency: reader %zu: %zu received, %zu skipped, %zu overwritten, latency p50 %.1f us, p99 %.1f us, max %.1f us, read %.1f us\n",
+                r, result.received, result.skipped, result.overwritten,
+                result.latency_p50_us, result.latency_p99_us, result.latency_max_us, result.read_mean_us);
+        }
+        close(result_fds[r]);
+        int status = 0;
+        waitpid(readers[r], &status, 0);
+    }
+    return (success ? EXIT_SUCCESS : EXIT_FAILURE);
+}
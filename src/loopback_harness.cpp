@@ -0,0 +1,349 @@
+/* Loopback throughput and latency harness for the multiscan driver.
+ *
+ * Emulates the lidar's udp stream with synthetic segments (see synthetic_scan.h) and subscribes to the
+ * published point clouds. The segment rate is stepped through multiples of the nominal rate (frame_rate
+ * rotations per second, 12 segments each); per step the harness reports frames sent and received, frame
+ * drop rate, incomplete frames, point drop rate and the latency from emitting the last segment of a frame
+ * to receiving its point cloud. The saturation point is the highest rate at which this and all lower rates
+ * stay within max_drop_rate.
+ *
+ * The emitted sensor timestamps are the emitter's system time in microseconds since the start of the harness
+ * (msgpack timestamps are 32 bit), so the latency is taken from the per point timestamps ("tl"/"th") of the
+ * received cloud without any clock model in between. Run the
+ * driver against sopas_mock_server and this node on the same host, see launch/loopback_test.launch.py. */
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include <rclcpp/rclcpp.hpp>
+
+#include <sensor_msgs/msg/point_cloud2.hpp>
+
+#include "util.hpp"
+#include "sick_scan_xd/udp_sockets.h"
+#include "sick_scan_xd/synthetic_scan.h"
+
+
+class LoopbackHarness : public rclcpp::Node
+{
+public:
+    LoopbackHarness();
+
+    // runs warmup and all rate steps, returns the process exit code
+    int run();
+
+protected:
+    struct FrameRecord
+    {
+        uint64_t recv_us;       // system time of receipt
+        uint64_t min_t_us;      // first and last point timestamp, i.e. emitter time of the first and the last segment
+        uint64_t max_t_us;
+        size_t points;
+    };
+
+    struct StepResult
+    {
+        double rate = 0.;               // multiple of the nominal segment rate
+        double segments_per_sec = 0.;   // achieved by the emitter
+        uint64_t t_begin_us = 0, t_end_us = 0;
+        size_t frames_sent = 0, frames_received = 0, frames_incomplete = 0;
+        size_t points_sent = 0, points_received = 0;
+        double latency_p50_ms = 0., latency_p95_ms = 0., latency_p99_ms = 0., latency_max_ms = 0.;
+
+        double frameDropRate() const { return this->frames_sent ? std::max(0., 1. - static_cast<double>(this->frames_received) / this->frames_sent) : 0.; }
+        double pointDropRate() const { return this->points_sent ? std::max(0., 1. - static_cast<double>(this->points_received) / this->points_sent) : 0.; }
+        double incompleteRate() const { return this->frames_received ? static_cast<double>(this->frames_incomplete) / this->frames_received : 0.; }
+    };
+
+    void on_scan(const sensor_msgs::msg::PointCloud2::ConstSharedPtr& scan);
+
+    // emits whole frames at the given rate for at least duration seconds or until stop_on_frame and a frame was received
+    void emit(StepResult& step, double duration, bool stop_on_frame = false);
+    void evaluate(StepResult& step);
+    void report(const std::vector<StepResult>& steps, double saturation_rate);
+
+    // emitter and receipt time in microseconds since the start of the harness
+    uint64_t now_us() const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now() - this->t0).count();
+    }
+
+private:
+    struct
+    {
+        std::string udp_dest_ip = "127.0.0.1";
+        int udp_dest_port = 2115;
+        int echos = 1;
+        int telegram_version = 4;
+        bool use_msgpack = false;
+        double frame_rate = 20.;
+        std::vector<double> rates = { 1., 2., 4., 8. };
+        double step_duration = 5.;
+        double settle_time = 1.;
+        double warmup_timeout = 30.;
+        double max_drop_rate = 0.01;
+        double min_pass_rate = 0.;
+        std::string csv_file = "";
+    }
+    config;
+
+    std::unique_ptr<sick_scansegment_xd::SyntheticScanGenerator> generator;
+    std::unique_ptr<sick_scansegment_xd::UdpSenderSocketImpl> udp_sender;
+    uint64_t telegram_counter = 1;
+    const std::chrono::system_clock::time_point t0 = std::chrono::system_clock::now();
+
+    rclcpp::Subscription<sensor_msgs::msg::PointCloud2>::SharedPtr scan_sub;
+    std::mutex frames_mtx;
+    std::vector<FrameRecord> frames;    // guarded by frames_mtx
+    std::atomic<size_t> num_frames = 0;
+
+};
+
+
+LoopbackHarness::LoopbackHarness() :
+    Node("loopback_harness")
+{
+    util::declare_param(this, "udp_dest_ip", this->config.udp_dest_ip, "127.0.0.1");
+    util::declare_param(this, "udp_dest_port", this->config.udp_dest_port, 2115);
+    util::declare_param(this, "echos", this->config.echos, 1);
+    util::declare_param(this, "telegram_version", this->config.telegram_version, 4);
+    util::declare_param(this, "use_msgpack", this->config.use_msgpack, false);
+    util::declare_param(this, "frame_rate", this->config.frame_rate, 20.);
+    util::declare_param(this, "rates", this->config.rates, std::vector<double>{ 1., 2., 4., 8. });
+    util::declare_param(this, "step_duration", this->config.step_duration, 5.);
+    util::declare_param(this, "settle_time", this->config.settle_time, 1.);
+    util::declare_param(this, "warmup_timeout", this->config.warmup_timeout, 30.);
+    util::declare_param(this, "max_drop_rate", this->config.max_drop_rate, 0.01);
+    util::declare_param(this, "min_pass_rate", this->config.min_pass_rate, 0.);
+    util::declare_param(this, "csv_file", this->config.csv_file, "");
+
+    this->generator = std::make_unique<sick_scansegment_xd::SyntheticScanGenerator>(
+        static_cast<uint32_t>(std::clamp(this->config.echos, 1, 3)),
+        static_cast<uint32_t>(this->config.telegram_version));
+    this->udp_sender = std::make_unique<sick_scansegment_xd::UdpSenderSocketImpl>(this->config.udp_dest_ip, this->config.udp_dest_port);
+
+    // keep more than the default depth, so that frames are not dropped on the subscriber side
+    this->scan_sub = this->create_subscription<sensor_msgs::msg::PointCloud2>(
+        "lidar_scan", rclcpp::SensorDataQoS{}.keep_last(64),
+        [this](const sensor_msgs::msg::PointCloud2::ConstSharedPtr& scan){ this->on_scan(scan); });
+}
+
+void LoopbackHarness::on_scan(const sensor_msgs::msg::PointCloud2::ConstSharedPtr& scan)
+{
+    const uint64_t recv_us = now_us();
+
+    uint32_t t_offset = std::numeric_limits<uint32_t>::max();
+    for(const auto& field : scan->fields)
+    {
+        if(field.name == "tl") t_offset = field.offset;     // "tl" and "th" are the lower and upper half of the point timestamp
+    }
+    if(t_offset == std::numeric_limits<uint32_t>::max() || scan->point_step < t_offset + sizeof(uint64_t))
+    {
+        RCLCPP_WARN_ONCE(this->get_logger(), "[LOOPBACK HARNESS]: Point cloud without timestamp fields - ignored.");
+        return;
+    }
+
+    FrameRecord record{ recv_us, std::numeric_limits<uint64_t>::max(), 0, scan->data.size() / scan->point_step };
+    for(size_t n = 0; n < record.points; n++)
+    {
+        uint64_t t;
+        memcpy(&t, scan->data.data() + n * scan->point_step + t_offset, sizeof(t));
+        record.min_t_us = std::min(record.min_t_us, t);
+        record.max_t_us = std::max(record.max_t_us, t);
+    }
+
+    std::lock_guard<std::mutex> lock{ this->frames_mtx };
+    this->frames.push_back(record);
+    this->num_frames = this->frames.size();
+}
+
+void LoopbackHarness::emit(StepResult& step, double duration, bool stop_on_frame)
+{
+    constexpr uint32_t SEGMENTS_PER_FRAME = sick_scansegment_xd::SyntheticScanGenerator::SegmentsPerFrame;
+    const double segment_rate = this->config.frame_rate * SEGMENTS_PER_FRAME * step.rate;
+    const auto segment_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1. / segment_rate));
+    const uint64_t segment_interval_us = static_cast<uint64_t>(1e6 / segment_rate);
+    const size_t frames_at_start = this->num_frames;
+
+    const auto start = std::chrono::steady_clock::now();
+    auto next = start;
+    size_t segments_sent = 0;
+    step.t_begin_us = now_us();
+    while(rclcpp::ok())
+    {
+        if(segments_sent % SEGMENTS_PER_FRAME == 0)    // only whole frames
+        {
+            const double elapsed = util::toFloatSeconds(std::chrono::steady_clock::now() - start);
+            if(elapsed >= duration || (stop_on_frame && this->num_frames > frames_at_start))
+            {
+                break;
+            }
+        }
+        std::this_thread::sleep_until(next);
+        next += segment_interval;
+        if(std::chrono::steady_clock::now() > next + 10 * segment_interval)
+        {
+            next = std::chrono::steady_clock::now();    // emitter can't keep up, don't send bursts
+        }
+
+        const uint32_t segment_idx = static_cast<uint32_t>(segments_sent % SEGMENTS_PER_FRAME);
+        const uint64_t t_stop = now_us();
+        const uint64_t t_start = t_stop - std::min(t_stop, segment_interval_us);
+        std::vector<uint8_t> datagram = this->config.use_msgpack ?
+            this->generator->MsgPackSegment(segment_idx, this->telegram_counter, t_start, t_stop) :
+            this->generator->CompactSegment(segment_idx, this->telegram_counter, t_start, t_stop);
+        this->udp_sender->Send(datagram);
+        this->telegram_counter++;
+        segments_sent++;
+    }
+    step.t_end_us = now_us();
+    step.frames_sent = segments_sent / SEGMENTS_PER_FRAME;
+    step.points_sent = step.frames_sent * this->generator->PointsPerFrame();
+    step.segments_per_sec = segments_sent / util::toFloatSeconds(std::chrono::steady_clock::now() - start);
+}
+
+void LoopbackHarness::evaluate(StepResult& step)
+{
+    const double frame_period_us = 1e6 / (this->config.frame_rate * step.rate);
+    std::vector<double> latency_ms;
+
+    std::lock_guard<std::mutex> lock{ this->frames_mtx };
+    for(const FrameRecord& frame : this->frames)
+    {
+        // frames are assigned to a step by the emitter time of their last segment
+        if(frame.points == 0 || frame.max_t_us < step.t_begin_us || frame.max_t_us > step.t_end_us)
+        {
+            continue;
+        }
+        step.frames_received++;
+        step.points_received += frame.points;
+        // complete: all points and all segments from the same rotation
+        const double span_us = static_cast<double>(frame.max_t_us - frame.min_t_us);
+        if(frame.points != this->generator->PointsPerFrame() || span_us > 1.5 * frame_period_us)
+        {
+            step.frames_incomplete++;
+        }
+        latency_ms.push_back(1e-3 * static_cast<double>(static_cast<int64_t>(frame.recv_us - frame.max_t_us)));
+    }
+    if(!latency_ms.empty())
+    {
+        std::sort(latency_ms.begin(), latency_ms.end());
+        auto percentile = [&latency_ms](double p) { return latency_ms[std::min(latency_ms.size() - 1, static_cast<size_t>(p * latency_ms.size()))]; };
+        step.latency_p50_ms = percentile(0.50);
+        step.latency_p95_ms = percentile(0.95);
+        step.latency_p99_ms = percentile(0.99);
+        step.latency_max_ms = latency_ms.back();
+    }
+}
+
+void LoopbackHarness::report(const std::vector<StepResult>& steps, double saturation_rate)
+{
+    std::string table =
+        "  rate  seg/s   frames tx/rx    frame drop  incomplete  point drop   latency p50/p95/p99/max [ms]";
+    char line[256];
+    for(const StepResult& s : steps)
+    {
+        std::snprintf(line, sizeof(line), "\n%5.1fx %6.0f  %6lu/%-6lu  %9.2f%%  %9.2f%%  %9.2f%%   %.2f / %.2f / %.2f / %.2f",
+            s.rate, s.segments_per_sec, s.frames_sent, s.frames_received, 100. * s.frameDropRate(), 100. * s.incompleteRate(),
+            100. * s.pointDropRate(), s.latency_p50_ms, s.latency_p95_ms, s.latency_p99_ms, s.latency_max_ms);
+        table += line;
+    }
+    RCLCPP_INFO(this->get_logger(), "[LOOPBACK HARNESS]: Results (%d echo(s), %s, %.1f Hz nominal):\n%s\n\tSaturation point: %.1fx",
+        this->config.echos, this->config.use_msgpack ? "MsgPack" : "Compact", this->config.frame_rate, table.c_str(), saturation_rate);
+
+    if(!this->config.csv_file.empty())
+    {
+        FILE* csv = std::fopen(this->config.csv_file.c_str(), "w");
+        if(!csv)
+        {
+            RCLCPP_ERROR(this->get_logger(), "[LOOPBACK HARNESS]: Can't open %s", this->config.csv_file.c_str());
+            return;
+        }
+        std::fprintf(csv, "rate;segments_per_sec;frames_sent;frames_received;frame_drop_rate;incomplete_rate;point_drop_rate;latency_p50_ms;latency_p95_ms;latency_p99_ms;latency_max_ms\n");
+        for(const StepResult& s : steps)
+        {
+            std::fprintf(csv, "%.3f;%.1f;%lu;%lu;%.6f;%.6f;%.6f;%.3f;%.3f;%.3f;%.3f\n",
+                s.rate, s.segments_per_sec, s.frames_sent, s.frames_received, s.frameDropRate(), s.incompleteRate(),
+                s.pointDropRate(), s.latency_p50_ms, s.latency_p95_ms, s.latency_p99_ms, s.latency_max_ms);
+        }
+        std::fclose(csv);
+    }
+}
+
+int LoopbackHarness::run()
+{
+    if(!this->udp_sender->IsOpen())
+    {
+        RCLCPP_ERROR(this->get_logger(), "[LOOPBACK HARNESS]: Can't open udp socket for %s:%d", this->config.udp_dest_ip.c_str(), this->config.udp_dest_port);
+        return 1;
+    }
+
+    // stream at the nominal rate until the driver has completed its startup and publishes
+    RCLCPP_INFO(this->get_logger(), "[LOOPBACK HARNESS]: Waiting for the driver to publish...");
+    {
+        StepResult warmup;
+        warmup.rate = 1.;
+        this->emit(warmup, this->config.warmup_timeout, true);
+        if(this->num_frames == 0)
+        {
+            RCLCPP_ERROR(this->get_logger(), "[LOOPBACK HARNESS]: No point cloud received within %.1f seconds.", this->config.warmup_timeout);
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(this->config.settle_time));
+    }
+
+    std::vector<StepResult> steps;
+    double saturation_rate = 0.;
+    bool saturated = false;
+    for(double rate : this->config.rates)
+    {
+        if(!rclcpp::ok())
+        {
+            break;
+        }
+        StepResult step;
+        step.rate = rate;
+        this->emit(step, this->config.step_duration);
+        std::this_thread::sleep_for(std::chrono::duration<double>(this->config.settle_time)); // let the driver drain its queues
+        this->evaluate(step);
+        steps.push_back(step);
+
+        const bool passed = step.frameDropRate() <= this->config.max_drop_rate && step.incompleteRate() <= this->config.max_drop_rate;
+        RCLCPP_INFO(this->get_logger(), "[LOOPBACK HARNESS]: %.1fx: %lu/%lu frames, %.2f%% dropped, latency p50 %.2f ms - %s",
+            rate, step.frames_received, step.frames_sent, 100. * step.frameDropRate(), step.latency_p50_ms, passed ? "ok" : "SATURATED");
+        saturated |= !passed;
+        if(!saturated)
+        {
+            saturation_rate = rate;
+        }
+    }
+
+    this->report(steps, saturation_rate);
+    return (saturation_rate >= this->config.min_pass_rate) ? 0 : 1;
+}
+
+
+int main(int argc, char** argv)
+{
+    rclcpp::init(argc, argv);
+    auto node = std::make_shared<LoopbackHarness>();
+    rclcpp::executors::SingleThreadedExecutor executor;
+    executor.add_node(node);
+    std::thread spin_thread{ [&executor](){ executor.spin(); } };
+
+    const int result = node->run();
+
+    executor.cancel();
+    spin_thread.join();
+    rclcpp::shutdown();
+
+    return result;
+}
@@ -0,0 +1,691 @@
+/* Headless bulk conversion of recorded multiScan data.
+ *
+ * Reads pcap files or raw datagram logs (see datagram_log.h), reassembles compact and msgpack
+ * segments from their udp datagrams, checks the crc and decodes them like MultiscanNode::run_receiver(),
+ * but on all cores: datagrams are framed into segments by the reading thread, and each segment is
+ * decoded by one of the worker threads. Results are written in capture order, so the output does not
+ * depend on the number of threads.
+ *
+ * Output file format (all values little endian):
+ *   8 byte magic "MSPTS2\0\0" (--format points) or "MSCOL1\0\0" (--format columns)
+ *   followed by one block per scan segment:
+ *     uint64_t capture timestamp in nanoseconds since epoch (receive time of the first datagram)
+ *     uint64_t sensor timestamp in microseconds (start of scan)
+ *     uint32_t segment index
+ *     uint32_t number of points n
+ *     uint32_t telegram counter
+ *     uint32_t number of bytes following in this block
+ *   points:  n records of 56 byte, identical to the PointCloud2 points of the driver (see packed_point.h)
+ *            (x, y, z, i, range, azimuth, elevation as float, layer, echo, index as uint32_t, uint64_t t,
+ *            reflector as uint8_t, 7 byte zero padding)
+ *   columns: uint64_t t[n], float x[n], y[n], z[n], i[n], range[n], azimuth[n], elevation[n],
+ *            uint16_t index[n], uint8_t layer[n], echo[n], reflector[n], zero padded to a multiple of 8 bytes
+ *
+ * --format rangeimage losslessly compresses the compact scan segments instead of decoding them
+ * and writes a range image log (see range_image_codec.h) with one record per frame. Each segment
+ * is decompressed again and compared to the input, and compression ratio and throughput are reported.
+ * Msgpack segments are not supported by the codec and are skipped.
+ *
+ * IMU telegrams are optionally exported to a csv file. No ROS dependencies and no software pll:
+ * timestamps are sensor time for compact data and capture time for msgpack data. */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sick_scan_xd/compact_parser.h"
+#include "sick_scan_xd/datagram_log.h"
+#include "sick_scan_xd/msgpack_parser.h"
+#include "sick_scan_xd/packed_point.h"
+#include "sick_scan_xd/range_image_codec.h"
+#include "sick_scan_xd/udp_sockets.h"
+
+
+static const uint8_t POINTS_MAGIC[8] = { 'M', 'S', 'P', 'T', 'S', '2', 0, 0 };
+static const uint8_t COLUMNS_MAGIC[8] = { 'M', 'S', 'C', 'O', 'L', '1', 0, 0 };
+static constexpr size_t POINT_BYTE_LEN = sizeof(sick_scansegment_xd::PackedPoint); // PointCloud2 point step of the driver
+static constexpr size_t BLOCK_HEADER_LEN = 32;
+static constexpr uint32_t MAX_SEGMENT_BYTES = 1024 * 1024;
+
+enum class OutputFormat { POINTS, COLUMNS, RANGE_IMAGE };
+
+struct DecodeConfig
+{
+    std::vector<std::string> files;
+    int udp_port = 2115;
+    unsigned int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    OutputFormat format = OutputFormat::POINTS;
+    std::string out_dir;            // empty: output next to the input file
+    std::string imu_csv;            // empty: imu telegrams are not exported
+    size_t batch_segments = 256;    // segments per thread and batch
+    bool weather_filter = false;    // drop weak early echos, see DecoderConfig::SetWeatherFilter()
+    std::string calibration_file;   // empty: points are not corrected
+    std::string transform;          // "x,y,z,roll,pitch,yaw", empty: points are not transformed
+    bool verbose = false;
+    sick_scansegment_xd::DecoderConfig decoder_config; // decoder settings shared by all worker threads, set up in main()
+};
+
+struct DecodeStats
+{
+    size_t datagrams = 0;
+    size_t segments = 0;
+    size_t incomplete = 0;          // segments with missing datagrams
+    size_t crc_errors = 0;
+    size_t parse_errors = 0;
+    size_t imu_samples = 0;
+    size_t points = 0;
+    size_t bytes_in = 0;
+    size_t bytes_out = 0;
+    size_t msgpack_skipped = 0;     // msgpack segments, not supported by --format rangeimage
+    size_t codec_errors = 0;        // segments not restored by the range image decompression
+    size_t frames = 0;
+    size_t compact_bytes = 0;       // compact scan segments (incl. crc) compressed by the range image codec
+    size_t compressed_bytes = 0;
+    double compress_sec = 0;        // summed over all threads
+    double decompress_sec = 0;
+};
+
+// a complete compact or msgpack message, reassembled from one or more udp datagrams
+struct RawSegment
+{
+    uint64_t capture_nsec = 0;
+    std::vector<uint8_t> data;      // 0x02020202 ... crc
+    bool is_msgpack = false;
+};
+
+enum class SegmentStatus { OK, CRC_ERROR, PARSE_ERROR, CODEC_ERROR };
+
+struct DecodedSegment
+{
+    SegmentStatus status = SegmentStatus::OK;
+    size_t num_points = 0;
+    std::vector<uint8_t> block;     // output block incl. header, empty for imu telegrams
+    std::string imu_row;            // csv row, empty for scan segments
+    int segment_index = 0;
+    bool msgpack_skipped = false;   // --format rangeimage only
+    double compress_sec = 0;
+    double decompress_sec = 0;
+};
+
+
+static void printUsage(const char* argv0)
+{
+    std::printf(
+        "Usage: %s [options] <capture.pcap | datagrams.msdglog> ...\n"
+        "Options:\n"
+        "  --port <n>             udp port of scan data in pcap files (default 2115)\n"
+        "  --threads <n>          number of decoding threads (default %u)\n"
+        "  --format <name>        points (56 byte point records, default), columns or rangeimage\n"
+        "  --out-dir <dir>        output directory (default: next to the input file)\n"
+        "  --imu-csv <file>       export imu telegrams to a csv file\n"
+        "  --weather-filter       drop weak early echos of beams with a stronger farther echo (rain, fog, dust),\n"
+        "                         not applied to --format rangeimage, which is lossless\n"
+        "  --calibration <file>   apply per layer and per beam angle corrections (see DecoderConfig::LoadCalibration())\n"
+        "  --transform <x,y,z,roll,pitch,yaw>\n"
+        "                         transform the points into the vehicle frame (meter and radians)\n"
+        "  --verbose              print every failed segment\n"
+        "Each input <name>.<ext> is converted to <name>.mspts (points), <name>.mscol (columns)\n"
+        "or <name>.msri (compressed compact segments, see range_image_codec.h).\n",
+        argv0, std::max(1u, std::thread::hardware_concurrency()));
+}
+
+static bool parseArgs(int argc, char** argv, DecodeConfig& config)
+{
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto next = [&](const char* name) -> const char*
+        {
+            if(i + 1 >= argc)
+            {
+                std::fprintf(stderr, "## ERROR multiscan_decode: missing value for %s\n", name);
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if(arg == "--help" || arg == "-h") return false;
+        else if(arg == "--port") config.udp_port = std::atoi(next("--port"));
+        else if(arg == "--threads") config.num_threads = static_cast<unsigned int>(std::max(1, std::atoi(next("--threads"))));
+        else if(arg == "--format")
+        {
+            std::string format = next("--format");
+            if(format == "points") config.format = OutputFormat::POINTS;
+            else if(format == "columns") config.format = OutputFormat::COLUMNS;
+            else if(format == "rangeimage") config.format = OutputFormat::RANGE_IMAGE;
+            else
+            {
+                std::fprintf(stderr, "## ERROR multiscan_decode: unknown format %s\n", format.c_str());
+                return false;
+            }
+        }
+        else if(arg == "--out-dir") config.out_dir = next("--out-dir");
+        else if(arg == "--imu-csv") config.imu_csv = next("--imu-csv");
+        else if(arg == "--weather-filter") config.weather_filter = true;
+        else if(arg == "--calibration") config.calibration_file = next("--calibration");
+        else if(arg == "--transform") config.transform = next("--transform");
+        else if(arg == "--verbose") config.verbose = true;
+        else if(arg.size() > 2 && arg.compare(0, 2, "--") == 0)
+        {
+            std::fprintf(stderr, "## ERROR multiscan_decode: unknown option %s\n", arg.c_str());
+            return false;
+        }
+        else config.files.push_back(arg);
+    }
+    return !config.files.empty();
+}
+
+static std::string outputPath(const std::string& input, const DecodeConfig& config)
+{
+    size_t sep = input.find_last_of("/\\");
+    std::string dir = (sep == std::string::npos ? std::string() : input.substr(0, sep + 1));
+    std::string name = (sep == std::string::npos ? input : input.substr(sep + 1));
+    size_t ext = name.find_last_of('.');
+    if(ext != std::string::npos && ext > 0) name = name.substr(0, ext);
+    if(!config.out_dir.empty())
+    {
+        dir = config.out_dir;
+        if(dir.back() != '/') dir += '/';
+    }
+    const char* extension = (config.format == OutputFormat::COLUMNS ? ".mscol" : (config.format == OutputFormat::RANGE_IMAGE ? ".msri" : ".mspts"));
+    return dir + name + extension;
+}
+
+
+/* Reassembles segments from datagrams in capture order, the same way the driver receives them:
+ * a datagram starting with 0x02020202 starts a new segment, all other datagrams continue it. */
+class SegmentFramer
+{
+public:
+
+    SegmentFramer(DecodeStats& stats) : m_stats(stats) {}
+
+    // appends a datagram, returns true if a segment has been completed
+    bool Push(const sick_scansegment_xd::LoggedDatagram& datagram, RawSegment& segment)
+    {
+        const uint8_t* payload = datagram.payload.data();
+        const size_t size = datagram.payload.size();
+        if(size >= 4 && payload[0] == 0x02 && payload[1] == 0x02 && payload[2] == 0x02 && payload[3] == 0x02)
+        {
+            if(!m_pending.data.empty()) m_stats.incomplete++;
+            m_pending.capture_nsec = datagram.timestamp_nsec;
+            m_pending.data.assign(payload, payload + size);
+            m_pending.is_msgpack = false;
+            m_bytes_required = 0;
+            if(size > 8)
+            {
+                // compact datagrams have commandId 1 (scan) or 2 (imu), msgpack datagrams their payload length
+                uint32_t command_id = sick_scansegment_xd::Convert4Byte(payload + 4);
+                m_pending.is_msgpack = (command_id != 1 && command_id != 2);
+                if(m_pending.is_msgpack) m_bytes_required = command_id + 3 * sizeof(uint32_t); // start + length + payload + crc
+            }
+        }
+        else if(!m_pending.data.empty())
+        {
+            m_pending.data.insert(m_pending.data.end(), payload, payload + size);
+        }
+        else
+        {
+            return false; // continuation without a start, i.e. the capture started within a segment
+        }
+        return this->Complete(segment);
+    }
+
+    // drops a pending incomplete segment at the end of a file
+    void Flush()
+    {
+        if(!m_pending.data.empty()) m_stats.incomplete++;
+        m_pending.data.clear();
+    }
+
+protected:
+
+    bool Complete(RawSegment& segment)
+    {
+        if(!m_pending.is_msgpack)
+        {
+            uint32_t payload_length_bytes = 0, num_bytes_required = 0;
+            if(sick_scansegment_xd::CompactDataParser::ParseSegment(m_pending.data.data(), m_pending.data.size(), 0, payload_length_bytes, num_bytes_required))
+            {
+                m_bytes_required = payload_length_bytes + sizeof(uint32_t); // payload + 4 byte crc
+            }
+            else if(num_bytes_required > MAX_SEGMENT_BYTES)
+            {
+                m_stats.parse_errors++;
+                m_pending.data.clear();
+                return false;
+            }
+            else
+            {
+                return false; // more datagrams required
+            }
+        }
+        if(m_bytes_required > MAX_SEGMENT_BYTES)
+        {
+            m_stats.parse_errors++;
+            m_pending.data.clear();
+            return false;
+        }
+        if(m_bytes_required == 0 || m_pending.data.size() < m_bytes_required)
+        {
+            return false;
+        }
+        m_pending.data.resize(m_bytes_required);
+        segment = std::move(m_pending);
+        m_pending = RawSegment();
+        return true;
+    }
+
+    DecodeStats& m_stats;
+    RawSegment m_pending;
+    size_t m_bytes_required = 0;
+};
+
+
+template <typename T> static inline void appendValue(std::vector<uint8_t>& buffer, size_t& offset, T value)
+{
+    std::memcpy(buffer.data() + offset, &value, sizeof(T));
+    offset += sizeof(T);
+}
+
+static void encodeBlock(const sick_scansegment_xd::ScanSegmentParserOutput& segment, uint64_t capture_nsec, bool columns, DecodedSegment& decoded)
+{
+    size_t n = 0;
+    for(const auto& group : segment.scandata)
+    {
+        for(const auto& line : group.scanlines) n += line.points.size();
+    }
+    uint64_t sensor_usec = static_cast<uint64_t>(segment.timestamp_sec) * 1000000UL + segment.timestamp_nsec / 1000;
+    if(!segment.scandata.empty())
+    {
+        sensor_usec = static_cast<uint64_t>(segment.scandata[0].timestampStart_sec) * 1000000UL + segment.scandata[0].timestampStart_nsec / 1000;
+    }
+
+    size_t body_bytes = (columns ? ((n * (sizeof(uint64_t) + 7 * sizeof(float) + sizeof(uint16_t) + 3) + 7) & ~size_t(7)) : n * POINT_BYTE_LEN);
+    decoded.num_points = n;
+    decoded.block.assign(BLOCK_HEADER_LEN + body_bytes, 0);
+    size_t offset = 0;
+    appendValue<uint64_t>(decoded.block, offset, capture_nsec);
+    appendValue<uint64_t>(decoded.block, offset, sensor_usec);
+    appendValue<uint32_t>(decoded.block, offset, static_cast<uint32_t>(segment.segmentIndex));
+    appendValue<uint32_t>(decoded.block, offset, static_cast<uint32_t>(n));
+    appendValue<uint32_t>(decoded.block, offset, static_cast<uint32_t>(segment.telegramCnt));
+    appendValue<uint32_t>(decoded.block, offset, static_cast<uint32_t>(body_bytes));
+
+    uint8_t* body = decoded.block.data() + BLOCK_HEADER_LEN;
+    if(!columns)
+    {
+        for(const auto& group : segment.scandata)
+        {
+            for(const auto& line : group.scanlines)
+            {
+                for(const auto& point : line.points)
+                {
+                    sick_scansegment_xd::packPoint(point, body);
+                    body += POINT_BYTE_LEN;
+                }
+            }
+        }
+        return;
+    }
+
+    uint64_t* t = reinterpret_cast<uint64_t*>(body);
+    float* x = reinterpret_cast<float*>(t + n);
+    float *y = x + n, *z = y + n, *i = z + n, *range = i + n, *azimuth = range + n, *elevation = azimuth + n;
+    uint16_t* index = reinterpret_cast<uint16_t*>(elevation + n);
+    uint8_t* layer = reinterpret_cast<uint8_t*>(index + n);
+    uint8_t *echo = layer + n, *reflector = echo + n;
+    size_t k = 0;
+    for(const auto& group : segment.scandata)
+    {
+        for(const auto& line : group.scanlines)
+        {
+            for(const auto& point : line.points)
+            {
+                t[k] = point.lidar_timestamp_microsec;
+                x[k] = point.x;
+                y[k] = point.y;
+                z[k] = point.z;
+                i[k] = point.i;
+                range[k] = point.range;
+                azimuth[k] = point.azimuth;
+                elevation[k] = point.elevation;
+                index[k] = static_cast<uint16_t>(point.pointIdx);
+                layer[k] = static_cast<uint8_t>(point.groupIdx);
+                echo[k] = static_cast<uint8_t>(point.echoIdx);
+                reflector[k] = point.reflectorbit;
+                k++;
+            }
+        }
+    }
+}
+
+// range image compression of a compact scan segment, verified by decompression
+static void compressSegment(const RawSegment& raw, DecodedSegment& decoded)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    bool success = sick_scansegment_xd::RangeImageCodec::CompressSegment(raw.data.data(), raw.data.size(), decoded.block);
+    auto t1 = std::chrono::steady_clock::now();
+    std::vector<uint8_t> restored;
+    size_t block_size = 0;
+    success = success && sick_scansegment_xd::RangeImageCodec::DecompressSegment(decoded.block.data(), decoded.block.size(), block_size, restored);
+    auto t2 = std::chrono::steady_clock::now();
+    decoded.compress_sec = std::chrono::duration<double>(t1 - t0).count();
+    decoded.decompress_sec = std::chrono::duration<double>(t2 - t1).count();
+    if(!success || block_size != decoded.block.size() || restored != raw.data)
+    {
+        decoded.status = SegmentStatus::CODEC_ERROR;
+        decoded.block.clear();
+    }
+}
+
+// crc check and decoding of one segment, runs concurrently in the worker threads
+static void decodeSegment(const RawSegment& raw, OutputFormat format, const sick_scansegment_xd::DecoderConfig& decoder_config, DecodedSegment& decoded)
+{
+    const size_t size = raw.data.size();
+    const size_t payload_offset = (raw.is_msgpack ? 2 * sizeof(uint32_t) : 0); // compact crc covers the complete message (incl. header)
+    uint32_t crc_received = sick_scansegment_xd::Convert4Byte(raw.data.data() + size - sizeof(uint32_t));
+    if(crc_received != sick_scansegment_xd::crc32(0, raw.data.data() + payload_offset, size - sizeof(uint32_t) - payload_offset))
+    {
+        decoded.status = SegmentStatus::CRC_ERROR;
+        return;
+    }
+
+    fifo_timestamp capture_timestamp{ std::chrono::duration_cast<fifo_timestamp::duration>(std::chrono::nanoseconds(raw.capture_nsec)) };
+    sick_scansegment_xd::ScanSegmentParserOutput segment;
+    bool success = false;
+    if(raw.is_msgpack)
+    {
+        std::vector<uint8_t> msgpack_payload(raw.data.begin() + payload_offset, raw.data.end() - sizeof(uint32_t));
+        success = sick_scansegment_xd::MsgPackParser::Parse(msgpack_payload, capture_timestamp, segment, false, false, 0, &decoder_config);
+    }
+    else
+    {
+        success = sick_scansegment_xd::CompactDataParser::Parse(raw.data, capture_timestamp, segment, 0, false, false, 0, &decoder_config);
+    }
+    if(!success)
+    {
+        decoded.status = SegmentStatus::PARSE_ERROR;
+        return;
+    }
+
+    if(segment.imudata.valid)
+    {
+        const auto& imu = segment.imudata;
+        char row[512];
+        std::snprintf(row, sizeof(row), "%llu;%llu;%.6f;%.6f;%.6f;%.6f;%.6f;%.6f;%.6f;%.6f;%.6f;%.6f\n",
+            static_cast<unsigned long long>(raw.capture_nsec),
+            static_cast<unsigned long long>(segment.timestamp_sec) * 1000000ULL + segment.timestamp_nsec / 1000,
+            imu.acceleration_x, imu.acceleration_y, imu.acceleration_z,
+            imu.angular_velocity_x, imu.angular_velocity_y, imu.angular_velocity_z,
+            imu.orientation_w, imu.orientation_x, imu.orientation_y, imu.orientation_z);
+        decoded.imu_row = row;
+    }
+    if(segment.scandata.empty())
+    {
+        return;
+    }
+    decoded.segment_index = segment.segmentIndex;
+    if(format != OutputFormat::RANGE_IMAGE)
+    {
+        encodeBlock(segment, raw.capture_nsec, format == OutputFormat::COLUMNS, decoded);
+    }
+    else if(raw.is_msgpack)
+    {
+        decoded.msgpack_skipped = true;
+    }
+    else
+    {
+        for(const auto& group : segment.scandata)
+        {
+            for(const auto& line : group.scanlines) decoded.num_points += line.points.size();
+        }
+        compressSegment(raw, decoded);
+    }
+}
+
+// decodes a batch of segments on all threads, each thread takes the next undecoded segment
+static void decodeBatch(const std::vector<RawSegment>& batch, std::vector<DecodedSegment>& decoded, const DecodeConfig& config)
+{
+    decoded.clear();
+    decoded.resize(batch.size());
+    std::atomic<size_t> next_idx(0);
+    auto worker = [&]()
+    {
+        for(size_t idx = next_idx++; idx < batch.size(); idx = next_idx++)
+        {
+            decodeSegment(batch[idx], config.format, config.decoder_config, decoded[idx]);
+        }
+    };
+    std::vector<std::thread> threads;
+    for(unsigned int n = 1; n < config.num_threads && n < batch.size(); n++)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+static bool convertFile(const std::string& file, const DecodeConfig& config, std::ofstream& imu_csv, DecodeStats& stats)
+{
+    sick_scansegment_xd::DatagramLogReader reader;
+    if(!reader.Open(file, config.udp_port))
+    {
+        std::fprintf(stderr, "## ERROR multiscan_decode: can't read %s\n", file.c_str());
+        return false;
+    }
+    std::string out_file = outputPath(file, config);
+    const bool range_image = (config.format == OutputFormat::RANGE_IMAGE);
+    std::ofstream out;
+    sick_scansegment_xd::RangeImageLogWriter range_image_log;
+    if(range_image)
+    {
+        range_image_log.Open(out_file);
+    }
+    else
+    {
+        out.open(out_file, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(config.format == OutputFormat::COLUMNS ? COLUMNS_MAGIC : POINTS_MAGIC), 8);
+    }
+    if(!out.is_open() && !range_image_log.IsOpen())
+    {
+        std::fprintf(stderr, "## ERROR multiscan_decode: can't write %s\n", out_file.c_str());
+        return false;
+    }
+    stats.bytes_out += 8;
+
+    // --format rangeimage: segment blocks are collected into frames, a frame ends when the segment index wraps around
+    std::vector<uint8_t> frame_blocks;
+    std::vector<uint8_t> frame;
+    uint16_t frame_segments = 0;
+    uint64_t frame_capture_nsec = 0;
+    int last_segment_index = -1;
+    bool write_error = false;
+    auto writeFrame = [&]()
+    {
+        if(frame_segments == 0) return;
+        sick_scansegment_xd::RangeImageCodec::BeginFrame(frame_segments, frame);
+        frame.insert(frame.end(), frame_blocks.begin(), frame_blocks.end());
+        if(!range_image_log.Write(frame_capture_nsec, frame.data(), static_cast<uint32_t>(frame.size()))) write_error = true;
+        stats.frames++;
+        stats.compressed_bytes += frame.size();
+        stats.bytes_out += frame.size() + sizeof(uint64_t) + sizeof(uint32_t);
+        frame_blocks.clear();
+        frame_segments = 0;
+    };
+
+    SegmentFramer framer(stats);
+    const size_t batch_size = config.batch_segments * config.num_threads;
+    std::vector<RawSegment> batch;
+    std::vector<DecodedSegment> decoded;
+    batch.reserve(batch_size);
+    sick_scansegment_xd::LoggedDatagram datagram;
+    bool eof = false;
+    while(!eof)
+    {
+        batch.clear();
+        while(batch.size() < batch_size)
+        {
+            if(!reader.Next(datagram))
+            {
+                framer.Flush();
+                eof = true;
+                break;
+            }
+            stats.datagrams++;
+            stats.bytes_in += datagram.payload.size();
+            RawSegment segment;
+            if(framer.Push(datagram, segment))
+            {
+                batch.push_back(std::move(segment));
+            }
+        }
+
+        decodeBatch(batch, decoded, config);
+
+        for(size_t idx = 0; idx < decoded.size(); idx++)
+        {
+            const DecodedSegment& result = decoded[idx];
+            stats.segments++;
+            if(result.status != SegmentStatus::OK)
+            {
+                if(result.status == SegmentStatus::CRC_ERROR) stats.crc_errors++;
+                else if(result.status == SegmentStatus::CODEC_ERROR) stats.codec_errors++;
+                else stats.parse_errors++;
+                if(config.verbose)
+                {
+                    std::fprintf(stderr, "multiscan_decode: %s: %s failed, segment captured at %llu ns, %zu bytes\n", file.c_str(),
+                        (result.status == SegmentStatus::CRC_ERROR ? "crc check" : (result.status == SegmentStatus::CODEC_ERROR ? "range image compression" : "parsing")),
+                        static_cast<unsigned long long>(batch[idx].capture_nsec), batch[idx].data.size());
+                }
+                continue;
+            }
+            if(!result.imu_row.empty())
+            {
+                stats.imu_samples++;
+                if(imu_csv.is_open()) imu_csv << result.imu_row;
+            }
+            if(result.msgpack_skipped)
+            {
+                stats.msgpack_skipped++;
+            }
+            else if(!result.block.empty() && range_image)
+            {
+                if(result.segment_index <= last_segment_index || frame_segments == 0xFFFF) writeFrame();
+                if(frame_segments == 0) frame_capture_nsec = batch[idx].capture_nsec;
+                last_segment_index = result.segment_index;
+                frame_blocks.insert(frame_blocks.end(), result.block.begin(), result.block.end());
+                frame_segments++;
+                stats.points += result.num_points;
+                stats.compact_bytes += batch[idx].data.size();
+                stats.compress_sec += result.compress_sec;
+                stats.decompress_sec += result.decompress_sec;
+            }
+            else if(!result.block.empty())
+            {
+                out.write(reinterpret_cast<const char*>(result.block.data()), result.block.size());
+                stats.points += result.num_points;
+                stats.bytes_out += result.block.size();
+            }
+        }
+    }
+    if(range_image)
+    {
+        writeFrame();
+        range_image_log.Close();
+    }
+    if(reader.NumSkippedPackets() > 0 && config.verbose)
+    {
+        std::printf("multiscan_decode: %s: %zu packets skipped\n", file.c_str(), reader.NumSkippedPackets());
+    }
+    if(range_image ? write_error : !out.good())
+    {
+        std::fprintf(stderr, "## ERROR multiscan_decode: writing %s failed\n", out_file.c_str());
+        return false;
+    }
+    std::printf("multiscan_decode: %s -> %s\n", file.c_str(), out_file.c_str());
+    return true;
+}
+
+
+int main(int argc, char** argv)
+{
+    DecodeConfig config;
+    if(!parseArgs(argc, argv, config))
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    config.decoder_config.SetWeatherFilter(config.weather_filter);
+    if(!config.calibration_file.empty() && !config.decoder_config.LoadCalibration(config.calibration_file))
+    {
+        std::fprintf(stderr, "## ERROR multiscan_decode: can't load calibration file %s\n", config.calibration_file.c_str());
+        return EXIT_FAILURE;
+    }
+    if(!config.decoder_config.SetTransform(config.transform))
+    {
+        std::fprintf(stderr, "## ERROR multiscan_decode: invalid transform %s\n", config.transform.c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream imu_csv;
+    if(!config.imu_csv.empty())
+    {
+        imu_csv.open(config.imu_csv, std::ios::trunc);
+        if(!imu_csv.is_open())
+        {
+            std::fprintf(stderr, "## ERROR multiscan_decode: can't write %s\n", config.imu_csv.c_str());
+            return EXIT_FAILURE;
+        }
+        imu_csv << "capture_nsec;sensor_usec;acc_x;acc_y;acc_z;angvel_x;angvel_y;angvel_z;orientation_w;orientation_x;orientation_y;orientation_z\n";
+    }
+
+    if(!config.out_dir.empty())
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(config.out_dir, ec);
+    }
+
+    DecodeStats stats;
+    bool success = true;
+    auto t_start = std::chrono::steady_clock::now();
+    for(const auto& file : config.files)
+    {
+        success = convertFile(file, config, imu_csv, stats) && success;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+    std::printf("multiscan_decode: %zu datagrams, %zu segments (%zu incomplete, %zu crc errors, %zu parse errors), %zu imu samples, %zu points\n",
+        stats.datagrams, stats.segments, stats.incomplete, stats.crc_errors, stats.parse_errors, stats.imu_samples, stats.points);
+    if(config.weather_filter)
+    {
+        std::printf("multiscan_decode: weather filter: %lu echos dropped\n", static_cast<unsigned long>(config.decoder_config.GetWeatherFilterDropCount()));
+    }
+    if(config.format == OutputFormat::RANGE_IMAGE)
+    {
+        // throughput per thread, the codec times are summed over all threads
+        std::printf("multiscan_decode: range image: %zu frames, %.1f MB compact -> %.1f MB compressed, ratio %.2f (%.1f vs. PointCloud2), %zu codec errors, %zu msgpack segments skipped\n",
+            stats.frames, stats.compact_bytes * 1e-6, stats.compressed_bytes * 1e-6,
+            stats.compact_bytes / std::max<double>(stats.compressed_bytes, 1), stats.points * POINT_BYTE_LEN / std::max<double>(stats.compressed_bytes, 1),
+            stats.codec_errors, stats.msgpack_skipped);
+        std::printf("multiscan_decode: range image: compression %.1f MB/s, decompression %.1f MB/s per thread\n",
+            stats.compact_bytes * 1e-6 / std::max(stats.compress_sec, 1e-9), stats.compact_bytes * 1e-6 / std::max(stats.decompress_sec, 1e-9));
+    }
+    std::printf("multiscan_decode: %.1f MB in, %.1f MB out in %.3f sec with %u threads: %.0f segments/s, %.1f MB/s, %.2f Mpoints/s\n",
+        stats.bytes_in * 1e-6, stats.bytes_out * 1e-6, seconds, config.num_threads,
+        stats.segments / std::max(seconds, 1e-9), stats.bytes_in * 1e-6 / std::max(seconds, 1e-9), stats.points * 1e-6 / std::max(seconds, 1e-9));
+    return (success ? EXIT_SUCCESS : EXIT_FAILURE);
+}
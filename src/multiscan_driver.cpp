@@ -2,23 +2,39 @@
 #include <mutex>
 #include <thread>
 #include <atomic>
+#include <chrono>
 #include <vector>
 #include <deque>
 #include <limits>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <condition_variable>
+#include <sstream>
+#include <iterator>
 
 #include <rclcpp/rclcpp.hpp>
 
 #include <sensor_msgs/msg/imu.hpp>
 #include <sensor_msgs/msg/point_cloud2.hpp>
+#include <sensor_msgs/msg/compressed_image.hpp>
+#include <sensor_msgs/msg/image.hpp>
+#include <sensor_msgs/msg/laser_scan.hpp>
 
 #include "util.hpp"
 #include "pub_map.hpp"
+#include "publish_stage.hpp"
 #include "sick_scan_xd/udp_sockets.h"
 #include "sick_scan_xd/msgpack_parser.h"
 #include "sick_scan_xd/compact_parser.h"
 #include "sick_scan_xd/scansegment_parser_output.h"
 #include "sick_scan_xd/sick_scan_common_tcp.h"
 #include "sick_scan_xd/sopas_services.h"
+#include "sick_scan_xd/softwarePLL.h"
+#include "sick_scan_xd/frame_store.h"
+#include "sick_scan_xd/frame_ring.h"
+#include "sick_scan_xd/range_image_codec.h"
+#include "sick_scan_xd/packed_point.h"
 
 
 class MultiscanNode : public rclcpp::Node
@@ -32,12 +48,31 @@ public:
 
 protected:
     void run_receiver();
+    void run_sopas();
+    void run_recorder();
+
+    // parameters applied while running (see on_parameters_changed()), written under sopas_mtx
+    struct LiveParams
+    {
+        bool use_msgpack;
+        bool imu_enable;
+        int performance_profile;
+    };
+    LiveParams get_live_params();   // snapshot of the live parameters, taken under sopas_mtx
+
+    rcl_interfaces::msg::SetParametersResult on_parameters_changed(const std::vector<rclcpp::Parameter>& params);
+
+    double udp_data_age() const;            // seconds since the last udp datagram, infinity if none was received
+    void wait_for_shutdown(double seconds); // sleeps, but returns early on shutdown
+    void publish_laserscans(const std::vector<const sick_scansegment_xd::ScanSegmentParserOutput*>& segments, uint64_t stamp_ns, bool full_rotation);
 
 private:
     static constexpr size_t
         MS100_SEGMENTS_PER_FRAME = 12U,
         MS100_POINTS_PER_SEGMENT_ECHO = 900U,   // points per segment * segments per frame = 10800 points per frame (with 1 echo)
-        MS100_MAX_ECHOS_PER_POINT = 3U;         // echos get filterd when we apply different settings in the web dashboard
+        MS100_MAX_ECHOS_PER_POINT = 3U,         // echos get filterd when we apply different settings in the web dashboard
+        MS100_LAYERS = 16U,                     // rows of the range image (groupIdx)
+        MAX_RECORD_QUEUE = 8U;                  // frames waiting for the frame store writer or the range image compression
 
     struct
     {
@@ -48,24 +83,98 @@ private:
         int lidar_udp_port = 2115;
         // int imu_udp_port = 2115;
         int sopas_tcp_port = 2111;
-        bool use_msgpack = false;
+        bool use_msgpack = false;           // live, read through get_live_params() once the node is constructed
         bool use_cola_binary = true;
+        bool imu_enable = true;             // live
+        int performance_profile = -1;       // live
+        std::string angle_range_filter = "";
+        std::string layer_filter = "";
         double udp_dropout_reset_thresh = 2.;
         double udp_receive_timeout = 1.;
         double sopas_read_timeout = 3.;
         double error_restart_timeout = 3.;
+        bool sopas_pipelined_startup = true;
+        double sopas_connect_timeout = 2.;
+        double reconnect_backoff_initial = 0.1;
         int max_segment_buffering = 3;
+        int publish_queue_size = 2;
+        std::string publish_overflow_policy = "drop_oldest";
+        std::string clock_estimator = "fifo_regression";
+        std::string frame_store_file = "";
+        bool publish_compressed = false;
+        bool publish_cloud = true;
+        bool publish_range_image = false;
+        bool publish_reflectors = false;
+        int range_image_echos = 1;
+        bool publish_laserscan = false;
+        std::string laserscan_layers = "5";
+        std::string laserscan_rate = "frame";
+        std::string shm_ring_name = "";
+        int shm_ring_slots = 4;
+        int shm_ring_max_points = 65536;
+        bool weather_filter = false;
+        double weather_filter_rssi_ratio = 0.25;
+        double weather_filter_range_gap = 0.5;
+        double weather_filter_max_range = 30.;
+        std::string calibration_file = "";
+        std::string add_transform_xyz_rpy = "0,0,0,0,0,0";
+        std::string transform_frame_id = "";
+        std::string compressed_record_file = "";
     }
     config;
 
     rclcpp::Publisher<sensor_msgs::msg::PointCloud2>::SharedPtr scan_pub;
     rclcpp::Publisher<sensor_msgs::msg::Imu>::SharedPtr imu_pub;
+    rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr compressed_pub;
+    rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr range_image_pub;
+    rclcpp::Publisher<sensor_msgs::msg::PointCloud2>::SharedPtr reflector_pub;
+
+    // publishing happens on separate threads so that slow middleware never stalls the UDP receive loop
+    std::unique_ptr<PublishStage<sensor_msgs::msg::PointCloud2>> scan_stage;
+    std::unique_ptr<PublishStage<sensor_msgs::msg::Imu>> imu_stage;
+    std::unique_ptr<PublishStage<sensor_msgs::msg::CompressedImage>> compressed_stage;
+    std::unique_ptr<PublishStage<sensor_msgs::msg::Image>> range_image_stage;
+    std::unique_ptr<PublishStage<sensor_msgs::msg::PointCloud2>> reflector_stage;
+    // LaserScan of selected layers, one topic per layer
+    std::vector<int> laserscan_layers;
+    std::vector<rclcpp::Publisher<sensor_msgs::msg::LaserScan>::SharedPtr> laserscan_pubs;
+    std::vector<std::unique_ptr<PublishStage<sensor_msgs::msg::LaserScan>>> laserscan_stages;
+    bool laserscan_per_segment = false;
 
-    sensor_msgs::msg::PointCloud2::_fields_type scan_fields;
+    sensor_msgs::msg::PointCloud2::_fields_type scan_fields;    // layout of sick_scansegment_xd::PackedPoint
+    std::string cloud_frame_id;     // lidar_frame, or transform_frame if the points are transformed
 
     sick_scansegment_xd::UdpReceiverSocketImpl udp_recv_socket;
-    std::thread recv_thread;
+    SoftwarePLL software_pll;   // per-sensor clock model, persists across reconnects
+    sick_scansegment_xd::DecoderConfig decoder_config;  // per-sensor decoder settings, set up before the receive thread starts
+    std::thread recv_thread, sopas_thread;
     std::atomic_bool is_running = true;
+    std::atomic<int64_t> last_udp_recv_ns = 0;  // steady clock, 0 until the first datagram
+
+    std::mutex sopas_mtx;               // guards the live parameters (use_msgpack, imu_enable, performance_profile)
+    std::condition_variable sopas_cv;   // wakes run_sopas() on shutdown and on parameter changes
+    bool reconfigure_pending = false;   // live parameters changed but not yet sent to the lidar
+
+    OnSetParametersCallbackHandle::SharedPtr param_cb_handle;
+
+    // optional recording of the assembled frames (see frame_store.h), written on run_recorder() from packed PointCloud2 data,
+    // and optional lossless compression of the compact datagrams of each frame (see range_image_codec.h), also on run_recorder()
+    struct RecordedFrame
+    {
+        uint64_t timestamp_nsec;
+        std::shared_ptr<const sensor_msgs::msg::PointCloud2> cloud;    // shared with the scan publisher, null if the frame store is disabled
+        std::vector<std::vector<uint8_t>> segments; // compact scan datagrams incl. crc, empty if compression is disabled
+    };
+    sick_scansegment_xd::FrameStoreWriter frame_store;
+    sick_scansegment_xd::RangeImageLogWriter compressed_log;
+    // optional shared memory ring of the assembled frames for local non-ROS readers (see frame_ring.h), written on run_receiver()
+    sick_scansegment_xd::FrameRingWriter frame_ring;
+    std::thread record_thread;
+    std::mutex record_mtx;
+    std::condition_variable record_cv;
+    std::deque<std::unique_ptr<RecordedFrame>> record_queue;
+    std::atomic<size_t> num_record_dropped = 0;
+    size_t num_compressed_frames = 0, num_compressed_bytes = 0, num_uncompressed_bytes = 0;  // written on run_recorder() only
 
 };
 
@@ -80,6 +189,118 @@ void swapSegmentsNoIMU(sick_scansegment_xd::ScanSegmentParserOutput& a, sick_sca
     std::swap(a.telegramCnt, b.telegramCnt);
 }
 
+// number of beams (pointIdx range) of a segment, i.e. its number of range image columns
+size_t segmentBeams(const sick_scansegment_xd::ScanSegmentParserOutput& segment)
+{
+    size_t beams = 0;
+    for(const auto& group : segment.scandata)
+    {
+        for(const auto& line : group.scanlines)
+        {
+            if(!line.points.empty())
+            {
+                beams = std::max(beams, static_cast<size_t>(line.points.back().pointIdx) + 1);  // echos dropped by the weather filter leave gaps
+            }
+        }
+    }
+    return beams;
+}
+
+// fills a LaserScan from the first echo of one layer (groupIdx), either a full rotation with one bin per beam or the azimuth
+// range of the points. Bins without a point are NaN, points without an echo (range 0) are +inf.
+bool fillLaserScan(
+    const std::vector<const sick_scansegment_xd::ScanSegmentParserOutput*>& segments,
+    int layer,
+    bool full_rotation,
+    sensor_msgs::msg::LaserScan& scan)
+{
+    constexpr float RANGE_MIN = 0.1f, RANGE_MAX = 64.f;  // multiScan100 working range
+    auto normalize = [](float a){ return a - static_cast<float>(2 * M_PI) * std::floor((a + static_cast<float>(M_PI)) / static_cast<float>(2 * M_PI)); };
+
+    float increment = 0, time_increment = 0;
+    float azimuth_min = std::numeric_limits<float>::max(), azimuth_max = -std::numeric_limits<float>::max();
+    size_t num_points = 0;
+    for(const auto* segment : segments)
+    {
+        for(const auto& group : segment->scandata)
+        {
+            for(const auto& line : group.scanlines)
+            {
+                const auto& points = line.points;
+                if(points.empty() || points[0].groupIdx != static_cast<uint32_t>(layer) || points[0].echoIdx != 0)
+                {
+                    continue;
+                }
+                if(increment == 0 && points.back().pointIdx > points.front().pointIdx)
+                {
+                    // beams are equidistant in azimuth and time within a segment, points may be missing after the weather filter
+                    const float delta = points.back().azimuth - points.front().azimuth;
+                    const float beams = static_cast<float>(points.back().pointIdx - points.front().pointIdx);
+                    increment = std::fabs(delta) / beams;
+                    time_increment = 1e-6f * static_cast<float>(points.back().lidar_timestamp_microsec - points.front().lidar_timestamp_microsec) / beams;
+                    if(delta < 0) time_increment = -time_increment;  // azimuth decreases over time
+                }
+                for(const auto& point : points)
+                {
+                    const float azimuth = normalize(point.azimuth);
+                    azimuth_min = std::min(azimuth_min, azimuth);
+                    azimuth_max = std::max(azimuth_max, azimuth);
+                }
+                num_points += points.size();
+            }
+        }
+    }
+    if(num_points < 2 || !(increment > 0))
+    {
+        return false;
+    }
+
+    size_t bins = 0;
+    float angle_min = 0;
+    if(full_rotation)
+    {
+        bins = static_cast<size_t>(std::lround(2 * M_PI / increment));
+        increment = static_cast<float>(2 * M_PI / bins);
+        angle_min = static_cast<float>(-M_PI);
+    }
+    else
+    {
+        bins = static_cast<size_t>(std::lround((azimuth_max - azimuth_min) / increment)) + 1;
+        angle_min = azimuth_min;
+    }
+    scan.angle_min = angle_min;
+    scan.angle_max = angle_min + (bins - 1) * increment;
+    scan.angle_increment = increment;
+    scan.time_increment = time_increment;
+    scan.scan_time = std::fabs(time_increment) * bins;
+    scan.range_min = RANGE_MIN;
+    scan.range_max = RANGE_MAX;
+    scan.ranges.assign(bins, std::numeric_limits<float>::quiet_NaN());
+    scan.intensities.assign(bins, 0.f);
+
+    for(const auto* segment : segments)
+    {
+        for(const auto& group : segment->scandata)
+        {
+            for(const auto& line : group.scanlines)
+            {
+                if(line.points.empty() || line.points[0].groupIdx != static_cast<uint32_t>(layer) || line.points[0].echoIdx != 0)
+                {
+                    continue;
+                }
+                for(const auto& point : line.points)
+                {
+                    long bin = std::lround((normalize(point.azimuth) - angle_min) / increment);
+                    bin = (full_rotation ? (bin % static_cast<long>(bins) + static_cast<long>(bins)) % static_cast<long>(bins) : std::clamp(bin, 0L, static_cast<long>(bins) - 1));
+                    scan.ranges[bin] = (point.range > 0 ? point.range : std::numeric_limits<float>::infinity());
+                    scan.intensities[bin] = point.i;
+                }
+            }
+        }
+    }
+    return true;
+}
+
 
 MultiscanNode::MultiscanNode(bool autostart) :
     Node("multiscan_driver")
@@ -92,14 +313,157 @@ MultiscanNode::MultiscanNode(bool autostart) :
     util::declare_param(this, "sopas_tcp_port", this->config.sopas_tcp_port, 2111);
     util::declare_param(this, "use_msgpack", this->config.use_msgpack, false);
     util::declare_param(this, "use_cola_binary", this->config.use_cola_binary, true);
+    util::declare_param(this, "imu_enable", this->config.imu_enable, true);
+    util::declare_param(this, "performance_profile", this->config.performance_profile, -1);
+    util::declare_param(this, "angle_range_filter", this->config.angle_range_filter, "");
+    util::declare_param(this, "layer_filter", this->config.layer_filter, "");
     util::declare_param(this, "udp_reset_timeout", this->config.udp_dropout_reset_thresh, 2.);
     util::declare_param(this, "udp_receive_timeout", this->config.udp_receive_timeout, 1.);
     util::declare_param(this, "sopas_read_timeout", this->config.sopas_read_timeout, 3.);
     util::declare_param(this, "error_restart_timeout", this->config.error_restart_timeout, 3.);
+    util::declare_param(this, "sopas_pipelined_startup", this->config.sopas_pipelined_startup, true);
+    util::declare_param(this, "sopas_connect_timeout", this->config.sopas_connect_timeout, 2.);
+    util::declare_param(this, "reconnect_backoff_initial", this->config.reconnect_backoff_initial, 0.1);
     util::declare_param(this, "max_segment_buffers", this->config.max_segment_buffering, 3);
+    util::declare_param(this, "publish_queue_size", this->config.publish_queue_size, 2);
+    util::declare_param(this, "publish_overflow_policy", this->config.publish_overflow_policy, "drop_oldest");
+    util::declare_param(this, "clock_estimator", this->config.clock_estimator, "fifo_regression");
+    util::declare_param(this, "frame_store_file", this->config.frame_store_file, "");
+    util::declare_param(this, "publish_compressed", this->config.publish_compressed, false);
+    util::declare_param(this, "publish_cloud", this->config.publish_cloud, true);
+    util::declare_param(this, "publish_range_image", this->config.publish_range_image, false);
+    util::declare_param(this, "publish_reflectors", this->config.publish_reflectors, false);
+    util::declare_param(this, "range_image_echos", this->config.range_image_echos, 1);
+    this->config.range_image_echos = std::clamp(this->config.range_image_echos, 1, static_cast<int>(MS100_MAX_ECHOS_PER_POINT));
+    util::declare_param(this, "publish_laserscan", this->config.publish_laserscan, false);
+    util::declare_param(this, "laserscan_layers", this->config.laserscan_layers, "5");
+    util::declare_param(this, "laserscan_rate", this->config.laserscan_rate, "frame");
+    util::declare_param(this, "shm_ring_name", this->config.shm_ring_name, "");
+    util::declare_param(this, "shm_ring_slots", this->config.shm_ring_slots, 4);
+    util::declare_param(this, "shm_ring_max_points", this->config.shm_ring_max_points, 65536);
+    util::declare_param(this, "weather_filter", this->config.weather_filter, false);
+    util::declare_param(this, "weather_filter_rssi_ratio", this->config.weather_filter_rssi_ratio, 0.25);
+    util::declare_param(this, "weather_filter_range_gap", this->config.weather_filter_range_gap, 0.5);
+    util::declare_param(this, "weather_filter_max_range", this->config.weather_filter_max_range, 30.);
+    util::declare_param(this, "calibration_file", this->config.calibration_file, "");
+    util::declare_param(this, "add_transform_xyz_rpy", this->config.add_transform_xyz_rpy, "0,0,0,0,0,0");
+    util::declare_param(this, "transform_frame", this->config.transform_frame_id, "");
+    util::declare_param(this, "compressed_record_file", this->config.compressed_record_file, "");
+
+    this->software_pll.setClockEstimator(
+        this->config.clock_estimator == "kalman" ?
+            SoftwarePLL::CLOCK_ESTIMATOR_KALMAN_FILTER :
+            SoftwarePLL::CLOCK_ESTIMATOR_FIFO_REGRESSION);
+
+    // disabled layers are not transmitted, so the decoder has to know which layers the received groups belong to
+    {
+        std::istringstream layer_filter{ this->config.layer_filter };
+        std::vector<int> layer_active{ std::istream_iterator<int>{ layer_filter }, std::istream_iterator<int>{} };
+        if(layer_active.size() == 17 && layer_active[0])
+        {
+            this->decoder_config.SetActiveLayers({ layer_active.begin() + 1, layer_active.end() });
+        }
+    }
+    // rain, fog and dust echos are dropped in the decoder, before any point is packed or published
+    this->decoder_config.SetWeatherFilter(
+        this->config.weather_filter,
+        static_cast<float>(this->config.weather_filter_rssi_ratio),
+        static_cast<float>(this->config.weather_filter_range_gap),
+        static_cast<float>(this->config.weather_filter_max_range));
+    // intrinsic angle corrections are folded into the decoder lookup tables
+    if(!this->config.calibration_file.empty() && !this->decoder_config.LoadCalibration(this->config.calibration_file))
+    {
+        RCLCPP_ERROR(this->get_logger(), "[MULTISCAN DRIVER]: Failed to load calibration file \"%s\" - points are not corrected.",
+            this->config.calibration_file.c_str());
+    }
+    // the sensor to vehicle transform is applied while the points are converted, the clouds are then published in transform_frame
+    if(!this->decoder_config.SetTransform(this->config.add_transform_xyz_rpy))
+    {
+        RCLCPP_ERROR(this->get_logger(), "[MULTISCAN DRIVER]: Invalid add_transform_xyz_rpy \"%s\" - points are not transformed.",
+            this->config.add_transform_xyz_rpy.c_str());
+    }
+    // transformed points published in lidar_frame would be silently wrong, so a transform requires transform_frame
+    if(this->decoder_config.GetTransform() && this->config.transform_frame_id.empty())
+    {
+        RCLCPP_ERROR(this->get_logger(), "[MULTISCAN DRIVER]: add_transform_xyz_rpy \"%s\" is set without transform_frame - points are not transformed.",
+            this->config.add_transform_xyz_rpy.c_str());
+        this->decoder_config.SetTransform("");
+    }
+    this->cloud_frame_id = this->decoder_config.GetTransform() ?
+        this->config.transform_frame_id : this->config.lidar_frame_id;
+
+    // use_msgpack, imu_enable and performance_profile are applied live, changes to all other parameters are rejected
+    this->param_cb_handle = this->add_on_set_parameters_callback(
+        [this](const std::vector<rclcpp::Parameter>& params){ return this->on_parameters_changed(params); });
 
     this->scan_pub = this->create_publisher<sensor_msgs::msg::PointCloud2>("lidar_scan", rclcpp::SensorDataQoS{});
     this->imu_pub = this->create_publisher<sensor_msgs::msg::Imu>("lidar_imu", rclcpp::SensorDataQoS{});
+    if(this->config.publish_compressed)
+    {
+        this->compressed_pub = this->create_publisher<sensor_msgs::msg::CompressedImage>("lidar_scan/compressed", rclcpp::SensorDataQoS{});
+    }
+    if(this->config.publish_range_image)
+    {
+        this->range_image_pub = this->create_publisher<sensor_msgs::msg::Image>("lidar_scan/range_image", rclcpp::SensorDataQoS{});
+    }
+    if(this->config.publish_reflectors)
+    {
+        this->reflector_pub = this->create_publisher<sensor_msgs::msg::PointCloud2>("lidar_scan/reflectors", rclcpp::SensorDataQoS{});
+    }
+    if(this->config.publish_laserscan)
+    {
+        std::istringstream laserscan_layers{ this->config.laserscan_layers };
+        for(int layer; laserscan_layers >> layer; )
+        {
+            if(layer < 0 || layer >= static_cast<int>(MS100_LAYERS))
+            {
+                RCLCPP_WARN(this->get_logger(), "[MULTISCAN DRIVER]: Ignoring invalid laserscan layer %d.", layer);
+                continue;
+            }
+            this->laserscan_layers.push_back(layer);
+            this->laserscan_pubs.push_back(this->create_publisher<sensor_msgs::msg::LaserScan>(
+                "lidar_scan/layer_" + std::to_string(layer), rclcpp::SensorDataQoS{}));
+        }
+        this->laserscan_per_segment = (this->config.laserscan_rate == "segment");
+    }
+
+    {
+        const size_t queue_size = static_cast<size_t>(std::max(this->config.publish_queue_size, 1));
+        OverflowPolicy overflow_policy;
+        if(!parseOverflowPolicy(this->config.publish_overflow_policy, overflow_policy))
+        {
+            RCLCPP_WARN(this->get_logger(),
+                "[MULTISCAN DRIVER]: Unknown publish_overflow_policy \"%s\" - valid choices are \"drop_oldest\", \"drop_newest\" and \"block\", using \"drop_oldest\".",
+                this->config.publish_overflow_policy.c_str());
+        }
+        this->scan_stage = std::make_unique<PublishStage<sensor_msgs::msg::PointCloud2>>(
+            this->scan_pub, this->get_logger(), this->get_clock(), queue_size, overflow_policy);
+        // imu samples are small and frequent, so allow more of them to queue up behind a slow publish
+        this->imu_stage = std::make_unique<PublishStage<sensor_msgs::msg::Imu>>(
+            this->imu_pub, this->get_logger(), this->get_clock(), queue_size * 16, overflow_policy);
+        if(this->compressed_pub)
+        {
+            this->compressed_stage = std::make_unique<PublishStage<sensor_msgs::msg::CompressedImage>>(
+                this->compressed_pub, this->get_logger(), this->get_clock(), queue_size, overflow_policy);
+        }
+        if(this->range_image_pub)
+        {
+            this->range_image_stage = std::make_unique<PublishStage<sensor_msgs::msg::Image>>(
+                this->range_image_pub, this->get_logger(), this->get_clock(), queue_size, overflow_policy);
+        }
+        if(this->reflector_pub)
+        {
+            this->reflector_stage = std::make_unique<PublishStage<sensor_msgs::msg::PointCloud2>>(
+                this->reflector_pub, this->get_logger(), this->get_clock(), queue_size, overflow_policy);
+        }
+        for(const auto& laserscan_pub : this->laserscan_pubs)
+        {
+            // at segment rate, one frame worth of scans may queue up
+            this->laserscan_stages.push_back(std::make_unique<PublishStage<sensor_msgs::msg::LaserScan>>(
+                laserscan_pub, this->get_logger(), this->get_clock(), queue_size * (this->laserscan_per_segment ? MS100_SEGMENTS_PER_FRAME : 1),
+                overflow_policy));
+        }
+    }
 
     this->scan_fields = {
         sensor_msgs::msg::PointField{}
@@ -161,7 +525,12 @@ MultiscanNode::MultiscanNode(bool autostart) :
             .set__name("th")
             .set__datatype(sensor_msgs::msg::PointField::UINT32)
             .set__count(1)
-            .set__offset(44)
+            .set__offset(44),
+        sensor_msgs::msg::PointField{}
+            .set__name("reflector")
+            .set__datatype(sensor_msgs::msg::PointField::UINT8)
+            .set__count(1)
+            .set__offset(48)
     };
 
     if(autostart)
@@ -180,290 +549,917 @@ void MultiscanNode::start()
     if(!this->recv_thread.joinable())
     {
         this->is_running = true;
+        this->scan_stage->start();
+        this->imu_stage->start();
+        if(this->compressed_stage)
+        {
+            this->compressed_stage->start();
+        }
+        if(this->range_image_stage)
+        {
+            this->range_image_stage->start();
+        }
+        if(this->reflector_stage)
+        {
+            this->reflector_stage->start();
+        }
+        for(auto& laserscan_stage : this->laserscan_stages)
+        {
+            laserscan_stage->start();
+        }
+        if(!this->config.frame_store_file.empty() && !this->frame_store.IsOpen() && !this->frame_store.Open(this->config.frame_store_file))
+        {
+            RCLCPP_ERROR(this->get_logger(), "[MULTISCAN DRIVER]: Failed to open frame store \"%s\" - frames are not recorded.",
+                this->config.frame_store_file.c_str());
+        }
+        if(!this->config.shm_ring_name.empty() && !this->frame_ring.IsOpen() &&
+            !this->frame_ring.Open(this->config.shm_ring_name, static_cast<uint32_t>(std::max(this->config.shm_ring_slots, 2)),
+                static_cast<size_t>(std::max(this->config.shm_ring_max_points, 1))))
+        {
+            RCLCPP_ERROR(this->get_logger(), "[MULTISCAN DRIVER]: Failed to create shared memory frame ring \"%s\".",
+                this->config.shm_ring_name.c_str());
+        }
+        if(!this->config.compressed_record_file.empty() && !this->compressed_log.IsOpen() && !this->compressed_log.Open(this->config.compressed_record_file))
+        {
+            RCLCPP_ERROR(this->get_logger(), "[MULTISCAN DRIVER]: Failed to open \"%s\" - compressed frames are not recorded.",
+                this->config.compressed_record_file.c_str());
+        }
+        if((this->frame_store.IsOpen() || this->compressed_log.IsOpen() || this->compressed_stage) && !this->record_thread.joinable())
+        {
+            if((this->compressed_log.IsOpen() || this->compressed_stage) && this->get_live_params().use_msgpack)
+            {
+                RCLCPP_WARN(this->get_logger(), "[MULTISCAN DRIVER]: Range image compression requires compact data - no compressed frames while use_msgpack is set.");
+            }
+            this->record_thread = std::thread{ &MultiscanNode::run_recorder, this };
+        }
         this->recv_thread = std::thread{ &MultiscanNode::run_receiver, this };
+        this->sopas_thread = std::thread{ &MultiscanNode::run_sopas, this };
     }
 }
 
 void MultiscanNode::run_receiver()
 {
-    while(this->is_running)
+    RCLCPP_INFO(this->get_logger(),
+        "[MULTISCAN DRIVER]: Initializing connections using the following parameters:"
+        "\n\tLidar IP address: %s"
+        "\n\tDriver IP address: %s"
+        "\n\tLidar UDP port: %d"
+        "\n\tSOPAS TCP port: %d"
+        "\n\tData format: %s"
+        "\n\tCoLa configuration: %s"
+        "\n\tPublish queue: %d (%s)",
+        this->config.lidar_hostname.c_str(),
+        this->config.driver_hostname.c_str(),
+        this->config.lidar_udp_port,
+        this->config.sopas_tcp_port,
+        this->get_live_params().use_msgpack ? "MsgPack" : "Compact",
+        this->config.use_cola_binary ? "Binary" : "ASCII",
+        this->config.publish_queue_size,
+        overflowPolicyName(this->scan_stage->overflowPolicy()));
+
+    while(this->is_running && !this->udp_recv_socket.Init(/*this->config.lidar_hostname*/ "", this->config.lidar_udp_port))
     {
-        RCLCPP_INFO(this->get_logger(),
-            "[MULTISCAN DRIVER]: Initializing connections using the following parameters:"
-            "\n\tLidar IP address: %s"
-            "\n\tDriver IP address: %s"
-            "\n\tLidar UDP port: %d"
-            "\n\tSOPAS TCP port: %d"
-            "\n\tData format: %s"
-            "\n\tCoLa configuration: %s",
-            this->config.lidar_hostname.c_str(),
-            this->config.driver_hostname.c_str(),
-            this->config.lidar_udp_port,
-            this->config.sopas_tcp_port,
-            this->config.use_msgpack ? "MsgPack" : "Compact",
-            this->config.use_cola_binary ? "Binary" : "ASCII");
-
-        if(this->udp_recv_socket.Init(/*this->config.lidar_hostname*/ "", this->config.lidar_udp_port))
-        {
-            RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: UDP socket created successfully");
-
-            sick_scan_xd::SickScanCommonTcp sopas_tcp{
-                this->config.lidar_hostname, this->config.sopas_tcp_port, this->config.use_cola_binary ? 'B' : 'A' };
-            sick_scan_xd::SopasServices sopas_service{ &sopas_tcp, this->config.use_cola_binary };
-            sopas_tcp.init_device();    // TODO: can block indefinitely with valid config that doesn't actually exist
-            sopas_tcp.setReadTimeOutInMs(static_cast<size_t>(this->config.sopas_read_timeout * 1e3));
-
-            if(sopas_tcp.isConnected())
-            {
-                RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: TCP connected! Sending startup commands...");
-                sopas_service.sendAuthorization();
-                sopas_service.sendMultiScanStartCmd(
-                    this->config.driver_hostname,
-                    this->config.lidar_udp_port,
-                    (2 - this->config.use_msgpack),
-                    true,
-                    this->config.lidar_udp_port);
-                RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Successfully sent all startup commands. Proceeding to UDP decode loop.");
-            }
-            else
-            {
-                RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: TCP not connected! Could not send SOPAS initialization command!");
-                // TODO: restart
-            }
+        RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Failed to create UDP socket - retrying after timeout...");
+        this->wait_for_shutdown(this->config.error_restart_timeout);
+    }
+    if(!this->is_running)
+    {
+        return;
+    }
+    RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: UDP socket created successfully");
 
-            constexpr size_t RECV_BUFFER_SIZE = 64 * 1024;
-            std::vector<uint8_t>
-                udp_buffer(RECV_BUFFER_SIZE, 0),
-                udp_msg_start_seq({ 0x02, 0x02,  0x02,  0x02 });
-            double udp_recv_timeout = -1.;
-            chrono_system_time timestamp_last_udp_recv = chrono_system_clock::now();
-            std::array<std::deque<sick_scansegment_xd::ScanSegmentParserOutput>, MS100_SEGMENTS_PER_FRAME> samples{};
-            size_t filled_segments = 0;
+    // the socket and the decoder state live as long as the node, so SOPAS reconnects (run_sopas()) don't interrupt the data stream
+    constexpr size_t RECV_BUFFER_SIZE = 64 * 1024;
+    std::vector<uint8_t>
+        udp_buffer(RECV_BUFFER_SIZE, 0),
+        udp_msg_start_seq({ 0x02, 0x02,  0x02,  0x02 });
+    double udp_recv_timeout = -1.;
+    chrono_system_time timestamp_last_udp_recv = chrono_system_clock::now();
+    std::array<std::deque<sick_scansegment_xd::ScanSegmentParserOutput>, MS100_SEGMENTS_PER_FRAME> samples{};
+    // copies of the latest compact datagram per segment for the range image compression, empty if disabled or msgpack
+    const bool compress_segments = (this->compressed_log.IsOpen() || this->compressed_stage);
+    std::array<std::vector<uint8_t>, MS100_SEGMENTS_PER_FRAME> raw_segments{};
+    size_t filled_segments = 0;
+    // with a sensor side angle range filter only some segments are transmitted: a frame is complete once all segments
+    // of a rotation are filled. The set is decided once two consecutive rotations (between segment index wrap-arounds)
+    // contained the same segments, so a reordered or duplicated datagram, or a start mid-rotation, can't decide it early.
+    size_t frame_segments = 0;
+    size_t rotation_segments = 0, last_rotation_segments = 0;
+    int last_segment_idx = -1;
+    bool frame_segments_known = false;
 
-            try
+    while(this->is_running)
+    {
+        try
+        {
+            while(this->is_running)
             {
-                while(this->is_running && sopas_tcp.isConnected())
+                size_t bytes_received = this->udp_recv_socket.Receive(udp_buffer, udp_recv_timeout, udp_msg_start_seq);
+                // RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Received %ld bytes from %d", bytes_received, this->udp_recv_socket.port());
+                if( bytes_received > udp_msg_start_seq.size() + 8 &&
+                    std::equal(udp_buffer.begin(), udp_buffer.begin() + udp_msg_start_seq.size(), udp_msg_start_seq.begin()) )
                 {
-                    size_t bytes_received = this->udp_recv_socket.Receive(udp_buffer, udp_recv_timeout, udp_msg_start_seq);
-                    // RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Received %ld bytes from %d", bytes_received, this->udp_recv_socket.port());
-                    if( bytes_received > udp_msg_start_seq.size() + 8 &&
-                        std::equal(udp_buffer.begin(), udp_buffer.begin() + udp_msg_start_seq.size(), udp_msg_start_seq.begin()) )
-                    {
-                        uint32_t payload_length_bytes = 0;
-                        uint32_t bytes_to_receive = 0;
-                        uint32_t udp_payload_offset = 0;
+                    uint32_t payload_length_bytes = 0;
+                    uint32_t bytes_to_receive = 0;
+                    uint32_t udp_payload_offset = 0;
+
+                    // detect the format per datagram, so a ScanDataFormat change (see on_parameters_changed()) is picked up
+                    // without resetting the decoder or the PLL: compact datagrams have commandId 1 (scan) or 2 (imu) where
+                    // msgpack datagrams have their payload length, which is never that small
+                    const uint32_t compact_command_id = sick_scansegment_xd::Convert4Byte(udp_buffer.data() + udp_msg_start_seq.size());
+                    const bool is_msgpack = (compact_command_id != 1 && compact_command_id != 2);
 
-                        if(this->config.use_msgpack)
+                    if(is_msgpack)
+                    {
+                        payload_length_bytes = sick_scansegment_xd::Convert4Byte(udp_buffer.data() + udp_msg_start_seq.size());
+                        bytes_to_receive = (uint32_t)(payload_length_bytes + udp_msg_start_seq.size() + 2 * sizeof(uint32_t));
+                        udp_payload_offset = udp_msg_start_seq.size() + sizeof(uint32_t); // payload starts after (4 byte \x02\x02\x02\x02) + (4 byte payload length)
+                    }
+                    else
+                    {
+                        bool parse_success = false;
+                        uint32_t num_bytes_required = 0;
+                        chrono_system_time recv_start_timestamp = chrono_system_clock::now();
+                        while (this->is_running &&
+                            (parse_success = sick_scansegment_xd::CompactDataParser::ParseSegment(udp_buffer.data(), bytes_received, 0, payload_length_bytes, num_bytes_required )) == false &&
+                            (udp_recv_timeout < 0 || sick_scansegment_xd::Seconds(recv_start_timestamp, chrono_system_clock::now()) < udp_recv_timeout)) // read blocking (udp_recv_timeout < 0) or udp_recv_timeout in seconds
                         {
-                            payload_length_bytes = sick_scansegment_xd::Convert4Byte(udp_buffer.data() + udp_msg_start_seq.size());
-                            bytes_to_receive = (uint32_t)(payload_length_bytes + udp_msg_start_seq.size() + 2 * sizeof(uint32_t));
-                            udp_payload_offset = udp_msg_start_seq.size() + sizeof(uint32_t); // payload starts after (4 byte \x02\x02\x02\x02) + (4 byte payload length)
+                            if(num_bytes_required > 1024 * 1024)
+                            {
+                                parse_success = false;
+                                // RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Received %ld bytes (compact), %lu bytes required - probably incorrect payload.", bytes_received, num_bytes_required + sizeof(uint32_t));
+                                sick_scansegment_xd::CompactDataParser::ParseSegment(udp_buffer.data(), bytes_received, 0, payload_length_bytes, num_bytes_required , 0.0f, 1); // parse again with debug output after error
+                                break;
+                            }
+                            // RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: %ld bytes received (compact), %lu bytes or more required.", bytes_received, num_bytes_required + sizeof(uint32_t));
+                            while(this->is_running && bytes_received < num_bytes_required + sizeof(uint32_t) && // payload + 4 byte CRC required
+                                (udp_recv_timeout < 0 || sick_scansegment_xd::Seconds(recv_start_timestamp, chrono_system_clock::now()) < udp_recv_timeout)) // read blocking (udp_recv_timeout < 0) or udp_recv_timeout in seconds
+                            {
+                                std::vector<uint8_t> chunk_buffer(RECV_BUFFER_SIZE, 0);
+                                size_t chunk_bytes_received = this->udp_recv_socket.Receive(chunk_buffer);
+                                // RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Received chunk of %ld bytes.", chunk_bytes_received);
+                                udp_buffer.insert(udp_buffer.begin() + bytes_received, chunk_buffer.begin(), chunk_buffer.begin() + chunk_bytes_received);
+                                bytes_received += chunk_bytes_received;
+                            }
                         }
-                        else
+                        if(!parse_success)
                         {
-                            bool parse_success = false;
-                            uint32_t num_bytes_required = 0;
-                            chrono_system_time recv_start_timestamp = chrono_system_clock::now();
-                            while (this->is_running &&
-                                (parse_success = sick_scansegment_xd::CompactDataParser::ParseSegment(udp_buffer.data(), bytes_received, 0, payload_length_bytes, num_bytes_required )) == false &&
-                                (udp_recv_timeout < 0 || sick_scansegment_xd::Seconds(recv_start_timestamp, chrono_system_clock::now()) < udp_recv_timeout)) // read blocking (udp_recv_timeout < 0) or udp_recv_timeout in seconds
+                            RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Compact payload parse failed.");
+                            continue;
+                        }
+                        bytes_to_receive = (uint32_t)(payload_length_bytes + sizeof(uint32_t)); // payload + (4 byte CRC)
+                        udp_payload_offset = 0; // compact format calculates CRC over complete message (incl. header)
+                        // RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Payload bytes: %ld, Bytes to receive: %lu, Bytes received: %ld", payload_length_bytes, bytes_to_receive, bytes_received);
+                    }
+
+                    // if(bytes_received != bytes_to_receive)
+                    // {
+                    //     RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: ERROR: Recieved %ld bytes but expected %lu bytes!", bytes_received, bytes_to_receive);
+                    // }
+
+                    size_t bytes_valid = std::min<size_t>(bytes_received, (size_t)bytes_to_receive);
+                    uint32_t u32PayloadCRC = sick_scansegment_xd::Convert4Byte(udp_buffer.data() + bytes_valid - sizeof(uint32_t)); // last 4 bytes are CRC
+                    std::vector<uint8_t> msgpack_payload{ udp_buffer.begin() + udp_payload_offset, udp_buffer.begin() + bytes_valid - sizeof(uint32_t) };
+                    uint32_t u32MsgPackCRC = sick_scansegment_xd::crc32(0, msgpack_payload.data(), msgpack_payload.size());
+
+                    if(u32PayloadCRC != u32MsgPackCRC)
+                    {
+                        RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: CRC payload check failed.");
+                        continue;
+                    }
+
+                    // process
+                    {
+                        sick_scansegment_xd::ScanSegmentParserOutput segment;
+                        if(is_msgpack)
+                        {
+                            if(!sick_scansegment_xd::MsgPackParser::Parse(msgpack_payload, fifo_clock::now(), segment, true, false, &this->software_pll, &this->decoder_config))
                             {
-                                if(num_bytes_required > 1024 * 1024)
-                                {
-                                    parse_success = false;
-                                    // RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Received %ld bytes (compact), %lu bytes required - probably incorrect payload.", bytes_received, num_bytes_required + sizeof(uint32_t));
-                                    sick_scansegment_xd::CompactDataParser::ParseSegment(udp_buffer.data(), bytes_received, 0, payload_length_bytes, num_bytes_required , 0.0f, 1); // parse again with debug output after error
-                                    break;
-                                }
-                                // RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: %ld bytes received (compact), %lu bytes or more required.", bytes_received, num_bytes_required + sizeof(uint32_t));
-                                while(this->is_running && bytes_received < num_bytes_required + sizeof(uint32_t) && // payload + 4 byte CRC required
-                                    (udp_recv_timeout < 0 || sick_scansegment_xd::Seconds(recv_start_timestamp, chrono_system_clock::now()) < udp_recv_timeout)) // read blocking (udp_recv_timeout < 0) or udp_recv_timeout in seconds
-                                {
-                                    std::vector<uint8_t> chunk_buffer(RECV_BUFFER_SIZE, 0);
-                                    size_t chunk_bytes_received = this->udp_recv_socket.Receive(chunk_buffer);
-                                    // RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Received chunk of %ld bytes.", chunk_bytes_received);
-                                    udp_buffer.insert(udp_buffer.begin() + bytes_received, chunk_buffer.begin(), chunk_buffer.begin() + chunk_bytes_received);
-                                    bytes_received += chunk_bytes_received;
-                                }
+                                RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Msgpack parse failed.");
+                                continue;
                             }
-                            if(!parse_success)
+                        }
+                        else
+                        {
+                            if(!sick_scansegment_xd::CompactDataParser::Parse(udp_buffer, fifo_clock::now(), segment, 0, true, false, &this->software_pll, &this->decoder_config))
                             {
-                                RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Compact payload parse failed.");
+                                RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Compact parse failed.");
                                 continue;
                             }
-                            bytes_to_receive = (uint32_t)(payload_length_bytes + sizeof(uint32_t)); // payload + (4 byte CRC)
-                            udp_payload_offset = 0; // compact format calculates CRC over complete message (incl. header)
-                            // RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Payload bytes: %ld, Bytes to receive: %lu, Bytes received: %ld", payload_length_bytes, bytes_to_receive, bytes_received);
                         }
 
-                        // if(bytes_received != bytes_to_receive)
-                        // {
-                        //     RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: ERROR: Recieved %ld bytes but expected %lu bytes!", bytes_received, bytes_to_receive);
-                        // }
+                        // export imu if available
+                        if(segment.imudata.valid)
+                        {
+                            auto msg_ptr = std::make_unique<sensor_msgs::msg::Imu>();
+                            sensor_msgs::msg::Imu& msg = *msg_ptr;
+
+                            msg.header.stamp.sec = segment.timestamp_sec;
+                            msg.header.stamp.nanosec = segment.timestamp_nsec;
+                            msg.header.frame_id = this->config.lidar_frame_id;
+
+                            msg.angular_velocity.x = segment.imudata.angular_velocity_x;
+                            msg.angular_velocity.y = segment.imudata.angular_velocity_y;
+                            msg.angular_velocity.z = segment.imudata.angular_velocity_z;
+
+                            msg.linear_acceleration.x = segment.imudata.acceleration_x;
+                            msg.linear_acceleration.y = segment.imudata.acceleration_y;
+                            msg.linear_acceleration.z = segment.imudata.acceleration_z;
+
+                            msg.orientation.w = segment.imudata.orientation_w;
+                            msg.orientation.x = segment.imudata.orientation_x;
+                            msg.orientation.y = segment.imudata.orientation_y;
+                            msg.orientation.z = segment.imudata.orientation_z;
 
-                        size_t bytes_valid = std::min<size_t>(bytes_received, (size_t)bytes_to_receive);
-                        uint32_t u32PayloadCRC = sick_scansegment_xd::Convert4Byte(udp_buffer.data() + bytes_valid - sizeof(uint32_t)); // last 4 bytes are CRC
-                        std::vector<uint8_t> msgpack_payload{ udp_buffer.begin() + udp_payload_offset, udp_buffer.begin() + bytes_valid - sizeof(uint32_t) };
-                        uint32_t u32MsgPackCRC = sick_scansegment_xd::crc32(0, msgpack_payload.data(), msgpack_payload.size());
+                            if(this->imu_stage->push(std::move(msg_ptr)) == PushResult::DROPPED)
+                            {
+                                RCLCPP_WARN_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+                                    "[MULTISCAN DRIVER]: IMU publish queue overflowed - %lu samples dropped so far.",
+                                    this->imu_stage->droppedCount());
+                            }
+                        }
 
-                        if(u32PayloadCRC != u32MsgPackCRC)
+                        if(segment.scandata.size() > 0 && this->laserscan_per_segment)
                         {
-                            RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: CRC payload check failed.");
-                            continue;
+                            this->publish_laserscans({ &segment },
+                                static_cast<uint64_t>(segment.timestamp_sec) * 1000000000UL + static_cast<uint64_t>(segment.timestamp_nsec), false);
                         }
 
-                        // process
+                        if(segment.scandata.size() > 0)
                         {
-                            sick_scansegment_xd::ScanSegmentParserOutput segment;
-                            if(this->config.use_msgpack)
+                            const size_t idx = segment.segmentIndex;
+                            samples[idx].emplace_front();
+                            if(samples[idx].size() > static_cast<size_t>(this->config.max_segment_buffering))
                             {
-                                if(!sick_scansegment_xd::MsgPackParser::Parse(udp_buffer, fifo_clock::now(), segment, true, false))
-                                {
-                                    RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Msgpack parse failed.");
-                                    continue;
-                                }
+                                samples[idx].resize(this->config.max_segment_buffering);
+                            }
+                            swapSegmentsNoIMU(samples[idx].front(), segment);
+                            if(compress_segments && !is_msgpack)
+                            {
+                                raw_segments[idx].assign(udp_buffer.begin(), udp_buffer.begin() + bytes_valid);
                             }
                             else
                             {
-                                if(!sick_scansegment_xd::CompactDataParser::Parse(udp_buffer, fifo_clock::now(), segment, 0, true, false))
+                                raw_segments[idx].clear();
+                            }
+                            filled_segments |= 1 << idx;
+                            if(static_cast<int>(idx) <= last_segment_idx)
+                            {
+                                if(!frame_segments_known && rotation_segments == last_rotation_segments)
                                 {
-                                    RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Compact parse failed.");
-                                    continue;
+                                    frame_segments = rotation_segments;
+                                    frame_segments_known = true;
                                 }
+                                last_rotation_segments = rotation_segments;
+                                rotation_segments = 0;
                             }
-
-                            // export imu if available
-                            if(segment.imudata.valid)
+                            rotation_segments |= 1 << idx;
+                            if(frame_segments_known)
                             {
-                                sensor_msgs::msg::Imu msg;
-
-                                msg.header.stamp.sec = segment.timestamp_sec;
-                                msg.header.stamp.nanosec = segment.timestamp_nsec;
-                                msg.header.frame_id = this->config.lidar_frame_id;
-
-                                msg.angular_velocity.x = segment.imudata.angular_velocity_x;
-                                msg.angular_velocity.y = segment.imudata.angular_velocity_y;
-                                msg.angular_velocity.z = segment.imudata.angular_velocity_z;
+                                frame_segments |= 1 << idx;
+                            }
+                            last_segment_idx = static_cast<int>(idx);
+                        }
 
-                                msg.linear_acceleration.x = segment.imudata.acceleration_x;
-                                msg.linear_acceleration.y = segment.imudata.acceleration_y;
-                                msg.linear_acceleration.z = segment.imudata.acceleration_z;
+                        if(frame_segments_known && (filled_segments & frame_segments) == frame_segments)
+                        {
+                            // assemble and publish pc
+                            auto scan_ptr = std::make_unique<sensor_msgs::msg::PointCloud2>();
+                            sensor_msgs::msg::PointCloud2& scan = *scan_ptr;
+                            constexpr size_t MS100_NOMINAL_POINTS_PER_SCAN = MS100_POINTS_PER_SEGMENT_ECHO * MS100_SEGMENTS_PER_FRAME;  // single echo
+                            constexpr size_t POINT_BYTE_LEN = sizeof(sick_scansegment_xd::PackedPoint);
+                            // the cloud is only packed if someone subscribes, or for the frame store and the frame ring, which take PointCloud2 data
+                            const bool publish_cloud = (this->config.publish_cloud && this->scan_pub->get_subscription_count() > 0);
+                            const bool pack_cloud = (publish_cloud || this->frame_store.IsOpen() || this->frame_ring.IsOpen());
+                            if(pack_cloud)
+                            {
+                                scan.data.reserve(MS100_NOMINAL_POINTS_PER_SCAN * POINT_BYTE_LEN);
+                            }
+                            scan.data.resize(0);
 
-                                msg.orientation.w = segment.imudata.orientation_w;
-                                msg.orientation.x = segment.imudata.orientation_x;
-                                msg.orientation.y = segment.imudata.orientation_y;
-                                msg.orientation.z = segment.imudata.orientation_z;
+                            // range image: one row per layer (groupIdx), the beams (pointIdx) of all transmitted segments side by side
+                            // in segment order, and per pixel range and intensity of each echo as float, 0 if no point was received
+                            std::unique_ptr<sensor_msgs::msg::Image> image_ptr;
+                            const size_t image_echos = static_cast<size_t>(this->config.range_image_echos);
+                            const size_t image_channels = 2 * image_echos;
+                            std::array<size_t, MS100_SEGMENTS_PER_FRAME> image_columns{}, image_column_offset{};
+                            if(this->range_image_stage)
+                            {
+                                size_t width = 0;
+                                for(size_t seg_idx = 0; seg_idx < samples.size(); seg_idx++)
+                                {
+                                    image_column_offset[seg_idx] = width;
+                                    image_columns[seg_idx] = (samples[seg_idx].empty() ? 0 : segmentBeams(samples[seg_idx].front()));
+                                    width += image_columns[seg_idx];
+                                }
+                                image_ptr = std::make_unique<sensor_msgs::msg::Image>();
+                                image_ptr->height = MS100_LAYERS;
+                                image_ptr->width = width;
+                                image_ptr->encoding = "32FC" + std::to_string(image_channels);
+                                image_ptr->is_bigendian = false;
+                                image_ptr->step = width * image_channels * sizeof(float);
+                                image_ptr->data.assign(static_cast<size_t>(image_ptr->step) * image_ptr->height, 0);
+                            }
+                            float* image_data = (image_ptr ? reinterpret_cast<float*>(image_ptr->data.data()) : nullptr);
 
-                                this->imu_pub->publish(msg);
+                            // reflector cloud: the points with reflector bit, packed like the full cloud
+                            std::unique_ptr<sensor_msgs::msg::PointCloud2> reflector_ptr;
+                            if(this->reflector_stage && this->reflector_pub->get_subscription_count() > 0)
+                            {
+                                reflector_ptr = std::make_unique<sensor_msgs::msg::PointCloud2>();
                             }
 
-                            if(segment.scandata.size() > 0)
+                            if(!this->laserscan_stages.empty() && !this->laserscan_per_segment)
                             {
-                                const size_t idx = segment.segmentIndex;
-                                samples[idx].emplace_front();
-                                if(samples[idx].size() > static_cast<size_t>(this->config.max_segment_buffering))
+                                std::vector<const sick_scansegment_xd::ScanSegmentParserOutput*> frame_segments;
+                                uint64_t frame_ts = std::numeric_limits<uint64_t>::max();
+                                for(const auto& segment_queue : samples)
                                 {
-                                    samples[idx].resize(this->config.max_segment_buffering);
+                                    if(!segment_queue.empty())
+                                    {
+                                        const auto& _seg = segment_queue.front();
+                                        frame_segments.push_back(&_seg);
+                                        frame_ts = std::min(frame_ts, static_cast<uint64_t>(_seg.timestamp_sec) * 1000000000UL + static_cast<uint64_t>(_seg.timestamp_nsec));
+                                    }
                                 }
-                                swapSegmentsNoIMU(samples[idx].front(), segment);
-                                filled_segments |= 1 << idx;
+                                this->publish_laserscans(frame_segments, frame_ts, true);
                             }
 
-                            if(filled_segments >= (1 << MS100_SEGMENTS_PER_FRAME) - 1)
+                            uint64_t earliest_ts = std::numeric_limits<uint64_t>::max();
+                            std::vector<std::vector<uint8_t>> frame_raw_segments;
+                            for(size_t seg_idx = 0; seg_idx < samples.size(); seg_idx++)
                             {
-                                // assemble and publish pc
-                                sensor_msgs::msg::PointCloud2 scan;
-                                constexpr size_t MS100_NOMINAL_POINTS_PER_SCAN = MS100_POINTS_PER_SEGMENT_ECHO * MS100_SEGMENTS_PER_FRAME;  // single echo
-                                constexpr size_t POINT_BYTE_LEN = 48;
-                                scan.data.reserve(MS100_NOMINAL_POINTS_PER_SCAN * POINT_BYTE_LEN);  // 48 bytes per point
-                                scan.data.resize(0);
-
-                                uint64_t earliest_ts = std::numeric_limits<uint64_t>::max();
-                                for(auto& segment_queue : samples)
+                                auto& segment_queue = samples[seg_idx];
+                                if(segment_queue.empty())
+                                {
+                                    continue;   // segment not transmitted
+                                }
+                                if(!raw_segments[seg_idx].empty())
                                 {
-                                    const auto& _seg = segment_queue.front();
-                                    uint64_t ts = static_cast<uint64_t>(_seg.timestamp_sec) * 1000000000UL + static_cast<uint64_t>(_seg.timestamp_nsec);
-                                    if(ts < earliest_ts) earliest_ts = ts;
+                                    frame_raw_segments.push_back(std::move(raw_segments[seg_idx]));
+                                    raw_segments[seg_idx].clear();
+                                }
+                                const auto& _seg = segment_queue.front();
+                                uint64_t ts = static_cast<uint64_t>(_seg.timestamp_sec) * 1000000000UL + static_cast<uint64_t>(_seg.timestamp_nsec);
+                                if(ts < earliest_ts) earliest_ts = ts;
 
-                                    for(const auto& _group : _seg.scandata)
+                                for(const auto& _group : _seg.scandata)
+                                {
+                                    for(const auto& _line : _group.scanlines)
                                     {
-                                        for(const auto& _line : _group.scanlines)
+                                        for(const auto& _point : _line.points)
                                         {
-                                            for(const auto& _point : _line.points)
+                                            if(pack_cloud)
                                             {
                                                 scan.data.resize(scan.data.size() + POINT_BYTE_LEN);
-                                                uint8_t* _point_data = scan.data.end().base() - POINT_BYTE_LEN;
-                                                memcpy(_point_data, &_point, 40);
-                                                reinterpret_cast<uint64_t*>(_point_data)[5] = _point.lidar_timestamp_microsec;
+                                                sick_scansegment_xd::packPoint(_point, scan.data.end().base() - POINT_BYTE_LEN);
+                                            }
+                                            if(reflector_ptr && _point.reflectorbit)
+                                            {
+                                                reflector_ptr->data.resize(reflector_ptr->data.size() + POINT_BYTE_LEN);
+                                                sick_scansegment_xd::packPoint(_point, reflector_ptr->data.end().base() - POINT_BYTE_LEN);
+                                            }
+                                            if(image_data &&
+                                                static_cast<size_t>(_point.groupIdx) < MS100_LAYERS &&
+                                                static_cast<size_t>(_point.echoIdx) < image_echos &&
+                                                static_cast<size_t>(_point.pointIdx) < image_columns[seg_idx])
+                                            {
+                                                float* _pixel = image_data +
+                                                    (_point.groupIdx * image_ptr->width + image_column_offset[seg_idx] + _point.pointIdx) * image_channels +
+                                                    2 * _point.echoIdx;
+                                                _pixel[0] = _point.range;
+                                                _pixel[1] = _point.i;
                                             }
                                         }
                                     }
-                                    segment_queue.clear();
                                 }
+                                segment_queue.clear();
+                            }
+
+                            scan.fields = this->scan_fields;
+                            scan.is_bigendian = false;
+                            scan.point_step = POINT_BYTE_LEN;
+                            scan.row_step = scan.data.size();
+                            scan.height = 1;
+                            scan.width = scan.data.size() / POINT_BYTE_LEN;
+                            scan.is_dense = true;
+                            scan.header.frame_id = this->cloud_frame_id;
+                            scan.header.stamp.sec = earliest_ts / 1000000000UL;
+                            scan.header.stamp.nanosec = earliest_ts % 1000000000UL;
 
-                                scan.fields = this->scan_fields;
-                                scan.is_bigendian = false;
-                                scan.point_step = POINT_BYTE_LEN;
-                                scan.row_step = scan.data.size();
-                                scan.height = 1;
-                                scan.width = scan.data.size() / POINT_BYTE_LEN;
-                                scan.is_dense = true;
-                                scan.header.frame_id = this->config.lidar_frame_id;
-                                scan.header.stamp.sec = earliest_ts / 1000000000UL;
-                                scan.header.stamp.nanosec = earliest_ts % 1000000000UL;
-
-                                this->scan_pub->publish(scan);
-                                filled_segments = 0;
+                            if(this->frame_ring.IsOpen() && !this->frame_ring.Write(earliest_ts, scan.data.data(), scan.width))
+                            {
+                                RCLCPP_WARN_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+                                    "[MULTISCAN DRIVER]: Frame of %u points exceeds shm_ring_max_points - %lu frames not written to the frame ring so far.",
+                                    scan.width, this->frame_ring.NumFramesDropped());
                             }
-                        }
 
-                        if(bytes_received > 0)
-                        {
-                            timestamp_last_udp_recv = chrono_system_clock::now();
-                        }
-                        if(sick_scansegment_xd::Seconds(timestamp_last_udp_recv, chrono_system_clock::now()) > this->config.udp_dropout_reset_thresh)
-                        {
-                            udp_recv_timeout = -1;
+                            // the recorder reads the packed points of the published cloud, so it shares the message instead of copying
+                            // scan.data -- from here on scan is read only
+                            std::shared_ptr<const sensor_msgs::msg::PointCloud2> shared_scan;
+                            if(this->record_thread.joinable())
+                            {
+                                std::unique_lock<std::mutex> lock{ this->record_mtx };
+                                if(this->record_queue.size() < MAX_RECORD_QUEUE)
+                                {
+                                    if(this->frame_store.IsOpen())
+                                    {
+                                        shared_scan = std::move(scan_ptr);
+                                    }
+                                    this->record_queue.emplace_back(new RecordedFrame{
+                                        earliest_ts,
+                                        shared_scan,
+                                        std::move(frame_raw_segments) });
+                                    lock.unlock();
+                                    this->record_cv.notify_one();
+                                }
+                                else
+                                {
+                                    this->num_record_dropped++;
+                                }
+                            }
+
+                            if(reflector_ptr)
+                            {
+                                reflector_ptr->fields = this->scan_fields;
+                                reflector_ptr->is_bigendian = false;
+                                reflector_ptr->point_step = POINT_BYTE_LEN;
+                                reflector_ptr->row_step = reflector_ptr->data.size();
+                                reflector_ptr->height = 1;
+                                reflector_ptr->width = reflector_ptr->data.size() / POINT_BYTE_LEN;
+                                reflector_ptr->is_dense = true;
+                                reflector_ptr->header = scan.header;
+                                if(this->reflector_stage->push(std::move(reflector_ptr)) == PushResult::DROPPED)
+                                {
+                                    RCLCPP_WARN_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+                                        "[MULTISCAN DRIVER]: Reflector publish queue overflowed - %lu frames dropped so far.",
+                                        this->reflector_stage->droppedCount());
+                                }
+                            }
+
+                            if(image_ptr)
+                            {
+                                image_ptr->header = scan.header;
+                                image_ptr->header.frame_id = this->config.lidar_frame_id;   // ranges and angles are not transformed
+                                if(this->range_image_stage->push(std::move(image_ptr)) == PushResult::DROPPED)
+                                {
+                                    RCLCPP_WARN_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+                                        "[MULTISCAN DRIVER]: Range image publish queue overflowed - %lu frames dropped so far.",
+                                        this->range_image_stage->droppedCount());
+                                }
+                            }
+
+                            if(publish_cloud &&
+                                (shared_scan ? this->scan_stage->push(std::move(shared_scan)) : this->scan_stage->push(std::move(scan_ptr))) == PushResult::DROPPED)
+                            {
+                                RCLCPP_WARN_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+                                    "[MULTISCAN DRIVER]: Scan publish queue overflowed - %lu frames dropped so far.",
+                                    this->scan_stage->droppedCount());
+                            }
+                            filled_segments = 0;
                         }
-                        else
+                    }
+
+                    if(bytes_received > 0)
+                    {
+                        timestamp_last_udp_recv = chrono_system_clock::now();
+                        this->last_udp_recv_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now().time_since_epoch()).count();
+                    }
+                    if(sick_scansegment_xd::Seconds(timestamp_last_udp_recv, chrono_system_clock::now()) > this->config.udp_dropout_reset_thresh)
+                    {
+                        udp_recv_timeout = -1;
+                    }
+                    else
+                    {
+                        udp_recv_timeout = this->config.udp_receive_timeout; // receive non-blocking with timeout
+                    }
+                }
+            }
+        }
+        catch(const std::exception& e)
+        {
+            RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: UDP decode loop encountered an exception - what():\n\t%s", e.what());
+        }
+    }
+}
+
+void MultiscanNode::run_sopas()
+{
+    sick_scan_xd::SickScanCommonTcp sopas_tcp{
+        this->config.lidar_hostname, this->config.sopas_tcp_port, this->config.use_cola_binary ? 'B' : 'A' };
+    sick_scan_xd::SopasServices sopas_service{ &sopas_tcp, this->config.use_cola_binary };
+    sopas_tcp.setReadTimeOutInMs(static_cast<size_t>(this->config.sopas_read_timeout * 1e3));
+    sopas_tcp.setConnectTimeOutInMs(static_cast<size_t>(this->config.sopas_connect_timeout * 1e3));
+
+    std::mt19937 rng{ std::random_device{}() };
+    double backoff = this->config.reconnect_backoff_initial;
+    bool started = false;   // startup commands have been sent successfully at least once
+
+    // live parameters as last sent to the lidar, copied under sopas_mtx
+    bool use_msgpack = false, imu_enable = true;
+    int performance_profile = -1;
+    auto take_live_params = [&]()
+    {
+        std::lock_guard<std::mutex> lock{ this->sopas_mtx };
+        use_msgpack = this->config.use_msgpack;
+        imu_enable = this->config.imu_enable;
+        performance_profile = this->config.performance_profile;
+        this->reconfigure_pending = false;
+    };
+
+    while(this->is_running)
+    {
+        const auto bringup_start = std::chrono::steady_clock::now();
+        sopas_tcp.init_device();    // fails after sopas_connect_timeout
+        const auto bringup_connected = std::chrono::steady_clock::now();
+
+        bool ready = false;
+        if(sopas_tcp.isConnected())
+        {
+            if(started && this->udp_data_age() < this->config.udp_dropout_reset_thresh)
+            {
+                // warm reconnect: the lidar kept streaming while the link was down, so its configuration is still in place
+                RCLCPP_INFO(this->get_logger(),
+                    "[MULTISCAN DRIVER]: SOPAS TCP reconnected after %.1f ms - lidar is still streaming, startup commands not required.",
+                    std::chrono::duration<double, std::milli>(bringup_connected - bringup_start).count());
+                ready = true;
+            }
+            else
+            {
+                RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: TCP connected! Sending startup commands...");
+                take_live_params();
+                if(this->config.sopas_pipelined_startup)
+                {
+                    ready = sopas_service.sendMultiScanStartCmdPipelined(
+                        this->config.driver_hostname,
+                        this->config.lidar_udp_port,
+                        (2 - use_msgpack),
+                        imu_enable,
+                        this->config.lidar_udp_port,
+                        performance_profile,
+                        this->config.angle_range_filter,
+                        this->config.layer_filter);
+                }
+                else
+                {
+                    ready = sopas_service.sendMultiScanStartCmd(
+                        this->config.driver_hostname,
+                        this->config.lidar_udp_port,
+                        (2 - use_msgpack),
+                        imu_enable,
+                        this->config.lidar_udp_port,
+                        performance_profile,
+                        this->config.angle_range_filter,
+                        this->config.layer_filter);
+                }
+                const auto bringup_end = std::chrono::steady_clock::now();
+                RCLCPP_INFO(this->get_logger(),
+                    "[MULTISCAN DRIVER]: %s all startup commands (bring-up %.1f ms: connect %.1f ms, %s startup %.1f ms).",
+                    ready ? "Successfully sent" : "Failed to send",
+                    std::chrono::duration<double, std::milli>(bringup_end - bringup_start).count(),
+                    std::chrono::duration<double, std::milli>(bringup_connected - bringup_start).count(),
+                    this->config.sopas_pipelined_startup ? "pipelined" : "sequential",
+                    std::chrono::duration<double, std::milli>(bringup_end - bringup_connected).count());
+            }
+        }
+        else
+        {
+            RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: TCP not connected! Could not send SOPAS initialization command!");
+        }
+
+        if(ready)
+        {
+            started = true;
+            backoff = this->config.reconnect_backoff_initial;
+
+            // supervise the link and apply parameter changes, UDP data is decoded independently by run_receiver()
+            while(this->is_running && sopas_tcp.isConnected())
+            {
+                bool reconfigure = false;
+                {
+                    std::unique_lock<std::mutex> lock{ this->sopas_mtx };
+                    reconfigure = this->sopas_cv.wait_for(lock, std::chrono::milliseconds(100),
+                        [this]{ return !this->is_running || this->reconfigure_pending; }) && this->is_running;
+                }
+                if(reconfigure)
+                {
+                    take_live_params();
+                    RCLCPP_INFO(this->get_logger(),
+                        "[MULTISCAN DRIVER]: Applying parameter changes -- data format: %s, IMU: %s, performance profile: %d",
+                        use_msgpack ? "MsgPack" : "Compact",
+                        imu_enable ? "enabled" : "disabled",
+                        performance_profile);
+                    if(!sopas_service.sendMultiScanReconfigureCmd(
+                        this->config.driver_hostname,
+                        (2 - use_msgpack),
+                        imu_enable,
+                        this->config.lidar_udp_port,
+                        performance_profile))
+                    {
+                        RCLCPP_WARN(this->get_logger(), "[MULTISCAN DRIVER]: Failed to apply parameter changes.");
+                        if(!sopas_tcp.isConnected())
                         {
-                            udp_recv_timeout = this->config.udp_receive_timeout; // receive non-blocking with timeout
+                            // retry after the reconnect
+                            std::lock_guard<std::mutex> lock{ this->sopas_mtx };
+                            this->reconfigure_pending = true;
                         }
                     }
                 }
+            }
+            if(this->is_running)
+            {
+                RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: SOPAS TCP connection lost - reconnecting...");
+            }
+            else if(sopas_tcp.isConnected())
+            {
+                sopas_service.sendAuthorization();
+                sopas_service.sendMultiScanStopCmd(imu_enable);
+            }
+        }
+        sopas_tcp.close_device();
 
-                if(!sopas_tcp.isConnected())
+        if(this->is_running && !ready)
+        {
+            // exponential backoff with jitter, so that multiple drivers don't retry in lockstep
+            const double delay = backoff * std::uniform_real_distribution<double>{ 0.5, 1. }(rng);
+            backoff = std::min(backoff * 2., std::max(this->config.error_restart_timeout, this->config.reconnect_backoff_initial));
+            RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Encountered error - retrying after %.2f s...", delay);
+            this->wait_for_shutdown(delay);
+        }
+    }
+}
+
+MultiscanNode::LiveParams MultiscanNode::get_live_params()
+{
+    std::lock_guard<std::mutex> lock{ this->sopas_mtx };
+    return LiveParams{ this->config.use_msgpack, this->config.imu_enable, this->config.performance_profile };
+}
+
+rcl_interfaces::msg::SetParametersResult MultiscanNode::on_parameters_changed(const std::vector<rclcpp::Parameter>& params)
+{
+    rcl_interfaces::msg::SetParametersResult result;
+    result.successful = true;
+
+    for(const rclcpp::Parameter& param : params)
+    {
+        const std::string& name = param.get_name();
+        if(name != "use_msgpack" && name != "imu_enable" && name != "performance_profile" && name != "use_sim_time")
+        {
+            // everything else is only read at startup (use_sim_time is handled by rclcpp)
+            result.successful = false;
+            result.reason = name + " is applied on restart only";
+            return result;
+        }
+        if(name == "performance_profile" && param.as_int() < -1)
+        {
+            result.successful = false;
+            result.reason = "performance_profile must be a profile number >= 0, or -1 to keep the lidar setting";
+            return result;
+        }
+    }
+
+    bool changed = false;
+    {
+        std::lock_guard<std::mutex> lock{ this->sopas_mtx };
+        for(const rclcpp::Parameter& param : params)
+        {
+            if(param.get_name() == "use_msgpack")
+            {
+                changed |= (this->config.use_msgpack != param.as_bool());
+                this->config.use_msgpack = param.as_bool();
+            }
+            else if(param.get_name() == "imu_enable")
+            {
+                changed |= (this->config.imu_enable != param.as_bool());
+                this->config.imu_enable = param.as_bool();
+            }
+            else if(param.get_name() == "performance_profile")
+            {
+                changed |= (this->config.performance_profile != param.as_int());
+                this->config.performance_profile = static_cast<int>(param.as_int());
+            }
+        }
+        this->reconfigure_pending |= changed;
+    }
+    if(changed)
+    {
+        this->sopas_cv.notify_all();    // run_sopas() sends the changes, or uses them on the next startup
+    }
+    return result;
+}
+
+double MultiscanNode::udp_data_age() const
+{
+    const int64_t last_ns = this->last_udp_recv_ns;
+    if(last_ns == 0)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    return 1e-9 * static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count() - last_ns);
+}
+
+void MultiscanNode::run_recorder()
+{
+    constexpr size_t POINT_BYTE_LEN = sizeof(sick_scansegment_xd::PackedPoint);
+    std::unique_lock<std::mutex> lock{ this->record_mtx };
+    while(true)
+    {
+        this->record_cv.wait(lock, [this]{ return !this->is_running || !this->record_queue.empty(); });
+        if(this->record_queue.empty())
+        {
+            break;  // stopped, and everything queued has been written
+        }
+        std::unique_ptr<RecordedFrame> frame = std::move(this->record_queue.front());
+        this->record_queue.pop_front();
+        lock.unlock();
+
+        // compress the compact datagrams of the frame, skipped while nobody subscribes and nothing is recorded
+        const bool publish_compressed = (this->compressed_stage && this->compressed_pub->get_subscription_count() > 0);
+        if(!frame->segments.empty() && (publish_compressed || this->compressed_log.IsOpen()))
+        {
+            std::vector<const std::vector<uint8_t>*> segments;
+            for(const auto& segment : frame->segments)
+            {
+                segments.push_back(&segment);
+            }
+            auto msg_ptr = std::make_unique<sensor_msgs::msg::CompressedImage>();
+            if(sick_scansegment_xd::RangeImageCodec::CompressFrame(segments, msg_ptr->data))
+            {
+                this->num_compressed_frames++;
+                this->num_compressed_bytes += msg_ptr->data.size();
+                for(const auto& segment : frame->segments)
+                {
+                    this->num_uncompressed_bytes += segment.size();
+                }
+                if(this->compressed_log.IsOpen())
                 {
-                    RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: SOPAS TCP connection lost - restarting...");
+                    this->compressed_log.Write(frame->timestamp_nsec, msg_ptr->data.data(), static_cast<uint32_t>(msg_ptr->data.size()));
+                }
+                if(publish_compressed)
+                {
+                    msg_ptr->header.frame_id = this->config.lidar_frame_id;
+                    msg_ptr->header.stamp.sec = frame->timestamp_nsec / 1000000000UL;
+                    msg_ptr->header.stamp.nanosec = frame->timestamp_nsec % 1000000000UL;
+                    msg_ptr->format = sick_scansegment_xd::RangeImageCodec::Format;
+                    this->compressed_stage->push(std::move(msg_ptr));
                 }
             }
-            catch(const std::exception& e)
+            else
             {
-                RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: UDP decode loop encountered an exception - what():\n\t%s", e.what());
+                this->num_record_dropped++;
             }
+        }
+        if(!frame->cloud || frame->cloud->data.empty())
+        {
+            lock.lock();
+            continue;
+        }
 
-            if(sopas_tcp.isConnected())
+        // transpose the packed points (see scan_fields) into the columns of the file
+        const size_t num_points = frame->cloud->data.size() / POINT_BYTE_LEN;
+        sick_scansegment_xd::FrameColumns columns;
+        if(this->frame_store.BeginFrame(frame->timestamp_nsec, num_points, columns))
+        {
+            const uint8_t* point = frame->cloud->data.data();
+            for(size_t n = 0; n < num_points; n++, point += POINT_BYTE_LEN)
             {
-                sopas_service.sendAuthorization();
-                sopas_service.sendMultiScanStopCmd(true);
+                const sick_scansegment_xd::PackedPoint packed = sick_scansegment_xd::unpackPoint(point);
+                columns.x[n] = packed.x;
+                columns.y[n] = packed.y;
+                columns.z[n] = packed.z;
+                columns.i[n] = packed.i;
+                columns.range[n] = packed.range;
+                columns.t[n] = packed.t;
+                columns.layer[n] = static_cast<uint8_t>(packed.layer);
             }
+            this->frame_store.CommitFrame();
+        }
+        else
+        {
+            this->num_record_dropped++;
         }
 
-        if(this->is_running)
+        lock.lock();
+    }
+}
+
+void MultiscanNode::publish_laserscans(
+    const std::vector<const sick_scansegment_xd::ScanSegmentParserOutput*>& segments,
+    uint64_t stamp_ns,
+    bool full_rotation)
+{
+    for(size_t n = 0; n < this->laserscan_layers.size(); n++)
+    {
+        if(this->laserscan_pubs[n]->get_subscription_count() == 0)
         {
-            RCLCPP_INFO(this->get_logger(), "[MULTISCAN DRIVER]: Encountered error - restarting after timeout...");
-            std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<size_t>(this->config.error_restart_timeout * 1e3)));
+            continue;
+        }
+        auto scan_ptr = std::make_unique<sensor_msgs::msg::LaserScan>();
+        if(!fillLaserScan(segments, this->laserscan_layers[n], full_rotation, *scan_ptr))
+        {
+            continue;   // layer not in these segments
+        }
+        scan_ptr->header.frame_id = this->config.lidar_frame_id;
+        scan_ptr->header.stamp.sec = stamp_ns / 1000000000UL;
+        scan_ptr->header.stamp.nanosec = stamp_ns % 1000000000UL;
+        if(this->laserscan_stages[n]->push(std::move(scan_ptr)) == PushResult::DROPPED)
+        {
+            RCLCPP_WARN_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+                "[MULTISCAN DRIVER]: LaserScan publish queue overflowed - %lu scans dropped so far.",
+                this->laserscan_stages[n]->droppedCount());
         }
     }
 }
 
+void MultiscanNode::wait_for_shutdown(double seconds)
+{
+    std::unique_lock<std::mutex> lock{ this->sopas_mtx };
+    this->sopas_cv.wait_for(lock, std::chrono::duration<double>(seconds), [this]{ return !this->is_running; });
+}
+
 void MultiscanNode::shutdown()
 {
     if(this->is_running || this->recv_thread.joinable())
     {
-        this->is_running = false;
+        {
+            std::lock_guard<std::mutex> lock{ this->sopas_mtx };
+            this->is_running = false;
+        }
+        this->sopas_cv.notify_all();
         this->udp_recv_socket.ForceStop();
+        this->scan_stage->stop();   // also releases the receive thread if it is blocked on a full queue
+        this->imu_stage->stop();
+        if(this->compressed_stage)
+        {
+            this->compressed_stage->stop();
+        }
+        if(this->range_image_stage)
+        {
+            this->range_image_stage->stop();
+        }
+        if(this->reflector_stage)
+        {
+            this->reflector_stage->stop();
+        }
+        for(auto& laserscan_stage : this->laserscan_stages)
+        {
+            laserscan_stage->stop();
+        }
         this->recv_thread.join();
+        if(this->frame_ring.IsOpen())
+        {
+            RCLCPP_INFO(this->get_logger(),
+                "[MULTISCAN DRIVER]: Frame ring \"%s\" -- %lu frames written, %lu dropped",
+                this->config.shm_ring_name.c_str(),
+                this->frame_ring.NumFramesWritten(),
+                this->frame_ring.NumFramesDropped());
+            this->frame_ring.Close();   // wakes the readers
+        }
+        if(this->config.weather_filter)
+        {
+            RCLCPP_INFO(this->get_logger(),
+                "[MULTISCAN DRIVER]: Weather filter -- %lu echos dropped",
+                static_cast<unsigned long>(this->decoder_config.GetWeatherFilterDropCount()));
+        }
+        this->sopas_thread.join();  // sends the stop commands if the SOPAS link is up
+        if(this->record_thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock{ this->record_mtx };  // the recorder either waits already or sees is_running
+            }
+            this->record_cv.notify_all();
+            this->record_thread.join(); // writes the remaining queued frames
+            if(this->frame_store.IsOpen())
+            {
+                this->frame_store.Close();
+                RCLCPP_INFO(this->get_logger(),
+                    "[MULTISCAN DRIVER]: Frame store \"%s\" -- %lu frames recorded, %lu dropped",
+                    this->config.frame_store_file.c_str(),
+                    this->frame_store.NumFrames(),
+                    this->num_record_dropped.load());
+            }
+            this->compressed_log.Close();
+            if(this->num_compressed_frames > 0)
+            {
+                RCLCPP_INFO(this->get_logger(),
+                    "[MULTISCAN DRIVER]: Range image compression -- %lu frames, %lu bytes compact -> %lu bytes compressed (ratio %.2f)",
+                    this->num_compressed_frames,
+                    this->num_uncompressed_bytes,
+                    this->num_compressed_bytes,
+                    static_cast<double>(this->num_uncompressed_bytes) / static_cast<double>(std::max<size_t>(this->num_compressed_bytes, 1)));
+            }
+        }
+
+        RCLCPP_INFO(this->get_logger(),
+            "[MULTISCAN DRIVER]: Publisher stats -- scans: %lu published, %lu dropped, %lu failed -- imu: %lu published, %lu dropped, %lu failed",
+            this->scan_stage->publishedCount(),
+            this->scan_stage->droppedCount(),
+            this->scan_stage->failedCount(),
+            this->imu_stage->publishedCount(),
+            this->imu_stage->droppedCount(),
+            this->imu_stage->failedCount());
     }
 }
 
@@ -0,0 +1,113 @@
+/*
+====================================================================================================
+File: clock_estimator.cpp
+====================================================================================================
+*/
+#include "clock_estimator.h"
+#include <cmath>
+#include <algorithm>
+
+static const double InitialOffsetVariance = 1.0e-4;  // (10 ms)^2
+static const double InitialDriftVariance = 1.0e-8;   // (100 ppm)^2
+
+ClockKalmanFilter::ClockKalmanFilter()
+{
+  numResets = 0;
+  reset();
+}
+
+void ClockKalmanFilter::reset()
+{
+  hasReference = false;
+  refTick = 0;
+  refTimeStamp = 0;
+  drift = 0;
+  P00 = InitialOffsetVariance;
+  P01 = 0;
+  P11 = InitialDriftVariance;
+  lastInnovation = 0;
+  numAccepted = 0;
+  numRejected = 0;
+  numConsecutiveRejects = 0;
+}
+
+void ClockKalmanFilter::restart(double systemTimeStamp, uint32_t tick)
+{
+  uint32_t resets = numResets;
+  reset();
+  numResets = resets;
+  hasReference = true;
+  refTick = tick;
+  refTimeStamp = systemTimeStamp;
+  numAccepted = 1;
+}
+
+double ClockKalmanFilter::timeStampOf(uint32_t tick) const
+{
+  int32_t deltaTick = (int32_t)(tick - refTick); // wraparound safe
+  return refTimeStamp + Slope() * deltaTick;
+}
+
+double ClockKalmanFilter::OffsetStdDev() const
+{
+  return std::sqrt(std::max(P00, 0.0));
+}
+
+/*!
+\brief Predicts the state to the new tick, then corrects it by the measured system time unless
+the innovation is gated as outlier. Predicting moves the reference point to the newest tick, so
+tick deltas stay small and the 32 bit wraparound never matters.
+*/
+bool ClockKalmanFilter::update(double systemTimeStamp, uint32_t tick)
+{
+  if (!hasReference)
+  {
+    restart(systemTimeStamp, tick);
+    return (true);
+  }
+
+  // predict: offset' = offset + dt * drift, drift' = drift
+  int32_t deltaTick = (int32_t)(tick - refTick);
+  double dtNominal = TickPeriodSec * deltaTick; // F = [[1, dtNominal], [0, 1]]
+  double dtAbs = std::fabs(dtNominal);
+  double predTimeStamp = refTimeStamp + dtNominal * (1.0 + drift);
+  double p00 = P00 + 2 * dtNominal * P01 + dtNominal * dtNominal * P11 + OffsetRandomWalk * dtAbs;
+  double p01 = P01 + dtNominal * P11;
+  double p11 = P11 + DriftRandomWalk * dtAbs;
+
+  refTick = tick;
+  refTimeStamp = predTimeStamp;
+  P00 = p00;
+  P01 = p01;
+  P11 = p11;
+
+  // gate: H = [1, 0]
+  double R = MeasurementStdDevSec * MeasurementStdDevSec;
+  double S = P00 + R;
+  double innovation = systemTimeStamp - predTimeStamp;
+  lastInnovation = innovation;
+  double gate = std::max(GateSigma * std::sqrt(S), MinGateSec);
+  if (numAccepted >= MinUpdatesToInitialize && std::fabs(innovation) > gate)
+  {
+    numRejected++;
+    numConsecutiveRejects++;
+    if (numConsecutiveRejects >= MaxConsecutiveRejects)
+    {
+      numResets++;
+      restart(systemTimeStamp, tick); // abrupt change of time base
+    }
+    return (false);
+  }
+  numConsecutiveRejects = 0;
+
+  // correct
+  double K0 = P00 / S;
+  double K1 = P01 / S;
+  refTimeStamp += K0 * innovation;
+  drift += K1 * innovation;
+  P11 -= K1 * P01;
+  P01 -= K0 * P01;
+  P00 -= K0 * P00;
+  numAccepted++;
+  return (true);
+}
@@ -0,0 +1,95 @@
+/*
+====================================================================================================
+File: clock_estimator.h
+====================================================================================================
+*/
+#pragma once
+
+#include <cstdint>
+
+/*!
+\brief Incremental estimator mapping lidar ticks (microseconds, 32 bit) to system time.
+
+Alternative to the fifo regression in SoftwarePLL: a two state Kalman filter on clock offset
+and clock drift. Each update is O(1) and allocation free. Tick differences are evaluated as
+signed 32 bit deltas, so wraparound of the 32 bit tick counter is handled transparently.
+
+Measurements whose innovation exceeds the gate (GateSigma standard deviations, but at least
+MinGateSec) are rejected and only advance the prediction. If MaxConsecutiveRejects measurements
+in a row are rejected, the time base is assumed to have jumped and the filter restarts from
+the most recent measurement.
+
+The estimate is exposed as a linear model time(tick) = RefTimeStamp() + Slope() * (int32_t)(tick - RefTick()),
+i.e. the same parametrization SoftwarePLL uses for FirstTimeStamp(), FirstTick() and InterpolationSlope().
+*/
+class ClockKalmanFilter
+{
+public:
+  ClockKalmanFilter();
+
+  // restart the filter, the next measurement initializes the reference point
+  void reset();
+
+  /*!
+  \brief Updates the filter with a new measurement
+  \param systemTimeStamp system time in seconds when the telegram with tick was received
+  \param tick lidar timestamp in microseconds (32 bit, may wrap)
+  \return true if the measurement was accepted, false if it was rejected as outlier (or the filter was restarted)
+  */
+  bool update(double systemTimeStamp, uint32_t tick);
+
+  // true after MinUpdatesToInitialize accepted measurements
+  bool isInitialized() const
+  { return numAccepted >= MinUpdatesToInitialize; }
+
+  // time(tick) = RefTimeStamp() + Slope() * (int32_t)(tick - RefTick())
+  double timeStampOf(uint32_t tick) const;
+
+  uint32_t RefTick() const
+  { return refTick; }
+
+  double RefTimeStamp() const
+  { return refTimeStamp; }
+
+  double Slope() const
+  { return TickPeriodSec * (1.0 + drift); }
+
+  double Drift() const
+  { return drift; }
+
+  double OffsetStdDev() const;
+
+  double LastInnovation() const
+  { return lastInnovation; }
+
+  uint32_t NumRejected() const
+  { return numRejected; }
+
+  uint32_t NumResets() const
+  { return numResets; }
+
+  // tuning, defaults suitable for multiScan segment rates and typical network jitter
+  double MeasurementStdDevSec = 0.5e-3;      // receive time jitter of a single telegram
+  double OffsetRandomWalk = 1.0e-8;          // process noise of the offset, variance per second
+  double DriftRandomWalk = 1.0e-12;          // process noise of the drift, variance per second
+  double GateSigma = 4.0;                    // reject measurements beyond GateSigma standard deviations
+  double MinGateSec = 2.0e-3;                // but never reject within this band
+  uint32_t MaxConsecutiveRejects = 20;       // restart after this many rejects in a row (same as SoftwarePLL::MaxExtrapolationCounter)
+
+  static const uint32_t MinUpdatesToInitialize = 8;
+  static constexpr double TickPeriodSec = 1.0e-6; // lidar ticks are microseconds
+
+private:
+  void restart(double systemTimeStamp, uint32_t tick);
+
+  bool hasReference;
+  uint32_t refTick;
+  double refTimeStamp;          // estimated system time at refTick (state: offset)
+  double drift;                 // relative clock drift (state: slope = TickPeriodSec * (1 + drift))
+  double P00, P01, P11;         // state covariance
+  double lastInnovation;
+  uint32_t numAccepted;
+  uint32_t numRejected;
+  uint32_t numConsecutiveRejects;
+  uint32_t numResets;
+};
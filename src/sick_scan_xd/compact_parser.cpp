@@ -52,6 +52,8 @@
 *  Copyright 2020 Ing.-Buero Dr. Michael Lehning
 *
 */
+#include <algorithm>
+#include <atomic>
 #include "softwarePLL.h"
 #include "compact_parser.h"
 #include "udp_receiver.h"
@@ -125,8 +127,10 @@ static inline bool endOfBuffer(uint32_t byte_cnt, size_t bytes_to_read, uint32_t
 
 static void print_error(const std::string& err_msg, int line_number, double print_rate = 1)
 {
+static std::mutex error_mutex; // segments may be parsed concurrently (e.g. multiscan_decode)
 static std::map<int, std::chrono::system_clock::time_point> last_error_printed;
 static std::map<int, size_t> error_cnt;
+std::lock_guard<std::mutex> error_lock(error_mutex);
 if (error_cnt[line_number] == 0 || std::chrono::duration<double>(std::chrono::system_clock::now() - last_error_printed[line_number]).count() > 1/print_rate)
 {
     if(error_cnt[line_number] <= 1)
@@ -326,7 +330,8 @@ sick_scansegment_xd::CompactDataHeader sick_scansegment_xd::CompactDataParser::P
 */
 sick_scansegment_xd::CompactModuleMetaData sick_scansegment_xd::CompactDataParser::ParseModuleMetaData(const uint8_t* scandata, uint32_t module_size, uint32_t telegramVersion, uint32_t& module_metadata_size)
 {
-    uint32_t byte_cnt = 0, byte_required = 0;
+    uint32_t byte_cnt = 0;
+    uint64_t byte_required = 0; // 64 bit, so that a corrupt number of layers can't wrap around the module size check
     sick_scansegment_xd::CompactModuleMetaData metadata;
     // metadata.valid flag is false and becomes true after successful parsing
     module_metadata_size = 0;
@@ -446,10 +451,30 @@ void sick_scansegment_xd::CompactDataParser::SetLayerElevationTable(const std::v
 * @param[in] layer_elevation_rad layer_elevation in radians
 * @return layer-id
 */
-int sick_scansegment_xd::CompactDataParser::GetLayerIDfromElevation(float layer_elevation_rad) // layer_elevation in radians
+int sick_scansegment_xd::DecoderConfig::GetLayerIDfromElevation(float layer_elevation_rad) const // layer_elevation in radians
 {
     int layer_elevation_mdeg = (int)std::lround(layer_elevation_rad * 180000 / M_PI);
-    if (!s_layer_elevation_table_mdeg.empty())
+    if (!s_layer_elevation_table_mdeg.empty() && !active_layer_ids.empty())
+    {
+        // nearest active layer, the table is sorted by elevation
+        int layer_id = active_layer_ids[0];
+        int elevation_dist = std::abs(layer_elevation_mdeg - s_layer_elevation_table_mdeg[layer_id]);
+        for(size_t n = 1; n < active_layer_ids.size(); n++)
+        {
+            int dist = std::abs(layer_elevation_mdeg - s_layer_elevation_table_mdeg[active_layer_ids[n]]);
+            if (elevation_dist > dist)
+            {
+                elevation_dist = dist;
+                layer_id = active_layer_ids[n];
+            }
+            else
+            {
+                break;
+            }
+        }
+        return layer_id;
+    }
+    else if (!s_layer_elevation_table_mdeg.empty())
     {
         int layer_idx = 0;
         int elevation_dist = std::abs(layer_elevation_mdeg - s_layer_elevation_table_mdeg[layer_idx]);
@@ -496,6 +521,328 @@ float sick_scansegment_xd::CompactDataParser::GetElevationDegFromLayerIdx(int la
     return 0;
 }
 
+/*
+* @brief Sets the layers enabled by a sensor side layer filter (LFPlayerFilter).
+* @param[in] layer_active layer_active[layer_idx] := 0 for disabled or 1 for enabled layer, empty for all layers
+*/
+void sick_scansegment_xd::DecoderConfig::SetActiveLayers(const std::vector<int>& layer_active)
+{
+    active_layer_ids.clear();
+    for (size_t layer_idx = 0; layer_idx < layer_active.size() && layer_idx < s_layer_elevation_table_mdeg.size(); layer_idx++)
+    {
+        if (layer_active[layer_idx])
+        {
+            active_layer_ids.push_back(static_cast<int>(layer_idx));
+        }
+    }
+    if (active_layer_ids.size() == s_layer_elevation_table_mdeg.size())
+    {
+        active_layer_ids.clear(); // all layers active
+    }
+}
+
+/*
+* @brief Configures the multi-echo weather filter.
+* @param[in] enable true: drop echos in CompactDataParser::Parse() and MsgPackParser::Parse(), false: keep all echos (default)
+* @param[in] max_rssi_ratio max. rssi of a dropped echo relative to the farther echo
+* @param[in] min_range_gap min. range difference to the farther echo in meter
+* @param[in] max_range max. range of a dropped echo in meter
+*/
+void sick_scansegment_xd::DecoderConfig::SetWeatherFilter(bool enable, float max_rssi_ratio, float min_range_gap, float max_range)
+{
+    weather_filter.enabled = enable;
+    weather_filter.max_rssi_ratio = max_rssi_ratio;
+    weather_filter.min_range_gap = min_range_gap;
+    weather_filter.max_range = max_range;
+}
+
+/*
+* @brief Applies the weather filter to the echos of a group (layer) and removes the dropped points.
+* @param[in,out] group scandata of one group
+* @return number of dropped points
+*/
+size_t sick_scansegment_xd::DecoderConfig::ApplyWeatherFilter(ScanSegmentParserOutput::Scangroup& group) const
+{
+    std::vector<ScanSegmentParserOutput::Scanline>& echos = group.scanlines;
+    if (!weather_filter.enabled || echos.size() < 2)
+    {
+        return 0;
+    }
+    size_t num_beams = echos[0].points.size();
+    for (size_t echo_idx = 1; echo_idx < echos.size(); echo_idx++)
+    {
+        num_beams = std::min(num_beams, echos[echo_idx].points.size());
+    }
+    // mark the dropped echos of each beam, then remove them from the scanlines
+    std::vector<std::vector<uint8_t>> drop(echos.size(), std::vector<uint8_t>(num_beams, 0));
+    size_t num_dropped = 0;
+    for (size_t beam_idx = 0; beam_idx < num_beams; beam_idx++)
+    {
+        for (size_t echo_idx = 0; echo_idx < echos.size(); echo_idx++)
+        {
+            const ScanSegmentParserOutput::LidarPoint& echo = echos[echo_idx].points[beam_idx];
+            if (echo.range <= 0 || echo.range > weather_filter.max_range)
+            {
+                continue;
+            }
+            for (size_t other_idx = 0; other_idx < echos.size(); other_idx++)
+            {
+                const ScanSegmentParserOutput::LidarPoint& other = echos[other_idx].points[beam_idx];
+                if (other.range >= echo.range + weather_filter.min_range_gap && other.i > 0 && echo.i <= weather_filter.max_rssi_ratio * other.i)
+                {
+                    drop[echo_idx][beam_idx] = 1;
+                    num_dropped++;
+                    break;
+                }
+            }
+        }
+    }
+    if (num_dropped > 0)
+    {
+        for (size_t echo_idx = 0; echo_idx < echos.size(); echo_idx++)
+        {
+            std::vector<ScanSegmentParserOutput::LidarPoint>& points = echos[echo_idx].points;
+            size_t num_kept = 0;
+            for (size_t point_idx = 0; point_idx < points.size(); point_idx++)
+            {
+                if (point_idx >= num_beams || !drop[echo_idx][point_idx])
+                {
+                    points[num_kept++] = points[point_idx];
+                }
+            }
+            points.resize(num_kept);
+        }
+        weather_filter_dropped += num_dropped;
+    }
+    return num_dropped;
+}
+
+/*
+* @brief Returns the number of points dropped by the weather filter of this config since startup.
+*/
+uint64_t sick_scansegment_xd::DecoderConfig::GetWeatherFilterDropCount() const
+{
+    return weather_filter_dropped.load();
+}
+
+/*
+* @brief Sets the per layer angle corrections, applied in CompactDataParser::Parse() and MsgPackParser::Parse().
+* @param[in] layer_elevation_offset_deg layer_elevation_offset_deg[layer_id] := elevation offset in degree, empty for no correction
+* @param[in] layer_azimuth_offset_deg layer_azimuth_offset_deg[layer_id] := azimuth offset in degree, empty for no correction
+*/
+void sick_scansegment_xd::DecoderConfig::SetLayerCalibration(const std::vector<float>& layer_elevation_offset_deg, const std::vector<float>& layer_azimuth_offset_deg)
+{
+    size_t num_layers = std::max(layer_elevation_offset_deg.size(), layer_azimuth_offset_deg.size());
+    if (layer_calibration.size() < num_layers)
+    {
+        layer_calibration.resize(num_layers);
+    }
+    for (size_t layer_id = 0; layer_id < layer_calibration.size(); layer_id++)
+    {
+        layer_calibration[layer_id].elevation_offset = (layer_id < layer_elevation_offset_deg.size() ? layer_elevation_offset_deg[layer_id] * static_cast<float>(M_PI / 180) : 0.0f);
+        layer_calibration[layer_id].azimuth_offset = (layer_id < layer_azimuth_offset_deg.size() ? layer_azimuth_offset_deg[layer_id] * static_cast<float>(M_PI / 180) : 0.0f);
+    }
+}
+
+/*
+* @brief Sets optional per beam angle corrections of a layer in bins over the full rotation, starting at -180 deg.
+* @param[in] layer_id layer id (groupIdx)
+* @param[in] beam_elevation_offset_deg elevation offset in degree per bin
+* @param[in] beam_azimuth_offset_deg azimuth offset in degree per bin
+*/
+bool sick_scansegment_xd::DecoderConfig::SetBeamCalibration(int layer_id, const std::vector<float>& beam_elevation_offset_deg, const std::vector<float>& beam_azimuth_offset_deg)
+{
+    if (layer_id < 0 || beam_elevation_offset_deg.size() != beam_azimuth_offset_deg.size())
+    {
+        ROS_ERROR_STREAM("## ERROR DecoderConfig::SetBeamCalibration(): invalid calibration of layer " << layer_id << " with " << beam_elevation_offset_deg.size() << " elevation and " << beam_azimuth_offset_deg.size() << " azimuth offsets");
+        return false;
+    }
+    if (layer_calibration.size() <= static_cast<size_t>(layer_id))
+    {
+        layer_calibration.resize(layer_id + 1);
+    }
+    LayerCalibration& calibration = layer_calibration[layer_id];
+    size_t num_beams = beam_elevation_offset_deg.size();
+    calibration.beam_elevation_offset.resize(num_beams);
+    calibration.beam_sin_elevation_offset.resize(num_beams);
+    calibration.beam_cos_elevation_offset.resize(num_beams);
+    calibration.beam_azimuth_offset.resize(num_beams);
+    calibration.beam_scale = static_cast<float>(num_beams / (2 * M_PI));
+    for (size_t beam_idx = 0; beam_idx < num_beams; beam_idx++)
+    {
+        calibration.beam_elevation_offset[beam_idx] = beam_elevation_offset_deg[beam_idx] * static_cast<float>(M_PI / 180);
+        calibration.beam_sin_elevation_offset[beam_idx] = std::sin(calibration.beam_elevation_offset[beam_idx]);
+        calibration.beam_cos_elevation_offset[beam_idx] = std::cos(calibration.beam_elevation_offset[beam_idx]);
+        calibration.beam_azimuth_offset[beam_idx] = beam_azimuth_offset_deg[beam_idx] * static_cast<float>(M_PI / 180);
+    }
+    return true;
+}
+
+/*
+* @brief Loads per layer and optional per beam corrections from a text file.
+* @param[in] filepath calibration file
+* @return true on success, false if the file can't be read or has invalid entries (no corrections are applied)
+*/
+bool sick_scansegment_xd::DecoderConfig::LoadCalibration(const std::string& filepath)
+{
+    std::ifstream fs(filepath);
+    if (!fs.is_open())
+    {
+        ROS_ERROR_STREAM("## ERROR DecoderConfig::LoadCalibration(): can't open file \"" << filepath << "\"");
+        return false;
+    }
+    std::vector<float> layer_elevation_offset_deg, layer_azimuth_offset_deg;
+    std::map<int, std::pair<std::vector<float>, std::vector<float>>> beam_offsets_deg;
+    std::string line;
+    for (int line_cnt = 1; std::getline(fs, line); line_cnt++)
+    {
+        std::istringstream entry(line.substr(0, line.find('#')));
+        std::string type;
+        int layer_id = -1;
+        if (!(entry >> type))
+        {
+            continue; // empty line or comment
+        }
+        bool valid = (entry >> layer_id) && layer_id >= 0 && layer_id < 256;
+        if (valid && type == "layer")
+        {
+            float elevation_offset = 0, azimuth_offset = 0;
+            valid = static_cast<bool>(entry >> elevation_offset >> azimuth_offset);
+            if (valid && layer_elevation_offset_deg.size() <= static_cast<size_t>(layer_id))
+            {
+                layer_elevation_offset_deg.resize(layer_id + 1, 0.0f);
+                layer_azimuth_offset_deg.resize(layer_id + 1, 0.0f);
+            }
+            if (valid)
+            {
+                layer_elevation_offset_deg[layer_id] = elevation_offset;
+                layer_azimuth_offset_deg[layer_id] = azimuth_offset;
+            }
+        }
+        else if (valid && type == "beam")
+        {
+            size_t num_beams = 0;
+            valid = (entry >> num_beams) && num_beams > 0 && num_beams <= 65536;
+            std::vector<float>& elevation_offsets = beam_offsets_deg[layer_id].first;
+            std::vector<float>& azimuth_offsets = beam_offsets_deg[layer_id].second;
+            elevation_offsets.resize(num_beams);
+            azimuth_offsets.resize(num_beams);
+            for (size_t beam_idx = 0; valid && beam_idx < num_beams; beam_idx++)
+            {
+                valid = static_cast<bool>(entry >> elevation_offsets[beam_idx] >> azimuth_offsets[beam_idx]);
+            }
+        }
+        else
+        {
+            valid = false;
+        }
+        if (!valid)
+        {
+            ROS_ERROR_STREAM("## ERROR DecoderConfig::LoadCalibration(): invalid entry in line " << line_cnt << " of file \"" << filepath << "\"");
+            return false;
+        }
+    }
+    layer_calibration.clear();
+    SetLayerCalibration(layer_elevation_offset_deg, layer_azimuth_offset_deg);
+    for (const auto& beam_offsets : beam_offsets_deg)
+    {
+        SetBeamCalibration(beam_offsets.first, beam_offsets.second.first, beam_offsets.second.second);
+    }
+    ROS_INFO_STREAM("DecoderConfig::LoadCalibration(): " << layer_elevation_offset_deg.size() << " layer and " << beam_offsets_deg.size() << " per beam corrections loaded from \"" << filepath << "\"");
+    return true;
+}
+
+/*
+* @brief Returns the corrections of a layer, or nullptr if the layer is not corrected.
+*/
+const sick_scansegment_xd::LayerCalibration* sick_scansegment_xd::DecoderConfig::GetLayerCalibration(int layer_id) const
+{
+    if (layer_id >= 0 && static_cast<size_t>(layer_id) < layer_calibration.size())
+    {
+        const LayerCalibration& calibration = layer_calibration[layer_id];
+        if (calibration.elevation_offset != 0 || calibration.azimuth_offset != 0 || calibration.HasBeams())
+        {
+            return &calibration;
+        }
+    }
+    return nullptr;
+}
+
+/*
+* @brief Sets an optional transform of the cartesian points, applied in CompactDataParser::Parse() and MsgPackParser::Parse() while the points are converted.
+* @param[in] add_transform_xyz_rpy "x,y,z,roll,pitch,yaw" with translation in meter and rotation in radians, "" or "0,0,0,0,0,0" for no transform
+* @return true on success, false if add_transform_xyz_rpy can't be parsed (no transform is applied)
+*/
+bool sick_scansegment_xd::DecoderConfig::SetTransform(const std::string& add_transform_xyz_rpy)
+{
+    transform = CartesianTransform();
+    transform_enabled = false;
+    std::string values = add_transform_xyz_rpy;
+    std::replace(values.begin(), values.end(), ',', ' ');
+    std::istringstream values_stream(values);
+    std::vector<double> xyz_rpy;
+    for (double value = 0; values_stream >> value; )
+    {
+        xyz_rpy.push_back(value);
+    }
+    if (xyz_rpy.empty() && values.find_first_not_of(' ') == std::string::npos)
+    {
+        return true; // no transform
+    }
+    if (xyz_rpy.size() != 6 || !values_stream.eof())
+    {
+        ROS_ERROR_STREAM("## ERROR DecoderConfig::SetTransform(): invalid transform \"" << add_transform_xyz_rpy << "\", expected \"x,y,z,roll,pitch,yaw\"");
+        return false;
+    }
+    double cr = std::cos(xyz_rpy[3]), sr = std::sin(xyz_rpy[3]);
+    double cp = std::cos(xyz_rpy[4]), sp = std::sin(xyz_rpy[4]);
+    double cy = std::cos(xyz_rpy[5]), sy = std::sin(xyz_rpy[5]);
+    double rotation[9] = {
+        cy * cp, cy * sp * sr - sy * cr, cy * sp * cr + sy * sr,
+        sy * cp, sy * sp * sr + cy * cr, sy * sp * cr - cy * sr,
+        -sp,     cp * sr,                cp * cr };
+    for (int n = 0; n < 9; n++)
+    {
+        transform.rotation[n] = static_cast<float>(rotation[n]);
+    }
+    for (int n = 0; n < 3; n++)
+    {
+        transform.translation[n] = static_cast<float>(xyz_rpy[n]);
+    }
+    transform_enabled = (xyz_rpy != std::vector<double>(6, 0.0));
+    return true;
+}
+
+/*
+* @brief Returns the transform of the cartesian points, or nullptr if no transform is applied.
+*/
+const sick_scansegment_xd::CartesianTransform* sick_scansegment_xd::DecoderConfig::GetTransform() const
+{
+    return (transform_enabled ? &transform : nullptr);
+}
+
+/*
+* @brief Return the layer-id of the group_idx-th received group.
+* @param[in] group_idx index of the group in the received scandata
+* @return layer-id, or -1 if group_idx exceeds the number of active layers
+*/
+int sick_scansegment_xd::DecoderConfig::GetLayerIDfromGroupIdx(int group_idx) const
+{
+    if (group_idx < 0)
+    {
+        return -1;
+    }
+    if (!active_layer_ids.empty())
+    {
+        return (static_cast<size_t>(group_idx) < active_layer_ids.size() ? active_layer_ids[group_idx] : -1);
+    }
+    if (!s_layer_elevation_table_mdeg.empty() && static_cast<size_t>(group_idx) >= s_layer_elevation_table_mdeg.size())
+    {
+        return -1; // more groups than layers
+    }
+    return group_idx;
+}
+
 
 /*
 * @brief Parses module measurement data in compact format.
@@ -503,11 +850,15 @@ float sick_scansegment_xd::CompactDataParser::GetElevationDegFromLayerIdx(int la
 * @param[in] num_bytes size of binary payload in bytes
 * @param[in] meta_data module metadata with measurement properties
 * @param[out] measurement_data parsed and converted module measurement data
+* @param[in] decoder_config settings of the sensor which sent the payload (default: 0, i.e. all layers active, no filter)
 * @return true on success, false on error
 */
 bool sick_scansegment_xd::CompactDataParser::ParseModuleMeasurementData(const uint8_t* payload, uint32_t num_bytes, const sick_scansegment_xd::CompactDataHeader& compact_header,
-    const sick_scansegment_xd::CompactModuleMetaData& meta_data, float azimuth_offset, sick_scansegment_xd::CompactModuleMeasurementData& measurement_data)
+    const sick_scansegment_xd::CompactModuleMetaData& meta_data, float azimuth_offset, sick_scansegment_xd::CompactModuleMeasurementData& measurement_data,
+    const DecoderConfig* decoder_config_ptr)
 {
+    static const DecoderConfig s_default_decoder_config;
+    const DecoderConfig& decoder_config = (decoder_config_ptr ? *decoder_config_ptr : s_default_decoder_config);
     measurement_data = sick_scansegment_xd::CompactModuleMeasurementData();
     measurement_data.valid = false;
     if (meta_data.NumberOfLinesInModule < 1 ||
@@ -540,7 +891,13 @@ bool sick_scansegment_xd::CompactDataParser::ParseModuleMeasurementData(const ui
     std::vector<uint64_t> lut_layer_lidar_timestamp_microsec_stop(num_layers);
     std::vector<float> lut_sin_elevation(num_layers);
     std::vector<float> lut_cos_elevation(num_layers);
+    std::vector<float> lut_layer_azimuth_offset(num_layers);
+    std::vector<const LayerCalibration*> lut_beam_calibration(num_layers); // layers with per beam corrections, nullptr otherwise
     std::vector<int> lut_groupIdx(num_layers);
+    const CartesianTransform* transform = decoder_config.GetTransform();
+    const float translation_x = (transform ? transform->translation[0] : 0.0f);
+    const float translation_y = (transform ? transform->translation[1] : 0.0f);
+    const float translation_z = (transform ? transform->translation[2] : 0.0f);
 
     for (uint32_t layer_idx = 0; layer_idx < num_layers; layer_idx++)
     {
@@ -563,9 +920,17 @@ bool sick_scansegment_xd::CompactDataParser::ParseModuleMeasurementData(const ui
         lut_layer_azimuth_delta[layer_idx] = (lut_layer_azimuth_stop[layer_idx] - lut_layer_azimuth_start[layer_idx]) / (float)(std::max(1, (int)meta_data.NumberOfBeamsPerScan - 1));
         lut_layer_lidar_timestamp_microsec_start[layer_idx] = meta_data.TimeStampStart[layer_idx];
         lut_layer_lidar_timestamp_microsec_stop[layer_idx] = meta_data.TimeStampStop[layer_idx];    
+        lut_groupIdx[layer_idx] = decoder_config.GetLayerIDfromElevation(meta_data.Phi[layer_idx]);
+        lut_layer_azimuth_offset[layer_idx] = azimuth_offset;
+        const LayerCalibration* calibration = decoder_config.GetLayerCalibration(lut_groupIdx[layer_idx]);
+        if (calibration) // fold the intrinsic layer corrections into the lookup tables
+        {
+            lut_layer_elevation[layer_idx] += calibration->elevation_offset;
+            lut_layer_azimuth_offset[layer_idx] += calibration->azimuth_offset;
+            lut_beam_calibration[layer_idx] = (calibration->HasBeams() ? calibration : nullptr);
+        }
         lut_sin_elevation[layer_idx] = std::sin(lut_layer_elevation[layer_idx]);
         lut_cos_elevation[layer_idx] = std::cos(lut_layer_elevation[layer_idx]);
-        lut_groupIdx[layer_idx] = GetLayerIDfromElevation(meta_data.Phi[layer_idx]);
     }
     // Parse scan data
     uint32_t byte_cnt = 0;
@@ -635,11 +1000,11 @@ bool sick_scansegment_xd::CompactDataParser::ParseModuleMeasurementData(const ui
                                 << ", point " << point_idx << " of " << meta_data.NumberOfBeamsPerScan);
                             return false;
                         }
-                        azimuth = ((float)readUnsigned<uint16_t>(payload + byte_cnt, &byte_cnt) - 16384.0f) / 5215.0f + azimuth_offset;
+                        azimuth = ((float)readUnsigned<uint16_t>(payload + byte_cnt, &byte_cnt) - 16384.0f) / 5215.0f + lut_layer_azimuth_offset[layer_idx];
                     }
                     else
                     {
-                        azimuth = layer_azimuth_start + point_idx * layer_azimuth_delta + azimuth_offset;
+                        azimuth = layer_azimuth_start + point_idx * layer_azimuth_delta + lut_layer_azimuth_offset[layer_idx];
                     }
                 }
                 if (azim_prop_order[azim_prop_cnt] == READ_BEAM_PROP)
@@ -656,8 +1021,25 @@ bool sick_scansegment_xd::CompactDataParser::ParseModuleMeasurementData(const ui
                     }
                 }
             }
-            float sin_azimuth = std::sin(azimuth);
-            float cos_azimuth = std::cos(azimuth);
+            if (lut_beam_calibration[layer_idx]) // per beam corrections: sin and cos of the elevation by angle addition
+            {
+                const LayerCalibration& calibration = *lut_beam_calibration[layer_idx];
+                size_t beam_idx = calibration.BeamIdx(azimuth);
+                float sin_offset = calibration.beam_sin_elevation_offset[beam_idx];
+                float cos_offset = calibration.beam_cos_elevation_offset[beam_idx];
+                azimuth += calibration.beam_azimuth_offset[beam_idx];
+                layer_elevation = lut_layer_elevation[layer_idx] + calibration.beam_elevation_offset[beam_idx];
+                sin_elevation = lut_sin_elevation[layer_idx] * cos_offset + lut_cos_elevation[layer_idx] * sin_offset;
+                cos_elevation = lut_cos_elevation[layer_idx] * cos_offset - lut_sin_elevation[layer_idx] * sin_offset;
+            }
+            // unit direction of the beam, rotated once for all echos by the optional transform
+            float dir_x = std::cos(azimuth) * cos_elevation;
+            float dir_y = std::sin(azimuth) * cos_elevation;
+            float dir_z = sin_elevation;
+            if (transform)
+            {
+                transform->Rotate(dir_x, dir_y, dir_z);
+            }
             // std::stringstream s;
             // s << "Measurement[" << layer_idx << "," << point_idx << "]=(";
             // for(uint32_t echo_idx = 0; echo_idx < num_echos; echo_idx++)
@@ -668,9 +1050,9 @@ bool sick_scansegment_xd::CompactDataParser::ParseModuleMeasurementData(const ui
             {
                 points[echo_idx].azimuth = azimuth;
                 points[echo_idx].elevation = layer_elevation;
-                points[echo_idx].x = points[echo_idx].range * cos_azimuth * cos_elevation;
-                points[echo_idx].y = points[echo_idx].range * sin_azimuth * cos_elevation;
-                points[echo_idx].z = points[echo_idx].range * sin_elevation;
+                points[echo_idx].x = points[echo_idx].range * dir_x + translation_x;
+                points[echo_idx].y = points[echo_idx].range * dir_y + translation_y;
+                points[echo_idx].z = points[echo_idx].range * dir_z + translation_z;
                 points[echo_idx].echoIdx = echo_idx;
                 points[echo_idx].groupIdx = groupIdx;
                 points[echo_idx].pointIdx = point_idx;
@@ -698,9 +1080,10 @@ bool sick_scansegment_xd::CompactDataParser::ParseModuleMeasurementData(const ui
 * @param[out] num_bytes_required  min number of bytes required for successful parsing
 * @param[in] azimuth_offset optional offset in case of additional coordinate transform (default: 0)
 * @param[in] verbose > 0: print debug messages (default: 0)
+* @param[in] decoder_config settings of the sensor which sent the payload (default: 0, i.e. all layers active, no filter)
 */
 bool sick_scansegment_xd::CompactDataParser::ParseSegment(const uint8_t* payload, size_t bytes_received, sick_scansegment_xd::CompactSegmentData* segment_data,
-    uint32_t& payload_length_bytes, uint32_t& num_bytes_required , float azimuth_offset, int verbose)
+    uint32_t& payload_length_bytes, uint32_t& num_bytes_required , float azimuth_offset, int verbose, const DecoderConfig* decoder_config)
 {
     // Read 32 byte compact data header
     const uint32_t header_size_bytes = 32;
@@ -772,7 +1155,7 @@ bool sick_scansegment_xd::CompactDataParser::ParseSegment(const uint8_t* payload
         {
             sick_scansegment_xd::CompactModuleData segment_module;
             segment_module.moduleMetadata = module_meta_data;
-            sick_scansegment_xd::CompactDataParser::ParseModuleMeasurementData(payload + module_offset + module_metadata_size, module_size - module_metadata_size, compact_header, module_meta_data, azimuth_offset, segment_module.moduleMeasurement);
+            sick_scansegment_xd::CompactDataParser::ParseModuleMeasurementData(payload + module_offset + module_metadata_size, module_size - module_metadata_size, compact_header, module_meta_data, azimuth_offset, segment_module.moduleMeasurement, decoder_config);
             if (verbose > 0)
             {
                 ROS_INFO_STREAM("CompactDataParser::ParseSegment(): module measurement data = { " << segment_module.moduleMeasurement.to_string() << " }");
@@ -863,20 +1246,25 @@ return success;
 * @param[in] parser_config configuration and settings for multiScan and picoScan parser
 * @param[in] segment_data binary segment data in compact format
 * @param[in] system_timestamp receive timestamp of segment_data (system time)
-* @param[in] add_transform_xyz_rpy Optionally apply an additional transform to the cartesian pointcloud, default: "0,0,0,0,0,0" (i.e. no transform)
+* An optional transform of the cartesian pointcloud is configured by DecoderConfig::SetTransform()
 * @param[out] result scandata converted to ScanSegmentParserOutput
 * @param[in] use_software_pll true (default): result timestamp from sensor ticks by software pll, false: result timestamp from msg receiving
 * @param[in] verbose true: enable debug output, false: quiet mode
+* @param[in] software_pll pll of the sensor which sent the payload (default: 0, i.e. the process wide SoftwarePLL::instance())
+* @param[in] decoder_config settings of the sensor which sent the payload (default: 0, i.e. all layers active, no filter)
 */
 bool sick_scansegment_xd::CompactDataParser::Parse(const std::vector<uint8_t>& payload, fifo_timestamp system_timestamp, 
-    ScanSegmentParserOutput& result, int imu_latency_microsec, bool use_software_pll, bool verbose)
+    ScanSegmentParserOutput& result, int imu_latency_microsec, bool use_software_pll, bool verbose, SoftwarePLL* software_pll_ptr,
+    const DecoderConfig* decoder_config_ptr)
 {
     (void)verbose;
+    static const DecoderConfig s_default_decoder_config;
+    const DecoderConfig& decoder_config = (decoder_config_ptr ? (*decoder_config_ptr) : s_default_decoder_config);
 
     // Parse segment data
     sick_scansegment_xd::CompactSegmentData segment_data;
     uint32_t payload_length_bytes = 0, num_bytes_required  = 0;
-    if (!sick_scansegment_xd::CompactDataParser::ParseSegment(payload.data(), payload.size(), &segment_data, payload_length_bytes, num_bytes_required))
+    if (!sick_scansegment_xd::CompactDataParser::ParseSegment(payload.data(), payload.size(), &segment_data, payload_length_bytes, num_bytes_required, 0, 0, &decoder_config))
     {
         ROS_ERROR_STREAM("## ERROR CompactDataParser::Parse(): CompactDataParser::ParseSegment() failed, payload = " << sick_scansegment_xd::UdpReceiver::ToHexString(payload, payload.size()));
         return false;
@@ -899,18 +1287,8 @@ bool sick_scansegment_xd::CompactDataParser::Parse(const std::vector<uint8_t>& p
         for (size_t measurement_idx = 0; measurement_idx < moduleMeasurement.scandata.size(); measurement_idx++)
         {
             ScanSegmentParserOutput::Scangroup& scandata = moduleMeasurement.scandata[measurement_idx];
-            // Apply optional range filter and optional transform
-            for(size_t line_idx = 0; line_idx < scandata.scanlines.size(); line_idx++)
-            {
-                std::vector<ScanSegmentParserOutput::LidarPoint>& points_in = scandata.scanlines[line_idx].points;
-                std::vector<ScanSegmentParserOutput::LidarPoint> points_out;
-                points_out.reserve(points_in.size());
-                for(size_t point_idx = 0; point_idx < points_in.size(); point_idx++)
-                {
-                    points_out.push_back(points_in[point_idx]);
-                }
-                scandata.scanlines[line_idx].points = points_out;
-            }
+            // Apply optional weather filter, which needs all echos of a beam
+            decoder_config.ApplyWeatherFilter(scandata);
             // result.scandata.push_back(scandata);
             // Reorder lidar points by layer id (groupIdx) and echoIdx (identical to the msgpack scandata)
             // result.scandata[groupIdx] = all scandata of layer <groupIdx> appended to one scanline
@@ -970,7 +1348,7 @@ bool sick_scansegment_xd::CompactDataParser::Parse(const std::vector<uint8_t>& p
     result.timestamp_nsec= 1000 * (sensor_timeStamp % 1000000);
     if (use_software_pll)
     {
-        SoftwarePLL& software_pll = SoftwarePLL::instance();
+        SoftwarePLL& software_pll = (software_pll_ptr ? *software_pll_ptr : SoftwarePLL::instance());
         int64_t systemtime_nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(system_timestamp.time_since_epoch()).count();
         uint32_t systemtime_sec = (uint32_t)(systemtime_nanoseconds / 1000000000);  // seconds part of system timestamp
         uint32_t systemtime_nsec = (uint32_t)(systemtime_nanoseconds % 1000000000); // nanoseconds part of system timestamp
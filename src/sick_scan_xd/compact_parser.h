@@ -55,10 +55,13 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "common.h"
 #include "fifo.h"
 #include "scansegment_parser_output.h"
 
+class SoftwarePLL;
 
 namespace sick_scansegment_xd
 {
@@ -136,6 +139,160 @@ namespace sick_scansegment_xd
         std::vector<CompactModuleData> segmentModules;
     }; // class CompactSegmentData
 
+    /*
+    * @brief class LayerCalibration contains the intrinsic angle corrections of a layer in radians. The layer offsets are folded
+    * into the per layer lookup tables of the parsers. Optional per beam offsets are stored in bins over the full rotation
+    * (starting at -180 deg) as sin and cos of the elevation offset, so the corrected elevation needs no trigonometric functions.
+    */
+    class LayerCalibration
+    {
+    public:
+        float elevation_offset = 0;                       // added to the elevation of all points of the layer
+        float azimuth_offset = 0;                         // added to the azimuth of all points of the layer
+        std::vector<float> beam_elevation_offset;         // per beam elevation offsets, empty if no per beam correction
+        std::vector<float> beam_sin_elevation_offset;     // sin(beam_elevation_offset)
+        std::vector<float> beam_cos_elevation_offset;     // cos(beam_elevation_offset)
+        std::vector<float> beam_azimuth_offset;           // per beam azimuth offsets
+        float beam_scale = 0;                             // number of beams / (2 * pi)
+        bool HasBeams() const { return !beam_elevation_offset.empty(); }
+        size_t BeamIdx(float azimuth) const               // bin of an azimuth in radians (incl. the layer offset)
+        {
+            long idx = static_cast<long>(std::floor((azimuth + static_cast<float>(M_PI)) * beam_scale)) % static_cast<long>(beam_elevation_offset.size());
+            return static_cast<size_t>(idx < 0 ? idx + static_cast<long>(beam_elevation_offset.size()) : idx);
+        }
+    }; // class LayerCalibration
+
+    /*
+    * @brief class CartesianTransform is an optional sensor to vehicle transform (3x3 rotation and translation), which the parsers
+    * apply to the unit direction of each beam before it is scaled by the ranges of its echos.
+    */
+    class CartesianTransform
+    {
+    public:
+        float rotation[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 }; // row major rotation matrix R = Rz(yaw) * Ry(pitch) * Rx(roll)
+        float translation[3] = { 0, 0, 0 };               // translation in meter
+        void Rotate(float& x, float& y, float& z) const   // (x, y, z) := R * (x, y, z)
+        {
+            float rx = rotation[0] * x + rotation[1] * y + rotation[2] * z;
+            float ry = rotation[3] * x + rotation[4] * y + rotation[5] * z;
+            float rz = rotation[6] * x + rotation[7] * y + rotation[8] * z;
+            x = rx;
+            y = ry;
+            z = rz;
+        }
+    }; // class CartesianTransform
+
+    /*
+    * @brief class DecoderConfig contains the per sensor settings of CompactDataParser::Parse() and MsgPackParser::Parse().
+    * Each sensor owns its config and passes it to the parsers like its SoftwarePLL, without config all layers are active,
+    * all echos are kept and neither angle corrections nor a transform are applied.
+    */
+    class DecoderConfig
+    {
+    public:
+
+        /*
+        * @brief Sets the layers enabled by a sensor side layer filter (LFPlayerFilter). Disabled layers are not transmitted,
+        * so the layer ids of received groups are searched among the active layers only.
+        * @param[in] layer_active layer_active[layer_idx] := 0 for disabled or 1 for enabled layer, empty for all layers
+        */
+        void SetActiveLayers(const std::vector<int>& layer_active);
+
+        /*
+        * @brief Return the layer-id of the group_idx-th received group, i.e. group_idx if all layers are active,
+        * otherwise the group_idx-th active layer
+        * @param[in] group_idx index of the group in the received scandata
+        * @return layer-id, or -1 if group_idx exceeds the number of active layers
+        */
+        int GetLayerIDfromGroupIdx(int group_idx) const;
+
+        /*
+        * @brief Return a layer-id from a given elevation angle, i.e. the active layer with the nearest elevation
+        * (see CompactDataParser::SetLayerElevationTable())
+        * @param[in] layer_elevation_rad layer_elevation in radians
+        * @return layer-id
+        */
+        int GetLayerIDfromElevation(float layer_elevation_rad) const;
+
+        /*
+        * @brief Configures the multi-echo weather filter. With more than one echo per beam, rain, fog and dust show up as weak
+        * early echos followed by a strong later echo. An echo closer than max_range is dropped, if another echo of the same beam
+        * is at least min_range_gap farther away and its rssi is at least 1 / max_rssi_ratio times higher.
+        * @param[in] enable true: drop echos in CompactDataParser::Parse() and MsgPackParser::Parse(), false: keep all echos (default)
+        * @param[in] max_rssi_ratio max. rssi of a dropped echo relative to the farther echo
+        * @param[in] min_range_gap min. range difference to the farther echo in meter
+        * @param[in] max_range max. range of a dropped echo in meter
+        */
+        void SetWeatherFilter(bool enable, float max_rssi_ratio = 0.25f, float min_range_gap = 0.5f, float max_range = 30.0f);
+
+        /*
+        * @brief Applies the weather filter to the echos of a group (layer) and removes the dropped points. The scanlines of the group
+        * are its echos, points with the same index in all scanlines are the echos of one beam. Does nothing if the filter is disabled.
+        * @param[in,out] group scandata of one group
+        * @return number of dropped points
+        */
+        size_t ApplyWeatherFilter(ScanSegmentParserOutput::Scangroup& group) const;
+
+        /*
+        * @brief Returns the number of points dropped by the weather filter of this config since startup.
+        */
+        uint64_t GetWeatherFilterDropCount() const;
+
+        /*
+        * @brief Sets the per layer angle corrections, applied in CompactDataParser::Parse() and MsgPackParser::Parse().
+        * @param[in] layer_elevation_offset_deg layer_elevation_offset_deg[layer_id] := elevation offset in degree, empty for no correction
+        * @param[in] layer_azimuth_offset_deg layer_azimuth_offset_deg[layer_id] := azimuth offset in degree, empty for no correction
+        */
+        void SetLayerCalibration(const std::vector<float>& layer_elevation_offset_deg, const std::vector<float>& layer_azimuth_offset_deg);
+
+        /*
+        * @brief Sets optional per beam angle corrections of a layer in bins over the full rotation, starting at -180 deg.
+        * Both tables must have the same size, empty tables remove the per beam correction of the layer.
+        * @param[in] layer_id layer id (groupIdx)
+        * @param[in] beam_elevation_offset_deg elevation offset in degree per bin
+        * @param[in] beam_azimuth_offset_deg azimuth offset in degree per bin
+        */
+        bool SetBeamCalibration(int layer_id, const std::vector<float>& beam_elevation_offset_deg, const std::vector<float>& beam_azimuth_offset_deg);
+
+        /*
+        * @brief Loads per layer and optional per beam corrections from a text file. Angles are given in degree, '#' starts a comment:
+        *   layer <layer id> <elevation offset> <azimuth offset>
+        *   beam <layer id> <number of bins n> <elevation offset 0> <azimuth offset 0> ... <elevation offset n-1> <azimuth offset n-1>
+        * Layers not listed are not corrected.
+        * @param[in] filepath calibration file
+        * @return true on success, false if the file can't be read or has invalid entries (no corrections are applied)
+        */
+        bool LoadCalibration(const std::string& filepath);
+
+        /*
+        * @brief Returns the corrections of a layer, or nullptr if the layer is not corrected.
+        */
+        const LayerCalibration* GetLayerCalibration(int layer_id) const;
+
+        /*
+        * @brief Sets an optional transform of the cartesian points, applied in CompactDataParser::Parse() and MsgPackParser::Parse() while the points
+        * are converted. Points without echo (range 0) are mapped to the translation.
+        * @param[in] add_transform_xyz_rpy "x,y,z,roll,pitch,yaw" with translation in meter and rotation in radians, "" or "0,0,0,0,0,0" for no transform
+        * @return true on success, false if add_transform_xyz_rpy can't be parsed (no transform is applied)
+        */
+        bool SetTransform(const std::string& add_transform_xyz_rpy);
+
+        /*
+        * @brief Returns the transform of the cartesian points, or nullptr if no transform is applied.
+        */
+        const CartesianTransform* GetTransform() const;
+
+    protected:
+
+        std::vector<int> active_layer_ids; // Layer ids enabled by a sensor side layer filter in ascending order, empty if all layers are active
+        struct { bool enabled = false; float max_rssi_ratio = 0.25f; float min_range_gap = 0.5f; float max_range = 30.0f; } weather_filter; // see SetWeatherFilter()
+        mutable std::atomic<uint64_t> weather_filter_dropped{ 0 }; // counted while parsing, the config is passed read only
+        std::vector<LayerCalibration> layer_calibration; // layer_calibration[layer_id] := intrinsic corrections of a layer, empty if not calibrated
+        CartesianTransform transform;   // optional transform of the cartesian points, see SetTransform()
+        bool transform_enabled = false;
+
+    }; // class DecoderConfig
+
     /*
     * @brief class CompactDataParser parses scandata in compact format
     */
@@ -164,10 +321,12 @@ namespace sick_scansegment_xd
         * @param[in] num_bytes size of binary payload in bytes
         * @param[in] meta_data module metadata with measurement properties
         * @param[out] measurement_data parsed and converted module measurement data
+        * @param[in] decoder_config settings of the sensor which sent the payload (default: 0, i.e. all layers active, no filter)
         * @return true on success, false on error
         */
         static bool ParseModuleMeasurementData(const uint8_t* payload, uint32_t num_bytes, const sick_scansegment_xd::CompactDataHeader& compact_header, 
-            const sick_scansegment_xd::CompactModuleMetaData& meta_data, float azimuth_offset, sick_scansegment_xd::CompactModuleMeasurementData& measurement_data);
+            const sick_scansegment_xd::CompactModuleMetaData& meta_data, float azimuth_offset, sick_scansegment_xd::CompactModuleMeasurementData& measurement_data,
+            const DecoderConfig* decoder_config = 0);
 
         /*
         * @brief Parses a scandata segment in compact format.
@@ -178,22 +337,27 @@ namespace sick_scansegment_xd
         * @param[out] num_bytes_required  min number of bytes required for successful parsing
         * @param[in] azimuth_offset optional offset in case of additional coordinate transform (default: 0)
         * @param[in] verbose > 0: print debug messages (default: 0)
+        * @param[in] decoder_config settings of the sensor which sent the payload (default: 0, i.e. all layers active, no filter)
         */
         static bool ParseSegment(const uint8_t* payload, size_t bytes_received, sick_scansegment_xd::CompactSegmentData* segment_data,
-            uint32_t& payload_length_bytes, uint32_t& num_bytes_required , float azimuth_offset = 0, int verbose = 0);
+            uint32_t& payload_length_bytes, uint32_t& num_bytes_required , float azimuth_offset = 0, int verbose = 0,
+            const DecoderConfig* decoder_config = 0);
 
         /*
         * @brief Parses a scandata segment in compact format.
         * @param[in] parser_config configuration and settings for multiScan and picoScan parser
         * @param[in] payload binary segment data in compact format
         * @param[in] system_timestamp receive timestamp of segment_data (system time)
-        * @param[in] add_transform_xyz_rpy Optionally apply an additional transform to the cartesian pointcloud, default: "0,0,0,0,0,0" (i.e. no transform)
+        * An optional transform of the cartesian pointcloud is configured by DecoderConfig::SetTransform()
         * @param[out] result scandata converted to ScanSegmentParserOutput
         * @param[in] use_software_pll true (default): result timestamp from sensor ticks by software pll, false: result timestamp from msg receiving
         * @param[in] verbose true: enable debug output, false: quiet mode
+        * @param[in] software_pll pll of the sensor which sent the payload (default: 0, i.e. the process wide SoftwarePLL::instance())
+        * @param[in] decoder_config settings of the sensor which sent the payload (default: 0, i.e. all layers active, no filter)
         */
         static bool Parse(const std::vector<uint8_t>& payload, fifo_timestamp system_timestamp, 
-            ScanSegmentParserOutput& result, int imu_latency_microsec = 0, bool use_software_pll = true, bool verbose = false);
+            ScanSegmentParserOutput& result, int imu_latency_microsec = 0, bool use_software_pll = true, bool verbose = false,
+            SoftwarePLL* software_pll = 0, const DecoderConfig* decoder_config = 0);
 
         /*
         * @brief Sets the elevation in mdeg for layers in compact format.
@@ -201,15 +365,6 @@ namespace sick_scansegment_xd
         */
         static void SetLayerElevationTable(const std::vector<int>& layer_elevation_table_mdeg);
 
-        /*
-        * @brief Return a layer-id from a given elevation angle. See compact scanformat documention:
-        * The line/layer index in the figure below is not a layer id according to layer numbering for multi layer sensors.
-        * Therefore this functions returns a layer-id from the elevation angle in rad.
-        * @param[in] layer_elevation_rad layer_elevation in radians
-        * @return layer-id
-        */
-        static int GetLayerIDfromElevation(float layer_elevation_rad);
-
         /*
         * @brief Return the typical (default) elevation of a given layer index
         * @param[in] layer_idx layer index
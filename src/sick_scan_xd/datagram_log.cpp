@@ -0,0 +1,303 @@
+/*
+ * @brief datagram_log reads recorded udp datagrams from pcap files or raw datagram logs,
+ * and writes raw datagram logs. See datagram_log.h for the file formats.
+ */
+#include <cstring>
+
+#include "datagram_log.h"
+#include "sick_ros_wrapper.h"
+
+static const char s_raw_log_magic[8] = { 'M', 'S', 'D', 'G', 'L', 'O', 'G', '1' };
+static const size_t s_max_ip_fragment_sets = 64;     // incomplete fragment sets kept for reassembly
+static const uint32_t s_max_datagram_size = 0x10000; // max. size of an udp datagram
+
+static uint16_t readBE16(const uint8_t* p) { return (uint16_t)((p[0] << 8) | p[1]); }
+static uint32_t readBE32(const uint8_t* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3]; }
+
+static uint32_t readU32(const uint8_t* p, bool swapped)
+{
+    uint32_t val = 0;
+    memcpy(&val, p, sizeof(val));
+    if (swapped)
+        val = ((val & 0xFF) << 24) | ((val & 0xFF00) << 8) | ((val >> 8) & 0xFF00) | (val >> 24);
+    return val;
+}
+
+template<typename T> static void writeLE(std::ofstream& ostream, T val)
+{
+    uint8_t bytes[sizeof(T)];
+    for (size_t n = 0; n < sizeof(T); n++)
+        bytes[n] = (uint8_t)((val >> (8 * n)) & 0xFF);
+    ostream.write((const char*)bytes, sizeof(T));
+}
+
+template<typename T> static bool readLE(std::ifstream& istream, T& val)
+{
+    uint8_t bytes[sizeof(T)];
+    if (!istream.read((char*)bytes, sizeof(T)))
+        return false;
+    val = 0;
+    for (size_t n = 0; n < sizeof(T); n++)
+        val |= ((T)bytes[n] << (8 * n));
+    return true;
+}
+
+/*
+ * @brief opens a pcap file or raw datagram log, the format is detected by its magic number.
+ */
+bool sick_scansegment_xd::DatagramLogReader::Open(const std::string& filepath, int udp_port)
+{
+    m_istream = std::ifstream(filepath, std::ios::binary);
+    m_udp_port = udp_port;
+    m_num_skipped = 0;
+    m_ip_fragments.clear();
+    if (!m_istream.is_open())
+    {
+        ROS_ERROR_STREAM("## ERROR DatagramLogReader::Open(): can't open file \"" << filepath << "\"");
+        return false;
+    }
+    uint8_t magic[8] = { 0 };
+    if (!m_istream.read((char*)magic, 4))
+    {
+        ROS_ERROR_STREAM("## ERROR DatagramLogReader::Open(): \"" << filepath << "\" is empty");
+        return false;
+    }
+    uint32_t magic_le = (uint32_t)magic[0] | ((uint32_t)magic[1] << 8) | ((uint32_t)magic[2] << 16) | ((uint32_t)magic[3] << 24);
+    if (magic_le == 0xa1b2c3d4 || magic_le == 0xd4c3b2a1 || magic_le == 0xa1b23c4d || magic_le == 0x4d3cb2a1)
+    {
+        uint8_t header[20];
+        if (!m_istream.read((char*)header, sizeof(header)))
+            return false;
+        m_is_pcap = true;
+        m_pcap_swapped = (magic_le == 0xd4c3b2a1 || magic_le == 0x4d3cb2a1);
+        m_pcap_nanosec = (magic_le == 0xa1b23c4d || magic_le == 0x4d3cb2a1);
+        m_pcap_linktype = readU32(header + 16, m_pcap_swapped) & 0xFFFF;
+        return true;
+    }
+    if (m_istream.read((char*)magic + 4, 4) && memcmp(magic, s_raw_log_magic, sizeof(s_raw_log_magic)) == 0)
+    {
+        m_is_pcap = false;
+        return true;
+    }
+    ROS_ERROR_STREAM("## ERROR DatagramLogReader::Open(): \"" << filepath << "\" is neither a pcap file nor a raw datagram log");
+    m_istream.close();
+    return false;
+}
+
+/*
+ * @brief reads the next datagram.
+ */
+bool sick_scansegment_xd::DatagramLogReader::Next(LoggedDatagram& datagram)
+{
+    if (!m_istream.is_open())
+        return false;
+    return m_is_pcap ? NextPcap(datagram) : NextRaw(datagram);
+}
+
+/*
+ * @brief reads all remaining datagrams.
+ */
+std::vector<sick_scansegment_xd::LoggedDatagram> sick_scansegment_xd::DatagramLogReader::ReadAll()
+{
+    std::vector<LoggedDatagram> datagrams;
+    LoggedDatagram datagram;
+    while (Next(datagram))
+        datagrams.push_back(std::move(datagram));
+    return datagrams;
+}
+
+bool sick_scansegment_xd::DatagramLogReader::NextRaw(LoggedDatagram& datagram)
+{
+    uint32_t num_bytes = 0;
+    if (!readLE(m_istream, datagram.timestamp_nsec) || !readLE(m_istream, num_bytes))
+        return false;
+    if (num_bytes > s_max_datagram_size)
+    {
+        ROS_ERROR_STREAM("## ERROR DatagramLogReader::NextRaw(): invalid record size " << num_bytes << ", raw datagram log corrupted");
+        return false;
+    }
+    datagram.payload.resize(num_bytes);
+    return (bool)m_istream.read((char*)datagram.payload.data(), num_bytes);
+}
+
+bool sick_scansegment_xd::DatagramLogReader::NextPcap(LoggedDatagram& datagram)
+{
+    uint8_t record_header[16];
+    std::vector<uint8_t> packet;
+    while (m_istream.read((char*)record_header, sizeof(record_header)))
+    {
+        uint32_t ts_sec = readU32(record_header + 0, m_pcap_swapped);
+        uint32_t ts_frac = readU32(record_header + 4, m_pcap_swapped);
+        uint32_t incl_len = readU32(record_header + 8, m_pcap_swapped);
+        if (incl_len > 0x40000)
+        {
+            ROS_ERROR_STREAM("## ERROR DatagramLogReader::NextPcap(): invalid packet size " << incl_len << ", pcap file corrupted");
+            return false;
+        }
+        packet.resize(incl_len);
+        if (!m_istream.read((char*)packet.data(), incl_len))
+            return false;
+        uint64_t timestamp_nsec = (uint64_t)ts_sec * 1000000000ULL + (uint64_t)ts_frac * (m_pcap_nanosec ? 1ULL : 1000ULL);
+        if (DecodePcapPacket(packet, timestamp_nsec, datagram))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * @brief decodes link layer, ipv4 and udp header of a captured packet. Returns true if a complete udp datagram
+ * to the configured port is available (after reassembly of ip fragments if required).
+ */
+bool sick_scansegment_xd::DatagramLogReader::DecodePcapPacket(const std::vector<uint8_t>& packet, uint64_t timestamp_nsec, LoggedDatagram& datagram)
+{
+    size_t ip_offset = 0;
+    uint16_t ethertype = 0x0800;
+    switch (m_pcap_linktype)
+    {
+    case 1: // ethernet
+        if (packet.size() < 14)
+            return false;
+        ip_offset = 14;
+        ethertype = readBE16(packet.data() + 12);
+        while (ethertype == 0x8100 && packet.size() >= ip_offset + 4) // vlan tag(s)
+        {
+            ethertype = readBE16(packet.data() + ip_offset + 2);
+            ip_offset += 4;
+        }
+        break;
+    case 113: // linux cooked capture
+        if (packet.size() < 16)
+            return false;
+        ip_offset = 16;
+        ethertype = readBE16(packet.data() + 14);
+        break;
+    case 276: // linux cooked capture v2
+        if (packet.size() < 20)
+            return false;
+        ip_offset = 20;
+        ethertype = readBE16(packet.data() + 0);
+        break;
+    case 0: // bsd loopback, address family in host byte order
+        if (packet.size() < 4)
+            return false;
+        ip_offset = 4;
+        ethertype = (readU32(packet.data(), m_pcap_swapped) == 2) ? 0x0800 : 0;
+        break;
+    case 12:
+    case 101: // raw ip
+        ip_offset = 0;
+        break;
+    default:
+        m_num_skipped++;
+        return false;
+    }
+    if (ethertype != 0x0800 || packet.size() < ip_offset + 20 || (packet[ip_offset] >> 4) != 4)
+    {
+        m_num_skipped++;
+        return false;
+    }
+
+    // ipv4 header
+    const uint8_t* ip = packet.data() + ip_offset;
+    uint32_t ip_header_len = 4 * (ip[0] & 0x0F);
+    uint32_t ip_total_len = readBE16(ip + 2);
+    uint16_t ip_id = readBE16(ip + 4);
+    uint16_t ip_flags_offset = readBE16(ip + 6);
+    bool more_fragments = (ip_flags_offset & 0x2000) != 0;
+    uint32_t fragment_offset = 8 * (ip_flags_offset & 0x1FFF);
+    if (ip[9] != 17 || ip_header_len < 20 || ip_total_len < ip_header_len || ip_offset + ip_total_len > packet.size())
+    {
+        m_num_skipped++;
+        return false;
+    }
+    const uint8_t* ip_payload = ip + ip_header_len;
+    uint32_t ip_payload_len = ip_total_len - ip_header_len;
+
+    std::vector<uint8_t> udp_datagram;
+    if (!more_fragments && fragment_offset == 0)
+    {
+        udp_datagram.assign(ip_payload, ip_payload + ip_payload_len);
+    }
+    else
+    {
+        auto key = std::make_tuple(readBE32(ip + 12), readBE32(ip + 16), ip_id);
+        IpFragments& fragments = m_ip_fragments[key];
+        if (fragments.fragments.empty())
+            fragments.timestamp_nsec = timestamp_nsec;
+        fragments.fragments[fragment_offset].assign(ip_payload, ip_payload + ip_payload_len);
+        if (!more_fragments)
+            fragments.total_length = fragment_offset + ip_payload_len;
+        // complete if all fragments from 0 to total_length are contiguous
+        uint32_t contiguous_len = 0;
+        for (const auto& fragment : fragments.fragments)
+        {
+            if (fragment.first != contiguous_len)
+                break;
+            contiguous_len += (uint32_t)fragment.second.size();
+        }
+        if (fragments.total_length == 0 || contiguous_len < fragments.total_length)
+        {
+            if (m_ip_fragments.size() > s_max_ip_fragment_sets) // drop the oldest incomplete datagram
+            {
+                auto oldest = m_ip_fragments.begin();
+                for (auto iter = m_ip_fragments.begin(); iter != m_ip_fragments.end(); iter++)
+                    if (iter->second.timestamp_nsec < oldest->second.timestamp_nsec)
+                        oldest = iter;
+                m_ip_fragments.erase(oldest);
+                m_num_skipped++;
+            }
+            return false;
+        }
+        udp_datagram.reserve(fragments.total_length);
+        for (const auto& fragment : fragments.fragments)
+            udp_datagram.insert(udp_datagram.end(), fragment.second.begin(), fragment.second.end());
+        m_ip_fragments.erase(key);
+    }
+
+    // udp header
+    if (udp_datagram.size() < 8)
+    {
+        m_num_skipped++;
+        return false;
+    }
+    uint16_t dst_port = readBE16(udp_datagram.data() + 2);
+    uint16_t udp_len = readBE16(udp_datagram.data() + 4);
+    if (m_udp_port > 0 && dst_port != m_udp_port)
+        return false;
+    if (udp_len < 8 || udp_len > udp_datagram.size())
+    {
+        m_num_skipped++;
+        return false;
+    }
+    datagram.timestamp_nsec = timestamp_nsec;
+    datagram.payload.assign(udp_datagram.begin() + 8, udp_datagram.begin() + udp_len);
+    return true;
+}
+
+bool sick_scansegment_xd::DatagramLogWriter::Open(const std::string& filepath)
+{
+    m_ostream = std::ofstream(filepath, std::ios::binary | std::ios::trunc);
+    if (!m_ostream.is_open())
+    {
+        ROS_ERROR_STREAM("## ERROR DatagramLogWriter::Open(): can't open file \"" << filepath << "\"");
+        return false;
+    }
+    m_ostream.write(s_raw_log_magic, sizeof(s_raw_log_magic));
+    return (bool)m_ostream;
+}
+
+bool sick_scansegment_xd::DatagramLogWriter::Write(uint64_t timestamp_nsec, const uint8_t* payload, uint32_t num_bytes)
+{
+    if (!m_ostream.is_open())
+        return false;
+    writeLE(m_ostream, timestamp_nsec);
+    writeLE(m_ostream, num_bytes);
+    m_ostream.write((const char*)payload, num_bytes);
+    return (bool)m_ostream;
+}
+
+void sick_scansegment_xd::DatagramLogWriter::Close()
+{
+    if (m_ostream.is_open())
+        m_ostream.close();
+}
@@ -0,0 +1,110 @@
+/*
+ * @brief datagram_log reads recorded udp datagrams from pcap files or raw datagram logs,
+ * and writes raw datagram logs.
+ *
+ * Raw datagram log format (all values little endian):
+ *   8 byte magic "MSDGLOG1"
+ *   followed by records of
+ *     uint64_t receive timestamp in nanoseconds since epoch (system time)
+ *     uint32_t number of payload bytes
+ *     payload (udp payload, i.e. starting with 0x02020202 for compact and msgpack segments)
+ *
+ * pcap files (microsecond or nanosecond resolution, either byte order) with ethernet, linux cooked
+ * or raw ip link layer are supported. IPv4 fragments are reassembled, and only udp datagrams to
+ * the given destination port are returned.
+ */
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace sick_scansegment_xd
+{
+    /*
+     * @brief a single recorded udp datagram
+     */
+    struct LoggedDatagram
+    {
+        uint64_t timestamp_nsec = 0;   // receive timestamp (system time) in nanoseconds since epoch
+        std::vector<uint8_t> payload;  // udp payload
+    };
+
+    /*
+     * @brief class DatagramLogReader reads udp datagrams from a pcap file or a raw datagram log.
+     */
+    class DatagramLogReader
+    {
+    public:
+
+        /*
+         * @brief opens a pcap file or raw datagram log, the format is detected by its magic number.
+         * @param[in] filepath input file
+         * @param[in] udp_port destination port of datagrams to return (pcap only, 0: all udp datagrams)
+         * @return true on success, false if the file can't be opened or has an unknown format
+         */
+        bool Open(const std::string& filepath, int udp_port = 2115);
+
+        /*
+         * @brief reads the next datagram.
+         * @param[out] datagram next datagram
+         * @return true on success, false at end of file or on error
+         */
+        bool Next(LoggedDatagram& datagram);
+
+        /*
+         * @brief reads all remaining datagrams.
+         */
+        std::vector<LoggedDatagram> ReadAll();
+
+        bool IsPcap() const { return m_is_pcap; }
+        size_t NumSkippedPackets() const { return m_num_skipped; }
+
+    protected:
+
+        bool NextRaw(LoggedDatagram& datagram);
+        bool NextPcap(LoggedDatagram& datagram);
+        bool DecodePcapPacket(const std::vector<uint8_t>& packet, uint64_t timestamp_nsec, LoggedDatagram& datagram);
+
+        std::ifstream m_istream;
+        bool m_is_pcap = false;
+        bool m_pcap_swapped = false;     // pcap written with opposite byte order
+        bool m_pcap_nanosec = false;     // pcap with nanosecond timestamps
+        uint32_t m_pcap_linktype = 0;
+        int m_udp_port = 0;
+        size_t m_num_skipped = 0;
+
+        // ipv4 fragments in reassembly, key: (src, dst, identification)
+        struct IpFragments
+        {
+            std::map<uint32_t, std::vector<uint8_t>> fragments; // fragment offset in bytes -> fragment payload
+            uint32_t total_length = 0;                          // known when the last fragment was received, 0 otherwise
+            uint64_t timestamp_nsec = 0;
+        };
+        std::map<std::tuple<uint32_t, uint32_t, uint16_t>, IpFragments> m_ip_fragments;
+    };
+
+    /*
+     * @brief class DatagramLogWriter writes udp datagrams to a raw datagram log.
+     */
+    class DatagramLogWriter
+    {
+    public:
+
+        bool Open(const std::string& filepath);
+
+        bool Write(uint64_t timestamp_nsec, const uint8_t* payload, uint32_t num_bytes);
+
+        void Close();
+
+        bool IsOpen() const { return m_ostream.is_open(); }
+
+    protected:
+
+        std::ofstream m_ostream;
+    };
+
+} // namespace sick_scansegment_xd
@@ -0,0 +1,362 @@
+/*
+ * @brief frame_ring passes decoded frames to local processes through POSIX shared memory.
+ * See frame_ring.h for the layout.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "frame_ring.h"
+#include "packed_point.h"
+#include "sick_ros_wrapper.h"
+
+static const char s_frame_ring_magic[8] = { 'M', 'S', 'R', 'I', 'N', 'G', '1', 0 };
+static const uint32_t s_frame_ring_version = 2;
+static const uint32_t s_point_size = sizeof(sick_scansegment_xd::PackedPoint);
+static const uint64_t s_header_size = 4096;   // one page, mapped writeable by readers
+static const uint64_t s_slot_header_size = 64;
+
+namespace sick_scansegment_xd
+{
+    struct FrameRingHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t header_size;
+        uint32_t num_slots;
+        uint32_t point_size;
+        uint64_t slot_size;
+        uint64_t max_points;
+        std::atomic<uint64_t> frames_written;
+        std::atomic<uint32_t> futex_word;
+        std::atomic<uint32_t> num_waiters;
+        std::atomic<uint32_t> writer_active;
+    };
+
+    struct FrameRingSlotHeader
+    {
+        std::atomic<uint64_t> sequence;
+        uint64_t frame_number;
+        uint64_t timestamp_nsec;
+        uint64_t write_steady_nsec;
+        uint64_t num_points;
+        uint8_t reserved[24];
+    };
+
+    static_assert(sizeof(FrameRingHeader) <= s_header_size, "frame ring header exceeds its page");
+    static_assert(sizeof(FrameRingSlotHeader) == s_slot_header_size, "unexpected frame ring slot header size");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free, "frame ring requires lock free atomics");
+}
+
+// futex on a shared mapping, i.e. without FUTEX_PRIVATE_FLAG
+static inline long futexWait(std::atomic<uint32_t>* word, uint32_t expected, const struct timespec* timeout)
+{
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, timeout, nullptr, 0);
+}
+
+static inline long futexWakeAll(std::atomic<uint32_t>* word)
+{
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static inline uint64_t steadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+sick_scansegment_xd::FrameRingWriter::~FrameRingWriter()
+{
+    Close();
+}
+
+/*
+ * @brief creates the shared memory object, replacing an existing one with the same name.
+ */
+bool sick_scansegment_xd::FrameRingWriter::Open(const std::string& name, uint32_t num_slots, size_t max_points)
+{
+    Close();
+    if (num_slots < 2 || max_points == 0)
+    {
+        ROS_ERROR_STREAM("## ERROR FrameRingWriter::Open(): invalid ring size, " << num_slots << " slots of " << max_points << " points");
+        return false;
+    }
+    const uint64_t slot_size = (s_slot_header_size + max_points * s_point_size + 63) & ~(uint64_t)63; // cache line aligned
+    m_map_size = s_header_size + num_slots * slot_size;
+
+    shm_unlink(name.c_str()); // readers of a previous ring keep their mapping, new readers get the new ring
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd < 0)
+    {
+        ROS_ERROR_STREAM("## ERROR FrameRingWriter::Open(): can't create shared memory \"" << name << "\": " << strerror(errno));
+        return false;
+    }
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, (off_t)m_map_size) == 0)
+    {
+        map = mmap(nullptr, m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        ROS_ERROR_STREAM("## ERROR FrameRingWriter::Open(): can't map " << m_map_size << " bytes of shared memory \"" << name << "\": " << strerror(errno));
+        shm_unlink(name.c_str());
+        return false;
+    }
+    m_map = static_cast<uint8_t*>(map);
+    m_name = name;
+    m_frame_number = 0;
+    m_num_dropped = 0;
+
+    // the object is zero filled, i.e. all slots have sequence number 0; the magic is written last
+    FrameRingHeader* header = new (m_map) FrameRingHeader();
+    header->version = s_frame_ring_version;
+    header->header_size = (uint32_t)s_header_size;
+    header->num_slots = num_slots;
+    header->point_size = s_point_size;
+    header->slot_size = slot_size;
+    header->max_points = max_points;
+    header->frames_written.store(0);
+    header->futex_word.store(0);
+    header->num_waiters.store(0);
+    header->writer_active.store(1);
+    for (uint32_t slot = 0; slot < num_slots; slot++)
+    {
+        new (m_map + s_header_size + slot * slot_size) FrameRingSlotHeader();
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, s_frame_ring_magic, sizeof(s_frame_ring_magic));
+    m_header = header;
+    return true;
+}
+
+/*
+ * @brief writes a frame into the next slot and wakes all waiting readers.
+ */
+bool sick_scansegment_xd::FrameRingWriter::Write(uint64_t timestamp_nsec, const uint8_t* points, size_t num_points)
+{
+    if (!m_header)
+        return false;
+    if (num_points > m_header->max_points)
+    {
+        m_num_dropped++;
+        return false;
+    }
+    const uint64_t frame_number = m_frame_number++;
+    uint8_t* slot_data = m_map + s_header_size + (frame_number % m_header->num_slots) * m_header->slot_size;
+    FrameRingSlotHeader* slot = reinterpret_cast<FrameRingSlotHeader*>(slot_data);
+
+    // seqlock write: odd sequence number while the slot is written
+    slot->sequence.store(2 * frame_number + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->frame_number = frame_number;
+    slot->timestamp_nsec = timestamp_nsec;
+    slot->num_points = num_points;
+    memcpy(slot_data + s_slot_header_size, points, num_points * s_point_size);
+    slot->write_steady_nsec = steadyNanoseconds();
+    slot->sequence.store(2 * frame_number + 2, std::memory_order_release);
+
+    m_header->frames_written.store(frame_number + 1, std::memory_order_release);
+    m_header->futex_word.fetch_add(1);
+    if (m_header->num_waiters.load() > 0) // no syscall while nobody waits
+    {
+        futexWakeAll(&m_header->futex_word);
+    }
+    return true;
+}
+
+/*
+ * @brief wakes waiting readers and removes the shared memory name.
+ */
+void sick_scansegment_xd::FrameRingWriter::Close()
+{
+    if (m_header)
+    {
+        m_header->writer_active.store(0);
+        m_header->futex_word.fetch_add(1);
+        futexWakeAll(&m_header->futex_word);
+        shm_unlink(m_name.c_str());
+    }
+    if (m_map)
+    {
+        munmap(m_map, m_map_size);
+    }
+    m_map = 0;
+    m_map_size = 0;
+    m_header = 0;
+}
+
+sick_scansegment_xd::FrameRingReader::~FrameRingReader()
+{
+    Close();
+}
+
+/*
+ * @brief maps a frame ring.
+ */
+bool sick_scansegment_xd::FrameRingReader::Open(const std::string& name)
+{
+    Close();
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        ROS_ERROR_STREAM("## ERROR FrameRingReader::Open(): can't open shared memory \"" << name << "\": " << strerror(errno));
+        return false;
+    }
+    struct stat st;
+    void* header_map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (uint64_t)st.st_size > s_header_size)
+    {
+        header_map = mmap(nullptr, s_header_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (header_map == MAP_FAILED)
+    {
+        ROS_ERROR_STREAM("## ERROR FrameRingReader::Open(): can't map shared memory \"" << name << "\"");
+        close(fd);
+        return false;
+    }
+    m_header_map = static_cast<uint8_t*>(header_map);
+    FrameRingHeader* header = reinterpret_cast<FrameRingHeader*>(m_header_map);
+    bool valid = (memcmp(header->magic, s_frame_ring_magic, sizeof(s_frame_ring_magic)) == 0); // written last by the writer
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!valid || header->version != s_frame_ring_version
+        || header->header_size != s_header_size || header->point_size != s_point_size || header->num_slots == 0
+        || s_header_size + header->num_slots * header->slot_size > (uint64_t)st.st_size)
+    {
+        ROS_ERROR_STREAM("## ERROR FrameRingReader::Open(): \"" << name << "\" is not a frame ring or not yet initialized");
+        close(fd);
+        Close();
+        return false;
+    }
+    m_slot_map_size = header->num_slots * header->slot_size;
+    void* slot_map = mmap(nullptr, m_slot_map_size, PROT_READ, MAP_SHARED, fd, (off_t)s_header_size);
+    close(fd);
+    if (slot_map == MAP_FAILED)
+    {
+        ROS_ERROR_STREAM("## ERROR FrameRingReader::Open(): can't map " << m_slot_map_size << " bytes of shared memory \"" << name << "\": " << strerror(errno));
+        m_slot_map_size = 0;
+        Close();
+        return false;
+    }
+    m_slot_map = static_cast<const uint8_t*>(slot_map);
+    m_num_slots = header->num_slots;
+    m_slot_size = header->slot_size;
+    m_max_points = header->max_points;
+    m_header = header;
+    return true;
+}
+
+void sick_scansegment_xd::FrameRingReader::Close()
+{
+    if (m_slot_map)
+        munmap(const_cast<uint8_t*>(m_slot_map), m_slot_map_size);
+    if (m_header_map)
+        munmap(m_header_map, s_header_size);
+    m_slot_map = 0;
+    m_slot_map_size = 0;
+    m_header_map = 0;
+    m_header = 0;
+}
+
+uint64_t sick_scansegment_xd::FrameRingReader::NumFramesWritten() const
+{
+    return m_header ? m_header->frames_written.load(std::memory_order_acquire) : 0;
+}
+
+bool sick_scansegment_xd::FrameRingReader::WriterActive() const
+{
+    return m_header && m_header->writer_active.load() != 0;
+}
+
+/*
+ * @brief waits until more than num_frames frames have been written.
+ */
+bool sick_scansegment_xd::FrameRingReader::WaitForFrames(uint64_t num_frames, double timeout_sec)
+{
+    if (!m_header)
+        return false;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(std::max(timeout_sec, 0.0)));
+    while (true)
+    {
+        // the futex word is read before the frame counter, so a frame written in between changes the word and FUTEX_WAIT returns at once
+        uint32_t futex_word = m_header->futex_word.load();
+        if (m_header->frames_written.load(std::memory_order_acquire) > num_frames)
+            return true;
+        if (!m_header->writer_active.load())
+            return false;
+        struct timespec timeout = { 0, 0 };
+        if (timeout_sec >= 0)
+        {
+            int64_t remaining_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (remaining_nsec <= 0)
+                return false;
+            timeout.tv_sec = (time_t)(remaining_nsec / 1000000000);
+            timeout.tv_nsec = (long)(remaining_nsec % 1000000000);
+        }
+        m_header->num_waiters.fetch_add(1);
+        futexWait(&m_header->futex_word, futex_word, timeout_sec >= 0 ? &timeout : nullptr);
+        m_header->num_waiters.fetch_sub(1);
+    }
+}
+
+const sick_scansegment_xd::FrameRingSlotHeader* sick_scansegment_xd::FrameRingReader::Slot(uint64_t frame_number) const
+{
+    return reinterpret_cast<const FrameRingSlotHeader*>(m_slot_map + (frame_number % m_num_slots) * m_slot_size);
+}
+
+/*
+ * @brief returns a frame without copying.
+ */
+bool sick_scansegment_xd::FrameRingReader::Acquire(uint64_t frame_number, FrameRingView& view) const
+{
+    if (!m_header)
+        return false;
+    const FrameRingSlotHeader* slot = Slot(frame_number);
+    const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if (sequence != 2 * frame_number + 2)
+        return false; // not yet written, being written or overwritten
+    view.frame_number = frame_number;
+    view.timestamp_nsec = slot->timestamp_nsec;
+    view.write_steady_nsec = slot->write_steady_nsec;
+    view.num_points = (size_t)std::min<uint64_t>(slot->num_points, m_max_points);
+    view.points = reinterpret_cast<const uint8_t*>(slot) + s_slot_header_size;
+    view.sequence = sequence;
+    return Validate(view);
+}
+
+/*
+ * @brief checks that a frame has not been overwritten since Acquire().
+ */
+bool sick_scansegment_xd::FrameRingReader::Validate(const FrameRingView& view) const
+{
+    if (!m_header)
+        return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return Slot(view.frame_number)->sequence.load(std::memory_order_relaxed) == view.sequence;
+}
+
+/*
+ * @brief copies the points of a frame.
+ */
+bool sick_scansegment_xd::FrameRingReader::Copy(uint64_t frame_number, FrameRingView& view, std::vector<uint8_t>& points) const
+{
+    if (!Acquire(frame_number, view))
+        return false;
+    points.resize(view.num_points * s_point_size);
+    memcpy(points.data(), view.points, points.size());
+    if (!Validate(view))
+        return false;
+    view.points = points.data();
+    return true;
+}
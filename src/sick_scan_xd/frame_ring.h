@@ -0,0 +1,184 @@
+/*
+ * @brief frame_ring passes decoded frames (complete rotations) to local processes through a POSIX
+ * shared memory object. The driver writes each frame once into the next slot of a fixed ring, any
+ * number of readers map the ring and read the points in place. Every slot is guarded by a sequence
+ * number (seqlock): a reader never blocks the writer, it detects a frame overwritten while it was read.
+ * Readers wait for new frames on a futex in the ring header.
+ *
+ * Shared memory layout (host byte order, all offsets in bytes from the start of the object):
+ *   4096 byte ring header
+ *     8 byte magic "MSRING1\0"
+ *     uint32_t version (2), uint32_t header size (4096)
+ *     uint32_t number of slots, uint32_t point size (56)
+ *     uint64_t slot size incl. slot header
+ *     uint64_t max. number of points per slot
+ *     uint64_t number of frames written (atomic)
+ *     uint32_t futex word, incremented after each frame (atomic)
+ *     uint32_t number of waiting readers (atomic)
+ *     uint32_t writer active (atomic, 0 after the writer closed the ring)
+ *   slots, frame k is written to slot k % number of slots
+ *     64 byte slot header
+ *       uint64_t sequence number (atomic): 2k+1 while frame k is written, 2k+2 when complete, 0 if never written
+ *       uint64_t frame number k
+ *       uint64_t frame timestamp in nanoseconds (header.stamp of the PointCloud2)
+ *       uint64_t steady clock (CLOCK_MONOTONIC) time in nanoseconds when the frame was completed
+ *       uint64_t number of points n
+ *     n points of 56 byte, identical to the PointCloud2 points of the driver (see packed_point.h)
+ *     (x, y, z, i, range, azimuth, elevation as float, layer, echo, index as uint32_t, uint64_t t,
+ *     reflector as uint8_t, 7 byte zero padding)
+ *
+ * The header is mapped writeable by readers (futex and waiter count), the slots read only. The object
+ * is created with mode 0660, readers need the user or group of the driver.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sick_scansegment_xd
+{
+    struct FrameRingHeader;
+    struct FrameRingSlotHeader;
+
+    /*
+     * @brief a frame in the ring, pointing into the shared memory
+     */
+    struct FrameRingView
+    {
+        uint64_t frame_number = 0;
+        uint64_t timestamp_nsec = 0;      // frame timestamp in nanoseconds
+        uint64_t write_steady_nsec = 0;   // steady clock time when the frame was completed
+        size_t num_points = 0;
+        const uint8_t* points = 0;        // num_points x 56 byte, valid as long as Validate() returns true
+        uint64_t sequence = 0;
+    };
+
+    /*
+     * @brief class FrameRingWriter creates a frame ring and writes frames into it.
+     * A ring has a single writer.
+     */
+    class FrameRingWriter
+    {
+    public:
+
+        FrameRingWriter() = default;
+        FrameRingWriter(const FrameRingWriter&) = delete;
+        ~FrameRingWriter();
+
+        /*
+         * @brief creates the shared memory object, replacing an existing one with the same name.
+         * @param[in] name shared memory name, f.e. "/multiscan_frames"
+         * @param[in] num_slots number of frames in the ring
+         * @param[in] max_points max. number of points per frame
+         * @return true on success, false otherwise
+         */
+        bool Open(const std::string& name, uint32_t num_slots, size_t max_points);
+
+        /*
+         * @brief writes a frame into the next slot and wakes all waiting readers.
+         * @param[in] timestamp_nsec frame timestamp in nanoseconds
+         * @param[in] points packed 56 byte points
+         * @param[in] num_points number of points
+         * @return true on success, false if the frame has more than max_points points (the frame is dropped)
+         */
+        bool Write(uint64_t timestamp_nsec, const uint8_t* points, size_t num_points);
+
+        /*
+         * @brief wakes waiting readers and removes the shared memory name, mapped rings stay valid for their readers.
+         */
+        void Close();
+
+        bool IsOpen() const { return m_header != 0; }
+        uint64_t NumFramesWritten() const { return m_frame_number; }
+        uint64_t NumFramesDropped() const { return m_num_dropped; }
+
+    protected:
+
+        std::string m_name;
+        uint8_t* m_map = 0;
+        size_t m_map_size = 0;
+        FrameRingHeader* m_header = 0;
+        uint64_t m_frame_number = 0;
+        uint64_t m_num_dropped = 0;
+    };
+
+    /*
+     * @brief class FrameRingReader maps a frame ring created by FrameRingWriter.
+     * Frames are read in place: Acquire() returns a view into the shared memory, and the data read
+     * through it are consistent if Validate() returns true afterwards.
+     */
+    class FrameRingReader
+    {
+    public:
+
+        FrameRingReader() = default;
+        FrameRingReader(const FrameRingReader&) = delete;
+        ~FrameRingReader();
+
+        /*
+         * @brief maps a frame ring.
+         * @param[in] name shared memory name
+         * @return true on success, false if the ring does not exist or has an unknown format
+         */
+        bool Open(const std::string& name);
+
+        void Close();
+
+        bool IsOpen() const { return m_header != 0; }
+
+        /*
+         * @brief returns the number of frames written, i.e. the number of the next frame.
+         */
+        uint64_t NumFramesWritten() const;
+
+        /*
+         * @brief returns false after the writer closed the ring.
+         */
+        bool WriterActive() const;
+
+        /*
+         * @brief waits until more than num_frames frames have been written.
+         * @param[in] num_frames number of frames already seen
+         * @param[in] timeout_sec timeout in seconds, < 0: wait without timeout
+         * @return true if a new frame is available, false on timeout or if the writer closed the ring
+         */
+        bool WaitForFrames(uint64_t num_frames, double timeout_sec);
+
+        /*
+         * @brief returns a frame without copying.
+         * @param[in] frame_number frame number, f.e. NumFramesWritten() - 1 for the latest frame
+         * @param[out] view frame in the shared memory
+         * @return true on success, false if the frame has not been written yet or has been overwritten
+         */
+        bool Acquire(uint64_t frame_number, FrameRingView& view) const;
+
+        /*
+         * @brief checks that a frame has not been overwritten since Acquire(). Call after reading the points.
+         */
+        bool Validate(const FrameRingView& view) const;
+
+        /*
+         * @brief copies the points of a frame (Acquire(), copy and Validate()).
+         * @return true on success, false if the frame is not available or has been overwritten while copying
+         */
+        bool Copy(uint64_t frame_number, FrameRingView& view, std::vector<uint8_t>& points) const;
+
+        uint32_t NumSlots() const { return m_num_slots; }
+        size_t MaxPoints() const { return m_max_points; }
+
+    protected:
+
+        const FrameRingSlotHeader* Slot(uint64_t frame_number) const;
+
+        uint8_t* m_header_map = 0;
+        const uint8_t* m_slot_map = 0;
+        size_t m_slot_map_size = 0;
+        FrameRingHeader* m_header = 0;
+        uint32_t m_num_slots = 0;
+        uint64_t m_slot_size = 0;
+        size_t m_max_points = 0;
+    };
+
+} // namespace sick_scansegment_xd
@@ -0,0 +1,389 @@
+/*
+ * @brief frame_store records decoded frames in a columnar file written and read through mmap.
+ * See frame_store.h for the file format.
+ */
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "frame_store.h"
+#include "sick_ros_wrapper.h"
+
+static const char s_frame_store_magic[8] = { 'M', 'S', 'F', 'R', 'A', 'M', 'E', '1' };
+static const uint32_t s_frame_store_version = 1;
+static const uint64_t s_file_header_size = 64;
+static const uint64_t s_frame_header_size = 16;
+static const uint64_t s_file_chunk_size = 64 * 1024 * 1024; // the file grows in chunks of 64 MB
+
+static inline uint64_t frameSize(uint64_t num_points)
+{
+    return (s_frame_header_size + num_points * (sizeof(uint64_t) + 5 * sizeof(float) + sizeof(uint8_t)) + 7) & ~(uint64_t)7;
+}
+
+template <typename T> static inline T readValue(const uint8_t* p)
+{
+    T val;
+    memcpy(&val, p, sizeof(T));
+    return val;
+}
+
+template <typename T> static inline void writeValue(uint8_t* p, T val)
+{
+    memcpy(p, &val, sizeof(T));
+}
+
+template <typename Float_T, typename Uint8_T, typename Uint64_T, typename Byte_T>
+static void frameColumns(Byte_T* frame, uint64_t timestamp_nsec, size_t num_points, sick_scansegment_xd::FrameColumnsT<Float_T, Uint8_T, Uint64_T>& columns)
+{
+    columns.timestamp_nsec = timestamp_nsec;
+    columns.num_points = num_points;
+    columns.t = reinterpret_cast<Uint64_T*>(frame + s_frame_header_size);
+    columns.x = reinterpret_cast<Float_T*>(columns.t + num_points);
+    columns.y = columns.x + num_points;
+    columns.z = columns.y + num_points;
+    columns.i = columns.z + num_points;
+    columns.range = columns.i + num_points;
+    columns.layer = reinterpret_cast<Uint8_T*>(columns.range + num_points);
+}
+
+/*
+ * @brief builds the time grid of a frame index ({ timestamp, offset } pairs sorted by timestamp):
+ * grid[c] is the last frame at or before t0 + c * step.
+ */
+static void buildTimeGrid(const uint64_t* index, size_t num_frames, uint64_t& t0, uint64_t& step, std::vector<uint32_t>& grid)
+{
+    grid.clear();
+    t0 = 0;
+    step = 1;
+    if (num_frames == 0)
+        return;
+    t0 = index[0];
+    uint64_t span = index[2 * (num_frames - 1)] - t0;
+    uint64_t min_interval = span;
+    for (size_t n = 1; n < num_frames; n++)
+    {
+        uint64_t dt = index[2 * n] - index[2 * (n - 1)];
+        if (dt > 0)
+            min_interval = std::min(min_interval, dt);
+    }
+    // a few short intervals (f.e. after a dropout) must not blow up the grid
+    uint64_t mean_interval = (num_frames > 1 ? span / (num_frames - 1) : 0);
+    step = std::max<uint64_t>({ min_interval, mean_interval / 4, 1 });
+    grid.resize(span / step + 1);
+    size_t frame_idx = 0;
+    for (size_t c = 0; c < grid.size(); c++)
+    {
+        uint64_t t_cell = t0 + c * step;
+        while (frame_idx + 1 < num_frames && index[2 * (frame_idx + 1)] <= t_cell)
+            frame_idx++;
+        grid[c] = (uint32_t)frame_idx;
+    }
+}
+
+sick_scansegment_xd::FrameStoreWriter::~FrameStoreWriter()
+{
+    Close();
+}
+
+/*
+ * @brief creates (or truncates) a frame store file.
+ */
+bool sick_scansegment_xd::FrameStoreWriter::Open(const std::string& filepath)
+{
+    Close();
+    m_fd = ::open(filepath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+    {
+        ROS_ERROR_STREAM("## ERROR FrameStoreWriter::Open(): can't create file \"" << filepath << "\"");
+        return false;
+    }
+    m_index.clear();
+    m_size = s_file_header_size;
+    m_pending_size = 0;
+    if (!Reserve(s_file_chunk_size))
+    {
+        Close();
+        return false;
+    }
+    // the header without index marks the file as not closed, so it can be read after a crash
+    memcpy(m_map, s_frame_store_magic, sizeof(s_frame_store_magic));
+    writeValue<uint32_t>(m_map + 8, s_frame_store_version);
+    writeValue<uint32_t>(m_map + 12, (uint32_t)s_file_header_size);
+    return true;
+}
+
+/*
+ * @brief grows and remaps the file, if its mapped size is less than a given size.
+ */
+bool sick_scansegment_xd::FrameStoreWriter::Reserve(uint64_t size)
+{
+    if (size <= m_capacity)
+        return true;
+    uint64_t capacity = std::max(2 * m_capacity, ((size + s_file_chunk_size - 1) / s_file_chunk_size) * s_file_chunk_size);
+    if (m_map)
+    {
+        munmap(m_map, m_capacity);
+        m_map = 0;
+        m_capacity = 0;
+    }
+    void* map = MAP_FAILED;
+    if (ftruncate(m_fd, (off_t)capacity) == 0)
+        map = mmap(0, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        ROS_ERROR_STREAM("## ERROR FrameStoreWriter::Reserve(): can't map " << capacity << " byte");
+        return false;
+    }
+    m_map = (uint8_t*)map;
+    m_capacity = capacity;
+    return true;
+}
+
+/*
+ * @brief reserves a frame and returns its columns in the mapped file.
+ */
+bool sick_scansegment_xd::FrameStoreWriter::BeginFrame(uint64_t timestamp_nsec, size_t num_points, FrameColumns& columns)
+{
+    m_pending_size = 0;
+    uint64_t frame_size = frameSize(num_points);
+    if (m_fd < 0 || frame_size > 0xFFFFFFFF || !Reserve(m_size + frame_size))
+        return false;
+    uint8_t* frame = m_map + m_size;
+    writeValue<uint64_t>(frame, timestamp_nsec);
+    frameColumns(frame, timestamp_nsec, num_points, columns);
+    memset(columns.layer + num_points, 0, frame_size - (columns.layer + num_points - frame));
+    m_pending_size = frame_size;
+    return true;
+}
+
+/*
+ * @brief records the frame reserved by the last call to BeginFrame().
+ */
+void sick_scansegment_xd::FrameStoreWriter::CommitFrame()
+{
+    if (m_pending_size == 0)
+        return;
+    uint8_t* frame = m_map + m_size;
+    uint64_t num_points = (m_pending_size - s_frame_header_size) / (sizeof(uint64_t) + 5 * sizeof(float) + sizeof(uint8_t));
+    // the frame size is written last, a reader recovering an unclosed file stops at the first frame without size
+    writeValue<uint32_t>(frame + 8, (uint32_t)num_points);
+    writeValue<uint32_t>(frame + 12, (uint32_t)m_pending_size);
+    m_index.push_back({ readValue<uint64_t>(frame), m_size });
+    m_size += m_pending_size;
+    m_pending_size = 0;
+}
+
+/*
+ * @brief writes frame index and time grid, and truncates the file to its size.
+ */
+bool sick_scansegment_xd::FrameStoreWriter::Close()
+{
+    if (m_fd < 0)
+        return false;
+    bool success = false;
+    std::stable_sort(m_index.begin(), m_index.end(), [](const std::pair<uint64_t, uint64_t>& a, const std::pair<uint64_t, uint64_t>& b) { return a.first < b.first; });
+    std::vector<uint64_t> index;
+    index.reserve(2 * m_index.size());
+    for (const auto& entry : m_index)
+    {
+        index.push_back(entry.first);
+        index.push_back(entry.second);
+    }
+    uint64_t grid_t0 = 0, grid_step = 1;
+    std::vector<uint32_t> grid;
+    buildTimeGrid(index.data(), m_index.size(), grid_t0, grid_step, grid);
+    uint64_t index_offset = m_size, grid_offset = index_offset + index.size() * sizeof(uint64_t);
+    uint64_t file_size = grid_offset + grid.size() * sizeof(uint32_t);
+    if (m_map && Reserve(file_size))
+    {
+        memcpy(m_map + index_offset, index.data(), index.size() * sizeof(uint64_t));
+        memcpy(m_map + grid_offset, grid.data(), grid.size() * sizeof(uint32_t));
+        writeValue<uint64_t>(m_map + 16, m_index.size());
+        writeValue<uint64_t>(m_map + 32, grid_offset);
+        writeValue<uint64_t>(m_map + 40, grid_t0);
+        writeValue<uint64_t>(m_map + 48, grid_step);
+        writeValue<uint64_t>(m_map + 56, grid.size());
+        writeValue<uint64_t>(m_map + 24, index_offset); // the index offset marks the file as closed
+        success = true;
+    }
+    if (m_map)
+        munmap(m_map, m_capacity);
+    if (ftruncate(m_fd, (off_t)(success ? file_size : m_size)) != 0)
+        success = false;
+    ::close(m_fd);
+    m_fd = -1;
+    m_map = 0;
+    m_capacity = 0;
+    m_pending_size = 0;
+    if (!success)
+        ROS_ERROR_STREAM("## ERROR FrameStoreWriter::Close(): writing the frame index failed");
+    return success;
+}
+
+sick_scansegment_xd::FrameStoreReader::~FrameStoreReader()
+{
+    Close();
+}
+
+/*
+ * @brief maps a frame store file read only.
+ */
+bool sick_scansegment_xd::FrameStoreReader::Open(const std::string& filepath)
+{
+    Close();
+    m_fd = ::open(filepath.c_str(), O_RDONLY);
+    struct stat file_stat;
+    if (m_fd < 0 || fstat(m_fd, &file_stat) != 0 || (uint64_t)file_stat.st_size < s_file_header_size)
+    {
+        ROS_ERROR_STREAM("## ERROR FrameStoreReader::Open(): can't read file \"" << filepath << "\"");
+        Close();
+        return false;
+    }
+    m_size = (uint64_t)file_stat.st_size;
+    void* map = mmap(0, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        ROS_ERROR_STREAM("## ERROR FrameStoreReader::Open(): can't map file \"" << filepath << "\"");
+        m_map = 0;
+        Close();
+        return false;
+    }
+    m_map = (const uint8_t*)map;
+    if (memcmp(m_map, s_frame_store_magic, sizeof(s_frame_store_magic)) != 0 || readValue<uint32_t>(m_map + 8) != s_frame_store_version)
+    {
+        ROS_ERROR_STREAM("## ERROR FrameStoreReader::Open(): \"" << filepath << "\" is not a frame store file");
+        Close();
+        return false;
+    }
+    uint64_t num_frames = readValue<uint64_t>(m_map + 16);
+    uint64_t index_offset = readValue<uint64_t>(m_map + 24);
+    uint64_t grid_offset = readValue<uint64_t>(m_map + 32);
+    m_grid_t0 = readValue<uint64_t>(m_map + 40);
+    m_grid_step = readValue<uint64_t>(m_map + 48);
+    m_grid_size = readValue<uint64_t>(m_map + 56);
+    if (index_offset == 0)
+    {
+        ROS_WARN_STREAM("FrameStoreReader::Open(): \"" << filepath << "\" has not been closed, rebuilding the frame index");
+        return RebuildIndex();
+    }
+    if (index_offset % 8 != 0 || grid_offset % 4 != 0 || m_grid_step == 0 || (num_frames > 0 && m_grid_size == 0)
+        || index_offset < s_file_header_size || index_offset > m_size || grid_offset > m_size
+        || num_frames > (m_size - index_offset) / (2 * sizeof(uint64_t)) || m_grid_size > (m_size - grid_offset) / sizeof(uint32_t)
+        || index_offset + 2 * num_frames * sizeof(uint64_t) > grid_offset)
+    {
+        ROS_ERROR_STREAM("## ERROR FrameStoreReader::Open(): invalid frame index in \"" << filepath << "\"");
+        Close();
+        return false;
+    }
+    m_num_frames = (size_t)num_frames;
+    m_index = (const uint64_t*)(m_map + index_offset);
+    m_grid = (const uint32_t*)(m_map + grid_offset);
+    // Frame() and FrameAt() trust the index, so every frame has to lie between file header and index
+    for (size_t frame_idx = 0; frame_idx < m_num_frames; frame_idx++)
+    {
+        uint64_t offset = m_index[2 * frame_idx + 1];
+        bool valid = (offset >= s_file_header_size && offset % 8 == 0 && offset <= index_offset - s_frame_header_size);
+        if (valid)
+        {
+            uint64_t frame_size = frameSize(readValue<uint32_t>(m_map + offset + 8));
+            valid = (readValue<uint32_t>(m_map + offset + 12) == frame_size && frame_size <= index_offset - offset);
+        }
+        if (!valid)
+        {
+            ROS_ERROR_STREAM("## ERROR FrameStoreReader::Open(): invalid frame " << frame_idx << " at offset " << offset << " in \"" << filepath << "\"");
+            Close();
+            return false;
+        }
+    }
+    for (uint64_t cell = 0; cell < m_grid_size; cell++)
+    {
+        if (m_grid[cell] >= m_num_frames)
+        {
+            ROS_ERROR_STREAM("## ERROR FrameStoreReader::Open(): invalid time grid in \"" << filepath << "\"");
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * @brief rebuilds index and time grid of a file which has not been closed by the writer.
+ */
+bool sick_scansegment_xd::FrameStoreReader::RebuildIndex()
+{
+    std::vector<std::pair<uint64_t, uint64_t>> frames;
+    uint64_t offset = s_file_header_size;
+    while (offset + s_frame_header_size <= m_size)
+    {
+        uint64_t num_points = readValue<uint32_t>(m_map + offset + 8);
+        uint64_t frame_size = readValue<uint32_t>(m_map + offset + 12);
+        if (frame_size == 0 || frame_size != frameSize(num_points) || offset + frame_size > m_size)
+            break;
+        frames.push_back({ readValue<uint64_t>(m_map + offset), offset });
+        offset += frame_size;
+    }
+    std::stable_sort(frames.begin(), frames.end(), [](const std::pair<uint64_t, uint64_t>& a, const std::pair<uint64_t, uint64_t>& b) { return a.first < b.first; });
+    m_rebuilt_index.clear();
+    for (const auto& frame : frames)
+    {
+        m_rebuilt_index.push_back(frame.first);
+        m_rebuilt_index.push_back(frame.second);
+    }
+    buildTimeGrid(m_rebuilt_index.data(), frames.size(), m_grid_t0, m_grid_step, m_rebuilt_grid);
+    m_num_frames = frames.size();
+    m_index = m_rebuilt_index.data();
+    m_grid = m_rebuilt_grid.data();
+    m_grid_size = m_rebuilt_grid.size();
+    return true;
+}
+
+void sick_scansegment_xd::FrameStoreReader::Close()
+{
+    if (m_map)
+        munmap((void*)m_map, m_size);
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_fd = -1;
+    m_map = 0;
+    m_size = 0;
+    m_num_frames = 0;
+    m_index = 0;
+    m_grid = 0;
+    m_grid_t0 = 0;
+    m_grid_step = 1;
+    m_grid_size = 0;
+    m_rebuilt_index.clear();
+    m_rebuilt_grid.clear();
+}
+
+/*
+ * @brief returns the columns of a frame without copying.
+ */
+sick_scansegment_xd::FrameColumnsView sick_scansegment_xd::FrameStoreReader::Frame(size_t frame_idx) const
+{
+    FrameColumnsView columns;
+    if (frame_idx >= m_num_frames)
+        return columns;
+    const uint8_t* frame = m_map + m_index[2 * frame_idx + 1];
+    frameColumns(frame, readValue<uint64_t>(frame), readValue<uint32_t>(frame + 8), columns);
+    return columns;
+}
+
+/*
+ * @brief returns the number of the last frame with a timestamp at or before a given time.
+ */
+int64_t sick_scansegment_xd::FrameStoreReader::FrameAt(uint64_t timestamp_nsec) const
+{
+    if (m_num_frames == 0 || timestamp_nsec < m_index[0])
+        return -1;
+    uint64_t cell = std::min((timestamp_nsec - m_grid_t0) / m_grid_step, m_grid_size - 1);
+    size_t frame_idx = m_grid[cell];
+    while (frame_idx + 1 < m_num_frames && m_index[2 * (frame_idx + 1)] <= timestamp_nsec)
+        frame_idx++;
+    return (int64_t)frame_idx;
+}
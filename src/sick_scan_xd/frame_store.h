@@ -0,0 +1,166 @@
+/*
+ * @brief frame_store records decoded frames (complete rotations) in a columnar file, which is
+ * written and read through mmap. Each frame stores its points as contiguous columns, readers get
+ * pointers into the mapped file without copying, and the frame at a given time is found in O(1).
+ *
+ * File format (all values little endian, all offsets in bytes from the start of the file):
+ *   64 byte file header
+ *     8 byte magic "MSFRAME1"
+ *     uint32_t version (1), uint32_t header size (64)
+ *     uint64_t number of frames
+ *     uint64_t offset of the frame index (0: file not closed, the index is rebuilt by scanning the frames)
+ *     uint64_t offset of the time grid
+ *     uint64_t time of the first grid cell in nanoseconds
+ *     uint64_t grid cell duration in nanoseconds
+ *     uint64_t number of grid cells
+ *   frames, each 8 byte aligned
+ *     uint64_t frame timestamp in nanoseconds, uint32_t number of points n, uint32_t frame size in bytes (incl. this header)
+ *     uint64_t t[n]       point timestamps (lidar time) in microseconds
+ *     float x[n], y[n], z[n], i[n], range[n]
+ *     uint8_t layer[n]    zero padded to a multiple of 8 bytes
+ *   frame index: number of frames x { uint64_t timestamp in nanoseconds, uint64_t frame offset }, sorted by timestamp
+ *   time grid: number of grid cells x uint32_t, index of the last frame at or before the start of the cell
+ *
+ * The grid cell duration is the shortest frame interval (at least 1/4 of the mean interval), so a lookup
+ * by time reads one grid cell and advances over at most a few index entries.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sick_scansegment_xd
+{
+    /*
+     * @brief columns of a single frame, pointing into the mapped file
+     */
+    template <typename Float_T, typename Uint8_T, typename Uint64_T> struct FrameColumnsT
+    {
+        uint64_t timestamp_nsec = 0; // frame timestamp in nanoseconds
+        size_t num_points = 0;
+        Uint64_T* t = 0;             // point timestamps (lidar time) in microseconds
+        Float_T* x = 0;              // cartesian coordinates in meter
+        Float_T* y = 0;
+        Float_T* z = 0;
+        Float_T* i = 0;              // intensity
+        Float_T* range = 0;          // distance in meter
+        Uint8_T* layer = 0;          // layer (group) index
+    };
+    typedef FrameColumnsT<float, uint8_t, uint64_t> FrameColumns;                      // writeable columns of a frame in construction
+    typedef FrameColumnsT<const float, const uint8_t, const uint64_t> FrameColumnsView; // read only columns of a recorded frame
+
+    /*
+     * @brief class FrameStoreWriter appends frames to a frame store file.
+     * The file grows in chunks and is written through a shared writeable mapping.
+     */
+    class FrameStoreWriter
+    {
+    public:
+
+        FrameStoreWriter() = default;
+        FrameStoreWriter(const FrameStoreWriter&) = delete;
+        ~FrameStoreWriter();
+
+        /*
+         * @brief creates (or truncates) a frame store file.
+         * @param[in] filepath output file
+         * @return true on success, false otherwise
+         */
+        bool Open(const std::string& filepath);
+
+        /*
+         * @brief reserves a frame and returns its columns in the mapped file, which are valid until the next call
+         * to BeginFrame() or Close(). The frame is recorded by CommitFrame(). Frames should be appended in time order,
+         * otherwise lookups by time will return frames in index order.
+         * @param[in] timestamp_nsec frame timestamp in nanoseconds
+         * @param[in] num_points number of points
+         * @param[out] columns columns to fill
+         * @return true on success, false if the file could not be grown
+         */
+        bool BeginFrame(uint64_t timestamp_nsec, size_t num_points, FrameColumns& columns);
+
+        /*
+         * @brief records the frame reserved by the last call to BeginFrame().
+         */
+        void CommitFrame();
+
+        /*
+         * @brief writes frame index and time grid, and truncates the file to its size.
+         */
+        bool Close();
+
+        bool IsOpen() const { return m_fd >= 0; }
+        size_t NumFrames() const { return m_index.size(); }
+        uint64_t BytesWritten() const { return m_size; }
+
+    protected:
+
+        bool Reserve(uint64_t size);
+
+        int m_fd = -1;
+        uint8_t* m_map = 0;
+        uint64_t m_capacity = 0;      // mapped size of the file
+        uint64_t m_size = 0;          // size of header and committed frames
+        uint64_t m_pending_size = 0;  // size of the frame reserved by BeginFrame(), 0 if none
+        std::vector<std::pair<uint64_t, uint64_t>> m_index; // frame timestamps and offsets
+    };
+
+    /*
+     * @brief class FrameStoreReader maps a frame store file read only.
+     */
+    class FrameStoreReader
+    {
+    public:
+
+        FrameStoreReader() = default;
+        FrameStoreReader(const FrameStoreReader&) = delete;
+        ~FrameStoreReader();
+
+        /*
+         * @brief maps a frame store file. Files which have not been closed by the writer are supported,
+         * their frame index is rebuilt by scanning the frames.
+         * @param[in] filepath input file
+         * @return true on success, false if the file can't be mapped, has an unknown format or a frame index pointing outside the frames
+         */
+        bool Open(const std::string& filepath);
+
+        void Close();
+
+        size_t NumFrames() const { return m_num_frames; }
+
+        /*
+         * @brief returns the timestamp of a frame in nanoseconds.
+         */
+        uint64_t Timestamp(size_t frame_idx) const { return m_index[2 * frame_idx]; }
+
+        /*
+         * @brief returns the columns of a frame without copying, valid until Close().
+         * @param[in] frame_idx frame number, 0 <= frame_idx < NumFrames()
+         */
+        FrameColumnsView Frame(size_t frame_idx) const;
+
+        /*
+         * @brief returns the number of the last frame with a timestamp at or before a given time in O(1).
+         * @param[in] timestamp_nsec time in nanoseconds
+         * @return frame number, or -1 if timestamp_nsec is before the first frame
+         */
+        int64_t FrameAt(uint64_t timestamp_nsec) const;
+
+    protected:
+
+        bool RebuildIndex();
+
+        int m_fd = -1;
+        const uint8_t* m_map = 0;
+        uint64_t m_size = 0;
+        size_t m_num_frames = 0;
+        const uint64_t* m_index = 0;         // { timestamp, offset } pairs, mapped or m_rebuilt_index
+        const uint32_t* m_grid = 0;          // mapped or m_rebuilt_grid
+        uint64_t m_grid_t0 = 0, m_grid_step = 1, m_grid_size = 0;
+        std::vector<uint64_t> m_rebuilt_index;
+        std::vector<uint32_t> m_rebuilt_grid;
+    };
+
+} // namespace sick_scansegment_xd
@@ -82,6 +82,7 @@
 #include "softwarePLL.h"
 // #include "config.h"
 #include "msgpack_parser.h"
+#include "compact_parser.h"
 #include "sick_ros_wrapper.h"
 
 // /** normalizes an angle to [ -PI , +PI ] */
@@ -97,8 +98,8 @@
  /*
   * @brief Counter for each message (each scandata decoded from msgpack data)
   */
-int sick_scansegment_xd::MsgPackParser::messageCount = 0;
-int sick_scansegment_xd::MsgPackParser::telegramCount = 0;
+std::atomic<int> sick_scansegment_xd::MsgPackParser::messageCount(0);
+std::atomic<int> sick_scansegment_xd::MsgPackParser::telegramCount(0);
 
 /*
  * @brief Returns the tokenized integer of a msgpack key.
@@ -471,7 +472,7 @@ std::string sick_scansegment_xd::MsgPackParser::MsgpackToHexDump(const std::vect
  *
  * @param[in+out] msgpack_ifstream the binary input stream delivering the binary msgpack data
  * @param[in] msgpack_timestamp receive timestamp of msgpack_data
- * @param[in] add_transform_xyz_rpy Apply an additional transform to the cartesian pointcloud, default: "0,0,0,0,0,0" (i.e. no transform)
+ * An optional transform of the cartesian pointcloud is configured by DecoderConfig::SetTransform()
  * @param[out] result msgpack data converted to scanlines of type ScanSegmentParserOutput
  * @param[in+out] msgpack_validator_data_collector collects MsgPackValidatorData over N msgpacks
  * @param[in] msgpack_validator msgpack validation, see MsgPackValidator for details
@@ -479,12 +480,14 @@ std::string sick_scansegment_xd::MsgPackParser::MsgpackToHexDump(const std::vect
  * @param[in] discard_msgpacks_not_validated true: msgpacks are discarded if not validated, false: error message if a msgpack is not validated
  * @param[in] use_software_pll true (default): result timestamp from sensor ticks by software pll, false: result timestamp from msg receiving
  * @param[in] verbose true: enable debug output, false: quiet mode
+ * @param[in] software_pll pll of the sensor which sent the msgpack (default: 0, i.e. the process wide SoftwarePLL::instance())
+ * @param[in] decoder_config settings of the sensor which sent the msgpack (default: 0, i.e. all layers active, no filter)
  */
 bool sick_scansegment_xd::MsgPackParser::Parse(const std::vector<uint8_t>& msgpack_data, fifo_timestamp msgpack_timestamp, 
     ScanSegmentParserOutput& result,
     // sick_scansegment_xd::MsgPackValidatorData& msgpack_validator_data_collector, const sick_scansegment_xd::MsgPackValidator& msgpack_validator,
     // bool msgpack_validator_enabled, bool discard_msgpacks_not_validated,
-    bool use_software_pll, bool verbose)
+    bool use_software_pll, bool verbose, SoftwarePLL* software_pll, const DecoderConfig* decoder_config)
 {
     // To debug, print and visual msgpack_data, just paste hex dump to
     // https://toolslick.com/conversion/data/messagepack-to-json
@@ -497,7 +500,7 @@ bool sick_scansegment_xd::MsgPackParser::Parse(const std::vector<uint8_t>& msgpa
     // std::cout << std::endl << "MsgPack hexdump: " << std::endl << msgpack_hexdump << std::endl << std::endl;
     std::string msgpack_string((char*)msgpack_data.data(), msgpack_data.size());
     std::istringstream msgpack_istream(msgpack_string);
-    return Parse(msgpack_istream, msgpack_timestamp, result, use_software_pll, verbose);
+    return Parse(msgpack_istream, msgpack_timestamp, result, use_software_pll, verbose, software_pll, decoder_config);
 }
 
 /*
@@ -528,7 +531,7 @@ bool sick_scansegment_xd::MsgPackParser::Parse(const std::vector<uint8_t>& msgpa
  *
  * @param[in+out] msgpack_ifstream the binary input stream delivering the binary msgpack data
  * @param[in] msgpack_timestamp receive timestamp of msgpack_data
- * @param[in] add_transform_xyz_rpy Apply an additional transform to the cartesian pointcloud, default: "0,0,0,0,0,0" (i.e. no transform)
+ * An optional transform of the cartesian pointcloud is configured by DecoderConfig::SetTransform()
  * @param[out] result msgpack data converted to scanlines of type ScanSegmentParserOutput
  * @param[in] discard_msgpacks_not_validated true: msgpacks are discarded if not validated, false: error message if a msgpack is not validated
  * @param[in] msgpack_validator msgpack validation, see MsgPackValidator for details
@@ -536,14 +539,19 @@ bool sick_scansegment_xd::MsgPackParser::Parse(const std::vector<uint8_t>& msgpa
  * @param[in+out] msgpack_validator_data_collector collects MsgPackValidatorData over N msgpacks
  * @param[in] use_software_pll true (default): result timestamp from sensor ticks by software pll, false: result timestamp from msg receiving
  * @param[in] verbose true: enable debug output, false: quiet mode
+ * @param[in] software_pll pll of the sensor which sent the msgpack (default: 0, i.e. the process wide SoftwarePLL::instance())
+ * @param[in] decoder_config settings of the sensor which sent the msgpack (default: 0, i.e. all layers active, no filter)
  */
 bool sick_scansegment_xd::MsgPackParser::Parse(std::istream& msgpack_istream, fifo_timestamp msgpack_timestamp, 
     ScanSegmentParserOutput& result,
     // sick_scansegment_xd::MsgPackValidatorData& msgpack_validator_data_collector, 
     // const sick_scansegment_xd::MsgPackValidator& msgpack_validator,
     // bool msgpack_validator_enabled, bool discard_msgpacks_not_validated,
-    bool use_software_pll, bool verbose)
+    bool use_software_pll, bool verbose, SoftwarePLL* software_pll_ptr, const DecoderConfig* decoder_config_ptr)
 {
+    static const DecoderConfig s_default_decoder_config;
+    SoftwarePLL& software_pll = (software_pll_ptr ? *software_pll_ptr : SoftwarePLL::instance());
+    const DecoderConfig& decoder_config = (decoder_config_ptr ? *decoder_config_ptr : s_default_decoder_config);
     int64_t systemtime_nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(msgpack_timestamp.time_since_epoch()).count();
     uint32_t systemtime_sec = (uint32_t)(systemtime_nanoseconds / 1000000000);  // seconds part of timestamp
     uint32_t systemtime_nsec = (uint32_t)(systemtime_nanoseconds % 1000000000); // nanoseconds part of timestamp
@@ -602,7 +610,6 @@ bool sick_scansegment_xd::MsgPackParser::Parse(std::istream& msgpack_istream, fi
             // result.timestamp = std::to_string(timestamp_data.int64_value());
             // Calculate system time from sensor ticks using SoftwarePLL
             // result.timestamp = std::to_string(timestamp_data.int64_value());
-            SoftwarePLL& software_pll = SoftwarePLL::instance();
             uint32_t curtick = timestamp_data.int32_value();
             software_pll.updatePLL(systemtime_sec, systemtime_nsec, curtick);
             if (software_pll.IsInitialized())
@@ -668,9 +675,8 @@ bool sick_scansegment_xd::MsgPackParser::Parse(std::istream& msgpack_istream, fi
             uint32_t u32TimestampStop = timestampStopMsg->second.uint32_value();
             uint32_t u32TimestampStart_sec = 0, u32TimestampStart_nsec = 0;
             uint32_t u32TimestampStop_sec = 0, u32TimestampStop_nsec = 0;
-            if (use_software_pll && SoftwarePLL::instance().IsInitialized())
+            if (use_software_pll && software_pll.IsInitialized())
             {
-                SoftwarePLL& software_pll = SoftwarePLL::instance();
                 software_pll.getCorrectedTimeStamp(u32TimestampStart_sec, u32TimestampStart_nsec, u32TimestampStart);
                 software_pll.getCorrectedTimeStamp(u32TimestampStop_sec, u32TimestampStop_nsec, u32TimestampStop);
             }
@@ -728,6 +734,13 @@ bool sick_scansegment_xd::MsgPackParser::Parse(std::istream& msgpack_istream, fi
                 ROS_WARN_STREAM("## ERROR MsgPackParser::Parse(): invalid property values");
             }
 
+            int layerId = decoder_config.GetLayerIDfromGroupIdx((int)groupIdx); // groups of disabled layers are not transmitted
+            if (layerId < 0)
+            {
+                ROS_WARN_STREAM("## ERROR MsgPackParser::Parse(): group " << groupIdx << " exceeds the active layers, group ignored");
+                continue;
+            }
+
             // Convert to cartesian coordinates
             result.scandata.push_back(sick_scansegment_xd::ScanSegmentParserOutput::Scangroup());
             result.scandata.back().timestampStart_sec = u32TimestampStart_sec;
@@ -739,18 +752,46 @@ bool sick_scansegment_xd::MsgPackParser::Parse(std::istream& msgpack_istream, fi
             std::vector<sick_scansegment_xd::ScanSegmentParserOutput::Scanline>& groupData = result.scandata.back().scanlines;
             groupData.reserve(iEchoCount);
             int iPointCount = (int)channelTheta.data().size();
-            // Precompute sin and cos values of azimuth and elevation
-            float elevation = -channelPhi.data()[0]; // elevation must be negated, a positive pitch-angle yields negative z-coordinates
-            float cos_elevation = std::cos(elevation);
-            float sin_elevation = std::sin(elevation);
-            std::vector<float> cos_azimuth(iPointCount);
-            std::vector<float> sin_azimuth(iPointCount);
+            // Precompute sin and cos values of azimuth and elevation incl. the optional intrinsic corrections of the layer
+            const sick_scansegment_xd::LayerCalibration* calibration = decoder_config.GetLayerCalibration(layerId);
+            float layer_elevation = -channelPhi.data()[0] + (calibration ? calibration->elevation_offset : 0.0f); // elevation must be negated, a positive pitch-angle yields negative z-coordinates
+            float layer_cos_elevation = std::cos(layer_elevation);
+            float layer_sin_elevation = std::sin(layer_elevation);
+            float layer_azimuth_offset = (calibration ? calibration->azimuth_offset : 0.0f);
+            // Unit direction of each beam, rotated by the optional transform (see DecoderConfig::SetTransform())
+            const sick_scansegment_xd::CartesianTransform* transform = decoder_config.GetTransform();
+            const float translation_x = (transform ? transform->translation[0] : 0.0f);
+            const float translation_y = (transform ? transform->translation[1] : 0.0f);
+            const float translation_z = (transform ? transform->translation[2] : 0.0f);
+            std::vector<float> lut_azimuth(iPointCount);
+            std::vector<float> lut_elevation(iPointCount, layer_elevation);
+            std::vector<float> lut_dir_x(iPointCount);
+            std::vector<float> lut_dir_y(iPointCount);
+            std::vector<float> lut_dir_z(iPointCount);
             std::vector<uint64_t> lut_lidar_timestamp_microsec(iPointCount);
             for (int pointIdx = 0; pointIdx < iPointCount; pointIdx++)
             {
-                float azimuth = channelTheta.data()[pointIdx];
-                cos_azimuth[pointIdx] = std::cos(azimuth);
-                sin_azimuth[pointIdx] = std::sin(azimuth);
+                float azimuth = channelTheta.data()[pointIdx] + layer_azimuth_offset;
+                float cos_elevation = layer_cos_elevation;
+                float sin_elevation = layer_sin_elevation;
+                if (calibration && calibration->HasBeams())
+                {
+                    size_t beam_idx = calibration->BeamIdx(azimuth);
+                    float sin_offset = calibration->beam_sin_elevation_offset[beam_idx];
+                    float cos_offset = calibration->beam_cos_elevation_offset[beam_idx];
+                    azimuth += calibration->beam_azimuth_offset[beam_idx];
+                    lut_elevation[pointIdx] = layer_elevation + calibration->beam_elevation_offset[beam_idx];
+                    sin_elevation = layer_sin_elevation * cos_offset + layer_cos_elevation * sin_offset;
+                    cos_elevation = layer_cos_elevation * cos_offset - layer_sin_elevation * sin_offset;
+                }
+                lut_azimuth[pointIdx] = azimuth;
+                lut_dir_x[pointIdx] = std::cos(azimuth) * cos_elevation;
+                lut_dir_y[pointIdx] = std::sin(azimuth) * cos_elevation;
+                lut_dir_z[pointIdx] = sin_elevation;
+                if (transform)
+                {
+                    transform->Rotate(lut_dir_x[pointIdx], lut_dir_y[pointIdx], lut_dir_z[pointIdx]);
+                }
                 lut_lidar_timestamp_microsec[pointIdx] = ((pointIdx * (u32TimestampStop - u32TimestampStart)) / (iPointCount - 1)) + u32TimestampStart;
             }
             for (int echoIdx = 0; echoIdx < iEchoCount; echoIdx++)
@@ -767,15 +808,17 @@ bool sick_scansegment_xd::MsgPackParser::Parse(std::istream& msgpack_istream, fi
                         reflectorbit |= ((propertyValues[n][pointIdx]) & 0x01); // reflector bit is set, if a reflector is detected on any number of echos
                     float dist = 0.001f * distValues[echoIdx].data()[pointIdx]; // convert distance to meter
                     float intensity = rssiValues[echoIdx].data()[pointIdx];
-                    float x = dist * cos_azimuth[pointIdx] * cos_elevation;
-                    float y = dist * sin_azimuth[pointIdx] * cos_elevation;
-                    float z = dist * sin_elevation;
-                    float azimuth = channelTheta.data()[pointIdx];
+                    float x = dist * lut_dir_x[pointIdx] + translation_x;
+                    float y = dist * lut_dir_y[pointIdx] + translation_y;
+                    float z = dist * lut_dir_z[pointIdx] + translation_z;
+                    float azimuth = lut_azimuth[pointIdx];
+                    float elevation = lut_elevation[pointIdx];
                     // float azimuth_norm = normalizeAngle(azimuth);
                     uint64_t lidar_timestamp_microsec = lut_lidar_timestamp_microsec[pointIdx];
-                    scanline.points.push_back(sick_scansegment_xd::ScanSegmentParserOutput::LidarPoint(x, y, z, intensity, dist, azimuth, elevation, groupIdx, echoIdx, pointIdx, lidar_timestamp_microsec, reflectorbit));
+                    scanline.points.push_back(sick_scansegment_xd::ScanSegmentParserOutput::LidarPoint(x, y, z, intensity, dist, azimuth, elevation, layerId, echoIdx, pointIdx, lidar_timestamp_microsec, reflectorbit));
                 }
             }
+            decoder_config.ApplyWeatherFilter(result.scandata.back()); // optional weather filter, needs all echos of the group
         }
     }
     catch (const std::exception& exc)
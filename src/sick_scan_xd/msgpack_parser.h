@@ -78,12 +78,18 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "common.h"
 #include "fifo.h"
 #include "scansegment_parser_output.h"
 
+class SoftwarePLL;
+
 namespace sick_scansegment_xd
 {
+    class DecoderConfig;
+
 	/*
      * @brief class MsgPackParser unpacks and parses msgpack data for the sick 3D lidar multiScan136.
      */
@@ -110,7 +116,7 @@ namespace sick_scansegment_xd
          *
          * @param[in+out] msgpack_ifstream the binary input stream delivering the binary msgpack data
          * @param[in] msgpack_timestamp receive timestamp of msgpack_data
-         * @param[in] add_transform_xyz_rpy Apply an additional transform to the cartesian pointcloud, default: "0,0,0,0,0,0" (i.e. no transform)
+         * An optional transform of the cartesian pointcloud is configured by DecoderConfig::SetTransform()
          * @param[out] result msgpack data converted to scanlines of type ScanSegmentParserOutput
          * @param[in+out] msgpack_validator_data_collector collects MsgPackValidatorData over N msgpacks
          * @param[in] msgpack_validator msgpack validation, see MsgPackValidator for details
@@ -118,11 +124,14 @@ namespace sick_scansegment_xd
          * @param[in] discard_msgpacks_not_validated true: msgpacks are discarded if not validated, false: error message if a msgpack is not validated
          * @param[in] use_software_pll true (default): result timestamp from sensor ticks by software pll, false: result timestamp from msg receiving
          * @param[in] verbose true: enable debug output, false: quiet mode
+         * @param[in] software_pll pll of the sensor which sent the msgpack (default: 0, i.e. the process wide SoftwarePLL::instance())
+         * @param[in] decoder_config settings of the sensor which sent the msgpack (default: 0, i.e. all layers active, no filter)
          */
         static bool Parse(const std::vector<uint8_t>& msgpack_data, fifo_timestamp msgpack_timestamp, ScanSegmentParserOutput& result, 
             // sick_scansegment_xd::MsgPackValidatorData& msgpack_validator_data_collector, const sick_scansegment_xd::MsgPackValidator& msgpack_validator = sick_scansegment_xd::MsgPackValidator(), 
             // bool msgpack_validator_enabled = false, bool discard_msgpacks_not_validated = false,
-            bool use_software_pll = true, bool verbose = false);
+            bool use_software_pll = true, bool verbose = false, SoftwarePLL* software_pll = 0,
+            const DecoderConfig* decoder_config = 0);
 
     /*
         * @brief unpacks and parses msgpack data from a binary input stream.
@@ -152,7 +161,7 @@ namespace sick_scansegment_xd
         *
         * @param[in+out] msgpack_ifstream the binary input stream delivering the binary msgpack data
          * @param[in] msgpack_timestamp receive timestamp of msgpack_data
-         * @param[in] add_transform_xyz_rpy Apply an additional transform to the cartesian pointcloud, default: "0,0,0,0,0,0" (i.e. no transform)
+         * An optional transform of the cartesian pointcloud is configured by DecoderConfig::SetTransform()
          * @param[out] result msgpack data converted to scanlines of type ScanSegmentParserOutput
          * @param[in+out] msgpack_validator_data_collector collects MsgPackValidatorData over N msgpacks
          * @param[in] msgpack_validator msgpack validation, see MsgPackValidator for details
@@ -160,12 +169,15 @@ namespace sick_scansegment_xd
          * @param[in] discard_msgpacks_not_validated true: msgpacks are discarded if not validated, false: error message if a msgpack is not validated
          * @param[in] use_software_pll true (default): result timestamp from sensor ticks by software pll, false: result timestamp from msg receiving
          * @param[in] verbose true: enable debug output, false: quiet mode
+         * @param[in] software_pll pll of the sensor which sent the msgpack (default: 0, i.e. the process wide SoftwarePLL::instance())
+         * @param[in] decoder_config settings of the sensor which sent the msgpack (default: 0, i.e. all layers active, no filter)
          */
         static bool Parse(std::istream& msgpack_istream, fifo_timestamp msgpack_timestamp, ScanSegmentParserOutput& result, 
             // sick_scansegment_xd::MsgPackValidatorData& msgpack_validator_data_collector,
             // const sick_scansegment_xd::MsgPackValidator& msgpack_validator = sick_scansegment_xd::MsgPackValidator(),
             // bool msgpack_validator_enabled = false, bool discard_msgpacks_not_validated = false, 
-            bool use_software_pll = true, bool verbose = false);
+            bool use_software_pll = true, bool verbose = false, SoftwarePLL* software_pll = 0,
+            const DecoderConfig* decoder_config = 0);
 
         /*
          * @brief Returns a hexdump of a msgpack. To get a well formatted json struct from a msgpack,
@@ -176,10 +188,10 @@ namespace sick_scansegment_xd
     protected:
 
         /*
-         * @brief Counter for each message (each scandata decoded from msgpack data)
+         * @brief Counter for each message (each scandata decoded from msgpack data), atomic since Parse() may run in several threads
          */
-        static int messageCount;
-        static int telegramCount;
+        static std::atomic<int> messageCount;
+        static std::atomic<int> telegramCount;
 
 	};  // class MsgPackParser
 
@@ -0,0 +1,84 @@
+/*
+ * @brief packed_point defines the point layout of the PointCloud2 messages published by the driver.
+ * The same layout is used by the frame ring (see frame_ring.h), the points output of multiscan_decode
+ * and the packing benchmarks of decode_benchmark.
+ *
+ * Point layout (56 byte, host byte order), see MultiscanNode::scan_fields:
+ *   x, y, z, i, range, azimuth, elevation as float (offsets 0 ... 24)
+ *   layer, echo, index as uint32_t (offsets 28, 32, 36)
+ *   t as uint64_t lidar timestamp in microseconds (offset 40, fields "tl" and "th")
+ *   reflector as uint8_t (offset 48), followed by 7 byte zero padding
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "scansegment_parser_output.h"
+
+namespace sick_scansegment_xd
+{
+#pragma pack(push, 1)
+    /*
+    * @brief struct PackedPoint is one point of a PointCloud2 message of the driver. The struct is packed, so that
+    * its layout is the wire layout and independent of the layout of ScanSegmentParserOutput::LidarPoint.
+    */
+    struct PackedPoint
+    {
+        float x;            // cartesian x coordinate in meter
+        float y;            // cartesian y coordinate in meter
+        float z;            // cartesian z coordinate in meter
+        float i;            // intensity
+        float range;        // polar coordinate range in meter
+        float azimuth;      // polar coordinate azimuth in radians
+        float elevation;    // polar coordinate elevation in radians
+        uint32_t layer;     // group index
+        uint32_t echo;      // echo index
+        uint32_t index;     // point index within the segment
+        uint64_t t;         // lidar timestamp in microseconds
+        uint8_t reflector;  // reflector bit, 0 or 1
+        uint8_t padding[7]; // zero, keeps t of the next point 8 byte aligned
+    };
+#pragma pack(pop)
+
+    static_assert(sizeof(PackedPoint) == 56, "PackedPoint: unexpected size");
+    static_assert(offsetof(PackedPoint, layer) == 28 && offsetof(PackedPoint, echo) == 32 && offsetof(PackedPoint, index) == 36,
+        "PackedPoint: unexpected offset of layer, echo or index");
+    static_assert(offsetof(PackedPoint, t) == 40 && offsetof(PackedPoint, reflector) == 48, "PackedPoint: unexpected offset of t or reflector");
+
+    /*
+    * @brief Packs a point into sizeof(PackedPoint) bytes at data, which need not be aligned. The fields are
+    * written in place: a temporary PackedPoint copied as a whole is about twice as slow (store forwarding).
+    */
+    inline void packPoint(const ScanSegmentParserOutput::LidarPoint& point, uint8_t* data)
+    {
+        static_assert(sizeof(point.groupIdx) == sizeof(PackedPoint::layer) && sizeof(point.echoIdx) == sizeof(PackedPoint::echo)
+            && sizeof(point.pointIdx) == sizeof(PackedPoint::index) && sizeof(point.lidar_timestamp_microsec) == sizeof(PackedPoint::t)
+            && sizeof(point.reflectorbit) == sizeof(PackedPoint::reflector), "PackedPoint: field size differs from LidarPoint");
+        memcpy(data + offsetof(PackedPoint, x), &point.x, sizeof(float));
+        memcpy(data + offsetof(PackedPoint, y), &point.y, sizeof(float));
+        memcpy(data + offsetof(PackedPoint, z), &point.z, sizeof(float));
+        memcpy(data + offsetof(PackedPoint, i), &point.i, sizeof(float));
+        memcpy(data + offsetof(PackedPoint, range), &point.range, sizeof(float));
+        memcpy(data + offsetof(PackedPoint, azimuth), &point.azimuth, sizeof(float));
+        memcpy(data + offsetof(PackedPoint, elevation), &point.elevation, sizeof(float));
+        memcpy(data + offsetof(PackedPoint, layer), &point.groupIdx, sizeof(uint32_t));
+        memcpy(data + offsetof(PackedPoint, echo), &point.echoIdx, sizeof(uint32_t));
+        memcpy(data + offsetof(PackedPoint, index), &point.pointIdx, sizeof(uint32_t));
+        memcpy(data + offsetof(PackedPoint, t), &point.lidar_timestamp_microsec, sizeof(uint64_t));
+        data[offsetof(PackedPoint, reflector)] = point.reflectorbit;
+        memset(data + offsetof(PackedPoint, padding), 0, sizeof(PackedPoint::padding));
+    }
+
+    /*
+    * @brief Reads the point at data, which need not be aligned.
+    */
+    inline PackedPoint unpackPoint(const uint8_t* data)
+    {
+        PackedPoint packed;
+        memcpy(&packed, data, sizeof(PackedPoint));
+        return packed;
+    }
+
+} // namespace sick_scansegment_xd
@@ -0,0 +1,584 @@
+/*
+ * @brief range_image_codec losslessly compresses multiScan frames in compact format.
+ * See range_image_codec.h for the compressed formats.
+ */
+#include <algorithm>
+#include <cstring>
+
+#include "range_image_codec.h"
+#include "compact_parser.h"
+#include "udp_sockets.h"
+#include "sick_ros_wrapper.h"
+
+static const char s_frame_magic[4] = { 'M', 'S', 'R', 'I' };
+static const uint16_t s_frame_version = 1;
+static const char s_log_magic[8] = { 'M', 'S', 'R', 'I', 'L', 'O', 'G', '1' };
+static const uint32_t s_header_size = 32;           // compact header incl. start sequence
+static const uint32_t s_max_datagram_size = 1024 * 1024;
+static const uint32_t s_max_layers = 16;            // multiScan136
+static const uint32_t s_max_echos = 3;
+static const uint32_t s_rice_escape = 24;           // unary quotients >= s_rice_escape are followed by the raw 16 bit value
+
+enum RangeImageMethod { METHOD_STORED = 0, METHOD_RANGE_IMAGE = 1 };
+enum RangeImagePredictor { PREDICT_LEFT = 0, PREDICT_LINEAR = 1, PREDICT_UP = 2, PREDICT_MED = 3 };
+
+template <typename T> static inline void appendLE(std::vector<uint8_t>& buffer, T val)
+{
+    for (size_t n = 0; n < sizeof(T); n++)
+        buffer.push_back((uint8_t)((val >> (8 * n)) & 0xFF));
+}
+
+template <typename T> static inline T readLE(const uint8_t* p)
+{
+    T val = 0;
+    for (size_t n = 0; n < sizeof(T); n++)
+        val |= ((T)p[n] << (8 * n));
+    return val;
+}
+
+/*
+ * @brief msb first bit stream
+ */
+class BitWriter
+{
+public:
+    BitWriter(std::vector<uint8_t>& buffer) : m_buffer(buffer) {}
+    inline void Put(uint64_t value, int num_bits) // num_bits <= 56
+    {
+        m_acc = (m_acc << num_bits) | value;
+        m_num_bits += num_bits;
+        while (m_num_bits >= 8)
+        {
+            m_num_bits -= 8;
+            m_buffer.push_back((uint8_t)(m_acc >> m_num_bits));
+        }
+    }
+    inline void Flush()
+    {
+        if (m_num_bits > 0)
+            m_buffer.push_back((uint8_t)(m_acc << (8 - m_num_bits)));
+        m_num_bits = 0;
+    }
+protected:
+    std::vector<uint8_t>& m_buffer;
+    uint64_t m_acc = 0;
+    int m_num_bits = 0;
+};
+
+class BitReader
+{
+public:
+    BitReader(const uint8_t* data, size_t size) : m_data(data), m_end(data + size) {}
+    inline uint32_t Get(int num_bits) // num_bits <= 32
+    {
+        if (m_num_bits < num_bits)
+            Refill();
+        m_num_bits -= num_bits;
+        return (uint32_t)((m_acc >> m_num_bits) & ((1ULL << num_bits) - 1));
+    }
+    // counts and consumes up to max_ones (<= 32) one bits, and the terminating zero bit if less than max_ones
+    inline uint32_t GetUnary(uint32_t max_ones)
+    {
+        if (m_num_bits <= 32)
+            Refill();
+        uint64_t window = ~(m_acc << (64 - m_num_bits));
+        uint32_t num_ones = max_ones;
+        for (uint32_t n = 0; n < max_ones; n++) // leading zeros of window, i.e. leading ones of the stream
+        {
+            if (window & (1ULL << (63 - n)))
+            {
+                num_ones = n;
+                break;
+            }
+        }
+        m_num_bits -= (num_ones < max_ones ? num_ones + 1 : num_ones);
+        return num_ones;
+    }
+    bool Overrun() const { return m_num_bits < m_num_padding_bits; } // true if bits after the end of data have been consumed
+protected:
+    inline void Refill()
+    {
+        while (m_num_bits <= 56)
+        {
+            if (m_data < m_end)
+                m_acc = (m_acc << 8) | *m_data++;
+            else
+                m_acc <<= 8, m_num_padding_bits += 8;
+            m_num_bits += 8;
+        }
+    }
+    const uint8_t* m_data;
+    const uint8_t* m_end;
+    uint64_t m_acc = 0;
+    int m_num_bits = 0;
+    int m_num_padding_bits = 0;   // zero bits appended after the end of data
+};
+
+static inline uint16_t zigzag(int32_t residual)
+{
+    int16_t r = (int16_t)(uint16_t)residual; // residuals are taken modulo 2^16
+    return (uint16_t)(((uint16_t)r << 1) ^ (uint16_t)(r >> 15));
+}
+
+static inline uint16_t unzigzag(uint16_t z)
+{
+    return (uint16_t)((z >> 1) ^ (uint16_t)(0 - (z & 1)));
+}
+
+static inline int32_t predict(int predictor, const uint16_t* row, const uint16_t* up, size_t b)
+{
+    if (b == 0)
+        return (up ? up[0] : 0);
+    int32_t left = row[b - 1];
+    switch (predictor)
+    {
+    case PREDICT_LINEAR:
+        return (b >= 2 ? 2 * left - (int32_t)row[b - 2] : left);
+    case PREDICT_UP:
+        return (up ? up[b] : left);
+    case PREDICT_MED: // median edge detector of LOCO-I
+        if (up)
+        {
+            int32_t top = up[b], top_left = up[b - 1];
+            if (top_left >= std::max(left, top))
+                return std::min(left, top);
+            if (top_left <= std::min(left, top))
+                return std::max(left, top);
+            return left + top - top_left;
+        }
+        return left;
+    default:
+        return left;
+    }
+}
+
+// residuals of a row for a given predictor, returns the residual sum
+template <int predictor> static uint64_t predictRow(const uint16_t* row, const uint16_t* up, size_t num_values, uint16_t* residuals)
+{
+    uint64_t sum = 0;
+    for (size_t b = 0; b < num_values; b++)
+    {
+        residuals[b] = zigzag((int32_t)row[b] - predict(predictor, row, up, b));
+        sum += residuals[b];
+    }
+    return sum;
+}
+
+static inline uint32_t riceBits(const uint16_t* values, size_t num_values, int k)
+{
+    uint32_t bits = 0;
+    for (size_t n = 0; n < num_values; n++)
+    {
+        uint32_t q = (uint32_t)values[n] >> k;
+        bits += (q < s_rice_escape ? q + 1 + k : s_rice_escape + 16);
+    }
+    return bits;
+}
+
+/*
+ * @brief codes a row of values, predicted from the row itself and the row above (same channel, previous layer, 0 for the first layer).
+ */
+static void encodeRow(const uint16_t* row, const uint16_t* up, size_t num_values, BitWriter& bits, std::vector<uint16_t>& residuals, std::vector<uint16_t>& candidate)
+{
+    // choose the predictor with the least residual sum
+    residuals.resize(num_values);
+    candidate.resize(num_values);
+    int best_predictor = PREDICT_LEFT;
+    uint64_t best_sum = predictRow<PREDICT_LEFT>(row, up, num_values, residuals.data());
+    for (int predictor = PREDICT_LINEAR; predictor <= (up ? PREDICT_MED : PREDICT_LINEAR); predictor++)
+    {
+        uint64_t sum = 0;
+        switch (predictor)
+        {
+        case PREDICT_LINEAR: sum = predictRow<PREDICT_LINEAR>(row, up, num_values, candidate.data()); break;
+        case PREDICT_UP: sum = predictRow<PREDICT_UP>(row, up, num_values, candidate.data()); break;
+        default: sum = predictRow<PREDICT_MED>(row, up, num_values, candidate.data()); break;
+        }
+        if (sum < best_sum)
+        {
+            best_sum = sum;
+            best_predictor = predictor;
+            residuals.swap(candidate);
+        }
+    }
+    // rice parameter near log2 of the mean residual, refined by the exact bit count
+    int k_mean = 0;
+    for (uint64_t mean = best_sum / std::max<size_t>(num_values, 1); mean > 0; mean >>= 1)
+        k_mean++;
+    int best_k = k_mean;
+    uint32_t best_bits = UINT32_MAX;
+    for (int k = std::max(0, k_mean - 2); k <= std::min(16, k_mean + 1); k++)
+    {
+        uint32_t num_bits = riceBits(residuals.data(), num_values, k);
+        if (num_bits < best_bits)
+        {
+            best_bits = num_bits;
+            best_k = k;
+        }
+    }
+    bits.Put((uint32_t)best_predictor, 2);
+    bits.Put((uint32_t)best_k, 5);
+    for (size_t b = 0; b < num_values; b++)
+    {
+        uint32_t q = (uint32_t)residuals[b] >> best_k;
+        if (q < s_rice_escape) // q ones, a zero and k bits remainder
+        {
+            bits.Put((((1ULL << q) - 1) << (best_k + 1)) | (residuals[b] & ((1u << best_k) - 1)), (int)q + 1 + best_k);
+        }
+        else
+        {
+            bits.Put((1u << s_rice_escape) - 1, (int)s_rice_escape);
+            bits.Put(residuals[b], 16);
+        }
+    }
+}
+
+static bool decodeRow(uint16_t* row, const uint16_t* up, size_t num_values, BitReader& bits)
+{
+    int predictor = (int)bits.Get(2);
+    int k = (int)bits.Get(5);
+    if (k > 16 || (!up && (predictor == PREDICT_UP || predictor == PREDICT_MED)))
+        return false;
+    for (size_t b = 0; b < num_values; b++)
+    {
+        uint32_t q = bits.GetUnary(s_rice_escape);
+        uint32_t z = (q < s_rice_escape ? ((q << k) | bits.Get(k)) : bits.Get(16));
+        if (z > 0xFFFF)
+            return false;
+        row[b] = (uint16_t)(predict(predictor, row, up, b) + (int32_t)(int16_t)unzigzag((uint16_t)z));
+    }
+    return !bits.Overrun();
+}
+
+/*
+ * @brief measurement data layout of a module: per beam and layer the channels (distance and rssi of each echo,
+ * azimuth, property) with their byte offset and size within a beam record.
+ */
+struct MeasurementLayout
+{
+    std::vector<uint32_t> channel_offset;
+    std::vector<uint32_t> channel_bytes;
+    uint32_t record_bytes = 0;
+    uint32_t num_layers = 0;
+    uint32_t num_beams = 0;
+
+    bool Init(const sick_scansegment_xd::CompactModuleMetaData& meta_data, uint32_t telegram_version, uint32_t measurement_size)
+    {
+        if (!meta_data.valid || meta_data.NumberOfLinesInModule < 1 || meta_data.NumberOfLinesInModule > s_max_layers
+            || meta_data.NumberOfBeamsPerScan < 1 || meta_data.NumberOfEchosPerBeam < 1 || meta_data.NumberOfEchosPerBeam > s_max_echos
+            || (telegram_version != 3 && telegram_version != 4))
+            return false;
+        // the measurement must hold exactly one record per layer and beam, checked before anything is allocated
+        bool dist = ((meta_data.DataContentEchos & 0x01) != 0), rssi = ((meta_data.DataContentEchos & 0x02) != 0);
+        bool prop = ((meta_data.DataContentBeams & 0x01) != 0), azim = ((meta_data.DataContentBeams & 0x02) != 0);
+        uint64_t expected_record_bytes = meta_data.NumberOfEchosPerBeam * ((dist ? 2 : 0) + (rssi ? 2 : 0)) + (azim ? 2 : 0) + (prop ? 1 : 0);
+        if (expected_record_bytes == 0 || expected_record_bytes * meta_data.NumberOfLinesInModule * meta_data.NumberOfBeamsPerScan != measurement_size)
+            return false;
+        auto add_channel = [this](uint32_t bytes) { channel_offset.push_back(record_bytes); channel_bytes.push_back(bytes); record_bytes += bytes; };
+        for (uint32_t echo_idx = 0; echo_idx < meta_data.NumberOfEchosPerBeam; echo_idx++)
+        {
+            if (dist)
+                add_channel(2); // distance
+            if (rssi)
+                add_channel(2); // rssi
+        }
+        if (telegram_version == 3)
+        {
+            if (azim) add_channel(2);
+            if (prop) add_channel(1);
+        }
+        else
+        {
+            if (prop) add_channel(1);
+            if (azim) add_channel(2);
+        }
+        num_layers = meta_data.NumberOfLinesInModule;
+        num_beams = meta_data.NumberOfBeamsPerScan;
+        return true;
+    }
+};
+
+static void encodeMeasurement(const uint8_t* data, const MeasurementLayout& layout, std::vector<uint8_t>& encoded)
+{
+    const size_t num_channels = layout.channel_bytes.size(), num_beams = layout.num_beams;
+    std::vector<uint16_t> image(num_channels * layout.num_layers * num_beams), residuals, candidate;
+    for (uint32_t beam_idx = 0; beam_idx < layout.num_beams; beam_idx++)
+    {
+        for (uint32_t layer_idx = 0; layer_idx < layout.num_layers; layer_idx++)
+        {
+            const uint8_t* record = data + ((size_t)beam_idx * layout.num_layers + layer_idx) * layout.record_bytes;
+            for (size_t channel_idx = 0; channel_idx < num_channels; channel_idx++)
+            {
+                const uint8_t* p = record + layout.channel_offset[channel_idx];
+                image[(channel_idx * layout.num_layers + layer_idx) * num_beams + beam_idx] = (layout.channel_bytes[channel_idx] == 2 ? readLE<uint16_t>(p) : p[0]);
+            }
+        }
+    }
+    BitWriter bits(encoded);
+    for (size_t channel_idx = 0; channel_idx < num_channels; channel_idx++)
+    {
+        for (uint32_t layer_idx = 0; layer_idx < layout.num_layers; layer_idx++)
+        {
+            const uint16_t* row = image.data() + (channel_idx * layout.num_layers + layer_idx) * num_beams;
+            encodeRow(row, (layer_idx > 0 ? row - num_beams : 0), num_beams, bits, residuals, candidate);
+        }
+    }
+    bits.Flush();
+}
+
+static bool decodeMeasurement(const uint8_t* encoded, size_t encoded_size, const MeasurementLayout& layout, uint8_t* data)
+{
+    const size_t num_channels = layout.channel_bytes.size(), num_beams = layout.num_beams;
+    std::vector<uint16_t> image(num_channels * layout.num_layers * num_beams);
+    BitReader bits(encoded, encoded_size);
+    for (size_t channel_idx = 0; channel_idx < num_channels; channel_idx++)
+    {
+        for (uint32_t layer_idx = 0; layer_idx < layout.num_layers; layer_idx++)
+        {
+            uint16_t* row = image.data() + (channel_idx * layout.num_layers + layer_idx) * num_beams;
+            if (!decodeRow(row, (layer_idx > 0 ? row - num_beams : 0), num_beams, bits))
+                return false;
+        }
+    }
+    for (uint32_t beam_idx = 0; beam_idx < layout.num_beams; beam_idx++)
+    {
+        for (uint32_t layer_idx = 0; layer_idx < layout.num_layers; layer_idx++)
+        {
+            uint8_t* record = data + ((size_t)beam_idx * layout.num_layers + layer_idx) * layout.record_bytes;
+            for (size_t channel_idx = 0; channel_idx < num_channels; channel_idx++)
+            {
+                uint16_t value = image[(channel_idx * layout.num_layers + layer_idx) * num_beams + beam_idx];
+                uint8_t* p = record + layout.channel_offset[channel_idx];
+                p[0] = (uint8_t)(value & 0xFF);
+                if (layout.channel_bytes[channel_idx] == 2)
+                    p[1] = (uint8_t)(value >> 8);
+                else if (value > 0xFF)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * @brief appends a compressed segment block.
+ */
+bool sick_scansegment_xd::RangeImageCodec::CompressSegment(const uint8_t* datagram, size_t size, std::vector<uint8_t>& block)
+{
+    uint32_t datagram_size = 0, num_bytes_required = 0;
+    if (size < s_header_size + sizeof(uint32_t) || readLE<uint32_t>(datagram) != 0x02020202 || readLE<uint32_t>(datagram + 4) != 1
+        || !CompactDataParser::ParseSegment(datagram, size, 0, datagram_size, num_bytes_required) || datagram_size > s_max_datagram_size)
+    {
+        return false;
+    }
+    const size_t block_start = block.size();
+    appendLE<uint32_t>(block, 0); // block size, set below
+    appendLE<uint32_t>(block, datagram_size);
+    // the crc of a complete datagram is taken as is, it has been checked on receive
+    appendLE<uint32_t>(block, (size >= datagram_size + sizeof(uint32_t) ? readLE<uint32_t>(datagram + datagram_size) : crc32(0, datagram, datagram_size)));
+    block.insert(block.end(), datagram, datagram + s_header_size);
+    CompactDataHeader header = CompactDataParser::ParseHeader(datagram + 4);
+    uint32_t module_offset = s_header_size, module_size = header.sizeModule0;
+    while (module_size > 0 && module_offset + module_size <= datagram_size)
+    {
+        uint32_t metadata_size = 0;
+        CompactModuleMetaData meta_data = CompactDataParser::ParseModuleMetaData(datagram + module_offset, module_size, header.telegramVersion, metadata_size);
+        if (!meta_data.valid || metadata_size > module_size)
+            return false;
+        const uint8_t* measurement = datagram + module_offset + metadata_size;
+        const uint32_t measurement_size = module_size - metadata_size;
+        appendLE<uint32_t>(block, metadata_size);
+        block.insert(block.end(), datagram + module_offset, measurement);
+        appendLE<uint32_t>(block, measurement_size);
+        MeasurementLayout layout;
+        std::vector<uint8_t> encoded;
+        if (layout.Init(meta_data, header.telegramVersion, measurement_size))
+            encodeMeasurement(measurement, layout, encoded);
+        if (!encoded.empty() && encoded.size() < measurement_size)
+        {
+            block.push_back(METHOD_RANGE_IMAGE);
+            appendLE<uint32_t>(block, (uint32_t)encoded.size());
+            block.insert(block.end(), encoded.begin(), encoded.end());
+        }
+        else
+        {
+            block.push_back(METHOD_STORED);
+            appendLE<uint32_t>(block, measurement_size);
+            block.insert(block.end(), measurement, measurement + measurement_size);
+        }
+        module_offset += module_size;
+        module_size = meta_data.NextModuleSize;
+    }
+    if (module_offset != datagram_size)
+        return false;
+    uint32_t block_size = (uint32_t)(block.size() - block_start);
+    for (size_t n = 0; n < sizeof(block_size); n++)
+        block[block_start + n] = (uint8_t)((block_size >> (8 * n)) & 0xFF);
+    return true;
+}
+
+/*
+ * @brief decompresses a segment block.
+ */
+bool sick_scansegment_xd::RangeImageCodec::DecompressSegment(const uint8_t* block, size_t size, size_t& block_size, std::vector<uint8_t>& datagram)
+{
+    datagram.clear();
+    if (size < 3 * sizeof(uint32_t) + s_header_size)
+        return false;
+    block_size = readLE<uint32_t>(block);
+    const uint32_t datagram_size = readLE<uint32_t>(block + 4);
+    const uint32_t datagram_crc = readLE<uint32_t>(block + 8);
+    if (block_size > size || block_size < 3 * sizeof(uint32_t) + s_header_size || datagram_size > s_max_datagram_size || datagram_size < s_header_size)
+        return false;
+    const uint8_t* p = block + 12;
+    const uint8_t* end = block + block_size;
+    datagram.reserve(datagram_size + sizeof(uint32_t));
+    datagram.insert(datagram.end(), p, p + s_header_size);
+    p += s_header_size;
+    CompactDataHeader header = CompactDataParser::ParseHeader(datagram.data() + 4);
+    while (datagram.size() < datagram_size)
+    {
+        if (end - p < 4)
+            return false;
+        uint32_t metadata_size = readLE<uint32_t>(p);
+        p += 4;
+        if ((size_t)(end - p) < (size_t)metadata_size + 9)
+            return false;
+        const uint8_t* metadata = p;
+        p += metadata_size;
+        uint32_t measurement_size = readLE<uint32_t>(p);
+        uint8_t method = p[4];
+        uint32_t encoded_size = readLE<uint32_t>(p + 5);
+        p += 9;
+        if ((size_t)(end - p) < encoded_size || datagram.size() + metadata_size + (uint64_t)measurement_size > datagram_size)
+            return false;
+        datagram.insert(datagram.end(), metadata, metadata + metadata_size);
+        if (method == METHOD_STORED && encoded_size == measurement_size)
+        {
+            datagram.insert(datagram.end(), p, p + encoded_size);
+        }
+        else if (method == METHOD_RANGE_IMAGE)
+        {
+            uint32_t parsed_metadata_size = 0;
+            CompactModuleMetaData meta_data = CompactDataParser::ParseModuleMetaData(metadata, metadata_size, header.telegramVersion, parsed_metadata_size);
+            MeasurementLayout layout;
+            if (parsed_metadata_size != metadata_size || !layout.Init(meta_data, header.telegramVersion, measurement_size))
+                return false;
+            datagram.resize(datagram.size() + measurement_size);
+            if (!decodeMeasurement(p, encoded_size, layout, datagram.data() + datagram.size() - measurement_size))
+                return false;
+        }
+        else
+        {
+            return false;
+        }
+        p += encoded_size;
+    }
+    if (datagram.size() != datagram_size || p != end || crc32(0, datagram.data(), datagram.size()) != datagram_crc)
+        return false;
+    appendLE<uint32_t>(datagram, datagram_crc);
+    return true;
+}
+
+/*
+ * @brief compresses the segments of a frame.
+ */
+bool sick_scansegment_xd::RangeImageCodec::CompressFrame(const std::vector<const std::vector<uint8_t>*>& datagrams, std::vector<uint8_t>& frame)
+{
+    if (datagrams.size() > 0xFFFF)
+        return false;
+    BeginFrame((uint16_t)datagrams.size(), frame);
+    for (const std::vector<uint8_t>* datagram : datagrams)
+    {
+        if (!datagram || !CompressSegment(datagram->data(), datagram->size(), frame))
+            return false;
+    }
+    return true;
+}
+
+/*
+ * @brief starts a compressed frame.
+ */
+void sick_scansegment_xd::RangeImageCodec::BeginFrame(uint16_t num_segments, std::vector<uint8_t>& frame)
+{
+    frame.resize(sizeof(s_frame_magic)); // resize + memcpy instead of insert, which trips -Warray-bounds at -O3
+    memcpy(frame.data(), s_frame_magic, sizeof(s_frame_magic));
+    appendLE<uint16_t>(frame, s_frame_version);
+    appendLE<uint16_t>(frame, num_segments);
+}
+
+/*
+ * @brief decompresses a frame.
+ */
+bool sick_scansegment_xd::RangeImageCodec::DecompressFrame(const uint8_t* frame, size_t size, std::vector<std::vector<uint8_t>>& datagrams)
+{
+    datagrams.clear();
+    if (size < 8 || memcmp(frame, s_frame_magic, sizeof(s_frame_magic)) != 0 || readLE<uint16_t>(frame + 4) != s_frame_version)
+        return false;
+    uint16_t num_segments = readLE<uint16_t>(frame + 6);
+    if (num_segments > (size - 8) / (3 * sizeof(uint32_t) + s_header_size)) // each segment block holds at least its header
+        return false;
+    datagrams.resize(num_segments);
+    size_t offset = 8;
+    for (uint16_t segment_idx = 0; segment_idx < num_segments; segment_idx++)
+    {
+        size_t block_size = 0;
+        if (!DecompressSegment(frame + offset, size - offset, block_size, datagrams[segment_idx]))
+            return false;
+        offset += block_size;
+    }
+    return offset == size;
+}
+
+bool sick_scansegment_xd::RangeImageLogWriter::Open(const std::string& filepath)
+{
+    m_ostream = std::ofstream(filepath, std::ios::binary | std::ios::trunc);
+    if (!m_ostream.is_open())
+    {
+        ROS_ERROR_STREAM("## ERROR RangeImageLogWriter::Open(): can't create file \"" << filepath << "\"");
+        return false;
+    }
+    m_ostream.write(s_log_magic, sizeof(s_log_magic));
+    return m_ostream.good();
+}
+
+bool sick_scansegment_xd::RangeImageLogWriter::Write(uint64_t timestamp_nsec, const uint8_t* frame, uint32_t num_bytes)
+{
+    std::vector<uint8_t> record_header;
+    appendLE<uint64_t>(record_header, timestamp_nsec);
+    appendLE<uint32_t>(record_header, num_bytes);
+    m_ostream.write((const char*)record_header.data(), record_header.size());
+    m_ostream.write((const char*)frame, num_bytes);
+    return m_ostream.good();
+}
+
+void sick_scansegment_xd::RangeImageLogWriter::Close()
+{
+    if (m_ostream.is_open())
+        m_ostream.close();
+}
+
+bool sick_scansegment_xd::RangeImageLogReader::Open(const std::string& filepath)
+{
+    m_istream = std::ifstream(filepath, std::ios::binary);
+    char magic[sizeof(s_log_magic)] = { 0 };
+    if (!m_istream.is_open() || !m_istream.read(magic, sizeof(magic)) || memcmp(magic, s_log_magic, sizeof(magic)) != 0)
+    {
+        ROS_ERROR_STREAM("## ERROR RangeImageLogReader::Open(): \"" << filepath << "\" is not a range image log");
+        return false;
+    }
+    return true;
+}
+
+bool sick_scansegment_xd::RangeImageLogReader::Next(uint64_t& timestamp_nsec, std::vector<uint8_t>& frame)
+{
+    uint8_t record_header[12];
+    if (!m_istream.read((char*)record_header, sizeof(record_header)))
+        return false;
+    timestamp_nsec = readLE<uint64_t>(record_header);
+    uint32_t num_bytes = readLE<uint32_t>(record_header + 8);
+    if (num_bytes > 64 * s_max_datagram_size)
+        return false;
+    frame.resize(num_bytes);
+    return (bool)m_istream.read((char*)frame.data(), num_bytes);
+}
@@ -0,0 +1,131 @@
+/*
+ * @brief range_image_codec losslessly compresses multiScan frames in compact format.
+ *
+ * The measurement data of a compact module are interleaved by beam (per beam and layer: distance
+ * and rssi codes of all echos, azimuth code and beam property). The codec transposes them into
+ * 2-D images, one row of NumberOfBeamsPerScan values per layer and channel, predicts each value
+ * from its neighbours (left, linear, upper row or median of these, chosen per row) and Rice codes
+ * the residuals with a per row parameter. Header and module metadata are kept verbatim, so
+ * DecompressSegment() returns the original datagram incl. its crc, which decodes to the identical
+ * point cloud. Modules with an unexpected layout are stored uncompressed.
+ *
+ * Compressed frame format (all values little endian):
+ *   4 byte magic "MSRI", uint16_t version (1), uint16_t number of segments
+ *   followed by one block per segment:
+ *     uint32_t block size in bytes (incl. this field)
+ *     uint32_t datagram size in bytes (excl. crc)
+ *     uint32_t crc of the datagram, checked after decompression
+ *     32 byte compact header
+ *     per module:
+ *       uint32_t metadata size, metadata
+ *       uint32_t measurement data size, uint8_t method (0: stored, 1: range image), uint32_t encoded size, encoded data
+ *
+ * Recording format (RangeImageLogWriter, RangeImageLogReader):
+ *   8 byte magic "MSRILOG1"
+ *   followed by records of
+ *     uint64_t frame timestamp in nanoseconds
+ *     uint32_t number of bytes
+ *     compressed frame
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace sick_scansegment_xd
+{
+    /*
+     * @brief class RangeImageCodec compresses and decompresses compact segments and frames.
+     */
+    class RangeImageCodec
+    {
+    public:
+
+        /*
+         * @brief appends a compressed segment block.
+         * @param[in] datagram compact scan datagram (commandId 1) incl. start sequence, with or without crc
+         * @param[in] size datagram size in bytes
+         * @param[out] block output buffer, the block is appended
+         * @return true on success, false if the datagram is not a valid compact scan datagram
+         */
+        static bool CompressSegment(const uint8_t* datagram, size_t size, std::vector<uint8_t>& block);
+
+        /*
+         * @brief decompresses a segment block.
+         * @param[in] block compressed segment block
+         * @param[in] size number of bytes available
+         * @param[out] block_size size of the block in bytes
+         * @param[out] datagram original datagram incl. crc
+         * @return true on success, false on corrupted data
+         */
+        static bool DecompressSegment(const uint8_t* block, size_t size, size_t& block_size, std::vector<uint8_t>& datagram);
+
+        /*
+         * @brief compresses the segments of a frame.
+         * @param[in] datagrams compact scan datagrams of the frame
+         * @param[out] frame compressed frame
+         * @return true on success, false if a datagram could not be compressed
+         */
+        static bool CompressFrame(const std::vector<const std::vector<uint8_t>*>& datagrams, std::vector<uint8_t>& frame);
+
+        /*
+         * @brief starts a compressed frame, which is completed by appending num_segments segment blocks (see CompressSegment()).
+         */
+        static void BeginFrame(uint16_t num_segments, std::vector<uint8_t>& frame);
+
+        /*
+         * @brief decompresses a frame.
+         * @param[in] frame compressed frame
+         * @param[in] size size of the compressed frame in bytes
+         * @param[out] datagrams original datagrams incl. crc
+         * @return true on success, false on corrupted data
+         */
+        static bool DecompressFrame(const uint8_t* frame, size_t size, std::vector<std::vector<uint8_t>>& datagrams);
+
+        static constexpr const char* Format = "multiscan_range_image_v1"; // format of CompressedImage messages
+    };
+
+    /*
+     * @brief class RangeImageLogWriter writes compressed frames to a file.
+     */
+    class RangeImageLogWriter
+    {
+    public:
+
+        bool Open(const std::string& filepath);
+
+        bool Write(uint64_t timestamp_nsec, const uint8_t* frame, uint32_t num_bytes);
+
+        void Close();
+
+        bool IsOpen() const { return m_ostream.is_open(); }
+
+    protected:
+
+        std::ofstream m_ostream;
+    };
+
+    /*
+     * @brief class RangeImageLogReader reads compressed frames from a file.
+     */
+    class RangeImageLogReader
+    {
+    public:
+
+        bool Open(const std::string& filepath);
+
+        /*
+         * @brief reads the next compressed frame.
+         * @return true on success, false at end of file or on error
+         */
+        bool Next(uint64_t& timestamp_nsec, std::vector<uint8_t>& frame);
+
+    protected:
+
+        std::ifstream m_istream;
+    };
+
+} // namespace sick_scansegment_xd
@@ -83,6 +83,7 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <chrono>
 
 
 namespace sick_scansegment_xd
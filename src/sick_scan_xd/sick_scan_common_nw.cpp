@@ -139,7 +139,7 @@ bool SickScanCommonNw::setReadCallbackFunction(Tcp::ReadFunction readFunction,
 //
 
 
-bool SickScanCommonNw::connect()
+bool SickScanCommonNw::connect(UINT32 connectTimeoutMs)
 {
 
   assert (m_state == CONSTRUCTED); // must not be opened or running already
@@ -152,7 +152,7 @@ bool SickScanCommonNw::connect()
   // Set the data input callback for our TCP connection
   // m_tcp.setReadCallbackFunction(&SickScanCommonNw::readCallbackFunctionS, this);	// , this, _1, _2));
 
-  bool success = openTcpConnection();
+  bool success = openTcpConnection(connectTimeoutMs);
   if (success == true)
   {
     // Check if scanner type matches
@@ -167,10 +167,11 @@ bool SickScanCommonNw::connect()
 // True, if state is CONNECTED, that is:
 // - A TCP-connection exists
 // - Read thread is running
+// The read thread closes the socket if the connection is lost.
 //
 bool SickScanCommonNw::isConnected()
 {
-  return (m_state == CONNECTED);
+  return (m_state == CONNECTED) && m_tcp.isOpen();
 }
 
 
@@ -179,11 +180,11 @@ bool SickScanCommonNw::isConnected()
  *
  * true = Connected, false = no connection
  */
-bool SickScanCommonNw::openTcpConnection()
+bool SickScanCommonNw::openTcpConnection(UINT32 connectTimeoutMs)
 {
   //  printInfoMessage("SickScanCommonNw::openTcpConnection: Connecting TCP/IP connection to " + m_ipAddress + ":" + toString(m_portNumber) + " ...", m_beVerbose);
 
-  bool success = m_tcp.open(m_ipAddress, m_portNumber, m_beVerbose);
+  bool success = m_tcp.open(m_ipAddress, m_portNumber, m_beVerbose, connectTimeoutMs);
   if (success == false)
   {
     // printError("SickScanCommonNw::openTcpConnection: ERROR: Failed to establish TCP connection, aborting!");
@@ -206,10 +207,7 @@ uint64_t SickScanCommonNw::getNanosecTimestampLastTcpMessageReceived(void)
 //
 void SickScanCommonNw::closeTcpConnection()
 {
-  if (m_tcp.isOpen())
-  {
-    m_tcp.close();
-  }
+  m_tcp.close(); // also stops the read thread if the socket has already been closed after a connection loss
 }
 
 //
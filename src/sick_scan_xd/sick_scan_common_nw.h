@@ -51,10 +51,10 @@ public:
   bool setReadCallbackFunction(Tcp::ReadFunction readFunction,
                                void *obj);
 
-  /// Connects to a sensor via tcp and reads the device name.
-  bool connect();
+  /// Connects to a sensor via tcp and reads the device name. With connectTimeoutMs > 0, the connect fails after connectTimeoutMs milliseconds.
+  bool connect(UINT32 connectTimeoutMs = 0);
 
-  /// Returns true if the tcp connection is established.
+  /// Returns true if the tcp connection is established and has not been closed by the peer.
   bool isConnected();
 
   /** \brief Closes the connection to the LMS. This is the opposite of init().
@@ -73,7 +73,7 @@ public:
 
 private:
   // TCP
-  bool openTcpConnection();
+  bool openTcpConnection(UINT32 connectTimeoutMs = 0);
 
   void closeTcpConnection();
 
@@ -295,7 +295,7 @@ SickScanCommonTcp::SickScanCommonTcp(const std::string &hostname, int port, char
 
     assert(this->getProtocolType() != CoLa_Unknown);
 
-    m_numberOfBytesInReceiveBuffer = 0;
+    m_receiveBuffer.reserve(512 * 1024);
     m_alreadyReceivedBytes = 0;
     this->setReplyMode(0);
 }
@@ -353,6 +353,16 @@ size_t SickScanCommonTcp::getReadTimeOutInMs()
     return (readTimeOutInMs);
 }
 
+void SickScanCommonTcp::setConnectTimeOutInMs(size_t timeOutInMs)
+{
+    connectTimeOutInMs = timeOutInMs;
+}
+
+size_t SickScanCommonTcp::getConnectTimeOutInMs()
+{
+    return (connectTimeOutInMs);
+}
+
 
 int SickScanCommonTcp::getProtocolType(void)
 {
@@ -367,7 +377,8 @@ void SickScanCommonTcp::setProtocolType(SopasProtocol cola_dialect_id)
 
 //
 // Look for 23-frame (STX/ETX) in receive buffer.
-// Move frame to start of buffer
+// Discards bytes in front of the frame start, the frame itself stays in the buffer
+// until the caller consumes it.
 //
 // Return: 0 : No (complete) frame found
 //        >0 : Frame length
@@ -384,36 +395,20 @@ SopasEventMessage SickScanCommonTcp::findFrameInReceiveBuffer()
         // COLA-A
         //
         // Must start with STX (0x02)
-        if(m_receiveBuffer[0] != 0x02)
+        i = m_receiveBuffer.find(0x02);
+        if(i >= m_receiveBuffer.size())
         {
-            // Look for starting STX (0x02)
-            for(i = 1; i < m_numberOfBytesInReceiveBuffer; i++)
-            {
-                if(m_receiveBuffer[i] == 0x02) break;
-            }
-
-            // Found beginning of frame?
-            if(i >= m_numberOfBytesInReceiveBuffer)
-            {
-                // No start found, everything can be discarded
-                m_numberOfBytesInReceiveBuffer = 0; // Invalidate buffer
-                return SopasEventMessage{}; // No frame found
-            }
-
-            // Move frame start to index 0
-            UINT32 newLen = m_numberOfBytesInReceiveBuffer - i;
-            memmove(&(m_receiveBuffer[0]), &(m_receiveBuffer[i]), newLen);
-            m_numberOfBytesInReceiveBuffer = newLen;
+            // No start found, everything can be discarded
+            m_receiveBuffer.clear(); // Invalidate buffer
+            return SopasEventMessage{}; // No frame found
         }
+        m_receiveBuffer.consume(i); // frame starts at index 0
 
         // Look for ending ETX (0x03)
-        for(i = 1; i < m_numberOfBytesInReceiveBuffer; i++)
-        {
-            if(m_receiveBuffer[i] == 0x03) break;
-        }
+        i = m_receiveBuffer.find(0x03, 1);
 
         // Found end?
-        if(i >= m_numberOfBytesInReceiveBuffer)
+        if(i >= m_receiveBuffer.size())
         {
             // No end marker found, so it's not a complete frame (yet)
             return SopasEventMessage(); // No frame found
@@ -422,82 +417,59 @@ SopasEventMessage SickScanCommonTcp::findFrameInReceiveBuffer()
         // Calculate frame length in byte
         frameLen = i + 1;
 
-        return SopasEventMessage{ m_receiveBuffer, CoLa_A, frameLen };
+        return SopasEventMessage{ m_receiveBuffer.contiguous(0, frameLen, m_frameBuffer), CoLa_A, frameLen };
     }
     else if(this->getProtocolType() == CoLa_B)
     {
-        UINT32 magicWord;
+        static const UINT8 magicWord[4] = { 0x02, 0x02, 0x02, 0x02 };
         UINT32 payloadlength;
 
-        if(m_numberOfBytesInReceiveBuffer < 4)
+        if(m_receiveBuffer.size() < 4)
         {
             return SopasEventMessage{};
         }
 
-        UINT16 pos = 0;
-        magicWord = colab::getIntegerFromBuffer<UINT32>(m_receiveBuffer, pos);
-        if(magicWord != 0x02020202)
+        // Look for starting STX (0x02020202)
+        i = m_receiveBuffer.find(magicWord, sizeof(magicWord));
+        if(i >= m_receiveBuffer.size())
         {
-            // Look for starting STX (0x02020202)
-            for(i = 1; i <= m_numberOfBytesInReceiveBuffer - 4; i++)
-            {
-                pos = i; // this is needed, as the position value is updated by getIntegerFromBuffer
-                magicWord = colab::getIntegerFromBuffer<UINT32>(m_receiveBuffer, pos);
-                if(magicWord == 0x02020202)
-                {
-                    // found magic word
-                    break;
-                }
-            }
-
-            // Found beginning of frame?
-            if(i > m_numberOfBytesInReceiveBuffer - 4)
-            {
-                // No start found, everything can be discarded
-                m_numberOfBytesInReceiveBuffer = 0; // Invalidate buffer
-                return SopasEventMessage{}; // No frame found
-            }
-            else
-            {
-                // Move frame start to index
-                UINT32 bytesToMove = m_numberOfBytesInReceiveBuffer - i;
-                memmove(&(m_receiveBuffer[0]), &(m_receiveBuffer[i]), bytesToMove); // payload+magic+length+s+checksum
-                m_numberOfBytesInReceiveBuffer = bytesToMove;
-            }
+            // No start found, everything but a possibly incomplete magic word can be discarded
+            m_receiveBuffer.consume(m_receiveBuffer.size() - 3);
+            return SopasEventMessage{}; // No frame found
         }
+        m_receiveBuffer.consume(i); // frame starts at index 0
 
         // Pruefe Laenge des Pufferinhalts
-        if(m_numberOfBytesInReceiveBuffer < 9)
+        if(m_receiveBuffer.size() < 9)
         {
             // Es sind nicht genug Daten fuer einen Frame
             printInfoMessage("SickScanCommonNw::findFrameInReceiveBuffer: Frame cannot be decoded yet, only " +
-                            ::toString(m_numberOfBytesInReceiveBuffer) + " bytes in the buffer.", m_beVerbose);
+                            ::toString(m_receiveBuffer.size()) + " bytes in the buffer.", m_beVerbose);
             return SopasEventMessage{};
         }
 
-        // Read length of payload
-        pos = 4;
-        payloadlength = colab::getIntegerFromBuffer<UINT32>(m_receiveBuffer, pos);
+        // Read length of payload (big endian)
+        payloadlength = ((UINT32)m_receiveBuffer[4] << 24) | ((UINT32)m_receiveBuffer[5] << 16) | ((UINT32)m_receiveBuffer[6] << 8) | (UINT32)m_receiveBuffer[7];
         printInfoMessage(
             "SickScanCommonNw::findFrameInReceiveBuffer: Decoded payload length is " + ::toString(payloadlength) +
             " bytes.", m_beVerbose);
 
         // Ist die Datenlaenge plausibel und wuede in den Puffer passen?
-        if(payloadlength > (sizeof(m_receiveBuffer) - 9))
+        if(payloadlength > (m_receiveBuffer.capacity() - 9))
         {
             // magic word + length + checksum = 9
             printWarning(
                 "SickScanCommonNw::findFrameInReceiveBuffer: Frame too big for receive buffer. Frame discarded with length:"
                 + ::toString(payloadlength) + ".");
-            m_numberOfBytesInReceiveBuffer = 0;
+            m_receiveBuffer.clear();
             return SopasEventMessage{};
         }
-        if((payloadlength + 9) > m_numberOfBytesInReceiveBuffer)
+        if((payloadlength + 9) > m_receiveBuffer.size())
         {
             // magic word + length + s + checksum = 10
             printInfoMessage(
                 "SickScanCommonNw::findFrameInReceiveBuffer: Frame not complete yet. Waiting for the rest of it (" +
-                ::toString(payloadlength + 9 - m_numberOfBytesInReceiveBuffer) + " bytes missing).", m_beVerbose);
+                ::toString(payloadlength + 9 - m_receiveBuffer.size()) + " bytes missing).", m_beVerbose);
             return SopasEventMessage{}; // frame not complete
         }
 
@@ -507,31 +479,26 @@ SopasEventMessage SickScanCommonTcp::findFrameInReceiveBuffer()
         //
         // test checksum of payload
         //
-        UINT8 temp = 0;
+        UINT8 checkSum = m_receiveBuffer[frameLen - 1];
         UINT8 temp_xor = 0;
-        UINT8 checkSum;
-
-        // Read original checksum
-        pos = frameLen - 1;
-        checkSum = colab::getIntegerFromBuffer<UINT8>(m_receiveBuffer, pos);
-
-        // Erzeuge die Pruefsumme zum Vergleich
-        for(UINT16 j = 8; j < (frameLen - 1); j++)
+        m_receiveBuffer.forEachSpan(8, frameLen - 9, [&temp_xor](const UINT8* span, UINT32 span_len, UINT32)
         {
-            pos = j;
-            temp = colab::getIntegerFromBuffer<UINT8>(m_receiveBuffer, pos);
-            temp_xor = temp_xor ^ temp;
-        }
+            for(UINT32 j = 0; j < span_len; j++)
+            {
+                temp_xor ^= span[j];
+            }
+            return true;
+        });
 
         // Vergleiche die Pruefsummen
         if(temp_xor != checkSum)
         {
             printWarning("SickScanCommonNw::findFrameInReceiveBuffer: Wrong checksum, Frame discarded.");
-            m_numberOfBytesInReceiveBuffer = 0;
+            m_receiveBuffer.clear();
             return SopasEventMessage{};
         }
 
-        return SopasEventMessage{ m_receiveBuffer, CoLa_B, frameLen };
+        return SopasEventMessage{ m_receiveBuffer.contiguous(0, frameLen, m_frameBuffer), CoLa_B, frameLen };
     }
 
     // Return empty frame
@@ -565,7 +532,7 @@ void SickScanCommonTcp::processFrame(rosTime timeStamp, SopasEventMessage &frame
                                                                                         frame.getRawData() +
                                                                                         frame.size()) };
     // recvQueue.push(std::vector<unsigned char>(frame.getRawData(), frame.getRawData() + frame.size()));
-    recvQueue.push(dataGramWidthTimeStamp);
+    recvQueue.push(std::move(dataGramWidthTimeStamp));
 }
 
 void SickScanCommonTcp::readCallbackFunction(UINT8 *buffer, UINT32 &numOfBytes)
@@ -577,34 +544,26 @@ void SickScanCommonTcp::readCallbackFunction(UINT8 *buffer, UINT32 &numOfBytes)
         beVerboseHere);
 
     ScopedLock lock(&m_receiveDataMutex); // Mutex for access to the input buffer
-    UINT32 remainingSpace = sizeof(m_receiveBuffer) - m_numberOfBytesInReceiveBuffer;
-    UINT32 bytesToBeTransferred = numOfBytes;
-    if(remainingSpace < numOfBytes)
-    {
-        bytesToBeTransferred = remainingSpace;
-        // printWarning("SickScanCommonNw::readCallbackFunction(): Input buffer space is to small, transferring only " +
-        //              ::toString(bytesToBeTransferred) + " of " + ::toString(numOfBytes) + " bytes.");
-    }
-    else
-    {
-        // printInfoMessage("SickScanCommonNw::readCallbackFunction(): Transferring " + ::toString(bytesToBeTransferred) +
-        //                   " bytes from TCP to input buffer.", beVerboseHere);
-    }
-
-    if(bytesToBeTransferred > 0)
+    UINT32 bytesTransferred = 0;
+    while(bytesTransferred < numOfBytes)
     {
-        // Data can be transferred into our input buffer
-        memcpy(&(m_receiveBuffer[m_numberOfBytesInReceiveBuffer]), buffer, bytesToBeTransferred);
-        m_numberOfBytesInReceiveBuffer += bytesToBeTransferred;
-
-        UINT32 size = 0;
+        UINT32 bytesToBeTransferred = m_receiveBuffer.write(buffer + bytesTransferred, numOfBytes - bytesTransferred);
+        if(bytesToBeTransferred == 0)
+        {
+            // There was input data from the TCP interface, but our input buffer was unable to hold a single byte.
+            // Either we have not read data from our buffer for a long time, or something has gone wrong. To re-sync,
+            // we clear the input buffer here.
+            m_receiveBuffer.clear();
+            continue;
+        }
+        bytesTransferred += bytesToBeTransferred;
 
         while (1)
         {
             // Now work on the input buffer until all received datasets are processed
             SopasEventMessage frame = this->findFrameInReceiveBuffer();
 
-            size = frame.size();
+            UINT32 size = frame.size();
             if(size == 0)
             {
                 // Framesize = 0: There is no valid frame in the buffer. The buffer is either empty or the frame
@@ -622,27 +581,27 @@ void SickScanCommonTcp::readCallbackFunction(UINT8 *buffer, UINT32 &numOfBytes)
                     "SickScanCommonNw::readCallbackFunction(): Processing a frame of length " + ::toString(frame.size()) +
                     " bytes.", beVerboseHere);
                 this->processFrame(rcvTimeStamp, frame);
-                UINT32 bytesToMove = m_numberOfBytesInReceiveBuffer - size;
-                memmove(&(m_receiveBuffer[0]), &(m_receiveBuffer[size]), bytesToMove); // payload+magic+length+s+checksum
-                m_numberOfBytesInReceiveBuffer = bytesToMove;
+                m_receiveBuffer.consume(size); // payload+magic+length+s+checksum
             }
         }
     }
-    else
-    {
-        // There was input data from the TCP interface, but our input buffer was unable to hold a single byte.
-        // Either we have not read data from our buffer for a long time, or something has gone wrong. To re-sync,
-        // we clear the input buffer here.
-        m_numberOfBytesInReceiveBuffer = 0;
-    }
 }
 
 
 int SickScanCommonTcp::init_device()
 {
+    {
+        ScopedLock lock(&m_receiveDataMutex); // drop partial frames and stale replies of a previous connection
+        m_receiveBuffer.clear();
+    }
+    recvQueue.clear();
+
     m_nw.init(this->hostname_, this->port_, disconnectFunctionS, (void*)this);
     m_nw.setReadCallbackFunction(readCallbackFunctionS, (void*)this);
-    m_nw.connect();
+    if(!m_nw.connect(static_cast<UINT32>(this->getConnectTimeOutInMs())))
+    {
+        return ExitError;
+    }
 
     return ExitSuccess;
 }
@@ -1002,6 +961,8 @@ int SickScanCommonTcp::convertAscii2BinaryCmd(const char *requestAscii, std::vec
     std::string KeyWord25 = "sWN NLMDLandmarkDataFormat";
     std::string KeyWord26 = "sWN NAVScanDataFormat";
     std::string KeyWord27 = "sMN mNLAYEraseLayout";
+    std::string KeyWord28 = "sWN LFPangleRangeFilter"; // multiScan136: "sWN LFPangleRangeFilter <enabled> <azimuth_start> <azimuth_stop> <elevation_start> <elevation_stop> <beam_increment>", angles as hex int32 in 1/10000 deg
+    std::string KeyWord29 = "sWN LFPlayerFilter"; // multiScan136: "sWN LFPlayerFilter <enabled> <layer0-enabled> ... <layer15-enabled>"
 
     //BBB
 
@@ -1482,6 +1443,47 @@ int SickScanCommonTcp::convertAscii2BinaryCmd(const char *requestAscii, std::vec
         bufferLen = 1;
     }
 
+    else if (cmdAscii.find(KeyWord28) != std::string::npos && strlen(requestAscii) > KeyWord28.length() + 1) // "sWN LFPangleRangeFilter 1 FFF24460 000DBBA0 FFF24460 000DBBA0 1"
+    {
+        // { 1 byte enabled } + { 4 x 4 byte int32 angle in 1/10000 deg } + { 2 byte beam increment }
+        uint32_t args[6] = { 0, 0, 0, 0, 0, 0 };
+        sscanf(requestAscii + KeyWord28.length() + 1, " %u %x %x %x %x %u", &(args[0]), &(args[1]), &(args[2]), &(args[3]), &(args[4]), &(args[5]));
+        buffer[0] = (unsigned char) (0xFF & args[0]);
+        bufferLen = 1;
+        for(int arg_cnt = 1; arg_cnt < 5; arg_cnt++)
+        {
+            buffer[bufferLen + 0] = (unsigned char) (0xFF & (args[arg_cnt] >> 24));
+            buffer[bufferLen + 1] = (unsigned char) (0xFF & (args[arg_cnt] >> 16));
+            buffer[bufferLen + 2] = (unsigned char) (0xFF & (args[arg_cnt] >> 8));
+            buffer[bufferLen + 3] = (unsigned char) (0xFF & (args[arg_cnt] >> 0));
+            bufferLen += 4;
+        }
+        buffer[bufferLen + 0] = (unsigned char) (0xFF & (args[5] >> 8));
+        buffer[bufferLen + 1] = (unsigned char) (0xFF & (args[5] >> 0));
+        bufferLen += 2;
+    }
+
+    else if (cmdAscii.find(KeyWord29) != std::string::npos && strlen(requestAscii) > KeyWord29.length() + 1) // "sWN LFPlayerFilter 1 1 1 1 1 0 0 0 0 0 0 0 0 0 0 0 0"
+    {
+        // { 1 byte enabled } + { 2 byte array length 16 } + { 16 x 1 byte layer enabled }
+        std::istringstream ascii_args(requestAscii + KeyWord29.length() + 1);
+        int arg_val = 0;
+        std::vector<int> args;
+        while (args.size() < 17 && ascii_args >> arg_val)
+        {
+            args.push_back(arg_val);
+        }
+        args.resize(17, 0);
+        buffer[0] = (unsigned char) (0xFF & args[0]);
+        buffer[1] = 0x00;
+        buffer[2] = 0x10;
+        bufferLen = 3;
+        for(int layer = 1; layer < 17; layer++)
+        {
+            buffer[bufferLen++] = (unsigned char) (0xFF & args[layer]);
+        }
+    }
+
     // copy base command string to buffer
     bool switchDoBinaryData = false;
     for (int i = 1; i <= (int) (msgLen); i++)  // STX DATA ETX --> 0 1 2
@@ -1605,7 +1607,20 @@ int SickScanCommonTcp::sendSopasAndCheckAnswer(std::string requestStr, std::vect
 */
 int SickScanCommonTcp::sendSopasAndCheckAnswer(std::vector<unsigned char> requestStr, std::vector<unsigned char> *reply, int cmdId)
 {
-    std::lock_guard<std::mutex> send_lock_guard(sopasSendMutex); // lock send mutex in case of asynchronous service calls
+    return this->sendSopasAndCheckAnswer(requestStr, SickScanCommonTcp::generateExpectedAnswerString(requestStr), reply, cmdId);
+}
+
+/**
+ \brief send command and check answer
+ \param requestStr: Sopas-Command given as byte-vector
+ \param searchPattern: expected answers, see generateExpectedAnswerString()
+ \param *reply: Antwort-String
+ \param cmdId: Command index to derive the correct error message (optional)
+ \return error code
+*/
+int SickScanCommonTcp::sendSopasAndCheckAnswer(const std::vector<unsigned char>& requestStr, const std::vector<std::string>& searchPattern, std::vector<unsigned char> *reply, int cmdId)
+{
+    std::unique_lock<std::mutex> send_lock_guard = lockSopasExchange(); // lock send mutex in case of asynchronous service calls
 
     reply->clear();
     std::string cmdStr = "";
@@ -1653,7 +1668,6 @@ int SickScanCommonTcp::sendSopasAndCheckAnswer(std::vector<unsigned char> reques
         {
             std::string answerStr = SickScanCommonTcp::sopasReplyToString(*reply);
             std::stringstream expectedAnswers;
-            std::vector<std::string> searchPattern = SickScanCommonTcp::generateExpectedAnswerString(requestStr);
 
             for(size_t n = 0; result != 0 && n < searchPattern.size(); n++)
             {
@@ -1718,6 +1732,89 @@ int SickScanCommonTcp::sendSopasAndCheckAnswer(std::vector<unsigned char> reques
     return result;
 }
 
+/**
+ \brief send a batch of commands pipelined and check the answers
+ \param requests: Sopas-Commands given as byte-vectors
+ \param replies: Antwort-Strings (empty if no expected answer was received)
+ \param rtt_millisec: round trip time of each command in milliseconds, -1 if no answer
+ \param expected_answers: expected answers of each command (optional), generated by generateExpectedAnswerString() if not given
+ \return number of commands answered as expected
+*/
+int SickScanCommonTcp::sendSopasBatchAndCheckAnswers(const std::vector<std::vector<unsigned char>>& requests, std::vector<std::vector<unsigned char>>& replies, std::vector<double>& rtt_millisec,
+    const std::vector<std::vector<std::string>>* expected_answers)
+{
+    std::unique_lock<std::mutex> send_lock_guard = lockSopasExchange(); // lock send mutex in case of asynchronous service calls
+
+    replies.assign(requests.size(), std::vector<unsigned char>());
+    rtt_millisec.assign(requests.size(), -1.0);
+    std::vector<uint64_t> send_timestamp_nsec(requests.size(), 0);
+
+    // send all requests without waiting for replies
+    size_t num_sent = 0;
+    for( ; num_sent < requests.size(); num_sent++)
+    {
+        ROS_INFO_STREAM("Sending  : " << stripControl(requests[num_sent]));
+        send_timestamp_nsec[num_sent] = ::rosNanosecTimestampNow();
+        if(this->sendSopasRequest(requests[num_sent]) != ExitSuccess)
+        {
+            break;
+        }
+    }
+
+    // collect replies in request order. The lidar answers in request order, so a sopas error "sFA"
+    // popped while waiting for request n belongs to request n.
+    int num_answered = 0;
+    uint64_t deadline_nsec = ::rosNanosecTimestampNow() + static_cast<uint64_t>(this->getReadTimeOutInMs()) * 1000000;
+    for(size_t n = 0; n < num_sent; n++)
+    {
+        std::vector<std::string> response_keywords = { SickScanCommonTcp::getSopasCmdKeyword(requests[n].data(), requests[n].size()) };
+        std::vector<std::string> searchPattern = expected_answers ? (*expected_answers)[n] : SickScanCommonTcp::generateExpectedAnswerString(requests[n]);
+        for(int retry_answer_cnt = 0; retry_answer_cnt < 100; retry_answer_cnt++)
+        {
+            uint64_t now_nsec = ::rosNanosecTimestampNow();
+            if(now_nsec >= deadline_nsec || !this->recvQueue.waitForIncomingObject((deadline_nsec - now_nsec) / 1000000 + 1, response_keywords))
+            {
+                ROS_WARN_STREAM("## WARNING SickScanCommonTcp::sendSopasBatchAndCheckAnswers(): timeout waiting for reply to " << stripControl(requests[n]));
+                break;
+            }
+            DatagramWithTimeStamp datagram = this->recvQueue.pop(response_keywords);
+            std::string answerStr = SickScanCommonTcp::sopasReplyToString(datagram.datagram);
+            bool answer_expected = false;
+            for(size_t k = 0; !answer_expected && k < searchPattern.size(); k++)
+            {
+                answer_expected = (answerStr.find(searchPattern[k]) != std::string::npos);
+            }
+            if(answer_expected)
+            {
+                uint64_t recv_timestamp_nsec = static_cast<uint64_t>(datagram.timeStamp.sec) * 1000000000 + datagram.timeStamp.nsec;
+                rtt_millisec[n] = 1.0e-6 * static_cast<double>(std::max(recv_timestamp_nsec, send_timestamp_nsec[n]) - send_timestamp_nsec[n]);
+                replies[n] = std::move(datagram.datagram);
+                ROS_INFO_STREAM("Receiving: <STX>" << answerStr << "<ETX>");
+                num_answered++;
+                break;
+            }
+            if(answerStr.find("sFA") != std::string::npos)
+            {
+                ROS_WARN_STREAM("## WARNING SickScanCommonTcp::sendSopasBatchAndCheckAnswers(): error reply \"" << answerStr << "\" to " << stripControl(requests[n]));
+                break;
+            }
+            // unexpected datagram with the same keyword, e.g. an event message: try again
+        }
+    }
+    return num_answered;
+}
+
+/**
+ \brief send a request without waiting for the reply, the caller holds lockSopasExchange()
+ \param request: Sopas-Command given as byte-vector
+ \return ExitSuccess or ExitError
+*/
+int SickScanCommonTcp::sendSopasRequest(const std::vector<unsigned char>& request)
+{
+    std::string cmdStr(request.begin(), request.end()); // 0-terminated for ascii requests
+    return this->sendSOPASCommand(cmdStr.c_str(), 0, cmdStr.size(), false);
+}
+
 /*!
  \brief convert ASCII or binary reply to a human readable string
  \param reply datablock, which should be converted
@@ -54,6 +54,7 @@
  */
 #pragma once
 
+#include <atomic>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -61,6 +62,7 @@
 // #undef NOMINMAX // to get rid off warning C4005: "NOMINMAX": Makro-Neudefinition
 
 #include "tcp/Mutex.hpp"
+#include "tcp/RingBuffer.hpp"
 
 #include "sick_scan_common_nw.h"
 #include "sick_ros_wrapper.h"
@@ -76,7 +78,7 @@ public:
     DatagramWithTimeStamp(rosTime timeStamp_, std::vector<unsigned char> datagram_)
     {
         timeStamp = timeStamp_;
-        datagram = datagram_;
+        datagram = std::move(datagram_);
     }
 
     virtual std::vector<unsigned char> & data(void) { return datagram; }
@@ -227,6 +229,9 @@ public:
     size_t getReadTimeOutInMs();
     void setReadTimeOutInMs(size_t timeOutInMs);
 
+    size_t getConnectTimeOutInMs();
+    void setConnectTimeOutInMs(size_t timeOutInMs); // 0: blocking connect (default)
+
     int getProtocolType(void);
     void setProtocolType(SopasProtocol cola_dialect_id);
 
@@ -261,6 +266,45 @@ public:
 
     int sendSopasAndCheckAnswer(std::string request, std::vector<unsigned char> *reply, int cmdId = -1);
     int sendSopasAndCheckAnswer(std::vector<unsigned char> request, std::vector<unsigned char> *reply, int cmdId = -1);
+    int sendSopasAndCheckAnswer(const std::vector<unsigned char>& request, const std::vector<std::string>& expectedAnswers, std::vector<unsigned char> *reply, int cmdId = -1); // expectedAnswers precomputed, f.e. by SopasCmdCache
+
+    /**
+     * \brief Sends a batch of sopas requests back to back without waiting for replies (pipelined), then collects
+     * the replies by their keyword. The lidar processes requests in order, so independent commands can share one
+     * round trip. All requests of a batch should have different keywords.
+     * \param [in] requests sopas requests (ascii incl. <STX>/<ETX> or binary incl. header and crc)
+     * \param [out] replies reply for each request, empty if no expected answer was received
+     * \param [out] rtt_millisec round trip time of each request in milliseconds (send until receive timestamp), -1 if no reply
+     * \param [in] expected_answers expected answers of each request (optional, f.e. from SopasCmdCache), generated by generateExpectedAnswerString() if not given
+     * \returns number of requests answered with their expected answer
+     */
+    int sendSopasBatchAndCheckAnswers(const std::vector<std::vector<unsigned char>>& requests, std::vector<std::vector<unsigned char>>& replies, std::vector<double>& rtt_millisec,
+        const std::vector<std::vector<std::string>>* expected_answers = 0);
+
+    /**
+     * \brief Locks the sopas exchange, i.e. serializes requests and their replies with sendSopasAndCheckAnswer()
+     * and sendSopasBatchAndCheckAnswers(). Required for sendSopasRequest().
+     */
+    std::unique_lock<std::mutex> lockSopasExchange()
+    {
+      sopasExchangeWaiters++;
+      std::unique_lock<std::mutex> lock(sopasSendMutex);
+      sopasExchangeWaiters--;
+      return lock;
+    }
+
+    /**
+     * \brief Number of threads waiting in lockSopasExchange(), used to hand the link over between async batches
+     */
+    int numSopasExchangeWaiters() const { return sopasExchangeWaiters; }
+
+    /**
+     * \brief Sends a sopas request without waiting for its reply, which is queued in recvQueue.
+     * The caller holds lockSopasExchange() until the reply has been popped.
+     * \param [in] request sopas request (ascii incl. <STX>/<ETX> or binary incl. header and crc)
+     * \returns ExitSuccess or ExitError
+     */
+    int sendSopasRequest(const std::vector<unsigned char>& request);
 
     /**
      * \brief Converts reply from sendSOPASCommand to string
@@ -316,8 +360,8 @@ private:
     Mutex m_receiveDataMutex; ///< Access mutex for buffer
 
     // Receive buffer
-    UINT32 m_numberOfBytesInReceiveBuffer; ///< Number of bytes in buffer
-    UINT8 m_receiveBuffer[480000]; ///< Low-Level receive buffer for all data
+    RingBuffer m_receiveBuffer; ///< Low-Level receive buffer for all data, frames are found in place and consumed by advancing the head
+    std::vector<UINT8> m_frameBuffer; ///< Copy of a frame which wraps around the end of m_receiveBuffer
 
     bool m_beVerbose;
 
@@ -329,7 +373,9 @@ private:
     int m_replyMode;
 
     std::mutex sopasSendMutex; // mutex to lock sendSopasAndCheckAnswer
+    std::atomic<int> sopasExchangeWaiters{ 0 }; // threads waiting for sopasSendMutex in lockSopasExchange()
     size_t readTimeOutInMs;
+    size_t connectTimeOutInMs = 0;
     size_t m_read_timeout_millisec_default = 5000;
     size_t m_read_timeout_millisec_startup = 10000;
 
@@ -347,7 +393,7 @@ private:
         int num_layers = 0;
         int num_active_layers = 0;
 
-        void parse(const std::string& parameter);   // TODO
+        void parse(const std::string& parameter);
         // void print();
     };
 
@@ -70,15 +70,15 @@ std::istream &operator>>(std::istream &str, CSVRow &data)
 bool SoftwarePLL::pushIntoFifo(double curTimeStamp, uint32_t curtick)
 // update tick fifo and update clock (timestamp) fifo
 {
-  for (int i = 0; i < fifoSize - 1; i++)
+  for (int i = 0; i < fifoLength - 1; i++)
   {
     tickFifo[i] = tickFifo[i + 1];
     clockFifo[i] = clockFifo[i + 1];
   }
-  tickFifo[fifoSize - 1] = curtick; // push most recent tick and timestamp into fifo
-  clockFifo[fifoSize - 1] = curTimeStamp;
+  tickFifo[fifoLength - 1] = curtick; // push most recent tick and timestamp into fifo
+  clockFifo[fifoLength - 1] = curTimeStamp;
 
-  if (numberValInFifo < fifoSize)
+  if (numberValInFifo < fifoLength)
   {
     numberValInFifo++; // remember the number of valid number in fifo
   }
@@ -125,6 +125,7 @@ int SoftwarePLL::findDiffInFifo(double diff, double tol)
 */
 bool SoftwarePLL::updatePLL(uint32_t sec, uint32_t nanoSec, uint32_t curtick)
 {
+  std::lock_guard<std::mutex> lock(m_updateMutex);
   if (offsetTimestampFirstLidarTick == 0)
   {
     // Store first timestamp and ticks for optional TICKS_TO_MICROSEC_OFFSET_TIMESTAMP
@@ -139,7 +140,20 @@ bool SoftwarePLL::updatePLL(uint32_t sec, uint32_t nanoSec, uint32_t curtick)
     double start = sec + nanoSec * 1E-9;
     // bool bRet = true;
 
-    if (false == IsInitialized())
+    if (clockEstimator == CLOCK_ESTIMATOR_KALMAN_FILTER)
+    {
+      // O(1) update, the filter maintains a reference point at the most recent tick
+      kalmanFilter.update(start, curtick);
+      FirstTick(kalmanFilter.RefTick());
+      FirstTimeStamp(kalmanFilter.RefTimeStamp());
+      InterpolationSlope(kalmanFilter.Slope());
+      IsInitialized(kalmanFilter.isInitialized());
+      max_abs_delta_time = fabs(kalmanFilter.LastInnovation());
+      publishSnapshot();
+      return (isInitializedState());
+    }
+
+    if (false == isInitializedState())
     {
       pushIntoFifo(start, curtick);
       bool bCheck = this->updateInterpolationSlope();
@@ -149,8 +163,9 @@ bool SoftwarePLL::updatePLL(uint32_t sec, uint32_t nanoSec, uint32_t curtick)
       }
     }
 
-    if (IsInitialized() == false)
+    if (isInitializedState() == false)
     {
+      publishSnapshot();
       return (false);
     }
 
@@ -179,32 +194,71 @@ bool SoftwarePLL::updatePLL(uint32_t sec, uint32_t nanoSec, uint32_t curtick)
       }
       // END HANDLING Extrapolation divergence
     }
+    publishSnapshot();
     return (true);
   }
   else
   {
+    publishSnapshot();
     return (false);
     //this curtick has been updated allready
   }
 
 }
 
-//TODO Kommentare
-bool SoftwarePLL::getCorrectedTimeStamp(uint32_t &sec, uint32_t &nanoSec, uint32_t curtick)
+void SoftwarePLL::setClockEstimator(int val)
 {
-  if (IsInitialized() == false)
+  std::lock_guard<std::mutex> lock(m_updateMutex);
+  clockEstimator = (CLOCK_ESTIMATOR)val;
+  kalmanFilter.reset();
+  numberValInFifo = 0;
+  ExtrapolationDivergenceCounter(0);
+  IsInitialized(false);
+  publishSnapshot();
+}
+
+/*!
+\brief Publishes the current clock model for lock-free readers, called by the writer after each update
+*/
+void SoftwarePLL::publishSnapshot()
+{
+  ClockSnapshot snapshot;
+  snapshot.initialized = isInitializedState();
+  snapshot.ticksToTimestampMode = (int)ticksToTimestampMode;
+  snapshot.firstTick = firstTick;
+  snapshot.firstTimeStamp = firstTimeStamp;
+  snapshot.interpolationSlope = interpolationSlope;
+  snapshot.offsetTimestampFirstSystemSec = offsetTimestampFirstSystemSec;
+  snapshot.offsetTimestampFirstSystemMicroSec = offsetTimestampFirstSystemMicroSec;
+  snapshot.offsetTimestampFirstLidarTick = offsetTimestampFirstLidarTick;
+  m_snapshot.store(snapshot);
+}
+
+/*!
+\brief Converts lidar ticks to system time using the most recently published clock model (thread-safe, lock-free)
+
+\param sec: corrected system timestamp (seconds)
+\param nanoSec: corrected system timestamp (nanoseconds)
+\param curtick micro Seconds since scanner start
+\return false if the PLL is not yet initialized
+*/
+bool SoftwarePLL::getCorrectedTimeStamp(uint32_t &sec, uint32_t &nanoSec, uint32_t curtick) const
+{
+  const ClockSnapshot snapshot = m_snapshot.load();
+  if (snapshot.initialized == false)
   {
     return (false);
   }
   double corrTime = 0;
-  if (ticksToTimestampMode == TICKS_TO_MICROSEC_OFFSET_TIMESTAMP) // optional tick-mode: convert lidar ticks in microseconds to timestamp by 1.0e-6*(curtick-firstTick)+firstSystemTimestamp
+  if (snapshot.ticksToTimestampMode == TICKS_TO_MICROSEC_OFFSET_TIMESTAMP) // optional tick-mode: convert lidar ticks in microseconds to timestamp by 1.0e-6*(curtick-firstTick)+firstSystemTimestamp
   {
-    corrTime = 1.0e-6 * (curtick - offsetTimestampFirstLidarTick) + (offsetTimestampFirstSystemSec + 1.0e-6 * offsetTimestampFirstSystemMicroSec);
+    corrTime = 1.0e-6 * (curtick - snapshot.offsetTimestampFirstLidarTick) + (snapshot.offsetTimestampFirstSystemSec + 1.0e-6 * snapshot.offsetTimestampFirstSystemMicroSec);
   }
   else // default: convert lidar ticks in microseconds to system timestamp by software-pll
   {
-    double relTimeStamp = extraPolateRelativeTimeStamp(curtick); // evtl. hier wg. Ueberlauf noch einmal pruefen
-    corrTime = relTimeStamp + this->FirstTimeStamp();
+    int32_t tempTick = curtick - (uint32_t) (0xFFFFFFFF & snapshot.firstTick); // same as extraPolateRelativeTimeStamp()
+    double relTimeStamp = tempTick * snapshot.interpolationSlope;
+    corrTime = relTimeStamp + snapshot.firstTimeStamp;
   }
   sec = (uint32_t) corrTime;
   double frac = corrTime - sec;
@@ -214,28 +268,29 @@ bool SoftwarePLL::getCorrectedTimeStamp(uint32_t &sec, uint32_t &nanoSec, uint32
 }
 
 // converts a system timestamp to lidar ticks, computes the inverse to getCorrectedTimeStamp().
-bool SoftwarePLL::convSystemtimeToLidarTimestamp(uint32_t systemtime_sec, uint32_t systemtime_nanosec, uint32_t& tick)
+bool SoftwarePLL::convSystemtimeToLidarTimestamp(uint32_t systemtime_sec, uint32_t systemtime_nanosec, uint32_t& tick) const
 {
-  if (IsInitialized() == false)
+  const ClockSnapshot snapshot = m_snapshot.load();
+  if (snapshot.initialized == false)
   {
     return (false);
   }
-  if (ticksToTimestampMode == TICKS_TO_MICROSEC_OFFSET_TIMESTAMP) // optional tick-mode: convert lidar ticks in microseconds to timestamp by 1.0e-6*(curtick-firstTick)+firstSystemTimestamp
+  if (snapshot.ticksToTimestampMode == TICKS_TO_MICROSEC_OFFSET_TIMESTAMP) // optional tick-mode: convert lidar ticks in microseconds to timestamp by 1.0e-6*(curtick-firstTick)+firstSystemTimestamp
   {
-    double relSystemTimestamp = (systemtime_sec + 1.0e-9 * systemtime_nanosec) - (offsetTimestampFirstSystemSec + 1.0e-6 * offsetTimestampFirstSystemMicroSec);
+    double relSystemTimestamp = (systemtime_sec + 1.0e-9 * systemtime_nanosec) - (snapshot.offsetTimestampFirstSystemSec + 1.0e-6 * snapshot.offsetTimestampFirstSystemMicroSec);
     double relTicks = 1.0e6 * relSystemTimestamp;
-    tick = (uint32_t)std::round(relTicks + offsetTimestampFirstLidarTick);
+    tick = (uint32_t)std::round(relTicks + snapshot.offsetTimestampFirstLidarTick);
   }
   else // default: convert lidar ticks in microseconds to system timestamp by software-pll
   {
     double systemTimestamp = (double)systemtime_sec + 1.0e-9 * (double)systemtime_nanosec; // systemTimestamp := corrTime in getCorrectedTimeStamp
     // getCorrectedTimeStamp(): corrTime = relTimeStamp + this->FirstTimeStamp()
     // => inverse: relSystemTimestamp = systemTimestamp - this->FirstTimeStamp()
-    double relSystemTimestamp = systemTimestamp - this->FirstTimeStamp();
+    double relSystemTimestamp = systemTimestamp - snapshot.firstTimeStamp;
     // getCorrectedTimeStamp(): relSystemTimestamp = (tick - (uint32_t) (0xFFFFFFFF & FirstTick())) * this->InterpolationSlope() 
     //=> inverse: tick = (relSystemTimestamp / this->InterpolationSlope()) + (uint32_t) (0xFFFFFFFF & FirstTick())
-    double relTicks = relSystemTimestamp / this->InterpolationSlope();
-    uint32_t tick_offset = (uint32_t)(0xFFFFFFFF & FirstTick());
+    double relTicks = relSystemTimestamp / snapshot.interpolationSlope;
+    uint32_t tick_offset = (uint32_t)(0xFFFFFFFF & snapshot.firstTick);
     tick = (uint32_t)std::round(relTicks + tick_offset);
   }
   return (true);
@@ -257,14 +312,12 @@ bool SoftwarePLL::nearSameTimeStamp(double relTimeStamp1, double relTimeStamp2,
 bool SoftwarePLL::updateInterpolationSlope() // fifo already updated
 {
 
-  if (numberValInFifo < fifoSize)
+  if (numberValInFifo < fifoLength)
   {
     return (false);
   }
-  std::vector<uint64_t> tickFifoUnwrap;
-  std::vector<double> clockFifoUnwrap;
-  clockFifoUnwrap.resize(fifoSize);
-  tickFifoUnwrap.resize(fifoSize);
+  uint64_t tickFifoUnwrap[MaxFifoSize];
+  double clockFifoUnwrap[MaxFifoSize];
   uint64_t tickOffset = 0;
   clockFifoUnwrap[0] = 0.00;
   tickFifoUnwrap[0] = 0;
@@ -275,7 +328,7 @@ bool SoftwarePLL::updateInterpolationSlope() // fifo already updated
 
 
   for (int i = 1;
-       i < fifoSize; i++)  // typical 643 for 20ms -> round about 32150 --> near to 32768 standard clock in many watches
+       i < fifoLength; i++)  // typical 643 for 20ms -> round about 32150 --> near to 32768 standard clock in many watches
   {
     if (tickFifo[i] < tickFifo[i - 1]) // Overflow
     {
@@ -289,7 +342,7 @@ bool SoftwarePLL::updateInterpolationSlope() // fifo already updated
   double sum_x = 0.0;
   double sum_y = 0.0;
   double sum_xx = 0.0;
-  for (int i = 0; i < fifoSize; i++)
+  for (int i = 0; i < fifoLength; i++)
   {
     sum_xy += tickFifoUnwrap[i] * clockFifoUnwrap[i];
     sum_x += tickFifoUnwrap[i];
@@ -298,11 +351,11 @@ bool SoftwarePLL::updateInterpolationSlope() // fifo already updated
   }
 
   // calculate slope of regression line, interception is 0 by construction
-  double m = (fifoSize * sum_xy - sum_x * sum_y) / (fifoSize * sum_xx - sum_x * sum_x);
+  double m = (fifoLength * sum_xy - sum_x * sum_y) / (fifoLength * sum_xx - sum_x * sum_x);
 
   int matchCnt = 0;
   max_abs_delta_time = 0;
-  for (int i = 0; i < fifoSize; i++)
+  for (int i = 0; i < fifoLength; i++)
   {
     double yesti = m * tickFifoUnwrap[i];
     double abs_delta_time = 0;
@@ -311,24 +364,23 @@ bool SoftwarePLL::updateInterpolationSlope() // fifo already updated
       matchCnt++;
     }
     max_abs_delta_time = std::max(max_abs_delta_time, abs_delta_time);
-    // std::cout << "SoftwarePLL::updateInterpolationSlope(): matchCnt=" << matchCnt << "/" << fifoSize << ", yesti=" << yesti << ", clockFifoUnwrap=" << clockFifoUnwrap[i] << ", tickFifoUnwrap=" << tickFifoUnwrap[i] << std::endl;
+    // std::cout << "SoftwarePLL::updateInterpolationSlope(): matchCnt=" << matchCnt << "/" << fifoLength << ", yesti=" << yesti << ", clockFifoUnwrap=" << clockFifoUnwrap[i] << ", tickFifoUnwrap=" << tickFifoUnwrap[i] << std::endl;
   }
 
   bool retVal = false;
-  if (matchCnt == fifoSize)
+  if (matchCnt == fifoLength)
   {
     InterpolationSlope(m);
     retVal = true;
   }
   // else
   // {
-  //   std::cerr << "SoftwarePLL::updateInterpolationSlope(): matchCnt=" << matchCnt << "/" << fifoSize << ", max_abs_delta_time=" << max_abs_delta_time << " sec." << std::endl;
+  //   std::cerr << "SoftwarePLL::updateInterpolationSlope(): matchCnt=" << matchCnt << "/" << fifoLength << ", max_abs_delta_time=" << max_abs_delta_time << " sec." << std::endl;
   // }
 
   return (retVal);
 }
 
-#if 0
 bool SoftwarePLL::getDemoFileData(std::string fileName, std::vector<uint32_t>& tickVec,std::vector<uint32_t>& secVec, std::vector<uint32_t>& nanoSecVec )
 {
     std::ifstream file(fileName);
@@ -341,9 +393,9 @@ bool SoftwarePLL::getDemoFileData(std::string fileName, std::vector<uint32_t>& t
     while (file >> row) {
       if (lineCnt > 0)
     {
-        uint32_t tickVal = (uint32_t)std::stoi(row[0]);
-      uint32_t secVal = (uint32_t)std::stoi(row[1]);
-      uint32_t nanoSecVal = (uint32_t)std::stoi(row[2]);
+        uint32_t tickVal = (uint32_t)std::stoul(row[0]);
+      uint32_t secVal = (uint32_t)std::stoul(row[1]);
+      uint32_t nanoSecVal = (uint32_t)std::stoul(row[2]);
       tickVec.push_back(tickVal);
       secVec.push_back(secVal);
       nanoSecVec.push_back(nanoSecVal);
@@ -355,72 +407,73 @@ bool SoftwarePLL::getDemoFileData(std::string fileName, std::vector<uint32_t>& t
     else
         return true;
 }
-#endif
 
-//TODO update testbed
-void SoftwarePLL::testbed()
+/*!
+\brief Replays tick/system time pairs through updatePLL() and getCorrectedTimeStamp() and prints
+the deviation between corrected timestamp and system timestamp.
+
+\param fileName csv file with header line and rows "tick;sec;nanosec" (see getDemoFileData), synthetic data if empty
+\param clockEstimator CLOCK_ESTIMATOR_FIFO_REGRESSION or CLOCK_ESTIMATOR_KALMAN_FILTER
+*/
+void SoftwarePLL::testbed(const std::string &fileName, int clockEstimator)
 {
-  std::cout << "Running testbed for SofwarePLL" << std::endl;
-  uint32_t curtick = 0;
-  int cnt = 0;
+  std::cout << "Running testbed for SofwarePLL, estimator " << clockEstimator << std::endl;
 
   SoftwarePLL testPll;
-  uint32_t sec = 9999;
-  uint32_t nanoSec = 0;
-  double tickPerSec = 1E6;
-  uint32_t tickInc = 1000;
-  int maxLoop = 20;
+  testPll.setClockEstimator(clockEstimator);
 
   std::vector<uint32_t> tickVec;
   std::vector<uint32_t> secVec;
   std::vector<uint32_t> nanoSecVec;
-  //bool bRet = false;
-
-  bool testWithDataFile = true;
-  if (testWithDataFile)
-  {
-    // commented for trusty bRet = testPll.getDemoFileData("/home/rosuser/dumpimu3.csv", tickVec, secVec, nanoSecVec);
-    maxLoop = (int)tickVec.size();
-  }
 
-  for (int i = 0; i < maxLoop; i++)
+  if (!fileName.empty())
   {
-    if (testWithDataFile)
+    if (!getDemoFileData(fileName, tickVec, secVec, nanoSecVec))
     {
-      curtick = tickVec[i];
-      sec = secVec[i];
-      nanoSec = nanoSecVec[i];
+      std::cerr << "## ERROR SoftwarePLL::testbed(): could not read " << fileName << std::endl;
+      return;
     }
-    else
+  }
+  else
+  {
+    // synthetic data: 1 ms tick increments, 50 ppm drift, receive jitter up to 0.5 ms and a 32 bit tick wraparound
+    uint32_t curtick = 0xFFFFFFFF - 100000;
+    double sysTime = 9999.0;
+    for (int i = 0; i < 2000; i++)
     {
-      cnt++;
-      curtick += tickInc; // increment tick counter
-      double deltaT = tickInc / tickPerSec;
-      nanoSec += (int) (deltaT * 1E9);
-      if (nanoSec >= 1E9)
-      {
-        nanoSec = 0;
-        sec++;
-      }
-      if (cnt >= 8)
-      {
-        sec++;
-      }
+      curtick += 1000;
+      sysTime += 1000 * 1.0e-6 * (1.0 + 50.0e-6);
+      double jitter = 0.5e-3 * (double)((i * 7919) % 101) / 100.0;
+      double rxTime = sysTime + jitter;
+      tickVec.push_back(curtick);
+      secVec.push_back((uint32_t)rxTime);
+      nanoSecVec.push_back((uint32_t)(1.0e9 * (rxTime - (uint32_t)rxTime)));
     }
-    printf("Before correction: %3d.%09d\n", sec, nanoSec);
-    uint32_t org_sec = sec;
-    uint32_t org_nanoSec = nanoSec;
-
-    bool bRet = testPll.getCorrectedTimeStamp(sec, nanoSec, curtick);
+  }
 
-    bool corrected = false;
-    if ((nanoSec != org_nanoSec) || (sec != org_sec))
+  size_t numCorrected = 0;
+  double sumAbsDelta = 0, maxAbsDelta = 0;
+  for (size_t i = 0; i < tickVec.size(); i++)
+  {
+    uint32_t curtick = tickVec[i];
+    uint32_t sec = secVec[i];
+    uint32_t nanoSec = nanoSecVec[i];
+    testPll.updatePLL(sec, nanoSec, curtick);
+
+    uint32_t corr_sec = 0, corr_nanoSec = 0;
+    bool bRet = testPll.getCorrectedTimeStamp(corr_sec, corr_nanoSec, curtick);
+    double delta = (corr_sec + 1.0e-9 * corr_nanoSec) - (sec + 1.0e-9 * nanoSec);
+    if (bRet)
     {
-      corrected = true;
+      numCorrected++;
+      sumAbsDelta += fabs(delta);
+      maxAbsDelta = std::max(maxAbsDelta, fabs(delta));
     }
-    printf("After correction : %3d.%09d %s %s\n", sec, nanoSec, bRet ? "OK     " : "DISMISS",
-           corrected ? "MODI." : "OK   ");
+    printf("tick %10u: system %10u.%09u, corrected %10u.%09u %s delta %+.6f\n", curtick, sec, nanoSec, corr_sec, corr_nanoSec,
+           bRet ? "OK     " : "DISMISS", bRet ? delta : 0.0);
   }
+  printf("%lu of %lu timestamps corrected, mean |delta| = %.6f sec, max |delta| = %.6f sec\n", numCorrected, tickVec.size(),
+         numCorrected > 0 ? (sumAbsDelta / numCorrected) : 0.0, maxAbsDelta);
 
   return;
 }
@@ -431,7 +484,7 @@ int main(int argc, char **argv)
 {
   printf("Test for softwarePLL-Class\n");
   printf("\n");
-  SoftwarePLL::testbed();
+  SoftwarePLL::testbed(argc > 1 ? argv[1] : "", argc > 2 ? atoi(argv[2]) : 0);
 }
 #endif
 
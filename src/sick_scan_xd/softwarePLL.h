@@ -15,7 +15,77 @@
 #include <iomanip>
 #include <ctime>
 #include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+#include <algorithm>
+#include "clock_estimator.h"
+
+/*!
+\brief Seqlock protected value for a single writer and any number of lock-free readers.
+Readers retry if the writer was active while they copied the value, so a reader never
+observes a partially updated T. T must be trivially copyable.
+*/
+template<typename T>
+class SeqlockValue
+{
+  static_assert(std::is_trivially_copyable<T>::value, "SeqlockValue requires a trivially copyable type");
+
+public:
+  SeqlockValue()
+  {
+    store(T{});
+  }
+
+  // single writer only (callers serialize concurrent writers)
+  void store(const T &val)
+  {
+    uint64_t buf[NumWords] = {};
+    std::memcpy(buf, &val, sizeof(T));
+    uint32_t seq = m_seq.load(std::memory_order_relaxed);
+    m_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < NumWords; i++)
+    {
+      m_words[i].store(buf[i], std::memory_order_relaxed);
+    }
+    m_seq.store(seq + 2, std::memory_order_release);
+  }
+
+  T load() const
+  {
+    uint64_t buf[NumWords];
+    uint32_t seq0 = 0, seq1 = 0;
+    do
+    {
+      seq0 = m_seq.load(std::memory_order_acquire);
+      for (size_t i = 0; i < NumWords; i++)
+      {
+        buf[i] = m_words[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      seq1 = m_seq.load(std::memory_order_relaxed);
+    } while ((seq0 & 1) != 0 || seq0 != seq1);
+    T val;
+    std::memcpy(&val, buf, sizeof(T));
+    return val;
+  }
 
+private:
+  static constexpr size_t NumWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  std::atomic<uint32_t> m_seq{0};
+  std::atomic<uint64_t> m_words[NumWords];
+};
+
+/*!
+\brief Maps lidar ticks (microseconds) to system time.
+
+Each sensor should own its own SoftwarePLL; instance() only remains as the default
+process-wide instance for callers which do not pass one. updatePLL() is serialized
+internally, while getCorrectedTimeStamp(), convSystemtimeToLidarTimestamp() and
+IsInitialized() only read an immutable snapshot of the clock model and never block,
+so any number of decoder threads can convert ticks while one thread updates the model.
+*/
 class SoftwarePLL
 {
 public:
@@ -25,28 +95,52 @@ public:
     return _instance;
   }
 
+  SoftwarePLL()
+  {
+    AllowedTimeDeviation(SoftwarePLL::MaxAllowedTimeDeviation); // 1 ms
+    numberValInFifo = 0;
+    isInitialized = false;
+    firstTick = 0;
+    firstTimeStamp = 0;
+    interpolationSlope = 0;
+    publishSnapshot();
+  }
+
   ~SoftwarePLL()
   {}
 
+  SoftwarePLL(const SoftwarePLL &) = delete;
+  SoftwarePLL &operator=(const SoftwarePLL &) = delete;
+
   bool pushIntoFifo(double curTimeStamp, uint32_t curtick);// update tick fifo and update clock (timestamp) fifo;
   double extraPolateRelativeTimeStamp(uint32_t tick);
 
-  bool getCorrectedTimeStamp(uint32_t &sec, uint32_t &nanoSec, uint32_t tick);
+  bool getCorrectedTimeStamp(uint32_t &sec, uint32_t &nanoSec, uint32_t tick) const;
 
-  bool convSystemtimeToLidarTimestamp(uint32_t systemtime_sec, uint32_t systemtime_nanosec, uint32_t& tick);
+  bool convSystemtimeToLidarTimestamp(uint32_t systemtime_sec, uint32_t systemtime_nanosec, uint32_t& tick) const;
 
-  bool getDemoFileData(std::string fileName, std::vector<uint32_t> &tickVec, std::vector<uint32_t> &secVec,
+  static bool getDemoFileData(std::string fileName, std::vector<uint32_t> &tickVec, std::vector<uint32_t> &secVec,
                        std::vector<uint32_t> &nanoSecVec);
 
-  static void testbed();
+  // replays a csv file (tick;sec;nanosec, see getDemoFileData) or synthetic data if fileName is empty
+  static void testbed(const std::string &fileName = "", int clockEstimator = 0);
+
+  enum CLOCK_ESTIMATOR
+  {
+    CLOCK_ESTIMATOR_FIFO_REGRESSION = 0, // default: linear regression over the last fifoSize tick/timestamp pairs
+    CLOCK_ESTIMATOR_KALMAN_FILTER = 1    // incremental offset/drift kalman filter with outlier gating, see ClockKalmanFilter
+  };
+
+  // selects the estimator updated by updatePLL(), restarts the clock model
+  void setClockEstimator(int val);
+
+  int getClockEstimator() const
+  { return (int)clockEstimator; }
 
+  // thread-safe, reads the published snapshot
   bool IsInitialized() const
-  { 
-    if (ticksToTimestampMode == TICKS_TO_MICROSEC_OFFSET_TIMESTAMP)
-    {
-      return (offsetTimestampFirstLidarTick > 0);
-    }
-    return isInitialized; 
+  {
+    return m_snapshot.load().initialized;
   }
 
   void IsInitialized(bool val)
@@ -86,22 +180,75 @@ public:
 
   int findDiffInFifo(double diff, double tol);
 
-  static const int fifoSize = 7;
+  static const int fifoSize = 7;       // default fifo length
+  static const int MaxFifoSize = 64;   // max. fifo length configurable by setFifoSize()
+
+  // sets the number of tick/timestamp pairs used by the fifo regression, restarts the clock model
+  void setFifoSize(int val)
+  {
+    std::lock_guard<std::mutex> lock(m_updateMutex);
+    fifoLength = std::max(2, std::min(val, (int)MaxFifoSize));
+    numberValInFifo = 0;
+    IsInitialized(false);
+    publishSnapshot();
+  }
+
+  int FifoSize() const
+  { return fifoLength; }
+
+  // tuning parameter of CLOCK_ESTIMATOR_KALMAN_FILTER, must be set before updatePLL() is called
+  ClockKalmanFilter &KalmanFilter()
+  { return kalmanFilter; }
   size_t packets_dropped = 0;    // just for printing statusmessages when dropping packets
   size_t packets_received = 0;   // just for printing statusmessages when dropping packets
   double max_abs_delta_time = 0; // just for printing statusmessages when dropping packets
 
   void setTicksToTimestampMode(int val)
   {
+    std::lock_guard<std::mutex> lock(m_updateMutex);
     ticksToTimestampMode = (TICKS_TO_TIMESTAMP_MODE)val;
+    publishSnapshot();
   }
 
 private:
+  /*!
+  \brief Immutable copy of everything required to convert ticks to system time (and back)
+  */
+  struct ClockSnapshot
+  {
+    bool initialized;
+    int ticksToTimestampMode;
+    uint64_t firstTick;
+    double firstTimeStamp;
+    double interpolationSlope;
+    uint32_t offsetTimestampFirstSystemSec;
+    uint32_t offsetTimestampFirstSystemMicroSec;
+    uint32_t offsetTimestampFirstLidarTick;
+  };
+
+  // writer side state, same semantic as IsInitialized() had before snapshots were introduced
+  bool isInitializedState() const
+  {
+    if (ticksToTimestampMode == TICKS_TO_MICROSEC_OFFSET_TIMESTAMP)
+    {
+      return (offsetTimestampFirstLidarTick > 0);
+    }
+    return isInitialized;
+  }
+
+  void publishSnapshot();
+
+  std::mutex m_updateMutex;             // serializes updatePLL() and mode changes
+  CLOCK_ESTIMATOR clockEstimator = CLOCK_ESTIMATOR_FIFO_REGRESSION;
+  ClockKalmanFilter kalmanFilter;
+  SeqlockValue<ClockSnapshot> m_snapshot;
+
   int numberValInFifo;
   static const double MaxAllowedTimeDeviation;
   static const uint32_t MaxExtrapolationCounter;
-  uint32_t tickFifo[fifoSize]; //  = { 0 };
-  double clockFifo[fifoSize];
+  int fifoLength = fifoSize;
+  uint32_t tickFifo[MaxFifoSize]; //  = { 0 };
+  double clockFifo[MaxFifoSize];
   double lastValidTimeStamp;
   uint32_t lastValidTick; // = 0;
   bool isInitialized; // = false;
@@ -132,17 +279,4 @@ private:
 
   uint32_t extrapolationDivergenceCounter;
 
-  SoftwarePLL()
-  {
-    AllowedTimeDeviation(SoftwarePLL::MaxAllowedTimeDeviation); // 1 ms
-    numberValInFifo = 0;
-    isInitialized = false;
-  }
-
-  // verhindert, dass ein Objekt von au�erhalb von N erzeugt wird.
-  // protected, wenn man von der Klasse noch erben m�chte
-  SoftwarePLL(const SoftwarePLL &); /* verhindert, dass eine weitere Instanz via
-								   Kopier-Konstruktor erstellt werden kann */
-  SoftwarePLL &operator=(const SoftwarePLL &); //Verhindert weitere Instanz durch Kopie
-
 };
@@ -0,0 +1,266 @@
+/*
+====================================================================================================
+File: sopas_async_client.cpp
+====================================================================================================
+*/
+#include <algorithm>
+#include <thread>
+
+#include "sopas_async_client.h"
+#include "abstract_parser.h"
+#include "sick_ros_wrapper.h"
+
+static const int SopasAsyncPollMillisec = 20; // max. time the worker waits for a reply before it sends newly submitted requests
+
+sick_scan_xd::SopasAsyncClient::SopasAsyncClient(SickScanCommonTcp* common_tcp, bool use_cola_binary, int default_timeout_ms)
+  : m_common_tcp(common_tcp), m_cmd_cache(use_cola_binary), m_default_timeout_ms(default_timeout_ms)
+{
+  m_thread = std::thread(&SopasAsyncClient::run, this);
+}
+
+sick_scan_xd::SopasAsyncClient::~SopasAsyncClient()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_running = false;
+  }
+  m_cond.notify_all();
+  m_thread.join();
+  cancelAll();
+}
+
+std::future<sick_scan_xd::SopasAsyncResult> sick_scan_xd::SopasAsyncClient::sendAsync(const std::string& command, int timeout_ms, uint64_t* request_id)
+{
+  std::shared_ptr<Request> request = std::make_shared<Request>();
+  std::future<SopasAsyncResult> result = request->promise.get_future();
+  uint64_t id = submit(command, timeout_ms, request);
+  if (request_id)
+  {
+    *request_id = id;
+  }
+  return result;
+}
+
+uint64_t sick_scan_xd::SopasAsyncClient::sendAsync(const std::string& command, Callback callback, int timeout_ms)
+{
+  std::shared_ptr<Request> request = std::make_shared<Request>();
+  request->callback = callback;
+  return submit(command, timeout_ms, request);
+}
+
+uint64_t sick_scan_xd::SopasAsyncClient::submit(const std::string& command, int timeout_ms, std::shared_ptr<Request>& request)
+{
+  request->cmd = m_cmd_cache.get(command);
+  request->keyword = SickScanCommonTcp::getSopasCmdKeyword(request->cmd->request.data(), request->cmd->request.size());
+  request->timeout_ms = (timeout_ms < 0) ? m_default_timeout_ms : timeout_ms;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    request->id = m_next_id++;
+    if (m_running)
+    {
+      m_submitted.push_back(request);
+      m_cond.notify_all();
+      return request->id;
+    }
+  }
+  SopasAsyncResult result;
+  result.status = SopasAsyncResult::CANCELLED;
+  complete(request, result);
+  return request->id;
+}
+
+bool sick_scan_xd::SopasAsyncClient::cancel(uint64_t request_id)
+{
+  std::shared_ptr<Request> request;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto has_id = [request_id](const std::shared_ptr<Request>& r) { return r->id == request_id; };
+    std::deque<std::shared_ptr<Request>>::iterator submitted = std::find_if(m_submitted.begin(), m_submitted.end(), has_id);
+    if (submitted != m_submitted.end())
+    {
+      request = *submitted;
+      m_submitted.erase(submitted);
+    }
+    else
+    {
+      // already sent: stays in flight until its reply has been consumed, or discarded on timeout or when the client stops
+      std::deque<std::shared_ptr<Request>>::iterator in_flight = std::find_if(m_in_flight.begin(), m_in_flight.end(), has_id);
+      if (in_flight != m_in_flight.end() && !(*in_flight)->done)
+      {
+        request = *in_flight;
+      }
+    }
+  }
+  if (!request)
+  {
+    return false;
+  }
+  SopasAsyncResult result;
+  result.status = SopasAsyncResult::CANCELLED;
+  complete(request, result);
+  return true;
+}
+
+void sick_scan_xd::SopasAsyncClient::cancelAll()
+{
+  std::vector<std::shared_ptr<Request>> requests;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    requests.insert(requests.end(), m_submitted.begin(), m_submitted.end());
+    requests.insert(requests.end(), m_in_flight.begin(), m_in_flight.end());
+    m_submitted.clear();
+    if (!m_running)
+    {
+      // the worker has stopped: replies to requests still in flight will arrive late, so drop them
+      // instead of leaving them to the next synchronous command with the same keyword
+      for (size_t n = 0; n < m_in_flight.size(); n++)
+      {
+        if (m_in_flight[n]->sent)
+        {
+          m_common_tcp->recvQueue.discardNext(m_in_flight[n]->keyword);
+        }
+      }
+      m_in_flight.clear();
+    }
+  }
+  for (size_t n = 0; n < requests.size(); n++)
+  {
+    SopasAsyncResult result;
+    result.status = SopasAsyncResult::CANCELLED;
+    complete(requests[n], result);
+  }
+}
+
+size_t sick_scan_xd::SopasAsyncClient::numPending()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  size_t num_pending = m_submitted.size();
+  for (size_t n = 0; n < m_in_flight.size(); n++)
+  {
+    num_pending += (m_in_flight[n]->done ? 0 : 1);
+  }
+  return num_pending;
+}
+
+void sick_scan_xd::SopasAsyncClient::complete(std::shared_ptr<Request>& request, SopasAsyncResult& result)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (request->done)
+    {
+      return;
+    }
+    request->done = true;
+  }
+  result.command = request->cmd->command;
+  if (request->callback)
+  {
+    request->callback(result);
+  }
+  else
+  {
+    request->promise.set_value(result);
+  }
+}
+
+void sick_scan_xd::SopasAsyncClient::run()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (m_running)
+  {
+    if (m_submitted.empty())
+    {
+      m_cond.wait(lock);
+      continue;
+    }
+    lock.unlock();
+    std::unique_lock<std::mutex> exchange_lock = m_common_tcp->lockSopasExchange(); // waits for a synchronous exchange in progress
+    lock.lock();
+
+    // one batch: the requests submitted so far are sent back to back, then their replies are received.
+    // Requests submitted meanwhile wait for the next batch, so a steady stream of async requests can't keep the link.
+    size_t batch_size = m_submitted.size();
+    for (size_t n = 0; n < batch_size && !m_submitted.empty(); n++)
+    {
+      std::shared_ptr<Request> request = m_submitted.front();
+      m_submitted.pop_front();
+      m_in_flight.push_back(request);
+      lock.unlock();
+      request->send_time = std::chrono::steady_clock::now();
+      request->deadline = request->send_time + std::chrono::milliseconds(request->timeout_ms);
+      request->sent = (m_common_tcp->sendSopasRequest(request->cmd->request) == ExitSuccess);
+      if (!request->sent)
+      {
+        ROS_WARN_STREAM("## WARNING SopasAsyncClient: failed to send \"" << request->cmd->command << "\"");
+        SopasAsyncResult result;
+        result.status = SopasAsyncResult::SEND_FAILED;
+        complete(request, result);
+        request->deadline = request->send_time; // nothing to wait for
+      }
+      lock.lock();
+    }
+    while (m_running && !m_in_flight.empty())
+    {
+      // the lidar replies in request order: wait for the oldest request in flight
+      std::shared_ptr<Request> request = m_in_flight.front();
+      lock.unlock();
+      SopasAsyncResult result;
+      bool finished = receive(*request, SopasAsyncPollMillisec, result);
+      if (finished)
+      {
+        if (request->sent && result.status == SopasAsyncResult::TIMEOUT)
+        {
+          // a late reply must not be taken for the reply of a later request with the same keyword (async or synchronous)
+          m_common_tcp->recvQueue.discardNext(request->keyword);
+        }
+        complete(request, result); // no-op if cancelled or send failed
+      }
+      lock.lock();
+      if (finished)
+      {
+        m_in_flight.pop_front();
+      }
+    }
+
+    // hand the link over to synchronous commands waiting for it before the next batch
+    lock.unlock();
+    exchange_lock.unlock();
+    while (m_common_tcp->numSopasExchangeWaiters() > 0)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    lock.lock();
+  }
+}
+
+bool sick_scan_xd::SopasAsyncClient::receive(Request& request, int max_wait_ms, SopasAsyncResult& result)
+{
+  std::vector<std::string> keywords = { request.keyword };
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (now >= request.deadline)
+  {
+    result.status = SopasAsyncResult::TIMEOUT;
+    return true;
+  }
+  int wait_ms = (int)std::min<int64_t>(max_wait_ms, std::chrono::duration_cast<std::chrono::milliseconds>(request.deadline - now).count() + 1);
+  if (!m_common_tcp->recvQueue.waitForIncomingObject(wait_ms, keywords))
+  {
+    return false;
+  }
+  DatagramWithTimeStamp datagram = m_common_tcp->recvQueue.pop(keywords);
+  std::string reply_string = SickScanCommonTcp::sopasReplyToString(datagram.datagram);
+  bool expected = false;
+  for (size_t n = 0; !expected && n < request.cmd->expected_answers.size(); n++)
+  {
+    expected = (reply_string.find(request.cmd->expected_answers[n]) != std::string::npos);
+  }
+  if (!expected && reply_string.find("sFA") == std::string::npos)
+  {
+    return false; // unexpected datagram with the same keyword, e.g. an event message: keep waiting
+  }
+  result.status = expected ? SopasAsyncResult::SUCCESS : SopasAsyncResult::ERROR_REPLY;
+  result.rtt_millisec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - request.send_time).count();
+  result.reply = std::move(datagram.datagram);
+  result.reply_string = std::move(reply_string);
+  return true;
+}
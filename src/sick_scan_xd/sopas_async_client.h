@@ -0,0 +1,157 @@
+/*
+====================================================================================================
+File: sopas_async_client.h
+====================================================================================================
+*/
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sick_scan_common_tcp.h"
+#include "sopas_cmd_cache.h"
+
+namespace sick_scan_xd
+{
+
+  /*!
+  \brief Result of an asynchronous sopas request
+  */
+  struct SopasAsyncResult
+  {
+    enum Status
+    {
+      SUCCESS,      ///< expected answer received
+      ERROR_REPLY,  ///< lidar replied with sopas error "sFA"
+      TIMEOUT,      ///< no reply within the timeout
+      CANCELLED,    ///< cancelled by cancel(), cancelAll() or destruction of the client
+      SEND_FAILED   ///< request could not be sent, f.e. not connected
+    };
+
+    Status status = TIMEOUT;
+    std::string command;              ///< sopas command, f.e. "sRN SCdevicestate"
+    std::vector<unsigned char> reply; ///< reply incl. framing (empty if no reply)
+    std::string reply_string;         ///< reply converted by SickScanCommonTcp::sopasReplyToString()
+    double rtt_millisec = -1.0;       ///< round trip time, -1 if no reply
+
+    bool ok() const { return status == SUCCESS; }
+  };
+
+  /*!
+  \brief Asynchronous sopas client on top of SickScanCommonTcp.
+
+  Requests are queued and sent by a worker thread, results are delivered by std::future or by a completion
+  callback. Requests are sent in batches: all requests submitted when the worker takes the link are sent
+  back to back (pipelined), replies are correlated by their command keyword in request order. Cancelled
+  requests complete with CANCELLED at once; if already sent, their reply is still consumed and discarded.
+  If a request times out, or the client is destroyed while it is in flight, the next reply with its keyword
+  is dropped from the receive queue (see Queue::discardNext()), so a late reply is never matched to a later
+  request.
+
+  While a batch is in flight, the worker holds SickScanCommonTcp::lockSopasExchange(), so synchronous
+  commands (f.e. the startup sequence) wait for it instead of picking up its replies, and vice versa.
+  Between batches the worker releases the link until all waiting synchronous commands have taken it.
+  Callbacks run in the worker thread: they may submit new requests, but must not block or call the
+  synchronous SickScanCommonTcp/SopasServices api.
+  */
+  class SopasAsyncClient
+  {
+  public:
+
+    typedef std::function<void(const SopasAsyncResult&)> Callback;
+
+    /*!
+    \param common_tcp connection to the lidar
+    \param use_cola_binary encode requests as CoLa-B (true) or CoLa-A (false)
+    \param default_timeout_ms timeout for requests submitted without timeout
+    */
+    SopasAsyncClient(SickScanCommonTcp* common_tcp, bool use_cola_binary = true, int default_timeout_ms = 3000);
+
+    /*!
+    \brief cancels all pending requests and stops the worker thread
+    */
+    virtual ~SopasAsyncClient();
+
+    /*!
+    \brief submits a sopas command, f.e. "sRN SCdevicestate"
+    \param command sopas command without framing
+    \param timeout_ms timeout after sending, default_timeout_ms if < 0
+    \param request_id optional, set to the id for cancel()
+    \return future of the result
+    */
+    std::future<SopasAsyncResult> sendAsync(const std::string& command, int timeout_ms = -1, uint64_t* request_id = 0);
+
+    /*!
+    \brief submits a sopas command, callback is called with the result
+    \return request id for cancel()
+    */
+    uint64_t sendAsync(const std::string& command, Callback callback, int timeout_ms = -1);
+
+    /*!
+    \brief cancels a pending request
+    \return true if the request was pending, false if it has already completed
+    */
+    bool cancel(uint64_t request_id);
+
+    /*!
+    \brief cancels all pending requests
+    */
+    void cancelAll();
+
+    /*!
+    \brief number of requests queued or in flight
+    */
+    size_t numPending();
+
+  protected:
+
+    struct Request
+    {
+      uint64_t id = 0;
+      std::shared_ptr<const SopasCmdCache::Entry> cmd;
+      std::string keyword;
+      int timeout_ms = 0;
+      std::promise<SopasAsyncResult> promise;
+      Callback callback;
+      bool done = false;  // result delivered, protected by m_mutex
+      bool sent = false;  // request has been sent, set by the worker thread
+      std::chrono::steady_clock::time_point send_time;
+      std::chrono::steady_clock::time_point deadline;
+    };
+
+    uint64_t submit(const std::string& command, int timeout_ms, std::shared_ptr<Request>& request);
+
+    void run();
+
+    /*
+    ** waits for the reply to the oldest request in flight for at most max_wait_ms, returns true if the request is finished
+    */
+    bool receive(Request& request, int max_wait_ms, SopasAsyncResult& result);
+
+    /*
+    ** delivers the result unless the request has been completed before. Call without m_mutex locked.
+    */
+    void complete(std::shared_ptr<Request>& request, SopasAsyncResult& result);
+
+    SickScanCommonTcp* m_common_tcp;
+    SopasCmdCache m_cmd_cache;
+    int m_default_timeout_ms;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::shared_ptr<Request>> m_submitted; ///< requests not yet sent
+    std::deque<std::shared_ptr<Request>> m_in_flight; ///< requests sent, in request order
+    uint64_t m_next_id = 1;
+    bool m_running = true;
+    std::thread m_thread;
+  };
+
+} /* namespace sick_scan_xd */
@@ -0,0 +1,77 @@
+/*
+====================================================================================================
+File: sopas_cmd_cache.cpp
+====================================================================================================
+*/
+#include "sopas_cmd_cache.h"
+#include "sick_scan_common_tcp.h"
+
+sick_scan_xd::SopasCmdCache::SopasCmdCache(bool cola_binary, size_t max_entries)
+  : m_cola_binary(cola_binary), m_max_entries(max_entries)
+{
+  const std::vector<std::string>& commands = fixedCommands();
+  for (size_t n = 0; n < commands.size(); n++)
+  {
+    m_entries[commands[n]] = encode(commands[n]);
+  }
+}
+
+const std::vector<std::string>& sick_scan_xd::SopasCmdCache::fixedCommands()
+{
+  static const std::vector<std::string> commands = {
+    "sMN Run",
+    "sMN LMCstartmeas",
+    "sMN LMCstopmeas",
+    "sWN ScanDataPreformatting 1",
+    "sWN ScanDataEnable 0",
+    "sWN ScanDataEnable 1",
+    "sWN ImuDataEnable 0",
+    "sWN ImuDataEnable 1"
+  };
+  return commands;
+}
+
+std::shared_ptr<const sick_scan_xd::SopasCmdCache::Entry> sick_scan_xd::SopasCmdCache::get(const std::string& command)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unordered_map<std::string, std::shared_ptr<const Entry>>::iterator cached = m_entries.find(command);
+    if (cached != m_entries.end())
+    {
+      m_num_hits++;
+      return cached->second;
+    }
+    m_num_misses++;
+  }
+  std::shared_ptr<const Entry> entry = encode(command); // encode without lock, concurrent misses of the same command just encode twice
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_entries.size() >= m_max_entries)
+  {
+    m_entries.clear(); // only commands with many different arguments get here, entries in use stay valid (shared_ptr)
+  }
+  m_entries[command] = entry;
+  return entry;
+}
+
+size_t sick_scan_xd::SopasCmdCache::size()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_entries.size();
+}
+
+std::shared_ptr<const sick_scan_xd::SopasCmdCache::Entry> sick_scan_xd::SopasCmdCache::encode(const std::string& command) const
+{
+  std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+  entry->command = command;
+  std::string request = std::string("\x02") + command + "\x03";
+  if (m_cola_binary)
+  {
+    SickScanCommonTcp::convertAscii2BinaryCmd(request.c_str(), &entry->request);
+  }
+  else
+  {
+    entry->request.assign(request.begin(), request.end());
+  }
+  entry->expected_answers = SickScanCommonTcp::generateExpectedAnswerString(entry->request);
+  return entry;
+}
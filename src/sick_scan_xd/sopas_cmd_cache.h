@@ -0,0 +1,106 @@
+/*
+====================================================================================================
+File: sopas_cmd_cache.h
+====================================================================================================
+*/
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace sick_scan_xd
+{
+
+  /*!
+  \brief Cache of encoded sopas requests and their expected answers.
+
+  Encoding a request (framing, CoLa-B conversion by SickScanCommonTcp::convertAscii2BinaryCmd(), length
+  and checksum) and generating its expected answers by SickScanCommonTcp::generateExpectedAnswerString()
+  involve string parsing. Each command is encoded once and reused, so restarts and repeated commands only
+  cost a hash lookup. Fixed commands of the multiScan start and stop sequences are encoded on construction.
+
+  Parameterized commands are built by the templated format(), f.e. format("sWN ScanDataFormat", 2),
+  which appends the arguments without stream formatting.
+  */
+  class SopasCmdCache
+  {
+  public:
+
+    struct Entry
+    {
+      std::string command;                        ///< sopas command, f.e. "sWN ScanDataEnable 1"
+      std::vector<unsigned char> request;         ///< framed request, CoLa-A or CoLa-B
+      std::vector<std::string> expected_answers;  ///< see SickScanCommonTcp::generateExpectedAnswerString()
+    };
+
+    /*!
+    \param cola_binary encode requests as CoLa-B (true) or CoLa-A (false)
+    \param max_entries the cache is cleared if it grows beyond max_entries commands
+    */
+    SopasCmdCache(bool cola_binary = true, size_t max_entries = 256);
+
+    /*!
+    \brief returns the cached entry of a command, the command is encoded on first use
+    */
+    std::shared_ptr<const Entry> get(const std::string& command);
+
+    /*!
+    \brief builds a parameterized command "<name> <arg0> <arg1> ...", integral arguments are printed decimal
+    */
+    template<typename... Args>
+    static std::string format(const char* name, const Args&... args)
+    {
+      std::string command(name);
+      (appendArg(command, args), ...);
+      return command;
+    }
+
+    size_t size();
+    size_t numHits() const { return m_num_hits; }
+    size_t numMisses() const { return m_num_misses; }
+
+    /*!
+    \brief commands of the multiScan start and stop sequences without variable arguments
+    */
+    static const std::vector<std::string>& fixedCommands();
+
+  protected:
+
+    template<typename T>
+    static typename std::enable_if<std::is_integral<T>::value>::type appendArg(std::string& command, const T& value)
+    {
+      char buffer[24];
+      std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+      command.push_back(' ');
+      command.append(buffer, result.ptr);
+    }
+
+    static void appendArg(std::string& command, const std::string& value)
+    {
+      command.push_back(' ');
+      command.append(value);
+    }
+
+    static void appendArg(std::string& command, const char* value)
+    {
+      command.push_back(' ');
+      command.append(value);
+    }
+
+    std::shared_ptr<const Entry> encode(const std::string& command) const;
+
+    bool m_cola_binary;
+    size_t m_max_entries;
+    std::atomic<size_t> m_num_hits{ 0 };   // updated under m_mutex, read without it
+    std::atomic<size_t> m_num_misses{ 0 };
+    std::mutex m_mutex;
+    std::unordered_map<std::string, std::shared_ptr<const Entry>> m_entries;
+  };
+
+} /* namespace sick_scan_xd */
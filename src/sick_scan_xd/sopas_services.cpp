@@ -58,6 +58,8 @@
  * Based on the TiM communication example by SICK AG.
  *
  */
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <iomanip>
 #include <cmath>
@@ -69,8 +71,10 @@
 
 
 sick_scan_xd::SopasServices::SopasServices(sick_scan_xd::SickScanCommonTcp* common_tcp, bool use_cola_binary)
-  : m_common_tcp(common_tcp), m_cola_binary(use_cola_binary), m_client_authorization_pw("F4724744")
-{}
+  : m_common_tcp(common_tcp), m_cola_binary(use_cola_binary), m_client_authorization_pw("F4724744"), m_cmd_cache(use_cola_binary)
+{
+  m_cmd_cache.get(std::string("sMN SetAccessMode 3 ") + m_client_authorization_pw); // sent before every configuration step
+}
 
 sick_scan_xd::SopasServices::~SopasServices() {}
 
@@ -86,18 +90,8 @@ bool sick_scan_xd::SopasServices::sendSopasAndCheckAnswer(const std::string& sop
   if(m_common_tcp)
   {
     ROS_INFO_STREAM("SopasServices: Sending request \"" << sopasCmd << "\"");
-    std::string sopasRequest = std::string("\x02") + sopasCmd + "\x03";
-    int result = -1;
-    if (m_cola_binary)
-    {
-      std::vector<unsigned char> reqBinary;
-      m_common_tcp->convertAscii2BinaryCmd(sopasRequest.c_str(), &reqBinary);
-      result = m_common_tcp->sendSopasAndCheckAnswer(reqBinary, &sopasReplyBin, -1);
-    }
-    else
-    {
-      result = m_common_tcp->sendSopasAndCheckAnswer(sopasRequest.c_str(), &sopasReplyBin, -1);
-    }
+    std::shared_ptr<const SopasCmdCache::Entry> cmd = m_cmd_cache.get(sopasCmd);
+    int result = m_common_tcp->sendSopasAndCheckAnswer(cmd->request, cmd->expected_answers, &sopasReplyBin, -1);
     if (result != 0)
     {
       ROS_ERROR_STREAM("## ERROR SopasServices::sendSopasAndCheckAnswer: error sending sopas command \"" << sopasCmd << "\"");
@@ -116,6 +110,14 @@ bool sick_scan_xd::SopasServices::sendSopasAndCheckAnswer(const std::string& sop
   return false;
 }
 
+/*!
+ * Converts a sopas command to a sopas request incl. framing, Cola-B encoded if m_cola_binary is set
+ */
+std::vector<unsigned char> sick_scan_xd::SopasServices::createSopasRequest(const std::string& sopasCmd)
+{
+  return m_cmd_cache.get(sopasCmd)->request;
+}
+
 /*!
  * Sends the SOPAS authorization command "sMN SetAccessMode 3 F4724744".
  */
@@ -180,112 +182,257 @@ bool sick_scan_xd::SopasServices::sendSopasCmdCheckResponse(const std::string& s
 }
 
 /*!
-* Sends the multiScan start commands "sWN ScanDataFormat", "sWN ScanDataPreformatting", "sWN ScanDataEthSettings", "sWN ScanDataEnable 1", "sMN LMCstartmeas", "sMN Run"
-* @param[in] hostname IP address of multiScan136, default 192.168.0.1
-* @param[in] port IP port of multiScan136, default 2115
-* @param[in] scanner_type type of scanner, currently supported are multiScan136 and picoScan150
-* @param[in] scandataformat ScanDataFormat: 1 for msgpack or 2 for compact scandata, default: 2 
-* @param[in] imu_enable: Imu data transfer enabled
-* @param[in] imu_udp_port: UDP port of imu data (if imu_enable is true)
-*/
-bool sick_scan_xd::SopasServices::sendMultiScanStartCmd(const std::string& hostname, int port, int scandataformat, bool imu_enable, int imu_udp_port, int performanceprofilenumber)
+ * Returns the response keyword expected for a sopas command, f.e. "sWA ScanDataEnable" for "sWN ScanDataEnable 1"
+ */
+static std::string expectedSopasResponse(const std::string& sopas_request)
+{
+  std::string keyword = sopas_request.substr(4, sopas_request.find(' ', 4) - 4);
+  std::string method = sopas_request.substr(0, 3);
+  if (method == "sMN")
+    return "sAN " + keyword;
+  if (method.size() == 3 && method[2] == 'N')
+    return method.substr(0, 2) + "A " + keyword;
+  return keyword;
+}
+
+/*!
+ * Creates "<sopas_set_cmd> 1 +<ip0> +<ip1> +<ip2> +<ip3> +<port>", f.e. "sWN ScanDataEthSettings 1 +192 +168 +0 +100 +2115"
+ * @return false if hostname can't be split into 4 tokens
+ */
+bool sick_scan_xd::SopasServices::createEthSettingsCmd(const std::string& sopas_set_cmd, const std::string& hostname, int port, std::string& sopas_cmd)
 {
   std::stringstream ip_stream(hostname);
   std::string ip_token;
-  std::vector<std::string> ip_tokens;
+  std::stringstream eth_settings_cmd;
+  int num_ip_tokens = 0;
+  eth_settings_cmd << sopas_set_cmd << " 1";
   while (getline(ip_stream, ip_token, '.'))
   {
-    ip_tokens.push_back(ip_token);
+    eth_settings_cmd << " +" << ip_token;
+    num_ip_tokens++;
   }
-  if (ip_tokens.size() != 4)
+  eth_settings_cmd << " +" << port;
+  sopas_cmd = eth_settings_cmd.str();
+  return num_ip_tokens == 4;
+}
+
+/*!
+ * Creates "sWN PerformanceProfileNumber <hex>", the profile number is sent as uppercase hex value
+ */
+std::string sick_scan_xd::SopasServices::createPerformanceProfileCmd(int performanceprofilenumber)
+{
+  std::stringstream performanceprofilenumber_cmd;
+  performanceprofilenumber_cmd << "sWN PerformanceProfileNumber " << std::uppercase << std::hex << performanceprofilenumber;
+  return performanceprofilenumber_cmd.str();
+}
+
+/*!
+ * Creates the multiScan start sequence shared by sendMultiScanStartCmd() and sendMultiScanStartCmdPipelined(),
+ * see sendMultiScanStartCmdPipelined() for the stages. Parameters are identical to sendMultiScanStartCmd().
+ * @return false in case of an invalid configuration
+ */
+bool sick_scan_xd::SopasServices::createMultiScanStartCmds(const std::string& hostname, int port, int scandataformat, bool imu_enable, int imu_udp_port, int performanceprofilenumber,
+  const std::string& host_LFPangleRangeFilter, const std::string& host_LFPlayerFilter, std::vector<SopasStartupStage>& stages)
+{
+  std::string eth_settings_cmd, imu_eth_settings_cmd;
+  if (!createEthSettingsCmd("sWN ScanDataEthSettings", hostname, port, eth_settings_cmd)
+    || !createEthSettingsCmd("sWN ImuDataEthSettings", hostname, imu_udp_port, imu_eth_settings_cmd))
   {
-    ROS_ERROR_STREAM("## ERROR SopasServices::sendMultiScanStartCmd() failed: can't split ip address \"" << hostname << "\" into 4 tokens, check ip address");
+    ROS_ERROR_STREAM("## ERROR SopasServices::createMultiScanStartCmds() failed: can't split ip address \"" << hostname << "\" into 4 tokens, check ip address");
     ROS_ERROR_STREAM("## ERROR parsing ip address, check configuration of parameter \"hostname\" (launch file or commandline).");
     ROS_ERROR_STREAM("## In case of multiscan/sick_scansegment_xd lidars, check parameter \"udp_receiver_ip\", too.");
     return false;
   }
-  std::stringstream eth_settings_cmd, imu_eth_settings_cmd, scandataformat_cmd, performanceprofilenumber_cmd;
-  scandataformat_cmd << "sWN ScanDataFormat " << scandataformat;
+  if (scandataformat != 1 && scandataformat != 2)
+  {
+    ROS_ERROR_STREAM("## ERROR SopasServices::createMultiScanStartCmds(): invalid scandataformat configuration, unsupported scandataformat=" << scandataformat << ", check configuration and use 1 for msgpack or 2 for compact data");
+    return false;
+  }
+  std::vector<std::string> filter_cmds;
+  if (!createMultiScanFilterCmds(host_LFPangleRangeFilter, host_LFPlayerFilter, filter_cmds))
+  {
+    return false;
+  }
+  std::string authorization_cmd = std::string("sMN SetAccessMode 3 ") + m_client_authorization_pw;
+  SopasStartupStage configure = { "configure", { { authorization_cmd, true }, { eth_settings_cmd, true }, { SopasCmdCache::format("sWN ScanDataFormat", scandataformat), true } } };
   if (performanceprofilenumber >= 0)
   {
-    performanceprofilenumber_cmd << "sWN PerformanceProfileNumber " << std::uppercase << std::hex << performanceprofilenumber;
+    configure.cmds.push_back({ createPerformanceProfileCmd(performanceprofilenumber), true });
   }
-  eth_settings_cmd << "sWN ScanDataEthSettings 1";
-  imu_eth_settings_cmd << "sWN ImuDataEthSettings 1";
-  for (size_t i = 0; i < ip_tokens.size(); i++)
+  for (size_t n = 0; n < filter_cmds.size(); n++) // sensor side angle range and layer filter
   {
-    eth_settings_cmd << " +";
-    eth_settings_cmd << ip_tokens[i];
-    imu_eth_settings_cmd << " +";
-    imu_eth_settings_cmd << ip_tokens[i];
+    configure.cmds.push_back({ filter_cmds[n], true });
   }
-  eth_settings_cmd << " +";
-  eth_settings_cmd << port;
-  imu_eth_settings_cmd << " +";
-  imu_eth_settings_cmd << imu_udp_port;
-  if (!sendSopasCmdCheckResponse(eth_settings_cmd.str(), "sWA ScanDataEthSettings")) // configure destination scan data output destination , f.e. "sWN ScanDataEthSettings 1 +192 +168 +0 +52 +2115" (ip 192.168.0.52 port 2115)
+  configure.cmds.push_back({ "sWN ScanDataPreformatting 1", true }); // ScanDataPreformatting for multiScan136 only
+  if (imu_enable)
   {
-    ROS_ERROR_STREAM("## ERROR SopasServices::sendMultiScanStartCmd(): sendSopasCmdCheckResponse(\"sWN ScanDataEthSettings 1\") failed.");
-    return false;
+    configure.cmds.push_back({ imu_eth_settings_cmd, false });
   }
-  if (scandataformat != 1 && scandataformat != 2)
+  SopasStartupStage apply = { "apply", { { "sMN Run", true }, { authorization_cmd, true } } };
+  SopasStartupStage enable = { "enable", { { "sWN ScanDataEnable 1", true } } };
+  if (imu_enable)
   {
-    ROS_ERROR_STREAM("## ERROR SopasServices::sendMultiscanStartCmd(): invalid scandataformat configuration, unsupported scandataformat=" << scandataformat << ", check configuration and use 1 for msgpack or 2 for compact data");
-    return false;
+    enable.cmds.push_back({ "sWN ImuDataEnable 1", false });
   }
-  if (!sendSopasCmdCheckResponse(scandataformat_cmd.str(), "sWA ScanDataFormat")) // set scan data output format to MSGPACK (1) or COMPACT (2)
+  SopasStartupStage start = { "start", { { "sMN LMCstartmeas", true } } };
+
+  stages = { configure, apply, enable, apply, start };
+  return true;
+}
+
+/*!
+* Sends the multiScan start commands "sWN ScanDataFormat", "sWN ScanDataPreformatting", "sWN ScanDataEthSettings", "sWN ScanDataEnable 1", "sMN LMCstartmeas", "sMN Run"
+* one by one, each command waits for its reply.
+* @param[in] hostname IP address of multiScan136, default 192.168.0.1
+* @param[in] port IP port of multiScan136, default 2115
+* @param[in] scanner_type type of scanner, currently supported are multiScan136 and picoScan150
+* @param[in] scandataformat ScanDataFormat: 1 for msgpack or 2 for compact scandata, default: 2 
+* @param[in] imu_enable: Imu data transfer enabled
+* @param[in] imu_udp_port: UDP port of imu data (if imu_enable is true)
+*/
+bool sick_scan_xd::SopasServices::sendMultiScanStartCmd(const std::string& hostname, int port, int scandataformat, bool imu_enable, int imu_udp_port, int performanceprofilenumber,
+  const std::string& host_LFPangleRangeFilter, const std::string& host_LFPlayerFilter)
+{
+  std::vector<SopasStartupStage> stages;
+  if (!createMultiScanStartCmds(hostname, port, scandataformat, imu_enable, imu_udp_port, performanceprofilenumber, host_LFPangleRangeFilter, host_LFPlayerFilter, stages))
   {
-    ROS_ERROR_STREAM("## ERROR SopasServices::sendMultiscanStartCmd(): sendSopasCmdCheckResponse(\"sWN ScanDataFormat 1\") failed.");
     return false;
   }
-  if (performanceprofilenumber >= 0)
+  for (size_t i = 0; i < stages.size(); i++)
   {
-    if (!sendSopasCmdCheckResponse(performanceprofilenumber_cmd.str(), "sWA PerformanceProfileNumber"))
+    for (size_t n = 0; n < stages[i].cmds.size(); n++)
     {
-      ROS_ERROR_STREAM("## ERROR SopasServices::sendMultiscanStartCmd(): sendSopasCmdCheckResponse(\"sWN PerformanceProfileNumber ..\") failed.");
-      return false;
+      const SopasStartupCmd& cmd = stages[i].cmds[n];
+      if (!sendSopasCmdCheckResponse(cmd.request, expectedSopasResponse(cmd.request)))
+      {
+        if (cmd.required)
+        {
+          ROS_ERROR_STREAM("## ERROR SopasServices::sendMultiScanStartCmd(): stage \"" << stages[i].name << "\", request \"" << cmd.request << "\" failed.");
+          return false;
+        }
+        ROS_WARN_STREAM("## WARNING SopasServices::sendMultiScanStartCmd(): stage \"" << stages[i].name << "\", optional request \"" << cmd.request << "\" failed.");
+      }
     }
   }
-  if (!sendSopasCmdCheckResponse("sWN ScanDataPreformatting 1", "sWA ScanDataPreformatting")) // ScanDataPreformatting for multiScan136 only
+  return true;
+}
+
+/*!
+ * Sends all commands of one startup stage pipelined and appends the round trip times to the bring-up breakdown
+ */
+bool sick_scan_xd::SopasServices::sendSopasCmdBatch(const std::string& stage, const std::vector<SopasStartupCmd>& cmds, std::stringstream& breakdown)
+{
+  if (!m_common_tcp)
   {
-    ROS_ERROR_STREAM("## ERROR SopasServices::sendMultiscanStartCmd(): sendSopasCmdCheckResponse(\"sWN ScanDataPreformatting 1\") failed.");
+    ROS_ERROR_STREAM("## ERROR SopasServices::sendSopasCmdBatch: m_common_tcp not initialized");
     return false;
   }
-  if (imu_enable && !sendSopasCmdCheckResponse(imu_eth_settings_cmd.str(), "sWA ImuDataEthSettings")) // imu data eth settings
+  std::vector<std::vector<unsigned char>> requests, replies;
+  std::vector<std::vector<std::string>> expected_answers;
+  std::vector<double> rtt_millisec;
+  for (size_t n = 0; n < cmds.size(); n++)
   {
-    ROS_ERROR_STREAM("## ERROR SopasServices::sendMultiScanStartCmd(): sendSopasCmdCheckResponse(\"" << imu_eth_settings_cmd.str() << "\") failed.");
-  }
-  if (!sendRun())
-  {
-    return false;
+    std::shared_ptr<const SopasCmdCache::Entry> cmd = m_cmd_cache.get(cmds[n].request);
+    requests.push_back(cmd->request);
+    expected_answers.push_back(cmd->expected_answers);
   }
-  if (!sendAuthorization())
+  std::chrono::steady_clock::time_point stage_start = std::chrono::steady_clock::now();
+  m_common_tcp->sendSopasBatchAndCheckAnswers(requests, replies, rtt_millisec, &expected_answers);
+  double stage_millisec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stage_start).count();
+
+  bool success = true;
+  breakdown << "\n    " << std::left << std::setw(10) << stage << std::right << std::fixed << std::setprecision(1) << std::setw(8) << stage_millisec << " ms:";
+  for (size_t n = 0; n < cmds.size(); n++)
   {
-     return false;
+    breakdown << " \"" << cmds[n].request.substr(0, cmds[n].request.find(' ', 4)) << "\" ";
+    if (replies[n].empty())
+    {
+      breakdown << "failed";
+      if (cmds[n].required)
+      {
+        ROS_ERROR_STREAM("## ERROR SopasServices::sendSopasCmdBatch(): stage \"" << stage << "\", request \"" << cmds[n].request << "\" failed.");
+        success = false;
+      }
+      else
+      {
+        ROS_WARN_STREAM("## WARNING SopasServices::sendSopasCmdBatch(): stage \"" << stage << "\", optional request \"" << cmds[n].request << "\" failed.");
+      }
+    }
+    else
+    {
+      breakdown << rtt_millisec[n] << " ms";
+    }
   }
-  if (!sendSopasCmdCheckResponse("sWN ScanDataEnable 1", "sWA ScanDataEnable")) // enable scan data output
+  return success;
+}
+
+/*!
+ * Pipelined version of sendMultiScanStartCmd(): independent settings are sent back to back and only
+ * dependent steps wait for their replies. "sMN Run" applies the settings sent before, and the access
+ * level has to be restored after each "sMN Run", so these are the only points the sequence serializes.
+ */
+bool sick_scan_xd::SopasServices::sendMultiScanStartCmdPipelined(const std::string& hostname, int port, int scandataformat, bool imu_enable, int imu_udp_port, int performanceprofilenumber,
+  const std::string& host_LFPangleRangeFilter, const std::string& host_LFPlayerFilter)
+{
+  std::vector<SopasStartupStage> stages;
+  if (!createMultiScanStartCmds(hostname, port, scandataformat, imu_enable, imu_udp_port, performanceprofilenumber, host_LFPangleRangeFilter, host_LFPlayerFilter, stages))
   {
-    ROS_ERROR_STREAM("## ERROR SopasServices::sendMultiScanStartCmd(): sendSopasCmdCheckResponse(\"sWN ScanDataEnable 1\") failed.");
     return false;
   }
-  if (imu_enable && !sendSopasCmdCheckResponse("sWN ImuDataEnable 1", "sWA ImuDataEnable")) // enable imu data transfer
+  std::stringstream breakdown;
+  std::chrono::steady_clock::time_point startup_start = std::chrono::steady_clock::now();
+  bool success = true;
+  for (size_t i = 0; success && i < stages.size(); i++)
   {
-    ROS_ERROR_STREAM("## ERROR SopasServices::sendMultiScanStartCmd(): sendSopasCmdCheckResponse(\"sWN ImuDataEnable 1\") failed.");
+    success = sendSopasCmdBatch(stages[i].name, stages[i].cmds, breakdown);
   }
-  if (!sendRun())
+  double startup_millisec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup_start).count();
+  ROS_INFO_STREAM("SopasServices: multiScan startup " << (success ? "finished" : "failed") << " after " << std::fixed << std::setprecision(1) << startup_millisec << " ms" << breakdown.str());
+  return success;
+}
+
+/*!
+ * Applies a changed ScanDataFormat, PerformanceProfileNumber or ImuDataEnable while the lidar is measuring.
+ * ScanDataEthSettings, ScanDataEnable and LMCstartmeas are left untouched, so the scan data stream continues.
+ */
+bool sick_scan_xd::SopasServices::sendMultiScanReconfigureCmd(const std::string& hostname, int scandataformat, bool imu_enable, int imu_udp_port, int performanceprofilenumber)
+{
+  if (scandataformat != 1 && scandataformat != 2)
   {
+    ROS_ERROR_STREAM("## ERROR SopasServices::sendMultiScanReconfigureCmd(): invalid scandataformat configuration, unsupported scandataformat=" << scandataformat << ", check configuration and use 1 for msgpack or 2 for compact data");
     return false;
   }
-  if (!sendAuthorization())
+  std::string authorization_cmd = std::string("sMN SetAccessMode 3 ") + m_client_authorization_pw;
+  std::vector<SopasStartupCmd> configure_cmds = { { authorization_cmd, true }, { SopasCmdCache::format("sWN ScanDataFormat", scandataformat), true } };
+  if (performanceprofilenumber >= 0)
   {
-     return false;
+    configure_cmds.push_back({ createPerformanceProfileCmd(performanceprofilenumber), true });
   }
-  if (!sendSopasCmdCheckResponse("sMN LMCstartmeas", "sAN LMCstartmeas")) // start measurement
+  if (imu_enable)
   {
-    ROS_ERROR_STREAM("## ERROR SopasServices::sendMultiScanStartCmd(): sendSopasCmdCheckResponse(\"sMN LMCstartmeas\") failed.");
-    return false;
+    std::string imu_eth_settings_cmd;
+    if (createEthSettingsCmd("sWN ImuDataEthSettings", hostname, imu_udp_port, imu_eth_settings_cmd))
+    {
+      configure_cmds.push_back({ imu_eth_settings_cmd, false });
+    }
+    else
+    {
+      ROS_WARN_STREAM("## WARNING SopasServices::sendMultiScanReconfigureCmd(): can't split ip address \"" << hostname << "\" into 4 tokens, ImuDataEthSettings not changed");
+    }
   }
-  return true;
+  std::vector<SopasStartupCmd> apply_cmds = { { "sMN Run", true }, { authorization_cmd, true } };
+  std::vector<SopasStartupCmd> enable_cmds = { { imu_enable ? "sWN ImuDataEnable 1" : "sWN ImuDataEnable 0", false } };
+  std::vector<SopasStartupCmd> run_cmds = { { "sMN Run", true } };
+
+  std::stringstream breakdown;
+  std::chrono::steady_clock::time_point reconfigure_start = std::chrono::steady_clock::now();
+  bool success = sendSopasCmdBatch("configure", configure_cmds, breakdown)
+    && sendSopasCmdBatch("apply", apply_cmds, breakdown)
+    && sendSopasCmdBatch("enable", enable_cmds, breakdown)
+    && sendSopasCmdBatch("apply", run_cmds, breakdown);
+  double reconfigure_millisec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - reconfigure_start).count();
+  ROS_INFO_STREAM("SopasServices: multiScan reconfiguration " << (success ? "finished" : "failed") << " after " << std::fixed << std::setprecision(1) << reconfigure_millisec << " ms" << breakdown.str());
+  return success;
 }
 
 /*!
@@ -310,13 +457,13 @@ bool sick_scan_xd::SopasServices::sendMultiScanStopCmd(bool imu_enable)
   return true;
 }
 
-// union FLOAT_BYTE32_UNION
-// {
-//   uint8_t u8_bytes[4];
-//   uint32_t u32_bytes;
-//   int32_t i32_bytes;
-//   float value;
-// };
+union FLOAT_BYTE32_UNION
+{
+  uint8_t u8_bytes[4];
+  uint32_t u32_bytes;
+  int32_t i32_bytes;
+  float value;
+};
 
 /*!
 * Converts a hex string (hex_str: 4 byte hex value as string, little or big endian) to float.
@@ -407,25 +554,80 @@ bool sick_scan_xd::SopasServices::sendMultiScanStopCmd(bool imu_enable)
 /*!
 * Converts an angle in [deg] to hex string coded in 1/10000 deg (hex_str: 4 byte hex value as string, little or big endian).
 */
-// std::string sick_scan_xd::SopasServices::convertAngleDegToHexString(float angle_deg, bool hexStrIsBigEndian)
-// {
-//   int32_t angle_val = (int32_t)std::round(angle_deg * 10000.0f);
-//   FLOAT_BYTE32_UNION hex_buffer;
-//   hex_buffer.i32_bytes = angle_val;
-//   std::stringstream hex_str;
-//   if(hexStrIsBigEndian)
-//   {
-//     for(int n = 3; n >= 0; n--)
-//       hex_str << std::setfill('0') << std::setw(2) << std::uppercase << std::hex << (int)(hex_buffer.u8_bytes[n]);
-//   }
-//   else
-//   {
-//     for(int n = 0; n < 4; n++)
-//       hex_str << std::setfill('0') << std::setw(2) << std::uppercase << std::hex << (int)(hex_buffer.u8_bytes[n]);
-//   }
-//   // ROS_DEBUG_STREAM("convertAngleDegToHexString(" << angle_deg << "  [deg], " << hexStrIsBigEndian << "): " << hex_str.str());
-//   return hex_str.str();
-// }
+std::string sick_scan_xd::SopasServices::convertAngleDegToHexString(float angle_deg, bool hexStrIsBigEndian)
+{
+  int32_t angle_val = (int32_t)std::round(angle_deg * 10000.0f);
+  FLOAT_BYTE32_UNION hex_buffer;
+  hex_buffer.i32_bytes = angle_val;
+  std::stringstream hex_str;
+  if(hexStrIsBigEndian)
+  {
+    for(int n = 3; n >= 0; n--)
+      hex_str << std::setfill('0') << std::setw(2) << std::uppercase << std::hex << (int)(hex_buffer.u8_bytes[n]);
+  }
+  else
+  {
+    for(int n = 0; n < 4; n++)
+      hex_str << std::setfill('0') << std::setw(2) << std::uppercase << std::hex << (int)(hex_buffer.u8_bytes[n]);
+  }
+  // ROS_DEBUG_STREAM("convertAngleDegToHexString(" << angle_deg << "  [deg], " << hexStrIsBigEndian << "): " << hex_str.str());
+  return hex_str.str();
+}
+
+/*!
+* Converts the LFPangleRangeFilter and LFPlayerFilter settings to sopas commands. Angles are converted
+* from degree to 1/10000 deg hex strings, layer flags are passed unchanged.
+*/
+bool sick_scan_xd::SopasServices::createMultiScanFilterCmds(const std::string& host_LFPangleRangeFilter, const std::string& host_LFPlayerFilter, std::vector<std::string>& sopas_cmds)
+{
+  if (!host_LFPangleRangeFilter.empty())
+  {
+    std::istringstream parameter_stream(host_LFPangleRangeFilter);
+    int filter_enabled = 0, beam_increment = 0;
+    float angle_deg[4] = { 0, 0, 0, 0 };
+    std::string trailing;
+    if (!(parameter_stream >> filter_enabled >> angle_deg[0] >> angle_deg[1] >> angle_deg[2] >> angle_deg[3] >> beam_increment) || (parameter_stream >> trailing)
+      || angle_deg[0] >= angle_deg[1] || angle_deg[2] >= angle_deg[3] || beam_increment < 1)
+    {
+      ROS_ERROR_STREAM("## ERROR SopasServices::createMultiScanFilterCmds(): invalid LFPangleRangeFilter \"" << host_LFPangleRangeFilter
+        << "\", expected \"<enabled> <azimuth_start> <azimuth_stop> <elevation_start> <elevation_stop> <beam_increment>\" with angles in degree");
+      return false;
+    }
+    std::stringstream sopas_cmd;
+    sopas_cmd << "sWN LFPangleRangeFilter " << (filter_enabled ? 1 : 0);
+    for (int n = 0; n < 4; n++)
+    {
+      sopas_cmd << " " << convertAngleDegToHexString(angle_deg[n], SCANSEGMENT_XD_SOPAS_ARGS_BIG_ENDIAN);
+    }
+    sopas_cmd << " " << beam_increment;
+    sopas_cmds.push_back(sopas_cmd.str());
+  }
+  if (!host_LFPlayerFilter.empty())
+  {
+    std::istringstream parameter_stream(host_LFPlayerFilter);
+    std::vector<int> parameter;
+    int value = 0;
+    while (parameter_stream >> value)
+    {
+      parameter.push_back(value);
+    }
+    int num_active_layers = (int)std::count_if(parameter.begin() + std::min<size_t>(1, parameter.size()), parameter.end(), [](int layer_enabled) { return layer_enabled != 0; });
+    if (!parameter_stream.eof() || parameter.size() != 17 || (parameter[0] && num_active_layers == 0))
+    {
+      ROS_ERROR_STREAM("## ERROR SopasServices::createMultiScanFilterCmds(): invalid LFPlayerFilter \"" << host_LFPlayerFilter
+        << "\", expected \"<enabled> <layer0-enabled> <layer1-enabled> ... <layer15-enabled>\" with at least one enabled layer");
+      return false;
+    }
+    std::stringstream sopas_cmd;
+    sopas_cmd << "sWN LFPlayerFilter";
+    for (size_t n = 0; n < parameter.size(); n++)
+    {
+      sopas_cmd << " " << (parameter[n] ? 1 : 0);
+    }
+    sopas_cmds.push_back(sopas_cmd.str());
+  }
+  return true;
+}
 
 // #if defined SCANSEGMENT_XD_SUPPORT && SCANSEGMENT_XD_SUPPORT > 0
 // /*!
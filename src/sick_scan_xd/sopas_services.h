@@ -61,10 +61,12 @@
 
 #pragma once
 
+#include <sstream>
 #include <string>
 #include <vector>
 
 #include "sick_scan_common_tcp.h"
+#include "sopas_cmd_cache.h"
 
 namespace sick_scan_xd
 {
@@ -73,6 +75,24 @@ namespace sick_scan_xd
   {
   public:
 
+    /*!
+     * A SOPAS command of a pipelined startup stage
+     */
+    struct SopasStartupCmd
+    {
+      std::string request;  ///< sopas command, f.e. "sWN ScanDataEnable 1"
+      bool required = true; ///< false: a failure is logged, but the startup continues
+    };
+
+    /*!
+     * A named startup stage, the commands of a stage do not depend on each other's replies
+     */
+    struct SopasStartupStage
+    {
+      std::string name;                   ///< stage name for the bring-up breakdown, f.e. "configure"
+      std::vector<SopasStartupCmd> cmds;  ///< commands of this stage in send order
+    };
+
     SopasServices(sick_scan_xd::SickScanCommonTcp* common_tcp = 0, bool use_cola_binary = true);
 
     virtual ~SopasServices();
@@ -88,15 +108,44 @@ namespace sick_scan_xd
     bool sendSopasCmdCheckResponse(const std::string& sopas_request, const std::string& expected_response);
 
     /*!
-     * Sends the multiScan start commands "sWN ScanDataFormat", "sWN ScanDataPreformatting", "sWN ScanDataEthSettings", "sWN ScanDataEnable 1", "sMN LMCstartmeas", "sMN Run"
+     * Sends the multiScan start commands "sMN SetAccessMode", "sWN ScanDataFormat", "sWN ScanDataPreformatting", "sWN ScanDataEthSettings", "sWN ScanDataEnable 1", "sMN LMCstartmeas", "sMN Run"
+     * one by one, see createMultiScanStartCmds() for the sequence.
      * @param[in] hostname IP address of multiScan136, default 192.168.0.1
      * @param[in] port IP port of multiScan136, default 2115
      * @param[in] scanner_type type of scanner, currently supported are multiScan136 and picoScan150
      * @param[in] scandataformat ScanDataFormat: 1 for msgpack or 2 for compact scandata, default: 1 
      * @param[in] imu_enable: Imu data transfer enabled
      * @param[in] imu_udp_port: UDP port of imu data (if imu_enable is true)
+     * @param[in] performanceprofilenumber PerformanceProfileNumber, not changed if < 0
+     * @param[in] host_LFPangleRangeFilter optional LFPangleRangeFilter, "<enabled> <azimuth_start> <azimuth_stop> <elevation_start> <elevation_stop> <beam_increment>" with angles in degree, f.e. "1 -90.0 +90.0 -90.0 +90.0 1", not changed if empty
+     * @param[in] host_LFPlayerFilter optional LFPlayerFilter, "<enabled> <layer0-enabled> <layer1-enabled> ... <layer15-enabled>" with 1 for enabled and 0 for disabled, not changed if empty
+     */
+    bool sendMultiScanStartCmd(const std::string& hostname, int port, int scandataformat, bool imu_enable, int imu_udp_port, int performanceprofilenumber = -1,
+      const std::string& host_LFPangleRangeFilter = "", const std::string& host_LFPlayerFilter = "");
+
+    /*!
+     * Pipelined version of sendMultiScanStartCmd(): independent settings are sent back to back and only
+     * dependent steps wait for their replies, i.e. the startup takes 5 round trips instead of 12.
+     * Stages: configure (SetAccessMode and all sWN settings) -> apply (Run, SetAccessMode) ->
+     * enable (ScanDataEnable, ImuDataEnable) -> apply (Run, SetAccessMode) -> start (LMCstartmeas).
+     * The round trip time of each command and a bring-up time breakdown is printed.
+     * Parameters are identical to sendMultiScanStartCmd().
+     */
+    bool sendMultiScanStartCmdPipelined(const std::string& hostname, int port, int scandataformat, bool imu_enable, int imu_udp_port, int performanceprofilenumber = -1,
+      const std::string& host_LFPangleRangeFilter = "", const std::string& host_LFPlayerFilter = "");
+
+    /*!
+     * Applies a changed ScanDataFormat, PerformanceProfileNumber or ImuDataEnable while the lidar is measuring,
+     * i.e. without the complete start sequence. Scan data output and the measurement keep running.
+     * Stages: configure (SetAccessMode, ScanDataFormat, PerformanceProfileNumber, ImuDataEthSettings) ->
+     * apply (Run, SetAccessMode) -> enable (ImuDataEnable) -> apply (Run).
+     * @param[in] hostname IP address of the udp receiver, required for ImuDataEthSettings
+     * @param[in] scandataformat ScanDataFormat: 1 for msgpack or 2 for compact scandata
+     * @param[in] imu_enable: Imu data transfer enabled
+     * @param[in] imu_udp_port: UDP port of imu data (if imu_enable is true)
+     * @param[in] performanceprofilenumber PerformanceProfileNumber, not changed if < 0
      */
-    bool sendMultiScanStartCmd(const std::string& hostname, int port, int scandataformat, bool imu_enable, int imu_udp_port, int performanceprofilenumber = -1);
+    bool sendMultiScanReconfigureCmd(const std::string& hostname, int scandataformat, bool imu_enable, int imu_udp_port, int performanceprofilenumber = -1);
 
     /*!
      * Sends the multiScan stop commands "sWN ScanDataEnable 0" and "sMN Run"
@@ -158,7 +207,7 @@ namespace sick_scan_xd
     /*!
     * Converts an angle in [deg] to hex string coded in 1/10000 deg (hex_str: 4 byte hex value as string, little or big endian).
     */
-    // static std::string convertAngleDegToHexString(float angle_deg, bool hexStrIsBigEndian);
+    static std::string convertAngleDegToHexString(float angle_deg, bool hexStrIsBigEndian);
 
   protected:
 
@@ -167,6 +216,45 @@ namespace sick_scan_xd
     */
     bool sendRun();
 
+    /*!
+    * Converts a sopas command to a sopas request incl. framing, Cola-B encoded if m_cola_binary is set.
+    * Requests are cached, see SopasCmdCache.
+    */
+    std::vector<unsigned char> createSopasRequest(const std::string& sopasCmd);
+
+    /*!
+    * Converts the LFPangleRangeFilter and LFPlayerFilter settings (see sendMultiScanStartCmd()) to sopas commands,
+    * f.e. "sWN LFPangleRangeFilter 1 FFF24460 000DBBA0 FFF24460 000DBBA0 1". Empty settings are skipped.
+    * @return false in case of invalid settings
+    */
+    static bool createMultiScanFilterCmds(const std::string& host_LFPangleRangeFilter, const std::string& host_LFPlayerFilter, std::vector<std::string>& sopas_cmds);
+
+    /*!
+    * Creates "<sopas_set_cmd> 1 +<ip0> +<ip1> +<ip2> +<ip3> +<port>" for ScanDataEthSettings and ImuDataEthSettings
+    * @return false if hostname can't be split into 4 tokens
+    */
+    static bool createEthSettingsCmd(const std::string& sopas_set_cmd, const std::string& hostname, int port, std::string& sopas_cmd);
+
+    /*!
+    * Creates "sWN PerformanceProfileNumber <hex>"
+    */
+    static std::string createPerformanceProfileCmd(int performanceprofilenumber);
+
+    /*!
+    * Creates the multiScan start sequence shared by sendMultiScanStartCmd() and sendMultiScanStartCmdPipelined():
+    * configure (SetAccessMode and all sWN settings) -> apply (Run, SetAccessMode) -> enable (ScanDataEnable, ImuDataEnable)
+    * -> apply (Run, SetAccessMode) -> start (LMCstartmeas). Parameters are identical to sendMultiScanStartCmd().
+    * @return false in case of an invalid configuration
+    */
+    bool createMultiScanStartCmds(const std::string& hostname, int port, int scandataformat, bool imu_enable, int imu_udp_port, int performanceprofilenumber,
+      const std::string& host_LFPangleRangeFilter, const std::string& host_LFPlayerFilter, std::vector<SopasStartupStage>& stages);
+
+    /*!
+    * Sends all commands of one startup stage pipelined and appends the round trip times to the bring-up breakdown
+    * @return true if all required commands were answered as expected
+    */
+    bool sendSopasCmdBatch(const std::string& stage, const std::vector<SopasStartupCmd>& cmds, std::stringstream& breakdown);
+
     /*
      * Member data
      */
@@ -174,6 +262,7 @@ namespace sick_scan_xd
     sick_scan_xd::SickScanCommonTcp* m_common_tcp;     ///< common tcp handler
     bool m_cola_binary;                             ///< cola ascii or cola binary messages
     std::string m_client_authorization_pw;
+    SopasCmdCache m_cmd_cache;                      ///< encoded requests and expected answers
 
   }; /* class SopasServices */
 
@@ -0,0 +1,201 @@
+/*
+ * @brief synthetic_scan generates deterministic multiScan segments in compact and msgpack format.
+ * See synthetic_scan.h for details.
+ */
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include "synthetic_scan.h"
+#include "udp_sockets.h"
+#include "msgpack11/msgpack11.hpp"
+
+// default elevation of the multiScan layers in mdeg, identical to s_layer_elevation_table_mdeg in compact_parser.cpp
+static const int s_layer_elevation_mdeg[sick_scansegment_xd::SyntheticScanGenerator::NumLayers] =
+    { 22710, 17560, 12480, 7510, 2490, 70, -2430, -7290, -12790, -17280, -21940, -26730, -31860, -34420, -37180, -42790 };
+
+// msgpack keys and values, see MsgpackKeyToInt_* in msgpack_parser.cpp
+enum MsgpackKey
+{
+    KEY_data = 0x11, KEY_numOfElems = 0x12, KEY_elemSz = 0x13, KEY_endian = 0x14, KEY_elemTypes = 0x15,
+    VAL_little = 0x30, VAL_float32 = 0x31, VAL_uint8 = 0x33, VAL_uint16 = 0x34,
+    KEY_ChannelTheta = 0x50, KEY_ChannelPhi = 0x51, KEY_DistValues = 0x52, KEY_RssiValues = 0x53, KEY_PropertiesValues = 0x54,
+    KEY_TimestampStart = 0x71, KEY_TimestampStop = 0x72, KEY_EchoCount = 0x78,
+    KEY_SegmentCounter = 0x91, KEY_SegmentData = 0x96, KEY_TelegramCounter = 0xB0, KEY_TimestampTransmit = 0xB1
+};
+
+template<typename T> static void appendLE(std::vector<uint8_t>& data, T val)
+{
+    uint8_t bytes[sizeof(T)];
+    memcpy(bytes, &val, sizeof(T)); // compact and msgpack data are little endian
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+template<typename T> static void writeLE(std::vector<uint8_t>& data, size_t offset, T val)
+{
+    memcpy(data.data() + offset, &val, sizeof(T));
+}
+
+static msgpack11::MsgPack msgpackElement(const std::vector<uint8_t>& data, int elem_size, int elem_type)
+{
+    return msgpack11::MsgPack::object{
+        { KEY_data, msgpack11::MsgPack::binary(data) },
+        { KEY_numOfElems, (int)(data.size() / elem_size) },
+        { KEY_elemSz, elem_size },
+        { KEY_endian, VAL_little },
+        { KEY_elemTypes, msgpack11::MsgPack::array{ elem_type } } };
+}
+
+sick_scansegment_xd::SyntheticScanGenerator::SyntheticScanGenerator(uint32_t num_echos, uint32_t telegram_version, uint32_t num_beams)
+    : m_num_echos(num_echos), m_telegram_version(telegram_version), m_num_beams(num_beams < 2 ? 2 : num_beams)
+{
+}
+
+uint16_t sick_scansegment_xd::SyntheticScanGenerator::Distance(uint32_t beam, uint32_t layer, uint32_t echo)
+{
+    return (uint16_t)(1000 + ((beam * 7919 + layer * 104729 + echo * 1299709) % 59000)); // 1 up to 60 m
+}
+
+uint16_t sick_scansegment_xd::SyntheticScanGenerator::Rssi(uint32_t beam, uint32_t layer, uint32_t echo)
+{
+    return (uint16_t)((beam * 31 + layer * 17 + echo * 101) % 4096);
+}
+
+uint8_t sick_scansegment_xd::SyntheticScanGenerator::Property(uint32_t beam, uint32_t layer)
+{
+    return ((beam + layer) % 97 == 0) ? 1 : 0;
+}
+
+float sick_scansegment_xd::SyntheticScanGenerator::Elevation(uint32_t layer)
+{
+    return (float)(-s_layer_elevation_mdeg[layer] * M_PI / 180000.0); // phi is negated elevation
+}
+
+float sick_scansegment_xd::SyntheticScanGenerator::Azimuth(uint32_t segment_idx, uint32_t beam) const
+{
+    const float segment_width = (float)(2.0 * M_PI / SegmentsPerFrame);
+    return (float)(-M_PI) + (segment_idx % SegmentsPerFrame) * segment_width + beam * segment_width / m_num_beams;
+}
+
+std::vector<uint8_t> sick_scansegment_xd::SyntheticScanGenerator::CompactSegment(uint32_t segment_idx, uint64_t telegram_counter,
+    uint64_t timestamp_start_microsec, uint64_t timestamp_stop_microsec) const
+{
+    std::vector<uint8_t> data;
+    data.reserve(300 + NumLayers * m_num_beams * (4 * m_num_echos + 3));
+    // header
+    appendLE<uint32_t>(data, 0x02020202);
+    appendLE<uint32_t>(data, 1);                        // commandId: scan data
+    appendLE<uint64_t>(data, telegram_counter);
+    appendLE<uint64_t>(data, timestamp_stop_microsec);  // timeStampTransmit
+    appendLE<uint32_t>(data, m_telegram_version);
+    size_t size_module0_offset = data.size();
+    appendLE<uint32_t>(data, 0);                        // sizeModule0, set below
+    // module metadata
+    size_t module_offset = data.size();
+    appendLE<uint64_t>(data, segment_idx);              // SegmentCounter
+    appendLE<uint64_t>(data, telegram_counter / SegmentsPerFrame); // FrameNumber
+    appendLE<uint32_t>(data, 0);                        // SenderId
+    appendLE<uint32_t>(data, NumLayers);
+    appendLE<uint32_t>(data, m_num_beams);
+    appendLE<uint32_t>(data, m_num_echos);
+    for (uint32_t layer = 0; layer < NumLayers; layer++)
+        appendLE<uint64_t>(data, timestamp_start_microsec);
+    for (uint32_t layer = 0; layer < NumLayers; layer++)
+        appendLE<uint64_t>(data, timestamp_stop_microsec);
+    for (uint32_t layer = 0; layer < NumLayers; layer++)
+        appendLE<float>(data, Elevation(layer));
+    for (uint32_t layer = 0; layer < NumLayers; layer++)
+        appendLE<float>(data, Azimuth(segment_idx, 0));
+    for (uint32_t layer = 0; layer < NumLayers; layer++)
+        appendLE<float>(data, Azimuth(segment_idx, m_num_beams - 1));
+    if (m_telegram_version == 4)
+        appendLE<float>(data, 1.0f);                    // DistanceScalingFactor
+    appendLE<uint32_t>(data, 0);                        // NextModuleSize
+    appendLE<uint8_t>(data, 1);                         // Availability
+    appendLE<uint8_t>(data, 3);                         // DataContentEchos: distance and rssi
+    appendLE<uint8_t>(data, 3);                         // DataContentBeams: property and azimuth
+    appendLE<uint8_t>(data, 0);                         // reserved
+    // measurement data
+    for (uint32_t beam = 0; beam < m_num_beams; beam++)
+    {
+        uint16_t azimuth = (uint16_t)std::lround(Azimuth(segment_idx, beam) * 5215.0f + 16384.0f);
+        for (uint32_t layer = 0; layer < NumLayers; layer++)
+        {
+            for (uint32_t echo = 0; echo < m_num_echos; echo++)
+            {
+                appendLE<uint16_t>(data, Distance(beam, layer, echo));
+                appendLE<uint16_t>(data, Rssi(beam, layer, echo));
+            }
+            if (m_telegram_version == 3) // 2 byte azimuth + 1 byte property
+            {
+                appendLE<uint16_t>(data, azimuth);
+                appendLE<uint8_t>(data, Property(beam, layer));
+            }
+            else // 1 byte property + 2 byte azimuth
+            {
+                appendLE<uint8_t>(data, Property(beam, layer));
+                appendLE<uint16_t>(data, azimuth);
+            }
+        }
+    }
+    writeLE<uint32_t>(data, size_module0_offset, (uint32_t)(data.size() - module_offset));
+    appendLE<uint32_t>(data, crc32(0, data.data(), data.size())); // crc over the complete message
+    return data;
+}
+
+std::vector<uint8_t> sick_scansegment_xd::SyntheticScanGenerator::MsgPackPayload(uint32_t segment_idx, uint64_t telegram_counter,
+    uint64_t timestamp_start_microsec, uint64_t timestamp_stop_microsec) const
+{
+    msgpack11::MsgPack::array groups;
+    for (uint32_t layer = 0; layer < NumLayers; layer++)
+    {
+        std::vector<uint8_t> phi, theta;
+        appendLE<float>(phi, Elevation(layer));
+        for (uint32_t beam = 0; beam < m_num_beams; beam++)
+            appendLE<float>(theta, Azimuth(segment_idx, beam));
+        msgpack11::MsgPack::array dist_values, rssi_values, property_values;
+        for (uint32_t echo = 0; echo < m_num_echos; echo++)
+        {
+            std::vector<uint8_t> dist, rssi, properties;
+            for (uint32_t beam = 0; beam < m_num_beams; beam++)
+            {
+                appendLE<uint16_t>(dist, Distance(beam, layer, echo));
+                appendLE<uint16_t>(rssi, Rssi(beam, layer, echo));
+                properties.push_back(Property(beam, layer));
+            }
+            dist_values.push_back(msgpackElement(dist, 2, VAL_uint16));
+            rssi_values.push_back(msgpackElement(rssi, 2, VAL_uint16));
+            property_values.push_back(msgpackElement(properties, 1, VAL_uint8));
+        }
+        msgpack11::MsgPack::object group_data{
+            { KEY_EchoCount, (int)m_num_echos },
+            { KEY_ChannelPhi, msgpackElement(phi, 4, VAL_float32) },
+            { KEY_ChannelTheta, msgpackElement(theta, 4, VAL_float32) },
+            { KEY_DistValues, dist_values },
+            { KEY_RssiValues, rssi_values },
+            { KEY_PropertiesValues, property_values },
+            { KEY_TimestampStart, (uint32_t)timestamp_start_microsec },
+            { KEY_TimestampStop, (uint32_t)timestamp_stop_microsec } };
+        groups.push_back(msgpack11::MsgPack::object{ { KEY_data, group_data } });
+    }
+    msgpack11::MsgPack::object root_data{
+        { KEY_SegmentData, groups },
+        { KEY_TimestampTransmit, (uint32_t)timestamp_stop_microsec },
+        { KEY_SegmentCounter, (int)segment_idx },
+        { KEY_TelegramCounter, (int)telegram_counter } };
+    std::string packed = msgpack11::MsgPack(msgpack11::MsgPack::object{ { KEY_data, root_data } }).dump();
+    return std::vector<uint8_t>(packed.begin(), packed.end());
+}
+
+std::vector<uint8_t> sick_scansegment_xd::SyntheticScanGenerator::MsgPackSegment(uint32_t segment_idx, uint64_t telegram_counter,
+    uint64_t timestamp_start_microsec, uint64_t timestamp_stop_microsec) const
+{
+    std::vector<uint8_t> payload = MsgPackPayload(segment_idx, telegram_counter, timestamp_start_microsec, timestamp_stop_microsec);
+    std::vector<uint8_t> data;
+    data.reserve(payload.size() + 12);
+    appendLE<uint32_t>(data, 0x02020202);
+    appendLE<uint32_t>(data, (uint32_t)payload.size());
+    data.insert(data.end(), payload.begin(), payload.end());
+    appendLE<uint32_t>(data, crc32(0, payload.data(), payload.size())); // crc over the payload
+    return data;
+}
@@ -0,0 +1,74 @@
+/*
+ * @brief synthetic_scan generates deterministic multiScan segments in compact and msgpack format,
+ * f.e. for benchmarks and for emulating a lidar on loopback.
+ *
+ * A segment has 16 layers at the default multiScan elevations and NumBeams() beams per layer,
+ * spanning 1/SegmentsPerFrame of a rotation. Each echo has distance and rssi, each beam has
+ * azimuth and property (reflector bit set on a few beams). Measurement values depend only on
+ * beam, layer and echo index, timestamps are given by the caller.
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace sick_scansegment_xd
+{
+    /*
+     * @brief class SyntheticScanGenerator encodes synthetic segments.
+     */
+    class SyntheticScanGenerator
+    {
+    public:
+
+        static constexpr uint32_t NumLayers = 16;
+        static constexpr uint32_t SegmentsPerFrame = 12;
+
+        /*
+         * @param[in] num_echos echos per beam (1 up to 3)
+         * @param[in] telegram_version compact telegramVersion, 3 or 4
+         * @param[in] num_beams beams per layer and segment, default: ~900 points per segment and echo
+         */
+        SyntheticScanGenerator(uint32_t num_echos = 1, uint32_t telegram_version = 4, uint32_t num_beams = 56);
+
+        /*
+         * @brief returns a compact datagram incl. start sequence and crc
+         * @param[in] segment_idx segment counter (0 up to SegmentsPerFrame - 1)
+         * @param[in] telegram_counter telegram counter of the header
+         * @param[in] timestamp_start_microsec sensor timestamp of the first beam
+         * @param[in] timestamp_stop_microsec sensor timestamp of the last beam, also used as transmit timestamp
+         */
+        std::vector<uint8_t> CompactSegment(uint32_t segment_idx, uint64_t telegram_counter,
+            uint64_t timestamp_start_microsec, uint64_t timestamp_stop_microsec) const;
+
+        /*
+         * @brief returns the msgpack payload of a segment (without framing, as passed to MsgPackParser::Parse)
+         */
+        std::vector<uint8_t> MsgPackPayload(uint32_t segment_idx, uint64_t telegram_counter,
+            uint64_t timestamp_start_microsec, uint64_t timestamp_stop_microsec) const;
+
+        /*
+         * @brief returns a msgpack datagram, i.e. start sequence, payload length, payload and crc
+         */
+        std::vector<uint8_t> MsgPackSegment(uint32_t segment_idx, uint64_t telegram_counter,
+            uint64_t timestamp_start_microsec, uint64_t timestamp_stop_microsec) const;
+
+        uint32_t NumEchos() const { return m_num_echos; }
+        uint32_t NumBeams() const { return m_num_beams; }
+        uint32_t PointsPerSegment() const { return NumLayers * m_num_beams * m_num_echos; }
+        uint32_t PointsPerFrame() const { return SegmentsPerFrame * PointsPerSegment(); }
+
+    protected:
+
+        static uint16_t Distance(uint32_t beam, uint32_t layer, uint32_t echo);  // in mm
+        static uint16_t Rssi(uint32_t beam, uint32_t layer, uint32_t echo);
+        static uint8_t Property(uint32_t beam, uint32_t layer);
+        static float Elevation(uint32_t layer);                                 // phi in radians
+        float Azimuth(uint32_t segment_idx, uint32_t beam) const;               // theta in radians
+
+        uint32_t m_num_echos;
+        uint32_t m_telegram_version;
+        uint32_t m_num_beams;
+    };
+
+} // namespace sick_scansegment_xd
@@ -0,0 +1,182 @@
+//
+// RingBuffer.hpp
+//
+// Contiguous byte ring buffer for the tcp receive path.
+//
+// Received bytes are appended at the tail, frames are searched in place and
+// consumed from the head by advancing an offset, i.e. there is no per byte
+// allocation and no memmove after each frame. Only a frame which wraps around
+// the end of the buffer is copied (once) to be handed out contiguously.
+//
+// Not thread safe, the owner serializes access.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+#include "BasicDatatypes.hpp"
+
+
+class RingBuffer
+{
+public:
+	// The capacity is rounded up to the next power of 2.
+	RingBuffer(UINT32 capacity = 0)
+	{
+		reserve(capacity);
+	}
+
+	UINT32 size() const { return (UINT32)(m_tail - m_head); }			// Number of bytes in the buffer
+	UINT32 capacity() const { return (UINT32)m_buffer.size(); }
+	UINT32 freeSpace() const { return capacity() - size(); }
+	bool empty() const { return m_tail == m_head; }
+
+	void clear() { m_head = m_tail = 0; }
+
+	// Grows the buffer to at least capacity bytes, the content is preserved.
+	void reserve(UINT32 capacity)
+	{
+		size_t new_capacity = 1;
+		while (new_capacity < capacity)
+		{
+			new_capacity <<= 1;
+		}
+		if (new_capacity <= m_buffer.size())
+		{
+			return;
+		}
+		std::vector<UINT8> buffer(new_capacity);
+		UINT32 len = size();
+		copyTo(0, len, buffer.data());
+		m_buffer.swap(buffer);
+		m_mask = new_capacity - 1;
+		m_head = 0;
+		m_tail = len;
+	}
+
+	// Appends up to len bytes, returns the number of bytes appended (limited by freeSpace()).
+	UINT32 write(const UINT8* data, UINT32 len)
+	{
+		len = std::min(len, freeSpace());
+		size_t start = m_tail & m_mask;
+		size_t first = std::min((size_t)len, m_buffer.size() - start);
+		if (first > 0)
+		{
+			memcpy(&m_buffer[start], data, first);
+		}
+		if (len > first)
+		{
+			memcpy(&m_buffer[0], data + first, len - first);
+		}
+		m_tail += len;
+		return len;
+	}
+
+	// Copies up to len bytes from the head and consumes them, returns the number of bytes read.
+	UINT32 read(UINT8* data, UINT32 len)
+	{
+		len = std::min(len, size());
+		copyTo(0, len, data);
+		consume(len);
+		return len;
+	}
+
+	// Removes len bytes from the head.
+	void consume(UINT32 len)
+	{
+		m_head += std::min(len, size());
+		if (m_head == m_tail)
+		{
+			clear(); // keep new data at the start of the buffer, most frames then don't wrap
+		}
+	}
+
+	// Byte at position pos relative to the head, pos < size()
+	UINT8 operator[](UINT32 pos) const
+	{
+		return m_buffer[(m_head + pos) & m_mask];
+	}
+
+	// Position of the first byte value at or after position from, or size() if not found.
+	UINT32 find(UINT8 value, UINT32 from = 0) const
+	{
+		UINT32 found = size();
+		forEachSpan(from, size() - std::min(from, size()), [&](const UINT8* span, UINT32 span_len, UINT32 span_pos)
+		{
+			const UINT8* p = (const UINT8*)memchr(span, value, span_len);
+			if (p)
+			{
+				found = span_pos + (UINT32)(p - span);
+				return false;
+			}
+			return true;
+		});
+		return found;
+	}
+
+	// Position of the first occurrence of pattern at or after position from, or size() if not found.
+	UINT32 find(const UINT8* pattern, UINT32 pattern_len, UINT32 from = 0) const
+	{
+		for (UINT32 pos = find(pattern[0], from); pos + pattern_len <= size(); pos = find(pattern[0], pos + 1))
+		{
+			UINT32 i = 1;
+			while (i < pattern_len && (*this)[pos + i] == pattern[i])
+			{
+				i++;
+			}
+			if (i == pattern_len)
+			{
+				return pos;
+			}
+		}
+		return size();
+	}
+
+	// Returns a pointer to len contiguous bytes at position pos. If these bytes wrap around the end
+	// of the buffer, they are copied to scratch. The pointer is valid until the buffer is modified.
+	UINT8* contiguous(UINT32 pos, UINT32 len, std::vector<UINT8>& scratch)
+	{
+		size_t start = (m_head + pos) & m_mask;
+		if (start + len <= m_buffer.size())
+		{
+			return &m_buffer[start];
+		}
+		scratch.resize(len);
+		copyTo(pos, len, scratch.data());
+		return scratch.data();
+	}
+
+	// Calls f(span, span_len, span_pos) for the (at most two) contiguous spans of [pos, pos + len) until f returns false.
+	template<typename F>
+	void forEachSpan(UINT32 pos, UINT32 len, F f) const
+	{
+		if (len == 0)
+		{
+			return;
+		}
+		size_t start = (m_head + pos) & m_mask;
+		UINT32 first = (UINT32)std::min((size_t)len, m_buffer.size() - start);
+		if (f(&m_buffer[start], first, pos) && len > first)
+		{
+			f(&m_buffer[0], len - first, pos + first);
+		}
+	}
+
+private:
+	void copyTo(UINT32 pos, UINT32 len, UINT8* dst) const
+	{
+		forEachSpan(pos, len, [&](const UINT8* span, UINT32 span_len, UINT32 span_pos)
+		{
+			memcpy(dst + (span_pos - pos), span, span_len);
+			return true;
+		});
+	}
+
+	std::vector<UINT8> m_buffer;
+	size_t m_mask = 0;
+	size_t m_head = 0;	// Read offset, grows monotonically (masked on access)
+	size_t m_tail = 0;	// Write offset, grows monotonically (masked on access)
+};
@@ -11,6 +11,9 @@
 #else
 #include <sys/socket.h> // for socket(), bind(), and connect()
 #include <arpa/inet.h>  // for sockaddr_in and inet_ntoa()
+#include <netinet/tcp.h> // for TCP_NODELAY
+#include <fcntl.h>       // for fcntl()
+#include <errno.h>
 #endif
 #include <string.h>     // for memset()
 #include <netdb.h>      // for hostent
@@ -38,6 +41,8 @@ Tcp::Tcp()
 	m_disconnectFunction = NULL;
 	m_disconnectFunctionObjPtr = NULL;
 	m_readFunction = NULL;
+	m_rxBuffer.reserve(64 * 1024);
+	m_inBuffer.resize(64 * 1024);
 	m_readFunctionObjPtr = NULL;
 
     m_last_tcp_msg_received_nsec = 0; // no message received
@@ -148,7 +153,7 @@ bool Tcp::open(UINT32 ipAddress, UINT16 port,  bool enableVerboseDebugOutput)
 //
 // -- Wir sind der Client, und wollen uns z.B. mit einem Scanner verbinden --
 //
-bool Tcp::open(std::string ipAddress, UINT16 port, bool enableVerboseDebugOutput)
+bool Tcp::open(std::string ipAddress, UINT16 port, bool enableVerboseDebugOutput, UINT32 connectTimeoutMs)
 {
 	INT32 result;
 	m_beVerbose = enableVerboseDebugOutput;
@@ -194,14 +199,69 @@ bool Tcp::open(std::string ipAddress, UINT16 port, bool enableVerboseDebugOutput
 	}
 	addr.sin_port = htons(port);				// Host-2-Network byte order
 #ifdef _MSC_VER
-	result = connect(m_connectionSocket, (SOCKADDR*)(&addr), sizeof(addr));
+	if (connectTimeoutMs > 0)
+	{
+		// Non-blocking connect, wait at most connectTimeoutMs
+		u_long nonBlocking = 1;
+		ioctlsocket(m_connectionSocket, FIONBIO, &nonBlocking);
+		result = connect(m_connectionSocket, (SOCKADDR*)(&addr), sizeof(addr));
+		if (result < 0 && WSAGetLastError() == WSAEWOULDBLOCK)
+		{
+			fd_set writeSet, exceptSet;
+			FD_ZERO(&writeSet);
+			FD_ZERO(&exceptSet);
+			FD_SET(m_connectionSocket, &writeSet);
+			FD_SET(m_connectionSocket, &exceptSet);
+			struct timeval timeout;
+			timeout.tv_sec = connectTimeoutMs / 1000;
+			timeout.tv_usec = (connectTimeoutMs % 1000) * 1000;
+			result = (select(0, NULL, &writeSet, &exceptSet, &timeout) > 0 && FD_ISSET(m_connectionSocket, &writeSet)) ? 0 : -1;
+		}
+		nonBlocking = 0;
+		ioctlsocket(m_connectionSocket, FIONBIO, &nonBlocking);
+	}
+	else
+	{
+		result = connect(m_connectionSocket, (SOCKADDR*)(&addr), sizeof(addr));
+	}
 #else
-	result = connect(m_connectionSocket, (sockaddr*)(&addr), sizeof(addr));
+	if (connectTimeoutMs > 0)
+	{
+		// Non-blocking connect, wait at most connectTimeoutMs
+		int flags = fcntl(m_connectionSocket, F_GETFL, 0);
+		fcntl(m_connectionSocket, F_SETFL, flags | O_NONBLOCK);
+		result = connect(m_connectionSocket, (sockaddr*)(&addr), sizeof(addr));
+		if (result < 0 && errno == EINPROGRESS)
+		{
+			struct pollfd fd;
+			fd.fd = m_connectionSocket;
+			fd.events = POLLOUT;
+			result = -1;
+			if (poll(&fd, 1, (int)connectTimeoutMs) > 0)
+			{
+				int socketError = 0;
+				socklen_t socketErrorLen = sizeof(socketError);
+				if (getsockopt(m_connectionSocket, SOL_SOCKET, SO_ERROR, &socketError, &socketErrorLen) == 0 && socketError == 0)
+				{
+					result = 0;
+				}
+			}
+		}
+		fcntl(m_connectionSocket, F_SETFL, flags);
+	}
+	else
+	{
+		result = connect(m_connectionSocket, (sockaddr*)(&addr), sizeof(addr));
+	}
 #endif
 	if (result < 0)
 	{
 		// Verbindungsversuch ist fehlgeschlagen
 		std::string text = "Tcp::open: Failed to open TCP connection to " + ipAddress + ":" + toString(port) + ", aborting.";
+		if (connectTimeoutMs > 0)
+		{
+			text = "Tcp::open: Failed to open TCP connection to " + ipAddress + ":" + toString(port) + " within " + toString(connectTimeoutMs) + " ms, aborting.";
+		}
 #ifdef _MSC_VER
 		char msgbuf[256] = "";
 		int err = WSAGetLastError();
@@ -213,6 +273,13 @@ bool Tcp::open(std::string ipAddress, UINT16 port, bool enableVerboseDebugOutput
 		return false;
 	}
 
+	// Small sopas requests are sent back to back (pipelined), don't let Nagle's algorithm hold them back until the previous reply is acknowledged
+	int tcp_nodelay = 1;
+	if (setsockopt(m_connectionSocket, IPPROTO_TCP, TCP_NODELAY, (const char*)&tcp_nodelay, sizeof(tcp_nodelay)) < 0)
+	{
+		ROS_WARN_STREAM("sick_scan_xd: Tcp::open: setsockopt(TCP_NODELAY) failed, pipelined sopas requests may be delayed");
+	}
+
 	printInfoMessage("Tcp::open: Connection established. Now starting read thread.", m_beVerbose);
 
 	// Empfangsthread starten
@@ -266,8 +333,8 @@ void Tcp::readThreadFunction(bool& endThread, UINT16& waitTimeMs)
 INT32 Tcp::readInputData()
 {
 	// Prepare the input buffer
-	const UINT16 max_length = 8192;
-	UINT8 inBuffer[max_length];
+	const UINT32 max_length = (UINT32)m_inBuffer.size();
+	UINT8* inBuffer = m_inBuffer.data();
 	INT32 recvMsgSize = 0;
 
 	// Ist die Verbindung offen?
@@ -346,10 +413,11 @@ INT32 Tcp::readInputData()
 		{
 			// Es ist keine Callback-Funktion definiert, also die Daten im
 			// lokalen Puffer speichern.
-			for (INT32 i = 0; i < recvMsgSize; i++)
+			if (m_rxBuffer.freeSpace() < (UINT32)recvMsgSize)
 			{
-				m_rxBuffer.push_back(inBuffer[i]);
+				m_rxBuffer.reserve(m_rxBuffer.size() + (UINT32)recvMsgSize);
 			}
+			m_rxBuffer.write(inBuffer, (UINT32)recvMsgSize);
 		}
 		m_last_tcp_msg_received_nsec = ::rosNanosecTimestampNow(); // timestamp in nanoseconds of the last received tcp message (or 0 if no message received)
 	}
@@ -467,17 +535,7 @@ UINT32 Tcp::getNumReadableBytes()
 //
 UINT32 Tcp::read(UINT8* buffer, UINT32 bufferLen)
 {
-	UINT32 bytesRead = 0;
-	
-	// Lesen
-	while ((getNumReadableBytes() > 0) && (bufferLen > bytesRead))
-	{
-		buffer[bytesRead] = m_rxBuffer.front();
-		m_rxBuffer.pop_front();
-		bytesRead += 1;	// m_inBuffer.read(buffer, bufferLen);
-	}
-	
-	return bytesRead;
+	return m_rxBuffer.read(buffer, bufferLen);
 }
 
 
@@ -488,24 +546,26 @@ UINT32 Tcp::read(UINT8* buffer, UINT32 bufferLen)
  */
 std::string Tcp::readString(UINT8 delimiter)
 {
-	UINT8 c = delimiter;
 	std::string outString;
 	const UINT16 maxStringLength = 8192;
 
 	// String fuellen
-	while (m_rxBuffer.size() > 0)
+	UINT32 delimiterPos = m_rxBuffer.find(delimiter);
+	m_rxBuffer.forEachSpan(0, delimiterPos, [&](const UINT8* span, UINT32 span_len, UINT32)
 	{
-		// Es sind noch Daten im Puffer
-		c = m_rxBuffer.front();
-		m_rxBuffer.pop_front();
-		if (c == delimiter)
-		{
-			// Trennzeichen gefunden - wir sind fertig!
-			outString = m_rxString;
-			m_rxString.clear();
-			break;
-		}
-		m_rxString += c;
+		m_rxString.append((const char*)span, span_len);
+		return true;
+	});
+	if (delimiterPos < m_rxBuffer.size())
+	{
+		// Trennzeichen gefunden - wir sind fertig!
+		outString = m_rxString;
+		m_rxString.clear();
+		m_rxBuffer.consume(delimiterPos + 1);
+	}
+	else
+	{
+		m_rxBuffer.consume(delimiterPos);
 	}
 
 	// Ueberlauf der Ausgabe?
@@ -19,9 +19,10 @@
 #include <sys/socket.h> /* for socket(), bind(), and connect() */
 #include <arpa/inet.h>  /* for sockaddr_in and inet_ntoa() */
 #endif
-#include <list>
+#include <vector>
 
 #include "Mutex.hpp"
+#include "RingBuffer.hpp"
 #include "SickThread.hpp"
 #include "BasicDatatypes.hpp"
 
@@ -35,8 +36,8 @@ public:
 	Tcp();
 	~Tcp();
 
-	// Opens the connection.
-	bool open(std::string ipAddress, UINT16 port, bool enableVerboseDebugOutput = false);
+	// Opens the connection. With connectTimeoutMs > 0, the connect is non-blocking and fails after connectTimeoutMs milliseconds.
+	bool open(std::string ipAddress, UINT16 port, bool enableVerboseDebugOutput = false, UINT32 connectTimeoutMs = 0);
 	bool open(UINT32 ipAddress, UINT16 port, bool enableVerboseDebugOutput = false);
 	void close();											// Closes the connection, if it was open.
 	bool isOpen();	// "True" if a connection is currently open.
@@ -61,7 +62,8 @@ private:
 	bool m_longStringWarningPrinted;
 	std::string m_rxString;						// fuer readString()
 	bool isClientConnected_unlocked();
-	std::list<unsigned char> m_rxBuffer;		// Main input buffer
+	RingBuffer m_rxBuffer;						// Main input buffer (if no read callback is set)
+	std::vector<UINT8> m_inBuffer;				// recv() buffer
 	void closeSocket();
 	void stopReadThread();
 	void startServerThread();
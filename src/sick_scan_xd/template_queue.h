@@ -1,13 +1,30 @@
 #pragma once
 
-#include <queue>
-#include <thread>
-#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <list>
 #include <mutex>
-#include <condition_variable>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+/*!
+\brief Receive queue for sopas datagrams, indexed by the command keyword of each datagram.
 
+Datagrams are stored in arrival order. Each datagram is additionally indexed by its command keyword
+(f.e. "LMCstartmeas" in "sAN LMCstartmeas 0") or as sopas error reply ("sFA"), so waiting for and
+popping a reply by keyword is O(1) instead of a scan over all queued datagrams. Waiters are registered
+per keyword and are only woken by datagrams they can accept.
 
+Keywords match the complete command keyword of a datagram, i.e. use SickScanCommonTcp::getSopasCmdKeyword()
+of the request. A sopas error reply "sFA" is accepted by every keyword, an empty keyword list accepts any datagram.
+T must provide std::vector<unsigned char>& data().
+*/
 template<typename T>
 class Queue
 {
@@ -20,115 +37,283 @@ public:
   */
   int getNumberOfEntriesInQueue()
   {
-    int retVal = 0;
     std::unique_lock<std::mutex> mlock(mutex_);
-    retVal = queue_.size();
-    return (retVal);
+    return (int)queue_.size();
   }
 
   bool isQueueEmpty()
   {
-    bool retVal = false;
     std::unique_lock<std::mutex> mlock(mutex_);
-    retVal = queue_.empty();
-    return (retVal);
+    return queue_.empty();
   }
 
-  bool waitForIncomingObject(int timeOutInMs, const std::vector<std::string>& datagram_keywords)
+  /*!
+  \brief removes all entries
+  */
+  void clear()
   {
     std::unique_lock<std::mutex> mlock(mutex_);
-    bool ret = true;
-    typename std::list<T>::iterator datagram_found;
-    while (findFirstByKeyword(datagram_keywords, datagram_found) == false && (ret == true))
-    {
-      ret = (cond_.wait_for(mlock, std::chrono::milliseconds(timeOutInMs)) == std::cv_status::no_timeout);
-    }
-    return (ret);
+    queue_.clear();
+    index_.clear();
+    errors_.clear();
+    discards_.clear();
   }
 
-  T pop(const std::vector<std::string>& datagram_keywords) // T pop(const std::vector<std::string>& datagram_keywords = {})
+  /*!
+  \brief discards the next datagram with this keyword, f.e. the late reply to a request that timed out.
+  A matching datagram already queued is removed at once, otherwise the next one is dropped on arrival.
+  Pending discards are reset by clear().
+  */
+  void discardNext(const std::string& datagram_keyword)
   {
     std::unique_lock<std::mutex> mlock(mutex_);
-    typename std::list<T>::iterator datagram_found;
-    while (findFirstByKeyword(datagram_keywords, datagram_found) == false)
+    typename std::unordered_map<std::string, std::deque<typename std::list<Entry>::iterator>>::iterator entries = index_.find(datagram_keyword);
+    if (entries != index_.end())
+    {
+      erase(entries->second.front());
+    }
+    else
     {
-      cond_.wait(mlock);
+      discards_[datagram_keyword]++;
     }
-    T item = *datagram_found;
-    queue_.erase(datagram_found);
+  }
+
+  /*!
+  \brief waits until a datagram matching one of the keywords (or a sopas error reply) is queued
+  \param timeOutInMs max. time to wait in milliseconds
+  \param datagram_keywords command keywords, f.e. { "LMDscandata" }, or {} for any datagram
+  \return true if a matching datagram is queued, false after timeout
+  */
+  bool waitForIncomingObject(int timeOutInMs, const std::vector<std::string>& datagram_keywords)
+  {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeOutInMs);
+    return waitFor(mlock, datagram_keywords, &deadline);
+  }
+
+  /*!
+  \brief removes and returns the oldest datagram matching one of the keywords (or a sopas error reply), blocks until available
+  */
+  T pop(const std::vector<std::string>& datagram_keywords)
+  {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    waitFor(mlock, datagram_keywords, 0);
+    typename std::list<Entry>::iterator entry = findFirstByKeyword(datagram_keywords);
+    T item = std::move(entry->item);
+    erase(entry);
     return item;
   }
 
   void push(const T &item)
   {
+    push(T(item));
+  }
+
+  void push(T&& item)
+  {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    queue_.push_back(Entry{ next_seq_++, std::string(), false, std::move(item) });
+    typename std::list<Entry>::iterator entry = std::prev(queue_.end());
+    entry->is_error = getKeyword(entry->item.data(), entry->keyword);
+    if (entry->is_error)
     {
-      std::unique_lock<std::mutex> mlock(mutex_);
-      queue_.push_back(item);
+      errors_.push_back(entry);
+      ROS_DEBUG_STREAM("Queue::push(): error identifier sFA found in datagram");
+      for (typename std::unordered_map<std::string, std::list<Waiter*>>::iterator waiters = keyword_waiters_.begin(); waiters != keyword_waiters_.end(); waiters++)
+      {
+        notify(waiters->second);
+      }
     }
-    cond_.notify_all(); // cond_.notify_one();
+    else if (!entry->keyword.empty())
+    {
+      std::unordered_map<std::string, int>::iterator discard = discards_.find(entry->keyword);
+      if (discard != discards_.end())
+      {
+        ROS_DEBUG_STREAM("Queue::push(): discarding late datagram \"" << entry->keyword << "\"");
+        if (--discard->second <= 0)
+        {
+          discards_.erase(discard);
+        }
+        queue_.erase(entry);
+        return;
+      }
+      index_[entry->keyword].push_back(entry);
+      typename std::unordered_map<std::string, std::list<Waiter*>>::iterator waiters = keyword_waiters_.find(entry->keyword);
+      if (waiters != keyword_waiters_.end())
+      {
+        notify(waiters->second);
+      }
+    }
+    notify(any_waiters_);
   }
 
 
 protected:
-  
-  bool findFirstByKeyword(const std::vector<std::string>& keywords, typename std::list<T>::iterator & iter)
+
+  struct Entry
+  {
+    uint64_t seq;         // arrival order
+    std::string keyword;  // command keyword, empty if the datagram has none
+    bool is_error;        // sopas error reply "sFA"
+    T item;
+  };
+
+  struct Waiter
+  {
+    std::condition_variable cond;
+    bool notified = false;
+  };
+
+  /*
+  ** extracts the command keyword of a datagram, returns true for sopas error replies "sFA"
+  */
+  static bool getKeyword(std::vector<unsigned char>& datagram, std::string& keyword)
   {
-    iter = queue_.begin();
-    if(keywords.empty())
+    uint32_t cola_b_start = 0x02020202;
+    size_t commandIdOffset = 1, keyword_start = 0, keyword_end = datagram.size();
+    if (datagram.size() > 12 && memcmp(datagram.data(), &cola_b_start, sizeof(cola_b_start)) == 0)
+    {
+      commandIdOffset = 8;  // command id behind 0x02020202 + { 4 byte payload length }
+      keyword_start = 12;   // 0x02020202 + { 4 byte payload length } + { 4 byte command id incl. space }
+      keyword_end = datagram.size() - 1; // without checksum
+    }
+    else if (datagram.size() > 5)
     {
-      return !queue_.empty();
+      commandIdOffset = 1;
+      keyword_start = 5;    // 0x02 + { 4 byte command id incl. space }
     }
-    for( ; iter != queue_.end(); iter++)
+    else
     {
-      std::vector<unsigned char>& datagram = iter->data();
-      uint32_t cola_b_start = 0x02020202;
-      uint8_t* datagram_keyword_start = 0;
-      int64_t datagram_keyword_maxlen = static_cast<int64_t>(datagram.size());
-      int commandIdOffset = 1;
-      if(datagram.size() > 12 && memcmp(datagram.data(),&cola_b_start, sizeof(cola_b_start)) == 0)
+      return false;
+    }
+    if (memcmp(datagram.data() + commandIdOffset, "sFA", 3) == 0)
+    {
+      return true;
+    }
+    size_t n = keyword_start;
+    while (n < keyword_end && datagram[n] != ' ' && datagram[n] != 0x03)
+    {
+      n++;
+    }
+    keyword.assign((const char*)datagram.data() + keyword_start, n - keyword_start);
+    return false;
+  }
+
+  /*
+  ** returns the oldest entry matching the keywords or an error reply, or queue_.end()
+  */
+  typename std::list<Entry>::iterator findFirstByKeyword(const std::vector<std::string>& keywords)
+  {
+    if (keywords.empty())
+    {
+      return queue_.begin();
+    }
+    typename std::list<Entry>::iterator found = queue_.end();
+    if (!errors_.empty())
+    {
+      found = errors_.front();
+    }
+    for (size_t keyword_idx = 0; keyword_idx < keywords.size(); keyword_idx++)
+    {
+      typename std::unordered_map<std::string, std::deque<typename std::list<Entry>::iterator>>::iterator entries = index_.find(keywords[keyword_idx]);
+      if (entries != index_.end() && (found == queue_.end() || entries->second.front()->seq < found->seq))
       {
-        commandIdOffset = 8; // command id behind 0x02020202 + { 4 byte payload length }
-        datagram_keyword_start = datagram.data() + 12; // 0x02020202 + { 4 byte payload length } + { 4 byte command id incl. space }
-        datagram_keyword_maxlen -= 12;
+        found = entries->second.front();
       }
-      else if(datagram.size() > 5)
+    }
+    return found;
+  }
+
+  /*
+  ** removes an entry. Entries are always removed in arrival order per keyword, i.e. from the front of their index.
+  */
+  void erase(typename std::list<Entry>::iterator entry)
+  {
+    if (entry->is_error)
+    {
+      errors_.pop_front();
+    }
+    else if (!entry->keyword.empty())
+    {
+      typename std::unordered_map<std::string, std::deque<typename std::list<Entry>::iterator>>::iterator entries = index_.find(entry->keyword);
+      entries->second.pop_front();
+      if (entries->second.empty())
       {
-        commandIdOffset = 1;
-        datagram_keyword_start = datagram.data() + 5; // 0x02 + { 4 byte command id incl. space }
-        datagram_keyword_maxlen -= 5;
+        index_.erase(entries);
       }
-      else
-        continue;
-      
-      for(size_t keyword_idx = 0; keyword_idx < keywords.size(); keyword_idx++)
+    }
+    queue_.erase(entry);
+  }
+
+  /*
+  ** waits until a matching entry is queued or the deadline expires (deadline 0: no timeout)
+  */
+  bool waitFor(std::unique_lock<std::mutex>& mlock, const std::vector<std::string>& keywords, const std::chrono::steady_clock::time_point* deadline)
+  {
+    if (findFirstByKeyword(keywords) != queue_.end())
+    {
+      return true;
+    }
+    Waiter waiter;
+    std::vector<typename std::list<Waiter*>::iterator> registrations;
+    if (keywords.empty())
+    {
+      any_waiters_.push_back(&waiter);
+    }
+    for (size_t n = 0; n < keywords.size(); n++)
+    {
+      std::list<Waiter*>& waiters = keyword_waiters_[keywords[n]];
+      registrations.push_back(waiters.insert(waiters.end(), &waiter));
+    }
+    bool found = false;
+    while (!(found = (findFirstByKeyword(keywords) != queue_.end())))
+    {
+      waiter.notified = false;
+      if (deadline)
       {
-        const std::string& keyword = keywords[keyword_idx];
-        if(static_cast<int64_t>(keyword.size()) <= datagram_keyword_maxlen && memcmp(datagram_keyword_start, keyword.data(), keyword.size()) == 0)
+        if (!waiter.cond.wait_until(mlock, *deadline, [&waiter]{ return waiter.notified; }))
         {
-          // ROS_DEBUG_STREAM("Queue::findFirstByKeyword(): keyword_start=\"" << std::string((char*)datagram_keyword_start, keyword.size()) << "\", keyword=\"" << keyword << "\"");
-          return true;
+          found = (findFirstByKeyword(keywords) != queue_.end());
+          break;
         }
       }
-
-      // keyword not found.
-      // Check for possible sFA command as an error reply
-      std::string errorIdentifier = "sFA";
-      if (datagram.size() >= (commandIdOffset + errorIdentifier.length()))
+      else
       {
-        const char* errorIdentifierPtr = errorIdentifier.c_str();
-        const char* cmpPtr = (const char *)(datagram.data() + commandIdOffset);
-        if (memcmp(cmpPtr, errorIdentifierPtr, errorIdentifier.length() )== 0)
-        {
-          ROS_DEBUG_STREAM("Queue::findFirstByKeyword(): error identifier sFA found in datagram");
-          return true;
-        }
+        waiter.cond.wait(mlock, [&waiter]{ return waiter.notified; });
+      }
+    }
+    if (keywords.empty())
+    {
+      any_waiters_.remove(&waiter);
+    }
+    for (size_t n = 0; n < keywords.size(); n++)
+    {
+      typename std::unordered_map<std::string, std::list<Waiter*>>::iterator waiters = keyword_waiters_.find(keywords[n]);
+      waiters->second.erase(registrations[n]);
+      if (waiters->second.empty())
+      {
+        keyword_waiters_.erase(waiters);
       }
     }
-    return false; // keyword not found, iter == queue_.end()
+    return found;
+  }
+
+  static void notify(std::list<Waiter*>& waiters)
+  {
+    for (typename std::list<Waiter*>::iterator waiter = waiters.begin(); waiter != waiters.end(); waiter++)
+    {
+      (*waiter)->notified = true;
+      (*waiter)->cond.notify_one();
+    }
   }
 
-  std::list<T> queue_;
+  std::list<Entry> queue_;  // all datagrams in arrival order
+  std::unordered_map<std::string, std::deque<typename std::list<Entry>::iterator>> index_; // keyword -> datagrams in arrival order
+  std::deque<typename std::list<Entry>::iterator> errors_; // sopas error replies in arrival order
+  std::unordered_map<std::string, std::list<Waiter*>> keyword_waiters_;
+  std::list<Waiter*> any_waiters_;
+  std::unordered_map<std::string, int> discards_; // keyword -> number of datagrams to drop on arrival
+  uint64_t next_seq_ = 0;
   std::mutex mutex_;
-  std::condition_variable cond_;
 
 };
@@ -0,0 +1,623 @@
+/* Mock SOPAS server for testing the multiScan control path without hardware.
+ *
+ * Accepts tcp connections on the SOPAS port and answers the commands sent by SopasServices
+ * (SetAccessMode, Run, ScanData*, ImuData*, PerformanceProfileNumber, LMCstartmeas, LMCstopmeas)
+ * in the dialect of each request, i.e. CoLa-A (<STX>...<ETX>) or CoLa-B (0x02020202 + length + payload + checksum).
+ * Unknown commands are answered with a generic reply of the matching type (sRN -> sRA, sWN -> sWA, sMN -> sAN, sEN -> sEA).
+ *
+ * Faults can be injected for testing error handling: reply latency and jitter, sopas error replies (sFA)
+ * for given commands or at random, and connection drops after a number of requests or on a given command.
+ *
+ * Optionally a recorded pcap or raw datagram log (see datagram_log.h) is replayed via udp while the
+ * measurement is running, i.e. after "sMN LMCstartmeas" with scan data enabled, to the destination
+ * configured by "sWN ScanDataEthSettings" (or --udp-dest). Like the lidar, the emulator keeps streaming
+ * if the tcp connection is lost, and stops on "sWN ScanDataEnable 0" or "sMN LMCstopmeas".
+ *
+ * Connections are served one after the other. POSIX only. */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sick_scan_xd/datagram_log.h"
+#include "sick_scan_xd/udp_sockets.h"
+
+
+struct MockConfig
+{
+    int port = 2111;
+    double latency_ms = 0.;
+    double jitter_ms = 0.;
+    std::vector<std::string> error_keywords;    // commands answered with sFA
+    double error_rate = 0.;                     // probability of a sFA reply for any other command
+    int drop_after = 0;                         // close the connection on the n-th request of a connection (0: never)
+    std::vector<std::string> drop_keywords;     // close the connection when one of these commands is received
+    bool check_access = false;                  // require "sMN SetAccessMode" before sWN/sMN, "sMN Run" resets the access level
+    std::string replay_file;
+    int replay_port = 2115;                     // destination port of datagrams read from pcap files
+    std::string udp_dest;                       // "ip:port", overrides ScanDataEthSettings
+    double replay_speed = 1.;                   // 0: as fast as possible
+    bool verbose = false;
+    unsigned seed = 0;
+};
+
+/*
+ * a single sopas request, i.e. "<type> <keyword> <arguments>" with the arguments as received (ascii or binary)
+ */
+struct SopasRequest
+{
+    bool binary = false;
+    std::string type;           // "sRN", "sWN", "sMN", "sEN"
+    std::string keyword;
+    std::vector<uint8_t> args;
+};
+
+/*
+ * a sopas reply, values are single bytes in CoLa-B and hex numbers in CoLa-A
+ */
+struct SopasReply
+{
+    std::string head;           // f.e. "sAN LMCstartmeas"
+    std::vector<uint8_t> values;
+    bool error = false;         // sFA with error code values[0]
+};
+
+static std::string printable(const std::vector<uint8_t>& frame)
+{
+    std::stringstream s;
+    for(uint8_t c : frame)
+    {
+        if(c >= 0x20 && c < 0x7F) s << static_cast<char>(c);
+        else if(c == 0x02) s << "<STX>";
+        else if(c == 0x03) s << "<ETX>";
+        else s << "\\x" << "0123456789ABCDEF"[c >> 4] << "0123456789ABCDEF"[c & 0xF];
+    }
+    return s.str();
+}
+
+static std::vector<uint8_t> encodeReply(const SopasReply& reply, bool binary)
+{
+    std::vector<uint8_t> frame;
+    if(binary)
+    {
+        // 0x02020202 + { 4 byte payload length } + { payload } + { 1 byte xor checksum }
+        std::vector<uint8_t> payload(reply.head.begin(), reply.head.end());
+        if(reply.error)
+        {
+            payload.push_back(0);   // sFA + { 2 byte error code }
+            payload.push_back(reply.values.empty() ? 0 : reply.values[0]);
+        }
+        else if(!reply.values.empty())
+        {
+            payload.push_back(' ');
+            payload.insert(payload.end(), reply.values.begin(), reply.values.end());
+        }
+        frame = { 0x02, 0x02, 0x02, 0x02 };
+        for(int n = 3; n >= 0; n--)
+        {
+            frame.push_back(static_cast<uint8_t>((payload.size() >> (8 * n)) & 0xFF));
+        }
+        uint8_t checksum = 0;
+        for(uint8_t c : payload) checksum ^= c;
+        frame.insert(frame.end(), payload.begin(), payload.end());
+        frame.push_back(checksum);
+    }
+    else
+    {
+        std::stringstream s;
+        s << reply.head;
+        for(uint8_t value : reply.values) s << ' ' << std::uppercase << std::hex << static_cast<int>(value);
+        std::string text = s.str();
+        frame.push_back(0x02);
+        frame.insert(frame.end(), text.begin(), text.end());
+        frame.push_back(0x03);
+    }
+    return frame;
+}
+
+/*
+ * Splits the received byte stream into sopas requests. Returns false if no complete frame is buffered.
+ */
+class RequestParser
+{
+public:
+    void append(const uint8_t* data, size_t len) { this->buffer.insert(this->buffer.end(), data, data + len); }
+
+    bool next(SopasRequest& request)
+    {
+        while(!this->buffer.empty())
+        {
+            std::vector<uint8_t>::iterator stx = std::find(this->buffer.begin(), this->buffer.end(), 0x02);
+            this->buffer.erase(this->buffer.begin(), stx);  // skip garbage
+            if(this->buffer.size() < 4) return false;
+
+            std::vector<uint8_t> payload;
+            size_t frame_len = 0;
+            if(this->buffer[1] == 0x02 && this->buffer[2] == 0x02 && this->buffer[3] == 0x02)
+            {
+                if(this->buffer.size() < 8) return false;
+                size_t payload_len = (static_cast<size_t>(this->buffer[4]) << 24) | (this->buffer[5] << 16) | (this->buffer[6] << 8) | this->buffer[7];
+                frame_len = 8 + payload_len + 1;
+                if(this->buffer.size() < frame_len) return false;
+                payload.assign(this->buffer.begin() + 8, this->buffer.begin() + 8 + payload_len);
+                uint8_t checksum = 0;
+                for(uint8_t c : payload) checksum ^= c;
+                if(checksum != this->buffer[frame_len - 1])
+                {
+                    std::fprintf(stderr, "## ERROR sopas_mock_server: CoLa-B checksum error, request ignored\n");
+                    this->buffer.erase(this->buffer.begin(), this->buffer.begin() + frame_len);
+                    continue;
+                }
+                request.binary = true;
+            }
+            else
+            {
+                std::vector<uint8_t>::iterator etx = std::find(this->buffer.begin(), this->buffer.end(), 0x03);
+                if(etx == this->buffer.end()) return false;
+                frame_len = (etx - this->buffer.begin()) + 1;
+                payload.assign(this->buffer.begin() + 1, etx);
+                request.binary = false;
+            }
+            this->buffer.erase(this->buffer.begin(), this->buffer.begin() + frame_len);
+
+            // "<3 byte type> <keyword>[ <arguments>]"
+            request.type.assign(payload.begin(), payload.begin() + std::min<size_t>(3, payload.size()));
+            std::vector<uint8_t>::iterator keyword_start = payload.begin() + std::min<size_t>(4, payload.size());
+            std::vector<uint8_t>::iterator keyword_end = std::find(keyword_start, payload.end(), ' ');
+            request.keyword.assign(keyword_start, keyword_end);
+            request.args.assign(keyword_end == payload.end() ? payload.end() : keyword_end + 1, payload.end());
+            return true;
+        }
+        return false;
+    }
+
+protected:
+    std::vector<uint8_t> buffer;
+};
+
+/*
+ * Replays recorded udp datagrams while the measurement is running
+ */
+class UdpEmulator
+{
+public:
+    ~UdpEmulator() { stop(); }
+
+    bool load(const std::string& file, int udp_port)
+    {
+        sick_scansegment_xd::DatagramLogReader reader;
+        if(!reader.Open(file, udp_port)) return false;
+        this->datagrams = reader.ReadAll();
+        return !this->datagrams.empty();
+    }
+
+    size_t size() const { return this->datagrams.size(); }
+
+    void start(const std::string& ip, int port, double speed)
+    {
+        stop();
+        std::printf("sopas_mock_server: udp emulator started, sending %lu datagrams to %s:%d\n", this->datagrams.size(), ip.c_str(), port);
+        this->running = true;
+        this->thread = std::thread(&UdpEmulator::run, this, ip, port, speed);
+    }
+
+    void stop()
+    {
+        if(this->thread.joinable())
+        {
+            this->running = false;
+            this->thread.join();
+            std::printf("sopas_mock_server: udp emulator stopped after %lu datagrams\n", this->num_sent.load());
+        }
+    }
+
+    bool isRunning() const { return this->thread.joinable(); }
+
+protected:
+    // sends the datagrams in a loop, paced by their recorded timestamps
+    void run(std::string ip, int port, double speed)
+    {
+        sick_scansegment_xd::UdpSenderSocketImpl socket(ip, port);
+        if(!socket.IsOpen())
+        {
+            std::fprintf(stderr, "## ERROR sopas_mock_server: can't open udp socket for %s:%d\n", ip.c_str(), port);
+            return;
+        }
+        this->num_sent = 0;
+        while(this->running)
+        {
+            std::chrono::steady_clock::time_point loop_start = std::chrono::steady_clock::now();
+            for(size_t n = 0; this->running && n < this->datagrams.size(); n++)
+            {
+                if(speed > 0.)
+                {
+                    double offset = 1e-9 * (this->datagrams[n].timestamp_nsec - this->datagrams[0].timestamp_nsec) / speed;
+                    std::this_thread::sleep_until(loop_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(offset)));
+                }
+                socket.Send(this->datagrams[n].payload);
+                this->num_sent++;
+            }
+            if(speed > 0. && this->datagrams.size() > 1)    // keep the recorded period between the last and the first datagram
+            {
+                double period = 1e-9 * (this->datagrams.back().timestamp_nsec - this->datagrams[0].timestamp_nsec) / (this->datagrams.size() - 1) / speed;
+                std::this_thread::sleep_for(std::chrono::duration<double>(period));
+            }
+        }
+    }
+
+    std::vector<sick_scansegment_xd::LoggedDatagram> datagrams;
+    std::thread thread;
+    std::atomic_bool running = false;
+    std::atomic<size_t> num_sent = 0;
+};
+
+/*
+ * Lidar state as configured by the sopas commands, persists across connections
+ */
+class MockLidar
+{
+public:
+    MockLidar(const MockConfig& config) : config(config), rng(config.seed ? config.seed : std::random_device{}()) {}
+
+    UdpEmulator emulator;
+
+    /*
+     * Answers a request. Returns false if the connection should be dropped instead.
+     */
+    bool handle(const SopasRequest& request, int request_cnt, SopasReply& reply)
+    {
+        if((this->config.drop_after > 0 && request_cnt >= this->config.drop_after) || contains(this->config.drop_keywords, request.keyword))
+        {
+            return false;
+        }
+        std::string args = decodeArgs(request.args);
+        if(contains(this->config.error_keywords, request.keyword) ||
+            (this->config.error_rate > 0. && std::uniform_real_distribution<double>(0., 1.)(this->rng) < this->config.error_rate))
+        {
+            reply = SopasReply{ "sFA", { 0x05 }, true };    // 5: Sopas_Error_METHODIN_SERVERBUSY
+            return true;
+        }
+        if(this->config.check_access && (request.type == "sWN" || request.type == "sMN") && request.keyword != "SetAccessMode" && this->access_level < 3)
+        {
+            reply = SopasReply{ "sFA", { 0x01 }, true };    // 1: Sopas_Error_METHODIN_ACCESSDENIED
+            return true;
+        }
+
+        if(request.type == "sMN")
+        {
+            uint8_t result = 1;
+            if(request.keyword == "SetAccessMode")
+            {
+                this->access_level = request.binary ? (request.args.empty() ? 0 : request.args[0]) : std::atoi(args.c_str());
+            }
+            else if(request.keyword == "Run")
+            {
+                this->access_level = 0;
+            }
+            else if(request.keyword == "LMCstartmeas" || request.keyword == "LMCstopmeas")
+            {
+                this->measuring = (request.keyword == "LMCstartmeas");
+                result = 0; // 0: success
+            }
+            reply = SopasReply{ "sAN " + request.keyword, { result } };
+        }
+        else if(request.type == "sWN")
+        {
+            if(request.keyword == "ScanDataEnable")
+            {
+                this->scandata_enabled = (std::atoi(args.c_str()) != 0);
+            }
+            else if(request.keyword == "ScanDataEthSettings")
+            {
+                parseEthSettings(args);
+            }
+            reply = SopasReply{ "sWA " + request.keyword, {} };
+        }
+        else if(request.type == "sRN")
+        {
+            reply = SopasReply{ "sRA " + request.keyword, { 0 } };
+        }
+        else if(request.type == "sEN")
+        {
+            reply = SopasReply{ "sEA " + request.keyword, { static_cast<uint8_t>(std::atoi(args.c_str())) } };
+        }
+        else
+        {
+            reply = SopasReply{ "sFA", { 0x0A }, true };    // 10: Sopas_Error_UNKNOWN_CMD
+        }
+        updateEmulator();
+        return true;
+    }
+
+    // reply latency incl. jitter
+    std::chrono::steady_clock::duration latency()
+    {
+        double latency_ms = this->config.latency_ms;
+        if(this->config.jitter_ms > 0.)
+        {
+            latency_ms += std::uniform_real_distribution<double>(0., this->config.jitter_ms)(this->rng);
+        }
+        return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(latency_ms));
+    }
+
+protected:
+    static bool contains(const std::vector<std::string>& keywords, const std::string& keyword)
+    {
+        return std::find(keywords.begin(), keywords.end(), keyword) != keywords.end();
+    }
+
+    // SickScanCommonTcp::convertAscii2BinaryCmd() sends the digits of plain arguments as bytes 0...9
+    static std::string decodeArgs(const std::vector<uint8_t>& args)
+    {
+        std::string decoded;
+        for(uint8_t c : args) decoded.push_back(c < 10 ? static_cast<char>('0' + c) : static_cast<char>(c));
+        return decoded;
+    }
+
+    // "1 +192 +168 +0 +52 +2115": ip 192.168.0.52 port 2115
+    void parseEthSettings(const std::string& args)
+    {
+        std::stringstream s(args);
+        std::vector<int> values;
+        std::string token;
+        while(s >> token) values.push_back(std::atoi(token.c_str()));
+        if(values.size() >= 6)
+        {
+            this->udp_ip = std::to_string(values[1]) + "." + std::to_string(values[2]) + "." + std::to_string(values[3]) + "." + std::to_string(values[4]);
+            this->udp_port = values[5];
+        }
+    }
+
+    void updateEmulator()
+    {
+        bool streaming = this->measuring && this->scandata_enabled && this->emulator.size() > 0;
+        if(streaming && !this->emulator.isRunning())
+        {
+            std::string ip = this->udp_ip;
+            int port = this->udp_port;
+            if(!this->config.udp_dest.empty())
+            {
+                size_t sep = this->config.udp_dest.rfind(':');
+                ip = this->config.udp_dest.substr(0, sep);
+                port = (sep == std::string::npos) ? port : std::atoi(this->config.udp_dest.c_str() + sep + 1);
+            }
+            this->emulator.start(ip, port, this->config.replay_speed);
+        }
+        else if(!streaming && this->emulator.isRunning())
+        {
+            this->emulator.stop();
+        }
+    }
+
+    const MockConfig& config;
+    std::mt19937 rng;
+    int access_level = 0;
+    bool measuring = false;
+    bool scandata_enabled = false;
+    std::string udp_ip = "127.0.0.1";
+    int udp_port = 2115;
+};
+
+/*
+ * Sends replies when their latency has expired, in order of the requests
+ */
+class ReplySender
+{
+public:
+    ReplySender(int socket_fd) : socket_fd(socket_fd), thread(&ReplySender::run, this) {}
+
+    ~ReplySender()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->running = false;
+        }
+        this->cond.notify_all();
+        this->thread.join();
+    }
+
+    void push(std::chrono::steady_clock::time_point due, std::vector<uint8_t>&& frame)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if(!this->pending.empty()) due = std::max(due, this->pending.back().first);   // jitter must not reorder replies
+        this->pending.emplace_back(due, std::move(frame));
+        this->cond.notify_all();
+    }
+
+protected:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        while(this->running)
+        {
+            if(this->pending.empty())
+            {
+                this->cond.wait(lock);
+                continue;
+            }
+            if(this->cond.wait_until(lock, this->pending.front().first, [this]{ return !this->running; }))
+            {
+                break;
+            }
+            std::vector<uint8_t> frame = std::move(this->pending.front().second);
+            this->pending.pop_front();
+            lock.unlock();
+            if(send(this->socket_fd, frame.data(), frame.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(frame.size()))
+            {
+                std::fprintf(stderr, "## ERROR sopas_mock_server: send failed: %s\n", strerror(errno));
+            }
+            lock.lock();
+        }
+    }
+
+    int socket_fd;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::pair<std::chrono::steady_clock::time_point, std::vector<uint8_t>>> pending;
+    bool running = true;
+    std::thread thread;
+};
+
+static void serveConnection(int socket_fd, MockLidar& lidar, const MockConfig& config)
+{
+    RequestParser parser;
+    int request_cnt = 0;
+    std::vector<uint8_t> buffer(64 * 1024);
+    ReplySender sender(socket_fd);
+    ssize_t len = 0;
+    while((len = recv(socket_fd, buffer.data(), buffer.size(), 0)) > 0)
+    {
+        parser.append(buffer.data(), len);
+        SopasRequest request;
+        while(parser.next(request))
+        {
+            SopasReply reply;
+            request_cnt++;
+            if(!lidar.handle(request, request_cnt, reply))
+            {
+                std::printf("sopas_mock_server: dropping connection on request %d \"%s %s\"\n", request_cnt, request.type.c_str(), request.keyword.c_str());
+                return;
+            }
+            std::vector<uint8_t> frame = encodeReply(reply, request.binary);
+            if(config.verbose)
+            {
+                std::printf("sopas_mock_server: %s %s -> %s\n", request.type.c_str(), request.keyword.c_str(), printable(frame).c_str());
+            }
+            sender.push(std::chrono::steady_clock::now() + lidar.latency(), std::move(frame));
+        }
+    }
+}
+
+static void printUsage(const char* argv0)
+{
+    std::printf(
+        "Usage: %s [options]\n"
+        "Options:\n"
+        "  --port <n>             sopas tcp port (default 2111)\n"
+        "  --latency <ms>         reply latency in milliseconds (default 0)\n"
+        "  --jitter <ms>          additional uniform random reply latency in milliseconds (default 0)\n"
+        "  --error <keyword>      reply sFA to this command, f.e. --error LMCstartmeas, may be repeated\n"
+        "  --error-rate <p>       probability of a sFA reply to any command (default 0)\n"
+        "  --drop-after <n>       close each connection on its n-th request without reply (default 0: never)\n"
+        "  --drop-on <keyword>    close the connection on this command without reply, may be repeated\n"
+        "  --check-access         require sMN SetAccessMode before sWN/sMN commands, sMN Run resets the access level\n"
+        "  --replay <file>        pcap or raw datagram log to send via udp while the measurement is running\n"
+        "  --replay-port <n>      udp port of scan data in pcap files (default 2115)\n"
+        "  --replay-speed <f>     replay speed relative to the recorded timestamps, 0: as fast as possible (default 1)\n"
+        "  --udp-dest <ip:port>   udp destination, overrides sWN ScanDataEthSettings\n"
+        "  --seed <n>             random seed for jitter and errors\n"
+        "  --verbose              print every request and reply\n",
+        argv0);
+}
+
+static bool parseArgs(int argc, char** argv, MockConfig& config)
+{
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto next = [&](const char* name) -> const char*
+        {
+            if(i + 1 >= argc)
+            {
+                std::fprintf(stderr, "## ERROR sopas_mock_server: missing value for %s\n", name);
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if(arg == "--help" || arg == "-h") return false;
+        else if(arg == "--port") config.port = std::atoi(next("--port"));
+        else if(arg == "--latency") config.latency_ms = std::atof(next("--latency"));
+        else if(arg == "--jitter") config.jitter_ms = std::atof(next("--jitter"));
+        else if(arg == "--error") config.error_keywords.push_back(next("--error"));
+        else if(arg == "--error-rate") config.error_rate = std::atof(next("--error-rate"));
+        else if(arg == "--drop-after") config.drop_after = std::atoi(next("--drop-after"));
+        else if(arg == "--drop-on") config.drop_keywords.push_back(next("--drop-on"));
+        else if(arg == "--check-access") config.check_access = true;
+        else if(arg == "--replay") config.replay_file = next("--replay");
+        else if(arg == "--replay-port") config.replay_port = std::atoi(next("--replay-port"));
+        else if(arg == "--replay-speed") config.replay_speed = std::atof(next("--replay-speed"));
+        else if(arg == "--udp-dest") config.udp_dest = next("--udp-dest");
+        else if(arg == "--seed") config.seed = static_cast<unsigned>(std::atoi(next("--seed")));
+        else if(arg == "--verbose") config.verbose = true;
+        else
+        {
+            std::fprintf(stderr, "## ERROR sopas_mock_server: unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int main(int argc, char** argv)
+{
+    std::setvbuf(stdout, NULL, _IOLBF, 0);  // keep the log readable when redirected
+    MockConfig config;
+    if(!parseArgs(argc, argv, config))
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    MockLidar lidar(config);
+    if(!config.replay_file.empty())
+    {
+        if(!lidar.emulator.load(config.replay_file, config.replay_port))
+        {
+            std::fprintf(stderr, "## ERROR sopas_mock_server: no datagrams in %s\n", config.replay_file.c_str());
+            return EXIT_FAILURE;
+        }
+        std::printf("sopas_mock_server: %lu datagrams loaded from %s\n", lidar.emulator.size(), config.replay_file.c_str());
+    }
+
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int enable = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(config.port);
+    if(server_fd < 0 || bind(server_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(server_fd, 4) != 0)
+    {
+        std::fprintf(stderr, "## ERROR sopas_mock_server: can't listen on port %d: %s\n", config.port, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    std::printf("sopas_mock_server: listening on port %d\n", config.port);
+
+    while(true)
+    {
+        sockaddr_in client_addr;
+        socklen_t client_addr_len = sizeof(client_addr);
+        int client_fd = accept(server_fd, (sockaddr*)&client_addr, &client_addr_len);
+        if(client_fd < 0)
+        {
+            std::fprintf(stderr, "## ERROR sopas_mock_server: accept failed: %s\n", strerror(errno));
+            continue;
+        }
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        std::printf("sopas_mock_server: connection from %s:%d\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+        serveConnection(client_fd, lidar, config);
+        close(client_fd);
+        std::printf("sopas_mock_server: connection closed\n");
+    }
+    return EXIT_SUCCESS;
+}
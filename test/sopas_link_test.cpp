@@ -0,0 +1,326 @@
+/* Control path tests against sopas_mock_server (see sopas_mock_server.cpp), no hardware and no ROS required.
+ *
+ *   sopas_link_test <path/to/sopas_mock_server> [--port <n>] [--verbose]
+ *
+ * Each test starts its own mock server with the fault injection options it needs and talks to it
+ * through SickScanCommonTcp / SopasServices, like the driver does. Returns non-zero if a check fails.
+ * POSIX only. */
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sick_scan_xd/sick_scan_common_tcp.h"
+#include "sick_scan_xd/sopas_async_client.h"
+#include "sick_scan_xd/sopas_services.h"
+
+
+struct TestConfig
+{
+    std::string mock_server;
+    int port = 42111;
+    bool verbose = false;
+};
+
+static int s_num_checks = 0, s_num_failed = 0;
+
+static void check(bool ok, const char* test, const std::string& what)
+{
+    s_num_checks++;
+    if(!ok)
+    {
+        s_num_failed++;
+    }
+    std::printf("sopas_link_test: [%s] %s: %s\n", ok ? " OK " : "FAIL", test, what.c_str());
+}
+
+static double millisecSince(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * runs sopas_mock_server as a child process for the lifetime of the object
+ */
+class MockServer
+{
+public:
+    MockServer(const TestConfig& config, const std::vector<std::string>& options)
+        : port(config.port)
+    {
+        std::vector<std::string> args = { config.mock_server, "--port", std::to_string(config.port) };
+        args.insert(args.end(), options.begin(), options.end());
+        this->pid = fork();
+        if(this->pid == 0)
+        {
+            if(!config.verbose)
+            {
+                int null_fd = open("/dev/null", O_WRONLY);
+                dup2(null_fd, STDOUT_FILENO);
+                close(null_fd);
+            }
+            std::vector<char*> argv;
+            for(std::string& arg : args)
+            {
+                argv.push_back(&arg[0]);
+            }
+            argv.push_back(nullptr);
+            execv(argv[0], argv.data());
+            std::fprintf(stderr, "## ERROR sopas_link_test: can't run %s: %s\n", argv[0], strerror(errno));
+            _exit(EXIT_FAILURE);
+        }
+    }
+    ~MockServer()
+    {
+        if(this->pid > 0)
+        {
+            kill(this->pid, SIGTERM);
+            waitpid(this->pid, nullptr, 0);
+        }
+    }
+
+    // waits until the server accepts connections
+    bool waitReady(int timeout_ms = 3000)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        while(this->pid > 0 && millisecSince(start) < timeout_ms)
+        {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(this->port);
+            bool connected = (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+            close(fd);  // the mock serves connections one after the other, so this one is closed right away
+            if(connected)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        return false;
+    }
+
+protected:
+    int port;
+    pid_t pid = -1;
+};
+
+static bool waitDisconnected(sick_scan_xd::SickScanCommonTcp& tcp, int timeout_ms)
+{
+    const auto start = std::chrono::steady_clock::now();
+    while(tcp.isConnected() && millisecSince(start) < timeout_ms)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return !tcp.isConnected();
+}
+
+
+/*
+ * connecting to a port without server fails within the connect timeout instead of blocking
+ */
+static void testConnectTimeout(const TestConfig& config)
+{
+    sick_scan_xd::SickScanCommonTcp tcp{ "127.0.0.1", config.port, 'B' };
+    tcp.setConnectTimeOutInMs(500);
+    const auto start = std::chrono::steady_clock::now();
+    const bool connected = (tcp.init_device() == 0 && tcp.isConnected());
+    const double connect_ms = millisecSince(start);
+    check(!connected, "connect_timeout", "connect without server fails");
+    check(connect_ms < 1500, "connect_timeout", "connect returns after " + std::to_string(connect_ms) + " ms");
+    tcp.close_device();
+}
+
+/*
+ * the mock drops each connection on its second request: the loss is detected and the link
+ * is re-established on the same SickScanCommonTcp, as run_sopas() does after a drop
+ */
+static void testReconnect(const TestConfig& config)
+{
+    MockServer mock{ config, { "--drop-after", "2" } };
+    check(mock.waitReady(), "reconnect", "mock server started");
+
+    sick_scan_xd::SickScanCommonTcp tcp{ "127.0.0.1", config.port, 'B' };
+    tcp.setReadTimeOutInMs(500);
+    tcp.setConnectTimeOutInMs(1000);
+    sick_scan_xd::SopasServices sopas{ &tcp, true };
+    for(int cycle = 1; cycle <= 3; cycle++)
+    {
+        const std::string n = "#" + std::to_string(cycle);
+        const auto start = std::chrono::steady_clock::now();
+        check(tcp.init_device() == 0 && tcp.isConnected(), "reconnect", "connect " + n);
+        check(sopas.sendAuthorization(), "reconnect", "first request answered " + n);
+        check(!sopas.sendAuthorization(), "reconnect", "second request not answered " + n);
+        check(waitDisconnected(tcp, 1000), "reconnect", "connection loss detected " + n);
+        tcp.close_device();
+        if(config.verbose)
+        {
+            std::printf("sopas_link_test: reconnect cycle %s took %.1f ms\n", n.c_str(), millisecSince(start));
+        }
+    }
+}
+
+/*
+ * sends a synchronous "sRN SCdevicestate" and returns its round trip time in milliseconds, or -1 on error
+ */
+static double syncDeviceState(sick_scan_xd::SopasServices& sopas)
+{
+    const auto start = std::chrono::steady_clock::now();
+    if(!sopas.sendSopasCmdCheckResponse("sRN SCdevicestate", "sRA SCdevicestate"))
+    {
+        return -1.;
+    }
+    return millisecSince(start);
+}
+
+/*
+ * SopasAsyncClient: pipelined requests, late replies of timed out or abandoned requests are not
+ * taken by a later synchronous command, and a steady stream of async requests doesn't starve
+ * synchronous commands
+ */
+static void testAsyncClient(const TestConfig& config)
+{
+    const char* test = "async_client";
+    {
+        MockServer mock{ config, {} };
+        check(mock.waitReady(), test, "mock server started");
+        sick_scan_xd::SickScanCommonTcp tcp{ "127.0.0.1", config.port, 'B' };
+        tcp.setReadTimeOutInMs(1000);
+        tcp.setConnectTimeOutInMs(1000);
+        check(tcp.init_device() == 0, test, "connect");
+        sick_scan_xd::SopasServices sopas{ &tcp, true };
+        {
+            sick_scan_xd::SopasAsyncClient client{ &tcp, true, 1000 };
+            std::vector<std::future<sick_scan_xd::SopasAsyncResult>> results;
+            for(int n = 0; n < 8; n++)
+            {
+                results.push_back(client.sendAsync(n % 2 ? "sRN SCdevicestate" : "sRN DeviceIdent"));
+            }
+            int num_ok = 0;
+            for(auto& result : results)
+            {
+                num_ok += (result.get().ok() ? 1 : 0);
+            }
+            check(num_ok == 8, test, std::to_string(num_ok) + " of 8 pipelined requests answered");
+
+            // each completion submits the next request, a synchronous command must still get the link
+            std::atomic<bool> flood{ true };
+            std::atomic<int> num_flood{ 0 };
+            std::function<void(const sick_scan_xd::SopasAsyncResult&)> resubmit;
+            resubmit = [&](const sick_scan_xd::SopasAsyncResult&)
+            {
+                num_flood++;
+                if(flood)
+                {
+                    client.sendAsync("sRN DeviceIdent", resubmit);
+                }
+            };
+            client.sendAsync("sRN DeviceIdent", resubmit);
+            client.sendAsync("sRN DeviceIdent", resubmit);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            const double sync_ms = syncDeviceState(sopas);
+            flood = false;
+            while(client.numPending() > 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            check(sync_ms >= 0. && sync_ms < 500., test,
+                "synchronous command during " + std::to_string(num_flood.load()) + " async requests took " + std::to_string(sync_ms) + " ms");
+        }
+        tcp.close_device();
+    }
+    {
+        // every reply takes 300 ms, so the late reply of the previous request would arrive first
+        MockServer mock{ config, { "--latency", "300" } };
+        check(mock.waitReady(), test, "mock server with latency started");
+        sick_scan_xd::SickScanCommonTcp tcp{ "127.0.0.1", config.port, 'B' };
+        tcp.setReadTimeOutInMs(1000);
+        tcp.setConnectTimeOutInMs(1000);
+        check(tcp.init_device() == 0, test, "connect");
+        sick_scan_xd::SopasServices sopas{ &tcp, true };
+        {
+            sick_scan_xd::SopasAsyncClient client{ &tcp, true, 1000 };
+            sick_scan_xd::SopasAsyncResult timed_out = client.sendAsync("sRN SCdevicestate", 100).get();
+            check(timed_out.status == sick_scan_xd::SopasAsyncResult::TIMEOUT, test, "request times out");
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            const double sync_ms = syncDeviceState(sopas);
+            check(sync_ms > 250., test, "synchronous command after a timeout gets its own reply (" + std::to_string(sync_ms) + " ms)");
+
+            sick_scan_xd::SopasAsyncResult late = client.sendAsync("sRN SCdevicestate", 100).get();
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            sick_scan_xd::SopasAsyncResult next = client.sendAsync("sRN SCdevicestate", 1000).get();
+            check(late.status == sick_scan_xd::SopasAsyncResult::TIMEOUT && next.ok() && next.rtt_millisec > 250., test,
+                "async request after a timeout gets its own reply (" + std::to_string(next.rtt_millisec) + " ms)");
+        }
+        std::future<sick_scan_xd::SopasAsyncResult> abandoned;
+        {
+            sick_scan_xd::SopasAsyncClient client{ &tcp, true, 1000 };
+            abandoned = client.sendAsync("sRN SCdevicestate");
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        check(abandoned.get().status == sick_scan_xd::SopasAsyncResult::CANCELLED, test, "destruction cancels the request in flight");
+        const double sync_ms = syncDeviceState(sopas);
+        check(sync_ms > 250., test, "synchronous command after destruction gets its own reply (" + std::to_string(sync_ms) + " ms)");
+        tcp.close_device();
+    }
+}
+
+
+static void printUsage(const char* argv0)
+{
+    std::printf(
+        "Usage: %s <path/to/sopas_mock_server> [options]\n"
+        "Options:\n"
+        "  --port <n>     tcp port for the mock server (default 42111)\n"
+        "  --verbose      show the output of the mock server\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    std::setvbuf(stdout, NULL, _IOLBF, 0);
+    std::signal(SIGPIPE, SIG_IGN);
+    TestConfig config;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if(arg == "--port" && i + 1 < argc) config.port = std::atoi(argv[++i]);
+        else if(arg == "--verbose") config.verbose = true;
+        else if(config.mock_server.empty() && arg[0] != '-') config.mock_server = arg;
+        else
+        {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if(config.mock_server.empty())
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    testConnectTimeout(config);
+    testReconnect(config);
+    testAsyncClient(config);
+
+    std::printf("sopas_link_test: %d of %d checks failed\n", s_num_failed, s_num_checks);
+    return s_num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}